@@ -0,0 +1,292 @@
+#include "benchReport.hpp"
+#include <cmath>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+// Just enough JSON for reports: objects, arrays, strings, numbers and null;
+// `true`/`false` are only skipped.
+class JsonReader {
+public:
+    explicit JsonReader(std::string text)
+        : m_text(std::move(text))
+    {
+    }
+
+    void expect(const char c)
+    {
+        if (!consume(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    bool consume(const char c)
+    {
+        skip_space();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    // Calls `member(key)` for each key of an object; `member` reads the value.
+    template <typename Member>
+    void object(Member member)
+    {
+        expect('{');
+        if (consume('}')) {
+            return;
+        }
+        do {
+            const std::string key = string();
+            expect(':');
+            member(key);
+        } while (consume(','));
+        expect('}');
+    }
+
+    template <typename Element>
+    void array(Element element)
+    {
+        expect('[');
+        if (consume(']')) {
+            return;
+        }
+        do {
+            element();
+        } while (consume(','));
+        expect(']');
+    }
+
+    std::string string()
+    {
+        expect('"');
+        std::string value;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            char c = m_text[m_pos++];
+            if (c == '\\' && m_pos < m_text.size()) {
+                c = m_text[m_pos++];
+                if (c == 'u' && m_pos + 4 <= m_text.size()) {
+                    c = static_cast<char>(std::stoi(m_text.substr(m_pos, 4), nullptr, 16));
+                    m_pos += 4;
+                }
+                else if (c == 'n') {
+                    c = '\n';
+                }
+                else if (c == 't') {
+                    c = '\t';
+                }
+            }
+            value += c;
+        }
+        expect('"');
+        return value;
+    }
+
+    double number()
+    {
+        skip_space();
+        const char* begin = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        const double value = std::strtod(begin, &end);
+        if (end == begin) {
+            fail("expected a number");
+        }
+        m_pos += static_cast<size_t>(end - begin);
+        return value;
+    }
+
+    std::optional<double> number_or_null()
+    {
+        if (literal("null")) {
+            return {};
+        }
+        return number();
+    }
+
+    void skip_value()
+    {
+        skip_space();
+        const char c = m_pos < m_text.size() ? m_text[m_pos] : '\0';
+        if (c == '{') {
+            object([this](const std::string&) { skip_value(); });
+        }
+        else if (c == '[') {
+            array([this] { skip_value(); });
+        }
+        else if (c == '"') {
+            string();
+        }
+        else if (!literal("null") && !literal("true") && !literal("false")) {
+            number();
+        }
+    }
+
+    void finish()
+    {
+        skip_space();
+        if (m_pos != m_text.size()) {
+            fail("trailing characters");
+        }
+    }
+
+private:
+    std::string m_text;
+    size_t m_pos = 0;
+
+    void skip_space()
+    {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+            m_pos++;
+        }
+    }
+
+    bool literal(const std::string& word)
+    {
+        skip_space();
+        if (m_text.compare(m_pos, word.size(), word) == 0) {
+            m_pos += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        throw std::runtime_error(message + " at offset " + std::to_string(m_pos));
+    }
+};
+
+std::string formatMetric(const double value)
+{
+    std::ostringstream text;
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        text << static_cast<long long>(value);
+    }
+    else {
+        text << std::fixed << std::setprecision(3) << value;
+    }
+    return text.str();
+}
+}
+
+void writeReport(std::ostream& os, const BenchReport& report)
+{
+    os << "{\n  \"runs\": " << report.runs << ",\n  \"programs\": [";
+    for (size_t i = 0; i < report.programs.size(); i++) {
+        const ProgramReport& program = report.programs[i];
+        os << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"";
+        for (const char c : program.name) {
+            os << (c == '"' || c == '\\' ? "\\" : "") << c;
+        }
+        os << "\", \"exit_code\": " << program.exit_code << ", \"metrics\": {";
+        for (size_t m = 0; m < reportMetrics.size(); m++) {
+            os << (m == 0 ? "" : ", ") << '"' << reportMetrics[m].name << "\": "
+               << (program.metrics[m].has_value() ? formatMetric(program.metrics[m].value()) : "null");
+        }
+        os << "}}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+std::optional<BenchReport> readReport(std::istream& is, std::string& error)
+{
+    JsonReader reader { std::string(std::istreambuf_iterator<char>(is), {}) };
+    BenchReport report;
+    try {
+        reader.object([&](const std::string& key) {
+            if (key == "runs") {
+                report.runs = static_cast<size_t>(reader.number());
+            }
+            else if (key == "programs") {
+                reader.array([&] {
+                    ProgramReport& program = report.programs.emplace_back();
+                    reader.object([&](const std::string& field) {
+                        if (field == "name") {
+                            program.name = reader.string();
+                        }
+                        else if (field == "exit_code") {
+                            program.exit_code = static_cast<int>(reader.number());
+                        }
+                        else if (field == "metrics") {
+                            reader.object([&](const std::string& metric) {
+                                for (size_t m = 0; m < reportMetrics.size(); m++) {
+                                    if (metric == reportMetrics[m].name) {
+                                        program.metrics[m] = reader.number_or_null();
+                                        return;
+                                    }
+                                }
+                                reader.skip_value();
+                            });
+                        }
+                        else {
+                            reader.skip_value();
+                        }
+                    });
+                });
+            }
+            else {
+                reader.skip_value();
+            }
+        });
+        reader.finish();
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+        return {};
+    }
+    return report;
+}
+
+bool compareReports(
+    const BenchReport& baseline, const BenchReport& current, const Thresholds& thresholds, std::ostream& os)
+{
+    std::ostringstream text;
+    text << std::left << std::setw(20) << "program" << std::setw(15) << "metric" << std::right << std::setw(14)
+         << "baseline" << std::setw(14) << "current" << std::setw(10) << "change" << "\n";
+    bool passed = true;
+    for (const ProgramReport& before : baseline.programs) {
+        const ProgramReport* after = nullptr;
+        for (const ProgramReport& program : current.programs) {
+            if (program.name == before.name) {
+                after = &program;
+            }
+        }
+        if (after == nullptr) {
+            text << std::left << std::setw(20) << before.name << "not in the current report\n";
+            continue;
+        }
+        if (after->exit_code != before.exit_code) {
+            text << std::left << std::setw(20) << before.name << "WRONG RESULT: exit code " << after->exit_code
+                 << ", was " << before.exit_code << "\n";
+            passed = false;
+        }
+        for (size_t m = 0; m < reportMetrics.size(); m++) {
+            if (!before.metrics[m].has_value() || !after->metrics[m].has_value()) {
+                continue;
+            }
+            const MetricInfo& info = reportMetrics[m];
+            const double was = before.metrics[m].value();
+            const double now = after->metrics[m].value();
+            const double threshold = info.timing ? thresholds.times : thresholds.counters;
+            const double change = was == 0 ? 0 : now / was - 1;
+            const bool significant = std::fabs(now - was) > info.floor;
+            text << std::left << std::setw(20) << before.name << std::setw(15) << info.name << std::right
+                 << std::setw(14) << formatMetric(was) << std::setw(14) << formatMetric(now) << std::setw(9)
+                 << std::fixed << std::setprecision(1) << std::showpos << change * 100 << std::noshowpos << "%";
+            if (significant && change > threshold) {
+                text << (info.gated ? "  REGRESSION" : "  slower");
+                passed = passed && !info.gated;
+            }
+            else if (significant && change < -threshold) {
+                text << "  improved";
+            }
+            text << "\n";
+        }
+    }
+    os << text.str();
+    return passed;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct MetricInfo {
+    const char* name;
+    bool timing; // compared with the looser time threshold
+    double floor; // smaller absolute changes are noise
+    bool gated; // a regression fails the comparison; otherwise only shown
+};
+
+// Every metric of a report, in report order.
+inline constexpr std::array<MetricInfo, 8> reportMetrics { {
+    { "binary_bytes", false, 0, true },
+    { "instructions", false, 1000, true },
+    { "cycles", false, 1000, true },
+    { "branch_misses", false, 1000, true },
+    { "loads", false, 1000, true },
+    { "stores", false, 1000, true },
+    { "user_ms", true, 1, true },
+    { "wall_ms", true, 1, false }, // includes exec and page faults
+} };
+
+struct ProgramReport {
+    std::string name;
+    int exit_code = 0;
+    // Over the runs: the median of each counter and the minimum of each time.
+    // Indexed like `reportMetrics`; nullopt when a counter is unavailable on
+    // the machine that measured it.
+    std::array<std::optional<double>, reportMetrics.size()> metrics {};
+};
+
+struct BenchReport {
+    size_t runs = 0;
+    std::vector<ProgramReport> programs;
+};
+
+// JSON: {"runs": N, "programs": [{"name", "exit_code", "metrics": {...}}]},
+// with unavailable metrics written as null.
+void writeReport(std::ostream& os, const BenchReport& report);
+// Reads what `writeReport` wrote; unknown keys are skipped. Returns nullopt
+// and sets `error` on malformed input.
+std::optional<BenchReport> readReport(std::istream& is, std::string& error);
+
+struct Thresholds {
+    double counters = 0.02; // relative increase that counts as a regression
+    double times = 0.10;
+};
+
+// Prints each metric both reports have for a program and returns false if a
+// gated metric regressed past its threshold or a program's exit code changed.
+bool compareReports(
+    const BenchReport& baseline, const BenchReport& current, const Thresholds& thresholds, std::ostream& os);
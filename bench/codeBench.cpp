@@ -0,0 +1,269 @@
+#include "benchReport.hpp"
+#include "runCounters.hpp"
+#include "Components/driver/compileCache.hpp"
+#include "Components/driver/compiler.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Generated-code benchmarks: compiles a corpus of programs with the current
+// compiler, runs each binary under hardware counters and compares the results
+// against a baseline report from an earlier build. Each program must also
+// exit the same way and print the same output when built at -O0.
+
+std::optional<ProgramReport> benchmark(Compiler &compiler, const std::filesystem::path &input,
+                                       const std::filesystem::path &build_dir, size_t runs)
+{
+    const std::string name = input.filename().string();
+    const std::string binary = (build_dir / input.stem()).string();
+    const CompileResult compiled = compiler.compile_file(input.string(), binary, CompileOptions{});
+    if (!compiled.success)
+    {
+        std::cerr << name << ": failed to compile" << std::endl << compiled.diagnostics;
+        return {};
+    }
+
+    // A program that reads stdin gets `<name>.in` next to it.
+    std::filesystem::path stdin_path = input;
+    stdin_path.replace_extension(".in");
+    const std::string stdin_input = std::filesystem::exists(stdin_path) ? stdin_path.string() : "";
+    const std::string output = binary + ".out";
+
+    std::vector<RunSample> samples;
+    std::string error;
+    // The first run only warms the page cache.
+    for (size_t i = 0; i <= runs; i++)
+    {
+        const std::optional<RunSample> sample = runMeasured(binary, stdin_input, output, error);
+        if (!sample.has_value())
+        {
+            std::cerr << name << ": " << error << std::endl;
+            return {};
+        }
+        if (!samples.empty() && sample->exit_code != samples.front().exit_code)
+        {
+            std::cerr << name << ": exit code changed between runs" << std::endl;
+            return {};
+        }
+        if (i != 0 || runs == 0)
+        {
+            samples.push_back(sample.value());
+        }
+    }
+
+    // The passes must not change what the program does: the same program
+    // built with none of them has to exit and print the same way.
+    CompileOptions unoptimized;
+    unoptimized.opt_level = OptLevel::O0;
+    const std::string unoptimized_binary = binary + "-O0";
+    const CompileResult compiled_O0 = compiler.compile_file(input.string(), unoptimized_binary, unoptimized);
+    if (!compiled_O0.success)
+    {
+        std::cerr << name << ": failed to compile at -O0" << std::endl << compiled_O0.diagnostics;
+        return {};
+    }
+    const std::string unoptimized_output = unoptimized_binary + ".out";
+    const std::optional<RunSample> unoptimized_sample
+        = runMeasured(unoptimized_binary, stdin_input, unoptimized_output, error);
+    if (!unoptimized_sample.has_value())
+    {
+        std::cerr << name << ": " << error << std::endl;
+        return {};
+    }
+    if (unoptimized_sample->exit_code != samples.front().exit_code)
+    {
+        std::cerr << name << ": exits with " << samples.front().exit_code << ", but with "
+                  << unoptimized_sample->exit_code << " at -O0" << std::endl;
+        return {};
+    }
+    std::string printed;
+    std::string unoptimized_printed;
+    if (!readFile(output, printed) || !readFile(unoptimized_output, unoptimized_printed))
+    {
+        std::cerr << name << ": cannot read its output" << std::endl;
+        return {};
+    }
+    if (printed != unoptimized_printed)
+    {
+        std::cerr << name << ": prints different output at -O0" << std::endl;
+        return {};
+    }
+
+    ProgramReport report{.name = name, .exit_code = samples.front().exit_code};
+    // Counters take the median; times take the minimum, which interference
+    // from other processes can only raise.
+    const auto summary = [&](auto field, const bool minimum) -> std::optional<double> {
+        std::vector<double> values;
+        for (const RunSample &sample : samples)
+        {
+            const std::optional<double> value = field(sample);
+            if (!value.has_value())
+            {
+                return {};
+            }
+            values.push_back(value.value());
+        }
+        if (minimum)
+        {
+            return *std::min_element(values.begin(), values.end());
+        }
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    };
+    const auto counter = [](const std::optional<uint64_t> &value) {
+        return value.has_value() ? std::optional<double>(static_cast<double>(value.value())) : std::nullopt;
+    };
+    report.metrics = {
+        static_cast<double>(std::filesystem::file_size(binary)),
+        summary([&](const RunSample &s) { return counter(s.instructions); }, false),
+        summary([&](const RunSample &s) { return counter(s.cycles); }, false),
+        summary([&](const RunSample &s) { return counter(s.branch_misses); }, false),
+        summary([&](const RunSample &s) { return counter(s.loads); }, false),
+        summary([&](const RunSample &s) { return counter(s.stores); }, false),
+        summary([](const RunSample &s) { return std::optional(s.user_ms); }, true),
+        summary([](const RunSample &s) { return std::optional(s.wall_ms); }, true),
+    };
+    return report;
+}
+
+void print_report(const BenchReport &report)
+{
+    std::cout << std::left << std::setw(20) << "program" << std::right << std::setw(6) << "exit";
+    for (const MetricInfo &info : reportMetrics)
+    {
+        std::cout << std::setw(15) << info.name;
+    }
+    std::cout << std::endl;
+    for (const ProgramReport &program : report.programs)
+    {
+        std::cout << std::left << std::setw(20) << program.name << std::right << std::setw(6) << program.exit_code;
+        for (const std::optional<double> &value : program.metrics)
+        {
+            std::ostringstream text;
+            if (value.has_value())
+            {
+                text << std::fixed << std::setprecision(value.value() == static_cast<uint64_t>(value.value()) ? 0 : 3)
+                     << value.value();
+            }
+            std::cout << std::setw(15) << (value.has_value() ? text.str() : "n/a");
+        }
+        std::cout << std::endl;
+    }
+}
+
+void show_usage(const char *program_name)
+{
+    std::cerr << "Usage: " << program_name << " [options] [files.kei...]" << std::endl;
+    std::cerr << "  files default to the corpus in " << KEI_BENCH_CORPUS << std::endl;
+    std::cerr << "  --runs N               measured runs per program (default 10)" << std::endl;
+    std::cerr << "  --json FILE            write the report as JSON" << std::endl;
+    std::cerr << "  --baseline FILE        compare against an earlier JSON report" << std::endl;
+    std::cerr << "  --threshold PCT        counter regression threshold (default 2)" << std::endl;
+    std::cerr << "  --time-threshold PCT   CPU time regression threshold (default 10)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t runs = 10;
+    std::string json_path;
+    std::string baseline_path;
+    Thresholds thresholds;
+    std::vector<std::filesystem::path> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (arg[0] != '-')
+        {
+            inputs.emplace_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        const char *value = argv[++i];
+        if (std::strcmp(arg, "--runs") == 0)
+            runs = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--json") == 0)
+            json_path = value;
+        else if (std::strcmp(arg, "--baseline") == 0)
+            baseline_path = value;
+        else if (std::strcmp(arg, "--threshold") == 0)
+            thresholds.counters = std::strtod(value, nullptr) / 100;
+        else if (std::strcmp(arg, "--time-threshold") == 0)
+            thresholds.times = std::strtod(value, nullptr) / 100;
+        else
+        {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (inputs.empty())
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(KEI_BENCH_CORPUS))
+        {
+            if (hasKeiExtension(entry.path().string()))
+            {
+                inputs.push_back(entry.path());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+    }
+
+    std::optional<BenchReport> baseline;
+    if (!baseline_path.empty())
+    {
+        std::ifstream file(baseline_path);
+        std::string error;
+        if (!file || !(baseline = readReport(file, error)).has_value())
+        {
+            std::cerr << "Cannot read baseline " << baseline_path << (error.empty() ? "" : ": " + error) << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    char build_template[] = "/tmp/kei_codebench.XXXXXX";
+    if (mkdtemp(build_template) == nullptr)
+    {
+        std::cerr << "Cannot create a build directory: " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::filesystem::path build_dir = build_template;
+
+    Compiler compiler;
+    BenchReport report{.runs = runs};
+    bool success = true;
+    for (const std::filesystem::path &input : inputs)
+    {
+        std::optional<ProgramReport> program = benchmark(compiler, input, build_dir, runs);
+        success = success && program.has_value();
+        if (program.has_value())
+        {
+            report.programs.push_back(std::move(program.value()));
+        }
+    }
+    std::filesystem::remove_all(build_dir);
+
+    print_report(report);
+    if (!json_path.empty())
+    {
+        std::ofstream file(json_path);
+        writeReport(file, report);
+        if (!file)
+        {
+            std::cerr << "Cannot write " << json_path << std::endl;
+            success = false;
+        }
+    }
+    if (baseline.has_value())
+    {
+        std::cout << std::endl << "against " << baseline_path << ":" << std::endl;
+        success = compareReports(baseline.value(), report, thresholds, std::cout) && success;
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,325 @@
+#include "programGenerator.hpp"
+#include "Components/diagnostics/compileError.hpp"
+#include "Components/driver/moduleGraph.hpp"
+#include "Components/generator/generatorCode.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Compiler throughput benchmarks: the lexer, the parser and the code
+// generator are timed separately on synthetic programs, then on programs of
+// doubling size to check that no phase grows faster than linearly. With
+// `--import-graph`, a wide import graph is built over and over instead.
+
+struct PhaseTimes
+{
+    double tokenize = 0;
+    double parse = 0;
+    double generate = 0;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    size_t arena_bytes = 0;
+    size_t asm_bytes = 0;
+};
+
+// Best time of `run` over repeated runs lasting at least `min_seconds`;
+// `setup` runs untimed before each run.
+template <typename Setup, typename Run>
+double best_time(Setup setup, Run run, double min_seconds)
+{
+    using Clock = std::chrono::steady_clock;
+    double best = INFINITY;
+    double total = 0;
+    for (int i = 0; i < 3 || total < min_seconds; i++)
+    {
+        setup();
+        const auto start = Clock::now();
+        run();
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+    }
+    return best;
+}
+
+PhaseTimes measure(const std::string &source, double min_seconds, bool hash_cons)
+{
+    PhaseTimes times;
+    times.bytes = source.size();
+    std::vector<Token> tokens;
+    times.tokenize = best_time([] {}, [&] { tokens = LexicalAnalyzer(source).tokenize(); }, min_seconds);
+    times.tokens = tokens.size();
+
+    MemoryAllocator allocator(1024 * 1024 * 4);
+    std::vector<Token> input;
+    std::optional<ProgramNode> prog;
+    times.parse = best_time(
+        [&] {
+            allocator.reset();
+            input = tokens;
+        },
+        [&] { prog = SyntaxAnalyzer(std::move(input), allocator, hash_cons).parseProgram(); }, min_seconds);
+    times.nodes = allocator.allocations();
+    times.arena_bytes = allocator.bytesUsed();
+
+    std::string assembly;
+    times.generate = best_time([] {}, [&] { assembly = Generator(prog.value()).gen_prog(); }, min_seconds);
+    times.asm_bytes = assembly.size();
+    return times;
+}
+
+void print_throughput(const ProgramShape &shape, const PhaseTimes &times)
+{
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "program: " << shape.statements << " statements, " << times.bytes / 1024.0 << " KB, "
+              << times.tokens << " tokens, " << times.nodes << " nodes (" << times.arena_bytes / 1024.0 << " KB), "
+              << times.asm_bytes / 1024.0
+              << " KB of assembly" << std::endl;
+    std::cout << "  tokenize  " << std::setw(10) << times.tokenize * 1e3 << " ms  " << std::setw(10)
+              << times.tokens / times.tokenize / 1e6 << " M tokens/s  " << std::setw(8)
+              << times.bytes / times.tokenize / 1e6 << " MB/s" << std::endl;
+    std::cout << "  parse     " << std::setw(10) << times.parse * 1e3 << " ms  " << std::setw(10)
+              << times.nodes / times.parse / 1e6 << " M nodes/s  " << std::setw(9)
+              << times.tokens / times.parse / 1e6 << " M tokens/s" << std::endl;
+    std::cout << "  generate  " << std::setw(10) << times.generate * 1e3 << " ms  " << std::setw(10)
+              << times.nodes / times.generate / 1e6 << " M nodes/s  " << std::setw(9)
+              << times.asm_bytes / times.generate / 1e6 << " MB asm/s" << std::endl;
+}
+
+// Fits the growth exponent of each phase between the smallest and the
+// largest program; returns false if one is clearly above linear.
+bool check_scaling(ProgramShape shape, double min_seconds, double max_exponent, bool hash_cons)
+{
+    const size_t base = shape.statements;
+    std::vector<std::pair<size_t, PhaseTimes>> runs;
+    std::cout << "scaling (identifiers grow with the program):" << std::endl;
+    for (size_t factor = 1; factor <= 8; factor *= 2)
+    {
+        shape.statements = base * factor;
+        shape.identifiers = shape.statements;
+        const PhaseTimes times = measure(generateProgram(shape), min_seconds, hash_cons);
+        std::cout << std::fixed << std::setprecision(3) << "  " << std::setw(8) << shape.statements
+                  << " statements: tokenize " << times.tokenize * 1e3 << " ms, parse " << times.parse * 1e3
+                  << " ms, generate " << times.generate * 1e3 << " ms" << std::endl;
+        runs.emplace_back(times.bytes, times);
+    }
+    const auto &[small_bytes, small] = runs.front();
+    const auto &[large_bytes, large] = runs.back();
+    const double size_ratio = std::log(static_cast<double>(large_bytes) / static_cast<double>(small_bytes));
+    bool linear = true;
+    for (const auto &[name, small_time, large_time] : {std::tuple{"tokenize", small.tokenize, large.tokenize},
+                                                       std::tuple{"parse", small.parse, large.parse},
+                                                       std::tuple{"generate", small.generate, large.generate}})
+    {
+        const double exponent = std::log(large_time / small_time) / size_ratio;
+        const bool ok = exponent <= max_exponent;
+        std::cout << "  " << name << " grows as n^" << std::setprecision(2) << exponent << (ok ? "" : "  SUPERLINEAR")
+                  << std::endl;
+        linear = linear && ok;
+    }
+    return linear;
+}
+
+// Builds a two-level import graph `width` modules wide `rounds` times in a
+// row, every module compiled each time, and checks what the root sees: `mid<k>`
+// imports `leaf<k>` and `leaf<k+1>`, so each module's dependents are submitted
+// from the pool's own tasks. Returns false on an error or a wrong export.
+bool check_import_graph(size_t width, size_t rounds)
+{
+    namespace fs = std::filesystem;
+    char dir_template[] = "/tmp/kei_bench.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr)
+    {
+        std::cerr << "Cannot create a module directory: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const fs::path dir = dir_template;
+    const auto leaf_value = [](size_t k) { return k * 7 + 1; };
+    std::string root;
+    for (size_t k = 0; k < width; k++)
+    {
+        const size_t next = (k + 1) % width;
+        std::ofstream(dir / ("leaf" + std::to_string(k) + ".kei"))
+            << "export let c" << k << " = " << leaf_value(k) << ";\n";
+        std::ofstream(dir / ("mid" + std::to_string(k) + ".kei"))
+            << "import \"leaf" << k << ".kei\";\n"
+            << (next != k ? "import \"leaf" + std::to_string(next) + ".kei\";\n" : "") << "export let m" << k
+            << " = c" << k << " + c" << next << ";\n";
+        root += "import \"mid" + std::to_string(k) + ".kei\";\n";
+    }
+    root += "exit(0);\n";
+    const std::string input = (dir / "root.kei").string();
+    std::ofstream(input) << root;
+
+    CompileOptions options;
+    options.show_stats = true;
+    // Several workers even on a small machine, so tasks are stolen.
+    options.jobs = std::max(4u, std::thread::hardware_concurrency());
+    const std::string expected_stats = "modules: " + std::to_string(width * 2) + " compiled, 0 up to date\n";
+    bool correct = true;
+    double best = INFINITY;
+    for (size_t round = 0; round < rounds && correct; round++)
+    {
+        for (const auto &entry : fs::directory_iterator(dir))
+        {
+            if (entry.path().extension() == ".kif")
+            {
+                fs::remove(entry.path());
+            }
+        }
+        std::string diagnostics;
+        std::vector<ImportedModule> scope;
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            scope = buildImports(input, scanImports(root), options, diagnostics);
+        }
+        catch (const CompileError &error)
+        {
+            std::cerr << "round " << round << ": " << error.what() << std::endl;
+            correct = false;
+            break;
+        }
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        correct = scope.size() == width && diagnostics == expected_stats;
+        for (size_t k = 0; k < scope.size() && correct; k++)
+        {
+            const uint64_t value = leaf_value(k) + leaf_value((k + 1) % width);
+            correct = scope[k].exports == std::vector<ExportedConstant>{{"m" + std::to_string(k), value}};
+        }
+        if (!correct)
+        {
+            std::cerr << "round " << round << ": the root saw wrong imports" << std::endl << diagnostics;
+        }
+    }
+    fs::remove_all(dir);
+    if (correct)
+    {
+        std::cout << std::fixed << std::setprecision(3) << "import graph: " << width * 2 << " modules, " << rounds
+                  << " builds on " << options.jobs << " workers, best " << best * 1e3 << " ms" << std::endl;
+    }
+    return correct;
+}
+
+void show_usage(const char *program_name)
+{
+    std::cerr << "Usage: " << program_name << " [options]" << std::endl;
+    std::cerr << "  --statements N    statements in the program (default 20000)" << std::endl;
+    std::cerr << "  --depth N         expression nesting (default 3)" << std::endl;
+    std::cerr << "  --width N         operands per expression level (default 4)" << std::endl;
+    std::cerr << "  --scopes N        scope nesting (default 2)" << std::endl;
+    std::cerr << "  --elifs N         elif arms per if (default 2)" << std::endl;
+    std::cerr << "  --identifiers N   live variables (default 64)" << std::endl;
+    std::cerr << "  --comments P      comment probability per statement (default 0.1)" << std::endl;
+    std::cerr << "  --seed N          generator seed (default 1)" << std::endl;
+    std::cerr << "  --min-time S      minimum seconds per measurement (default 0.2)" << std::endl;
+    std::cerr << "  --max-exponent E  scaling failure threshold (default 1.3)" << std::endl;
+    std::cerr << "  --no-scaling      skip the scaling check" << std::endl;
+    std::cerr << "  --hash-cons       share identical pure subexpressions while parsing" << std::endl;
+    std::cerr << "  --unicode         name variables in Cyrillic" << std::endl;
+    std::cerr << "  --emit FILE       write the generated program and exit" << std::endl;
+    std::cerr << "  --import-graph N  instead, build a graph of N x 2 modules repeatedly" << std::endl;
+    std::cerr << "  --rounds N        builds of the import graph (default 200)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    ProgramShape shape;
+    shape.statements = 20000;
+    double min_seconds = 0.2;
+    double max_exponent = 1.3;
+    bool scaling = true;
+    bool hash_cons = false;
+    const char *emit = nullptr;
+    size_t import_graph = 0;
+    size_t rounds = 200;
+    for (int i = 1; i < argc; i++)
+    {
+        const auto value = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *arg = argv[i];
+        const char *text = nullptr;
+        if (std::strcmp(arg, "--no-scaling") == 0)
+        {
+            scaling = false;
+            continue;
+        }
+        if (std::strcmp(arg, "--hash-cons") == 0)
+        {
+            hash_cons = true;
+            continue;
+        }
+        if (std::strcmp(arg, "--unicode") == 0)
+        {
+            shape.unicode_names = true;
+            continue;
+        }
+        if ((text = value()) == nullptr)
+        {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (std::strcmp(arg, "--statements") == 0)
+            shape.statements = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--depth") == 0)
+            shape.expr_depth = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--width") == 0)
+            shape.expr_width = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--scopes") == 0)
+            shape.scope_depth = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--elifs") == 0)
+            shape.elif_chain = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--identifiers") == 0)
+            shape.identifiers = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--comments") == 0)
+            shape.comment_density = std::strtod(text, nullptr);
+        else if (std::strcmp(arg, "--seed") == 0)
+            shape.seed = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--min-time") == 0)
+            min_seconds = std::strtod(text, nullptr);
+        else if (std::strcmp(arg, "--max-exponent") == 0)
+            max_exponent = std::strtod(text, nullptr);
+        else if (std::strcmp(arg, "--emit") == 0)
+            emit = text;
+        else if (std::strcmp(arg, "--import-graph") == 0)
+            import_graph = std::strtoull(text, nullptr, 10);
+        else if (std::strcmp(arg, "--rounds") == 0)
+            rounds = std::strtoull(text, nullptr, 10);
+        else
+        {
+            show_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (import_graph != 0)
+    {
+        return check_import_graph(import_graph, rounds) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    const std::string source = generateProgram(shape);
+    if (emit != nullptr)
+    {
+        std::ofstream(emit) << source;
+        return EXIT_SUCCESS;
+    }
+    print_throughput(shape, measure(source, min_seconds, hash_cons));
+    if (scaling)
+    {
+        ProgramShape small = shape;
+        small.statements = std::max<size_t>(shape.statements / 8, 1000);
+        if (!check_scaling(small, min_seconds / 4, max_exponent, hash_cons))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
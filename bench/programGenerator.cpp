@@ -0,0 +1,156 @@
+#include "programGenerator.hpp"
+#include <vector>
+
+namespace {
+class ProgramWriter {
+public:
+    explicit ProgramWriter(const ProgramShape& shape)
+        : m_shape(shape)
+        , m_state(shape.seed)
+        , m_remaining(shape.statements)
+    {
+    }
+
+    std::string write()
+    {
+        while (m_remaining > 0) {
+            stmt(0);
+        }
+        m_out += "exit(";
+        expr(m_shape.expr_depth);
+        m_out += ");\n";
+        return std::move(m_out);
+    }
+
+private:
+    const ProgramShape& m_shape;
+    uint64_t m_state;
+    size_t m_remaining;
+    size_t m_next_name = 0;
+    size_t m_next_comment = 0;
+    std::string m_out {};
+    std::vector<std::string> m_live {};
+
+    uint64_t next()
+    {
+        uint64_t z = (m_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    size_t below(const size_t n) { return n == 0 ? 0 : static_cast<size_t>(next() % n); }
+    bool chance(const double p) { return static_cast<double>(next() >> 11) * 0x1.0p-53 < p; }
+
+    void indent(const size_t depth) { m_out.append(depth * 4, ' '); }
+
+    void term()
+    {
+        if (!m_live.empty() && chance(0.5)) {
+            m_out += m_live[below(m_live.size())];
+        }
+        else {
+            m_out += std::to_string(below(1000));
+        }
+    }
+
+    void expr(const size_t depth)
+    {
+        static constexpr const char* ops[] = { " + ", " - ", " * ", " / " };
+        const size_t width = std::max<size_t>(m_shape.expr_width, 1);
+        for (size_t i = 0; i < width; i++) {
+            if (i != 0) {
+                m_out += ops[below(4)];
+            }
+            if (depth > 0 && chance(0.3)) {
+                m_out += '(';
+                expr(depth - 1);
+                m_out += ')';
+            }
+            else {
+                term();
+            }
+        }
+    }
+
+    void comment()
+    {
+        if (!chance(m_shape.comment_density)) {
+            return;
+        }
+        if (chance(0.5)) {
+            m_out += " // note " + std::to_string(m_next_comment++) + "\n";
+        }
+        else {
+            m_out += " /* note " + std::to_string(m_next_comment++) + " */\n";
+        }
+    }
+
+    void block(const size_t depth)
+    {
+        m_out += "{\n";
+        const size_t mark = m_live.size();
+        const size_t count = 1 + below(4);
+        for (size_t i = 0; i < count && m_remaining > 0; i++) {
+            stmt(depth + 1);
+        }
+        m_live.resize(mark);
+        indent(depth);
+        m_out += "}";
+    }
+
+    void stmt(const size_t depth)
+    {
+        m_remaining--;
+        indent(depth);
+        if (depth < m_shape.scope_depth && chance(0.15)) {
+            switch (below(3)) {
+            case 0:
+                m_out += "if (";
+                expr(m_shape.expr_depth);
+                m_out += ") ";
+                block(depth);
+                for (size_t i = 0; i < m_shape.elif_chain; i++) {
+                    m_out += " elif (";
+                    expr(m_shape.expr_depth);
+                    m_out += ") ";
+                    block(depth);
+                }
+                if (chance(0.5)) {
+                    m_out += " else ";
+                    block(depth);
+                }
+                break;
+            case 1:
+                m_out += "while (";
+                expr(m_shape.expr_depth);
+                m_out += ") ";
+                block(depth);
+                break;
+            default:
+                block(depth);
+                break;
+            }
+            m_out += "\n";
+            comment();
+            return;
+        }
+        if (m_live.empty() || (m_live.size() < m_shape.identifiers && chance(0.6))) {
+            std::string name = (m_shape.unicode_names ? "пер" : "v") + std::to_string(m_next_name++);
+            m_out += "let " + name + " = ";
+            expr(m_shape.expr_depth);
+            m_live.push_back(std::move(name));
+        }
+        else {
+            m_out += m_live[below(m_live.size())] + " = ";
+            expr(m_shape.expr_depth);
+        }
+        m_out += ";\n";
+        comment();
+    }
+};
+}
+
+std::string generateProgram(const ProgramShape& shape)
+{
+    return ProgramWriter(shape).write();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Shape of a synthetic program. Every generated program is valid: names are
+// declared before use and never redeclared while live, and it ends in `exit`.
+struct ProgramShape {
+    size_t statements = 1000; // statements in total, nested ones included
+    size_t expr_depth = 3; // nesting of parenthesized subexpressions
+    size_t expr_width = 4; // operands per expression level
+    size_t scope_depth = 2; // nesting of `if`/`while`/bare scopes
+    size_t elif_chain = 2; // `elif` arms per `if`
+    size_t identifiers = 64; // variables live at once before lets turn into assignments
+    double comment_density = 0.1; // chance of a comment after each statement
+    bool unicode_names = false; // Cyrillic variable names instead of ASCII ones
+    uint64_t seed = 1;
+};
+
+// Deterministic for a given shape on every platform: the random choices come
+// from splitmix64, not from the standard distributions.
+std::string generateProgram(const ProgramShape& shape);
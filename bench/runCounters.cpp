@@ -0,0 +1,147 @@
+#include "runCounters.hpp"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+struct CounterSpec {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr uint64_t l1dAccess(const uint64_t op)
+{
+    return PERF_COUNT_HW_CACHE_L1D | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+}
+
+// In the order of the counter fields of `RunSample`.
+constexpr std::array<CounterSpec, 5> counterSpecs { {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, l1dAccess(PERF_COUNT_HW_CACHE_OP_READ) },
+    { PERF_TYPE_HW_CACHE, l1dAccess(PERF_COUNT_HW_CACHE_OP_WRITE) },
+} };
+
+// Attached to a child that has not exec'd yet; `enable_on_exec` starts the
+// count at the program's first instruction, so the fork and the wait for the
+// go-ahead are not measured.
+int openCounter(const CounterSpec& spec, const pid_t pid)
+{
+    perf_event_attr attributes {};
+    attributes.size = sizeof(attributes);
+    attributes.type = spec.type;
+    attributes.config = spec.config;
+    attributes.disabled = 1;
+    attributes.enable_on_exec = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attributes, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::optional<uint64_t> readCounter(const int fd)
+{
+    uint64_t value = 0;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return {};
+    }
+    return value;
+}
+
+double milliseconds(const timeval& time)
+{
+    return static_cast<double>(time.tv_sec) * 1e3 + static_cast<double>(time.tv_usec) / 1e3;
+}
+}
+
+std::optional<RunSample> runMeasured(
+    const std::string& path, const std::string& input, const std::string& output, std::string& error)
+{
+    // fork rather than posix_spawn: the counters must be attached between
+    // the fork and the exec, so the child waits on `go` until they are. A
+    // failed exec reports its errno on `failed`, which closes on success.
+    int go[2];
+    int failed[2];
+    if (pipe2(go, O_CLOEXEC) != 0) {
+        error = std::string("pipe: ") + std::strerror(errno);
+        return {};
+    }
+    if (pipe2(failed, O_CLOEXEC) != 0) {
+        error = std::string("pipe: ") + std::strerror(errno);
+        close(go[0]);
+        close(go[1]);
+        return {};
+    }
+    const pid_t pid = fork();
+    if (pid < 0) {
+        error = std::string("fork: ") + std::strerror(errno);
+        for (const int fd : { go[0], go[1], failed[0], failed[1] }) {
+            close(fd);
+        }
+        return {};
+    }
+    if (pid == 0) {
+        close(go[1]);
+        close(failed[0]);
+        char byte;
+        // Close-on-exec, so only the duplicates on 0 and 1 reach the program.
+        const int stdin_fd = input.empty() ? STDIN_FILENO : open(input.c_str(), O_RDONLY | O_CLOEXEC);
+        const int stdout_fd = output.empty() ? STDOUT_FILENO
+                                             : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (read(go[0], &byte, 1) == 1) {
+            if (stdin_fd >= 0 && stdout_fd >= 0 && dup2(stdin_fd, STDIN_FILENO) >= 0
+                && dup2(stdout_fd, STDOUT_FILENO) >= 0) {
+                execl(path.c_str(), path.c_str(), static_cast<char*>(nullptr));
+            }
+            const int exec_errno = errno;
+            [[maybe_unused]] const ssize_t written = write(failed[1], &exec_errno, sizeof(exec_errno));
+        }
+        _exit(127);
+    }
+    close(go[0]);
+    close(failed[1]);
+    std::array<int, counterSpecs.size()> fds {};
+    for (size_t i = 0; i < counterSpecs.size(); i++) {
+        fds[i] = openCounter(counterSpecs[i], pid);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const bool started = write(go[1], "x", 1) == 1;
+    close(go[1]);
+    int exec_errno = 0;
+    const bool exec_failed = started && read(failed[0], &exec_errno, sizeof(exec_errno)) == sizeof(exec_errno);
+    close(failed[0]);
+    int status = 0;
+    rusage usage {};
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) { }
+    const auto stop = std::chrono::steady_clock::now();
+
+    RunSample sample;
+    sample.wall_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    sample.user_ms = milliseconds(usage.ru_utime);
+    sample.instructions = readCounter(fds[0]);
+    sample.cycles = readCounter(fds[1]);
+    sample.branch_misses = readCounter(fds[2]);
+    sample.loads = readCounter(fds[3]);
+    sample.stores = readCounter(fds[4]);
+    for (const int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    if (!started || exec_failed) {
+        error = "Failed to run " + path + (exec_failed ? std::string(": ") + std::strerror(exec_errno) : "");
+        return {};
+    }
+    if (!WIFEXITED(status)) {
+        error = path + " was killed by signal " + std::to_string(WTERMSIG(status));
+        return {};
+    }
+    sample.exit_code = WEXITSTATUS(status);
+    return sample;
+}
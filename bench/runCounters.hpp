@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// One run of a compiled program. The hardware counters cover the program's
+// user-space execution only and are nullopt where the kernel or the CPU does
+// not provide them (no PMU in a VM, `perf_event_paranoid` too strict).
+struct RunSample {
+    int exit_code = 0;
+    double wall_ms = 0;
+    double user_ms = 0;
+    std::optional<uint64_t> instructions;
+    std::optional<uint64_t> cycles;
+    std::optional<uint64_t> branch_misses;
+    std::optional<uint64_t> loads; // L1D read accesses
+    std::optional<uint64_t> stores; // L1D write accesses
+};
+
+// Runs `path` with no arguments under `perf_event_open` counters, reading
+// stdin from `input` and writing stdout to `output` unless they are empty.
+// Returns nullopt and sets `error` if it cannot be started or is killed by a
+// signal.
+std::optional<RunSample> runMeasured(
+    const std::string& path, const std::string& input, const std::string& output, std::string& error);
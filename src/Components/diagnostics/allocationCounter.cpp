@@ -0,0 +1,73 @@
+#include "timeReport.hpp"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions so `--time-report` can attribute
+// heap allocations to compile phases. The counters are per thread and only
+// incremented, so the hook costs two adds per allocation.
+namespace {
+thread_local uint64_t t_allocations = 0;
+thread_local uint64_t t_allocated_bytes = 0;
+
+void* allocate(const std::size_t size) noexcept
+{
+    t_allocations++;
+    t_allocated_bytes += size;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* allocate_aligned(const std::size_t size, const std::align_val_t alignment) noexcept
+{
+    t_allocations++;
+    t_allocated_bytes += size;
+    const auto align = static_cast<std::size_t>(alignment);
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void* checked(void* pointer)
+{
+    if (pointer == nullptr) {
+        throw std::bad_alloc {};
+    }
+    return pointer;
+}
+}
+
+AllocationCounts threadAllocations()
+{
+    return { t_allocations, t_allocated_bytes };
+}
+
+void* operator new(const std::size_t size) { return checked(allocate(size)); }
+void* operator new[](const std::size_t size) { return checked(allocate(size)); }
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new(const std::size_t size, const std::align_val_t alignment)
+{
+    return checked(allocate_aligned(size, alignment));
+}
+void* operator new[](const std::size_t size, const std::align_val_t alignment)
+{
+    return checked(allocate_aligned(size, alignment));
+}
+void* operator new(const std::size_t size, const std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate_aligned(size, alignment);
+}
+void* operator new[](const std::size_t size, const std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocate_aligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { std::free(pointer); }
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+// Raised by the lexer, parser and generator on invalid input. The driver
+// catches it per file, so one bad input does not stop a batch or a server.
+class CompileError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
@@ -0,0 +1,216 @@
+#include "timeReport.hpp"
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+// Per-thread hardware counters, opened on first use. `inherit` makes tools
+// spawned by the thread count towards it once they exit.
+class HardwareCounters {
+public:
+    HardwareCounters()
+    {
+        m_instructions = open_counter(PERF_COUNT_HW_INSTRUCTIONS);
+        m_cache_misses = open_counter(PERF_COUNT_HW_CACHE_MISSES);
+    }
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+    ~HardwareCounters()
+    {
+        for (const int fd : { m_instructions, m_cache_misses }) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    [[nodiscard]] std::optional<uint64_t> instructions() const { return read_counter(m_instructions); }
+    [[nodiscard]] std::optional<uint64_t> cache_misses() const { return read_counter(m_cache_misses); }
+
+private:
+    int m_instructions = -1;
+    int m_cache_misses = -1;
+
+    static int open_counter(const uint64_t config)
+    {
+        perf_event_attr attributes {};
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = config;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.inherit = 1;
+        const long fd = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        return static_cast<int>(fd);
+    }
+
+    static std::optional<uint64_t> read_counter(const int fd)
+    {
+        uint64_t value = 0;
+        if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+            return {};
+        }
+        return value;
+    }
+};
+
+double nowUs()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+double threadCpuMs()
+{
+    timespec time {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) * 1e3 + static_cast<double>(time.tv_nsec) / 1e6;
+}
+
+std::string counterText(const std::optional<uint64_t>& value)
+{
+    return value.has_value() ? std::to_string(value.value()) : "n/a";
+}
+
+void writeJsonString(std::ostream& os, const std::string& text)
+{
+    os << '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec
+               << std::setfill(' ');
+        }
+        else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+}
+
+PhaseTimer::PhaseTimer(TimeReport* report)
+    : m_report(report)
+{
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    end();
+}
+
+PhaseTimer::Snapshot PhaseTimer::snapshot()
+{
+    thread_local const HardwareCounters counters;
+    return {
+        .wall_us = nowUs(),
+        .cpu_ms = threadCpuMs(),
+        .instructions = counters.instructions(),
+        .cache_misses = counters.cache_misses(),
+        .allocations = threadAllocations(),
+    };
+}
+
+void PhaseTimer::begin(std::string name)
+{
+    if (m_report == nullptr) {
+        return;
+    }
+    end();
+    m_phase = std::move(name);
+    m_start = snapshot();
+}
+
+void PhaseTimer::end(const double child_cpu_ms)
+{
+    if (m_report == nullptr || !m_phase.has_value()) {
+        return;
+    }
+    const Snapshot stop = snapshot();
+    const auto delta = [](const std::optional<uint64_t>& from, const std::optional<uint64_t>& to) {
+        return from.has_value() && to.has_value() ? std::optional(to.value() - from.value()) : std::nullopt;
+    };
+    m_report->phases.push_back({
+        .name = std::move(m_phase.value()),
+        .thread = static_cast<uint64_t>(gettid()),
+        .start_us = m_start.wall_us,
+        .wall_ms = (stop.wall_us - m_start.wall_us) / 1e3,
+        .cpu_ms = stop.cpu_ms - m_start.cpu_ms + child_cpu_ms,
+        .instructions = delta(m_start.instructions, stop.instructions),
+        .cache_misses = delta(m_start.cache_misses, stop.cache_misses),
+        .allocations = stop.allocations.count - m_start.allocations.count,
+        .allocated_bytes = stop.allocations.bytes - m_start.allocations.bytes,
+    });
+    m_phase.reset();
+}
+
+void printTimeReport(std::ostream& os, const std::string& input, const TimeReport& report)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3);
+    text << "time report for " << input << ":\n";
+    text << std::left << std::setw(12) << "  phase" << std::right << std::setw(11) << "wall ms" << std::setw(11)
+         << "cpu ms" << std::setw(15) << "instructions" << std::setw(14) << "cache misses" << std::setw(9)
+         << "allocs" << std::setw(12) << "alloc KB" << "\n";
+    PhaseSample total { .name = "total", .instructions = 0, .cache_misses = 0 };
+    for (const PhaseSample& phase : report.phases) {
+        text << "  " << std::left << std::setw(10) << phase.name << std::right << std::setw(11) << phase.wall_ms
+             << std::setw(11) << phase.cpu_ms << std::setw(15) << counterText(phase.instructions) << std::setw(14)
+             << counterText(phase.cache_misses) << std::setw(9) << phase.allocations << std::setw(12)
+             << static_cast<double>(phase.allocated_bytes) / 1024 << "\n";
+        total.wall_ms += phase.wall_ms;
+        total.cpu_ms += phase.cpu_ms;
+        total.instructions = phase.instructions.has_value() && total.instructions.has_value()
+            ? std::optional(total.instructions.value() + phase.instructions.value())
+            : std::nullopt;
+        total.cache_misses = phase.cache_misses.has_value() && total.cache_misses.has_value()
+            ? std::optional(total.cache_misses.value() + phase.cache_misses.value())
+            : std::nullopt;
+        total.allocations += phase.allocations;
+        total.allocated_bytes += phase.allocated_bytes;
+    }
+    text << "  " << std::left << std::setw(10) << total.name << std::right << std::setw(11) << total.wall_ms
+         << std::setw(11) << total.cpu_ms << std::setw(15) << counterText(total.instructions) << std::setw(14)
+         << counterText(total.cache_misses) << std::setw(9) << total.allocations << std::setw(12)
+         << static_cast<double>(total.allocated_bytes) / 1024 << "\n";
+    text << "  tokens: " << report.tokens << ", AST nodes: " << report.ast_nodes
+         << ", arena high-water: " << static_cast<double>(report.arena_bytes) / 1024
+         << " KB, assembly: " << static_cast<double>(report.asm_bytes) / 1024 << " KB\n";
+    os << text.str();
+}
+
+void writeChromeTrace(
+    std::ostream& os, const std::vector<std::string>& inputs, const std::vector<const TimeReport*>& reports)
+{
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (size_t i = 0; i < reports.size(); i++) {
+        for (const PhaseSample& phase : reports[i]->phases) {
+            os << (first ? "\n" : ",\n") << "{\"name\":";
+            writeJsonString(os, phase.name);
+            os << ",\"cat\":\"compile\",\"ph\":\"X\",\"pid\":" << getpid() << ",\"tid\":" << phase.thread
+               << ",\"ts\":" << std::fixed << std::setprecision(3) << phase.start_us
+               << ",\"dur\":" << phase.wall_ms * 1e3 << ",\"args\":{\"file\":";
+            writeJsonString(os, inputs[i]);
+            os << ",\"cpu_ms\":" << phase.cpu_ms << ",\"allocations\":" << phase.allocations
+               << ",\"allocated_bytes\":" << phase.allocated_bytes;
+            if (phase.instructions.has_value()) {
+                os << ",\"instructions\":" << phase.instructions.value();
+            }
+            if (phase.cache_misses.has_value()) {
+                os << ",\"cache_misses\":" << phase.cache_misses.value();
+            }
+            os << "}}";
+            first = false;
+        }
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
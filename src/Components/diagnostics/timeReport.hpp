@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Allocations made by the calling thread through the global `operator new`.
+struct AllocationCounts {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+AllocationCounts threadAllocations();
+
+struct PhaseSample {
+    std::string name;
+    uint64_t thread = 0;
+    double start_us = 0; // since the first phase timed by the process
+    double wall_ms = 0;
+    double cpu_ms = 0; // the thread's CPU time plus that of tools it ran
+    std::optional<uint64_t> instructions; // nullopt without perf_event_open
+    std::optional<uint64_t> cache_misses;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+};
+
+struct TimeReport {
+    std::vector<PhaseSample> phases;
+    size_t tokens = 0;
+    size_t ast_nodes = 0;
+    size_t arena_bytes = 0; // arena high-water mark
+    size_t asm_bytes = 0;
+};
+
+// Times consecutive phases on the calling thread: wall and CPU time, heap
+// allocations and, where the kernel allows `perf_event_open`, retired
+// instructions and cache misses. The hardware counters follow the thread
+// into the tools it spawns. A timer without a report does nothing.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(TimeReport* report);
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+    ~PhaseTimer();
+
+    // Ends the running phase, if any, and starts `name`.
+    void begin(std::string name);
+    // Ends the running phase; `child_cpu_ms` is the CPU time of a tool it ran.
+    void end(double child_cpu_ms = 0);
+
+private:
+    struct Snapshot {
+        double wall_us = 0;
+        double cpu_ms = 0;
+        std::optional<uint64_t> instructions;
+        std::optional<uint64_t> cache_misses;
+        AllocationCounts allocations;
+    };
+
+    TimeReport* m_report;
+    std::optional<std::string> m_phase {};
+    Snapshot m_start {};
+
+    static Snapshot snapshot();
+};
+
+void printTimeReport(std::ostream& os, const std::string& input, const TimeReport& report);
+// Chrome trace-event JSON (chrome://tracing, Perfetto) with one complete
+// event per phase; `inputs[i]` names the file `reports[i]` belongs to.
+void writeChromeTrace(
+    std::ostream& os, const std::vector<std::string>& inputs, const std::vector<const TimeReport*>& reports);
@@ -0,0 +1,331 @@
+#include "commandLine.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+bool parse_jobs(const std::string& text, size_t& jobs)
+{
+    char* end = nullptr;
+    const unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value == 0) {
+        return false;
+    }
+    jobs = value;
+    return true;
+}
+
+// A byte count with an optional K, M or G suffix.
+bool parse_size(const std::string& text, uint64_t& bytes)
+{
+    char* end = nullptr;
+    uint64_t value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        return false;
+    }
+    switch (*end) {
+    case 'G':
+        value *= 1024;
+        [[fallthrough]];
+    case 'M':
+        value *= 1024;
+        [[fallthrough]];
+    case 'K':
+        value *= 1024;
+        end++;
+        break;
+    default:
+        break;
+    }
+    if (*end != '\0' || value == 0) {
+        return false;
+    }
+    bytes = value;
+    return true;
+}
+}
+
+std::optional<CommandLine> parseCommandLine(const std::vector<std::string>& args, std::string& error)
+{
+    CommandLine command;
+    command.socket_path = defaultSocketPath();
+    command.options.cache_dir = defaultCacheDir();
+    command.options.cache_max_bytes = CompileCache::defaultMaxBytes;
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (arg == "--server") {
+            command.mode = CommandLine::Mode::server;
+            continue;
+        }
+        if (arg == "--client") {
+            command.mode = CommandLine::Mode::client;
+            continue;
+        }
+        if (arg == "--socket") {
+            if (i + 1 == args.size()) {
+                return {};
+            }
+            command.socket_path = args[++i];
+            continue;
+        }
+        command.forwarded.push_back(arg);
+        if (arg == "--stats") {
+            command.options.show_stats = true;
+        }
+        else if (arg == "-S") {
+            command.options.emit = CompileOptions::Emit::assembly;
+        }
+        else if (arg == "-c") {
+            command.options.emit = CompileOptions::Emit::object;
+        }
+        else if (arg == "-g") {
+            command.options.debug_info = true;
+        }
+        else if (arg == "--instrument") {
+            command.options.instrument = true;
+        }
+        else if (arg == "--profile-use") {
+            if (i + 1 == args.size()) {
+                return {};
+            }
+            command.options.profile_use = args[++i];
+            command.forwarded.push_back(command.options.profile_use);
+        }
+        else if (arg.starts_with("--profile-use=")) {
+            command.options.profile_use = arg.substr(std::string_view("--profile-use=").size());
+            if (command.options.profile_use.empty()) {
+                return {};
+            }
+        }
+        else if (arg == "--watch") {
+            command.watch = true;
+        }
+        else if (arg == "--hash-cons") {
+            command.options.hash_cons = true;
+        }
+        else if (arg == "--superopt") {
+            command.options.superopt = true;
+        }
+        else if (arg == "-mavx2") {
+            command.options.avx2 = true;
+        }
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-Os") {
+            command.options.opt_level = arg == "-O0" ? OptLevel::O0
+                : arg == "-O1"                      ? OptLevel::O1
+                : arg == "-O2"                      ? OptLevel::O2
+                                                    : OptLevel::Os;
+        }
+        else if (arg.starts_with("--passes=")) {
+            command.options.passes = parsePassList(arg.substr(std::string_view("--passes=").size()), error);
+            if (!command.options.passes.has_value()) {
+                error = "--passes: " + error + "; passes: " + passNames();
+                return {};
+            }
+        }
+        else if (arg.starts_with("--print-after=")) {
+            command.options.print_after = arg.substr(std::string_view("--print-after=").size());
+            if (!isPassName(command.options.print_after)) {
+                error = "--print-after: unknown pass '" + command.options.print_after + "'; passes: " + passNames();
+                return {};
+            }
+        }
+        else if (arg == "--cache") {
+            command.options.use_cache = true;
+        }
+        else if (arg == "--cache-stats") {
+            command.cache_stats = true;
+        }
+        else if (arg == "--time-report") {
+            command.print_time_report = true;
+            command.options.time_report = true;
+        }
+        else if (arg == "--trace") {
+            if (i + 1 == args.size()) {
+                return {};
+            }
+            command.trace_path = args[++i];
+            command.forwarded.push_back(command.trace_path);
+            command.options.time_report = true;
+        }
+        else if (arg == "--cache-dir" || arg == "--cache-size") {
+            if (i + 1 == args.size()) {
+                return {};
+            }
+            const std::string& value = args[++i];
+            command.forwarded.push_back(value);
+            if (arg == "--cache-dir") {
+                command.options.cache_dir = value;
+            }
+            else if (!parse_size(value, command.options.cache_max_bytes)) {
+                return {};
+            }
+        }
+        else if (arg == "-j") {
+            if (i + 1 == args.size() || !parse_jobs(args[i + 1], command.jobs)) {
+                return {};
+            }
+            command.forwarded.push_back(args[++i]);
+        }
+        else if (arg.starts_with("-j")) {
+            if (!parse_jobs(arg.substr(2), command.jobs)) {
+                return {};
+            }
+        }
+        else {
+            command.inputs.push_back(arg);
+        }
+    }
+    if (command.mode == CommandLine::Mode::server ? !command.forwarded.empty()
+                                                  : command.inputs.empty() && !command.cache_stats) {
+        return {};
+    }
+    // `--print-after` names a pass of the pipeline `-O` or `--passes` chose.
+    const std::vector<std::string> pipeline
+        = command.options.passes.value_or(pipelineFor(command.options.opt_level));
+    if (!command.options.print_after.empty() && std::ranges::find(pipeline, command.options.print_after) == pipeline.end()) {
+        std::string selected;
+        for (const std::string& pass : pipeline) {
+            selected += (selected.empty() ? "" : ", ") + pass;
+        }
+        error = "--print-after: pass '" + command.options.print_after + "' is not in the pipeline ("
+            + (selected.empty() ? "no passes" : selected) + ")";
+        return {};
+    }
+    command.options.jobs = command.jobs;
+    if (command.watch && (command.mode != CommandLine::Mode::compile || command.inputs.size() != 1 || command.jobs != 0)) {
+        return {};
+    }
+    return command;
+}
+
+void showUsage(const std::string& program_name)
+{
+    std::cerr << "Incorrect usage. Correct usage is:" << std::endl;
+    std::cerr << program_name << " [--stats] [-S | -c] [-g] [--hash-cons] [--cache] <input.kei>" << std::endl;
+    std::cerr << program_name << " [--stats] [-S | -c] [-g] [--hash-cons] [--cache] [-j N] <input.kei>..." << std::endl;
+    std::cerr << "cache options: --cache-dir DIR, --cache-size SIZE[K|M|G], --cache-stats" << std::endl;
+    std::cerr << "profiling options: --time-report, --trace FILE.json" << std::endl;
+    std::cerr << "profile-guided layout: --instrument, then --profile-use=FILE.kprof" << std::endl;
+    std::cerr << "superoptimizer: --superopt (memo kept in the cache directory)" << std::endl;
+    std::cerr << "array arithmetic: -mavx2 (default: SSE2)" << std::endl;
+    std::cerr << "optimization: -O0 | -O1 | -O2 (default) | -Os, --passes=PASS,..., --print-after=PASS" << std::endl;
+    std::cerr << "passes: " << passNames() << std::endl;
+    std::cerr << program_name << " --watch [--stats] [-S | -c] [-g] <input.kei>" << std::endl;
+    std::cerr << program_name << " --cache-stats [--cache-dir DIR]" << std::endl;
+    std::cerr << program_name << " --server [--socket PATH]" << std::endl;
+    std::cerr << program_name << " --client [--socket PATH] <compile arguments>..." << std::endl;
+}
+
+std::string defaultSocketPath()
+{
+    if (const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR"); runtime_dir != nullptr && *runtime_dir != '\0') {
+        return std::string(runtime_dir) + "/kei_lang.sock";
+    }
+    return "/tmp/kei_lang-" + std::to_string(getuid()) + ".sock";
+}
+
+std::string resolvePath(const std::string& cwd, const std::string& path)
+{
+    if (cwd.empty() || path.starts_with('/')) {
+        return path;
+    }
+    return cwd + "/" + path;
+}
+
+std::string outputBaseFor(const CommandLine& command, const std::string& input)
+{
+    if (command.inputs.size() == 1 && command.jobs == 0) {
+        return "out";
+    }
+    return outputBaseFor(input);
+}
+
+std::string batchReport(const std::vector<std::string>& inputs, const std::vector<CompileResult>& results,
+    const size_t workers, const double seconds)
+{
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+    size_t failed = 0;
+    size_t total_bytes = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const CompileResult& result = results[i];
+        total_bytes += result.source_bytes;
+        report << inputs[i] << ": ";
+        if (result.cache_hit) {
+            report << "cached, " << result.total_seconds * 1e3 << " ms total\n";
+        }
+        else if (result.success) {
+            report << result.frontend_seconds * 1e3 << " ms frontend, " << result.total_seconds * 1e3
+                   << " ms total, " << result.source_bytes / 1e6 / result.frontend_seconds << " MB/s\n";
+        }
+        else {
+            failed++;
+            report << "failed\n";
+        }
+        report << result.diagnostics;
+    }
+    report << inputs.size() << " files (" << failed << " failed), " << total_bytes / 1e3 << " KB in "
+           << seconds * 1e3 << " ms with " << workers << " workers: " << inputs.size() / seconds << " files/s, "
+           << total_bytes / 1e6 / seconds << " MB/s\n";
+    return report.str();
+}
+
+void reportTimes(const CommandLine& command, const std::string& cwd, const std::vector<CompileResult>& results,
+    std::string& diagnostics)
+{
+    if (command.print_time_report) {
+        std::ostringstream tables;
+        for (size_t i = 0; i < results.size(); i++) {
+            printTimeReport(tables, command.inputs[i], results[i].time_report);
+        }
+        diagnostics += tables.str();
+    }
+    if (!command.trace_path.empty()) {
+        std::vector<const TimeReport*> reports;
+        for (const CompileResult& result : results) {
+            reports.push_back(&result.time_report);
+        }
+        std::ofstream trace(resolvePath(cwd, command.trace_path));
+        writeChromeTrace(trace, command.inputs, reports);
+        if (!trace) {
+            diagnostics += "Failed to write " + command.trace_path + "\n";
+        }
+    }
+}
+
+int compileSequentially(
+    Compiler& compiler, const CommandLine& command, const std::string& cwd, std::string& diagnostics)
+{
+    CompileOptions options = command.options;
+    options.cache_dir = resolvePath(cwd, options.cache_dir);
+    if (!options.profile_use.empty()) {
+        options.profile_use = resolvePath(cwd, options.profile_use);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<CompileResult> results;
+    bool success = true;
+    for (const std::string& input : command.inputs) {
+        results.push_back(compiler.compile_file(
+            resolvePath(cwd, input), resolvePath(cwd, outputBaseFor(command, input)), options));
+        success = success && results.back().success;
+    }
+    if (command.inputs.size() == 1 && command.jobs == 0) {
+        diagnostics += results.front().diagnostics;
+    }
+    else if (!command.inputs.empty()) {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        diagnostics += batchReport(command.inputs, results, 1, seconds);
+    }
+    reportTimes(command, cwd, results, diagnostics);
+    if (command.cache_stats) {
+        std::ostringstream stats;
+        CompileCache(options.cache_dir, options.cache_max_bytes).print_stats(stats);
+        diagnostics += stats.str();
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
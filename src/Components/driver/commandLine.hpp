@@ -0,0 +1,44 @@
+#pragma once
+
+#include "compileCache.hpp"
+#include <optional>
+
+struct CommandLine {
+    enum class Mode {
+        compile,
+        server, // `--server`: serve compile requests on `socket_path`
+        client, // `--client`: forward `forwarded` to the server on `socket_path`
+    };
+    Mode mode = Mode::compile;
+    CompileOptions options {};
+    std::vector<std::string> inputs {};
+    size_t jobs = 0; // 0: one input goes to `out`, several use one worker per core
+    std::string socket_path {};
+    std::vector<std::string> forwarded {}; // every argument except the mode flags
+    bool cache_stats = false; // `--cache-stats`: print the cache counters
+    bool print_time_report = false; // `--time-report`
+    std::string trace_path {}; // `--trace FILE`: Chrome trace-event JSON
+    bool watch = false; // `--watch`: rebuild the single input whenever it is written
+};
+
+// Parses the arguments after the program name; nullopt means a usage error,
+// which `error` describes when it is more than a malformed command line.
+std::optional<CommandLine> parseCommandLine(const std::vector<std::string>& args, std::string& error);
+void showUsage(const std::string& program_name);
+std::string defaultSocketPath();
+// `path` taken relative to `cwd` unless it is absolute or `cwd` is empty.
+std::string resolvePath(const std::string& cwd, const std::string& path);
+// Output base of `input`: `out` for a single input without `-j`, the input
+// without its extension otherwise.
+std::string outputBaseFor(const CommandLine& command, const std::string& input);
+// Per-file results in input order, then the aggregate throughput.
+std::string batchReport(const std::vector<std::string>& inputs, const std::vector<CompileResult>& results,
+    size_t workers, double seconds);
+// Appends the `--time-report` tables and writes the `--trace` file.
+void reportTimes(const CommandLine& command, const std::string& cwd, const std::vector<CompileResult>& results,
+    std::string& diagnostics);
+// Compiles every input of `command` in turn on `compiler`, resolving paths
+// against `cwd`, and returns the process exit status. Also prints the cache
+// counters for `--cache-stats`.
+int compileSequentially(
+    Compiler& compiler, const CommandLine& command, const std::string& cwd, std::string& diagnostics);
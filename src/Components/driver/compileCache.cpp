@@ -0,0 +1,372 @@
+#include "compileCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#ifndef KEI_LANG_VERSION
+#define KEI_LANG_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::string_view entryMagic = "KEICACHE1\n";
+constexpr std::string_view entryExtension = ".entry";
+
+// Word-at-a-time multiply/xor-shift hash; two seeds give the 128-bit key.
+uint64_t fmix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash64(const std::string_view data, const uint64_t seed)
+{
+    constexpr uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = seed ^ (data.size() * multiplier);
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, sizeof(word));
+        h = (h ^ fmix64(word)) * multiplier;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    if (i < data.size()) {
+        std::memcpy(&tail, data.data() + i, data.size() - i);
+    }
+    h = (h ^ fmix64(tail)) * multiplier;
+    return fmix64(h);
+}
+
+// Identifies this compiler binary: its version and the size and time of the
+// executable, so a rebuilt compiler does not reuse stale entries.
+const std::string& compilerStamp()
+{
+    static const std::string stamp = [] {
+        std::string text = "kei_lang " KEI_LANG_VERSION;
+        struct stat info {};
+        if (stat("/proc/self/exe", &info) == 0) {
+            text += " " + std::to_string(info.st_size) + " " + std::to_string(info.st_mtim.tv_sec) + "."
+                + std::to_string(info.st_mtim.tv_nsec);
+        }
+        return text;
+    }();
+    return stamp;
+}
+
+// Suffixes of the outputs a compilation leaves at its output base.
+std::vector<std::string> artifactSuffixes(const CompileOptions::Emit emit)
+{
+    switch (emit) {
+    case CompileOptions::Emit::assembly:
+        return { ".asm" };
+    case CompileOptions::Emit::object:
+        return { ".asm", ".o" };
+    case CompileOptions::Emit::executable:
+        return { ".asm", ".o", "" };
+    }
+    return {};
+}
+
+void append_u64(std::string& buffer, const uint64_t value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_string(std::string& buffer, const std::string_view value)
+{
+    append_u64(buffer, value.size());
+    buffer += value;
+}
+
+bool take_string(std::string_view& buffer, std::string_view& value)
+{
+    uint64_t size = 0;
+    if (buffer.size() < sizeof(size)) {
+        return false;
+    }
+    std::memcpy(&size, buffer.data(), sizeof(size));
+    buffer.remove_prefix(sizeof(size));
+    if (buffer.size() < size) {
+        return false;
+    }
+    value = buffer.substr(0, size);
+    buffer.remove_prefix(size);
+    return true;
+}
+
+// Runs `update` on the counters in `dir`/stats while holding an exclusive lock.
+void withStats(const std::string& dir, const std::function<void(CompileCache::Stats&)>& update)
+{
+    const std::string path = dir + "/stats";
+    std::error_code error;
+    fs::create_directories(dir, error);
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    flock(fd, LOCK_EX);
+    std::string text(256, '\0');
+    const ssize_t count = pread(fd, text.data(), text.size(), 0);
+    text.resize(count > 0 ? static_cast<size_t>(count) : 0);
+    CompileCache::Stats stats;
+    std::istringstream input(text);
+    std::string name;
+    uint64_t value = 0;
+    while (input >> name >> value) {
+        if (name == "hits") {
+            stats.hits = value;
+        }
+        else if (name == "misses") {
+            stats.misses = value;
+        }
+        else if (name == "stores") {
+            stats.stores = value;
+        }
+        else if (name == "evictions") {
+            stats.evictions = value;
+        }
+        else if (name == "bytes") {
+            stats.bytes = value;
+        }
+    }
+    update(stats);
+    std::ostringstream output;
+    output << "hits " << stats.hits << "\nmisses " << stats.misses << "\nstores " << stats.stores << "\nevictions "
+           << stats.evictions << "\nbytes " << stats.bytes << "\n";
+    const std::string updated = output.str();
+    if (pwrite(fd, updated.data(), updated.size(), 0) == static_cast<ssize_t>(updated.size())) {
+        ftruncate(fd, static_cast<off_t>(updated.size()));
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+}
+
+CompileCache::CompileCache(std::string dir, const uint64_t max_bytes)
+    : m_dir(std::move(dir))
+    , m_max_bytes(max_bytes)
+{
+}
+
+std::string CompileCache::key(
+    const std::string_view source, const CompileOptions& options, const std::string_view context)
+{
+    std::string header = compilerStamp();
+    header += '\0';
+    header += static_cast<char>('0' + static_cast<int>(options.emit));
+    header += options.show_stats ? '1' : '0';
+    header += options.debug_info ? 'g' : '-';
+    header += options.instrument ? 'i' : '-';
+    header += options.hash_cons ? 'h' : '-';
+    header += options.superopt ? 's' : '-';
+    header += options.avx2 ? 'a' : '-';
+    header += static_cast<char>('0' + static_cast<int>(options.opt_level));
+    for (const std::string& pass : options.passes.value_or(std::vector<std::string> {})) {
+        header += pass + ',';
+    }
+    header += options.passes.has_value() ? ';' : '-';
+    header += options.print_after;
+    header += '\0';
+    header += context;
+    const uint64_t low = hash64(source, hash64(header, 0x6b65692d6c616e67ULL));
+    const uint64_t high = hash64(source, hash64(header, 0x63616368652d6b31ULL));
+    char text[33];
+    std::snprintf(text, sizeof(text), "%016llx%016llx", static_cast<unsigned long long>(high),
+        static_cast<unsigned long long>(low));
+    return text;
+}
+
+std::string CompileCache::entry_path(const std::string& key) const
+{
+    return m_dir + "/" + key.substr(0, 2) + "/" + key + std::string(entryExtension);
+}
+
+bool CompileCache::fetch(const std::string& key, const std::string& output_base, std::string& diagnostics)
+{
+    const std::string path = entry_path(key);
+    std::string entry;
+    bool hit = readFile(path, entry) && entry.starts_with(entryMagic);
+    std::string_view rest = std::string_view(entry).substr(hit ? entryMagic.size() : entry.size());
+    std::vector<std::pair<std::string_view, std::string_view>> artifacts;
+    std::string_view cached_diagnostics;
+    while (hit && !rest.empty()) {
+        std::string_view suffix;
+        std::string_view contents;
+        hit = take_string(rest, suffix) && take_string(rest, contents);
+        if (hit && suffix == "diagnostics") {
+            cached_diagnostics = contents;
+        }
+        else if (hit) {
+            artifacts.emplace_back(suffix, contents);
+        }
+    }
+    for (size_t i = 0; hit && i < artifacts.size(); i++) {
+        const auto& [suffix, contents] = artifacts[i];
+        hit = writeFileAtomic(output_base + std::string(suffix), contents, suffix.empty() ? 0755 : 0644);
+    }
+    if (hit) {
+        diagnostics += cached_diagnostics;
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    }
+    withStats(m_dir, [hit](Stats& stats) { (hit ? stats.hits : stats.misses)++; });
+    return hit;
+}
+
+void CompileCache::store(const std::string& key, const std::string& output_base, const CompileOptions& options,
+    const std::string& diagnostics)
+{
+    std::string entry(entryMagic);
+    for (const std::string& suffix : artifactSuffixes(options.emit)) {
+        std::string contents;
+        if (!readFile(output_base + suffix, contents)) {
+            return;
+        }
+        append_string(entry, suffix);
+        append_string(entry, contents);
+    }
+    append_string(entry, "diagnostics");
+    append_string(entry, diagnostics);
+
+    const std::string path = entry_path(key);
+    std::error_code error;
+    fs::create_directories(fs::path(path).parent_path(), error);
+    if (error) {
+        return;
+    }
+    // Renamed under the stats lock, so an entry a concurrent miss stored for
+    // the same key is replaced and counted only once.
+    withStats(m_dir, [&](Stats& stats) {
+        std::error_code size_error;
+        const uint64_t replaced = fs::file_size(path, size_error);
+        if (!writeFileAtomic(path, entry, 0644)) {
+            return;
+        }
+        stats.stores++;
+        stats.bytes += entry.size() - (size_error ? 0 : replaced);
+        if (stats.bytes > m_max_bytes) {
+            stats.bytes = evict(stats.evictions);
+        }
+    });
+}
+
+uint64_t CompileCache::evict(uint64_t& evictions) const
+{
+    struct Entry {
+        fs::file_time_type time;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (auto it = fs::recursive_directory_iterator(m_dir, error); !error && it != fs::recursive_directory_iterator();
+         it.increment(error)) {
+        if (it->path().extension() != entryExtension) {
+            continue;
+        }
+        std::error_code entry_error;
+        const uint64_t size = it->file_size(entry_error);
+        const fs::file_time_type time = it->last_write_time(entry_error);
+        if (!entry_error) {
+            entries.push_back({ time, size, it->path() });
+            total += size;
+        }
+    }
+    // Evict down to 90% of the limit so the next few stores do not rescan.
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    const uint64_t target = m_max_bytes / 10 * 9;
+    for (size_t i = 0; i < entries.size() && total > target; i++) {
+        if (fs::remove(entries[i].path, error)) {
+            total -= entries[i].size;
+            evictions++;
+        }
+    }
+    return total;
+}
+
+CompileCache::Stats CompileCache::stats() const
+{
+    Stats result;
+    withStats(m_dir, [&](const Stats& stats) { result = stats; });
+    return result;
+}
+
+void CompileCache::print_stats(std::ostream& os) const
+{
+    const Stats current = stats();
+    const uint64_t lookups = current.hits + current.misses;
+    os << "cache directory: " << m_dir << "\n";
+    std::ostringstream hit_rate;
+    hit_rate << std::fixed << std::setprecision(1)
+             << (lookups == 0 ? 0.0 : 100.0 * static_cast<double>(current.hits) / static_cast<double>(lookups));
+    os << "hits: " << current.hits << ", misses: " << current.misses << ", hit rate: " << hit_rate.str() << "%\n";
+    os << "stores: " << current.stores << ", evictions: " << current.evictions << "\n";
+    os << "size: " << current.bytes / 1024 << " KB of " << m_max_bytes / 1024 << " KB" << std::endl;
+}
+
+std::string defaultCacheDir()
+{
+    if (const char* cache_home = std::getenv("XDG_CACHE_HOME"); cache_home != nullptr && *cache_home != '\0') {
+        return std::string(cache_home) + "/kei_lang";
+    }
+    if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        return std::string(home) + "/.cache/kei_lang";
+    }
+    return "/tmp/kei_lang-cache-" + std::to_string(getuid());
+}
+
+bool readFile(const std::string& path, std::string& contents)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info {};
+    bool ok = fstat(fd, &info) == 0;
+    contents.resize(ok ? static_cast<size_t>(info.st_size) : 0);
+    size_t done = 0;
+    while (ok && done < contents.size()) {
+        const ssize_t count = read(fd, contents.data() + done, contents.size() - done);
+        ok = count > 0;
+        done += ok ? static_cast<size_t>(count) : 0;
+    }
+    close(fd);
+    return ok;
+}
+
+bool writeFileAtomic(const std::string& path, const std::string_view contents, const mode_t mode)
+{
+    const std::string temporary = path + ".tmp." + std::to_string(getpid()) + "."
+        + std::to_string(std::hash<std::thread::id> {}(std::this_thread::get_id()));
+    const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    size_t done = 0;
+    while (ok && done < contents.size()) {
+        const ssize_t count = write(fd, contents.data() + done, contents.size() - done);
+        ok = count > 0;
+        done += ok ? static_cast<size_t>(count) : 0;
+    }
+    ok = close(fd) == 0 && ok && fchmodat(AT_FDCWD, temporary.c_str(), mode, 0) == 0
+        && rename(temporary.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        unlink(temporary.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "compiler.hpp"
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <sys/types.h>
+
+// On-disk, content-addressed cache of compilation outputs. An entry is keyed
+// by a 128-bit hash of the source bytes, the compiler version and build, and
+// the options that change the outputs; it holds every file the compilation
+// produced (`.asm`, `.o`, the executable) plus its diagnostics.
+//
+// Entries are written to a temporary file and renamed into place, so
+// concurrent compilers never see a partial entry. A hit refreshes the entry's
+// modification time; once the cache grows past its size limit the entries
+// with the oldest times are evicted. Counters live in a `stats` file updated
+// under `flock`.
+class CompileCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stores = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0; // size of all entries
+    };
+
+    static constexpr uint64_t defaultMaxBytes = 256 * 1024 * 1024; // 256 MB default size
+
+    CompileCache(std::string dir, uint64_t max_bytes);
+
+    // `context` is whatever else the outputs depend on, such as paths they embed.
+    [[nodiscard]] static std::string key(
+        std::string_view source, const CompileOptions& options, std::string_view context);
+    // Places the cached outputs for `key` at `output_base` and appends the
+    // cached diagnostics. Returns false on a miss.
+    bool fetch(const std::string& key, const std::string& output_base, std::string& diagnostics);
+    // Stores the outputs a successful compilation left at `output_base`.
+    void store(const std::string& key, const std::string& output_base, const CompileOptions& options,
+        const std::string& diagnostics);
+    [[nodiscard]] Stats stats() const;
+    void print_stats(std::ostream& os) const;
+
+private:
+    std::string m_dir;
+    uint64_t m_max_bytes;
+
+    [[nodiscard]] std::string entry_path(const std::string& key) const;
+    // Removes the least recently used entries; returns the size left.
+    uint64_t evict(uint64_t& evictions) const;
+};
+
+std::string defaultCacheDir();
+bool readFile(const std::string& path, std::string& contents);
+// Writes through a temporary file in the same directory and renames it over
+// `path`, so readers see the old contents or the new ones, never a mix.
+bool writeFileAtomic(const std::string& path, std::string_view contents, mode_t mode);
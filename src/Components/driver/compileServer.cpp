@@ -0,0 +1,224 @@
+#include "compileServer.hpp"
+#include "commandLine.hpp"
+#include "threadPool.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t maxMessageStrings = 1 << 16;
+constexpr uint32_t maxStringSize = 1 << 20;
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void append_u32(std::string& buffer, const uint32_t value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_string(std::string& buffer, const std::string& value)
+{
+    append_u32(buffer, static_cast<uint32_t>(value.size()));
+    buffer += value;
+}
+
+bool write_all(const int fd, const std::string& buffer)
+{
+    size_t written = 0;
+    while (written < buffer.size()) {
+        const ssize_t count = send(fd, buffer.data() + written, buffer.size() - written, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool read_exact(const int fd, char* data, const size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t count = read(fd, data + done, size - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool read_u32(const int fd, uint32_t& value)
+{
+    return read_exact(fd, reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+bool read_string(const int fd, std::string& value)
+{
+    uint32_t size = 0;
+    if (!read_u32(fd, size) || size > maxStringSize) {
+        return false;
+    }
+    value.resize(size);
+    return read_exact(fd, value.data(), size);
+}
+
+bool make_address(const std::string& socket_path, sockaddr_un& address)
+{
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+int connect_to(const sockaddr_un& address)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void handle_request(const int fd, Compiler& compiler)
+{
+    uint32_t count = 0;
+    std::vector<std::string> strings;
+    bool valid = read_u32(fd, count) && count >= 1 && count <= maxMessageStrings;
+    for (uint32_t i = 0; valid && i < count; i++) {
+        valid = read_string(fd, strings.emplace_back());
+    }
+    if (!valid) {
+        close(fd);
+        return;
+    }
+
+    int status = EXIT_FAILURE;
+    std::string diagnostics;
+    const std::vector<std::string> args(strings.begin() + 1, strings.end());
+    std::string usage_error;
+    const std::optional<CommandLine> command = parseCommandLine(args, usage_error);
+    if (!usage_error.empty()) {
+        diagnostics = "Incorrect usage: " + usage_error + "\n";
+    }
+    else if (!command.has_value() || command->mode != CommandLine::Mode::compile) {
+        diagnostics = "Incorrect usage: the server only accepts compile arguments.\n";
+    }
+    else {
+        status = compileSequentially(compiler, command.value(), strings.front(), diagnostics);
+    }
+
+    std::string reply;
+    append_u32(reply, static_cast<uint32_t>(status));
+    append_string(reply, diagnostics);
+    write_all(fd, reply);
+    close(fd);
+}
+}
+
+int runServer(const std::string& socket_path)
+{
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) {
+        std::cerr << "Socket path is too long: " << socket_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (const int fd = connect_to(address); fd >= 0) {
+        close(fd);
+        std::cerr << "A server is already listening on " << socket_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    unlink(socket_path.c_str());
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Failed to listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // No SA_RESTART, so a signal interrupts `accept` and the loop can clean up.
+    struct sigaction stop = {};
+    stop.sa_handler = [](int) { g_stop = 1; };
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, nullptr);
+    sigaction(SIGTERM, &stop, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Workers start with the signals blocked so they are delivered here.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+    std::vector<std::unique_ptr<Compiler>> compilers;
+    for (size_t i = 0; i < pool.size(); i++) {
+        compilers.push_back(std::make_unique<Compiler>());
+    }
+    std::cerr << "kei_lang server listening on " << socket_path << " with " << pool.size() << " workers"
+              << std::endl;
+    while (g_stop == 0) {
+        const int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            }
+            continue;
+        }
+        pool.submit([fd, &compilers](const size_t worker) { handle_request(fd, *compilers[worker]); });
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+    pool.wait();
+    return EXIT_SUCCESS;
+}
+
+std::optional<int> runClient(const std::string& socket_path, const std::vector<std::string>& args)
+{
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) {
+        return {};
+    }
+    const int fd = connect_to(address);
+    if (fd < 0) {
+        return {};
+    }
+    const std::unique_ptr<char, decltype(&free)> cwd(getcwd(nullptr, 0), &free);
+    std::string request;
+    append_u32(request, static_cast<uint32_t>(args.size() + 1));
+    append_string(request, cwd != nullptr ? cwd.get() : "");
+    for (const std::string& arg : args) {
+        append_string(request, arg);
+    }
+    uint32_t status = 0;
+    std::string diagnostics;
+    const bool ok = write_all(fd, request) && read_u32(fd, status) && read_string(fd, diagnostics);
+    close(fd);
+    if (!ok) {
+        std::cerr << "Lost connection to the server on " << socket_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cerr << diagnostics;
+    return static_cast<int>(status);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+// Compile server. `kei_lang --server` listens on a Unix domain socket and runs
+// every request on a pool worker with that worker's long-lived `Compiler`, so
+// a request pays for neither process start-up nor cold arenas and tables.
+//
+// Messages are length-prefixed: a request is a string list holding the
+// client's working directory followed by its compile arguments; the reply is
+// the exit status followed by the diagnostics text. Outputs are written by the
+// server straight into the client's directory.
+int runServer(const std::string& socket_path);
+// Sends `args` to the server and prints its diagnostics; nullopt when no
+// server is listening on `socket_path`.
+std::optional<int> runClient(const std::string& socket_path, const std::vector<std::string>& args);
@@ -0,0 +1,397 @@
+#include "compiler.hpp"
+#include "compileCache.hpp"
+#include "moduleGraph.hpp"
+#include "Components/diagnostics/compileError.hpp"
+#include "Components/generator/branchProfile.hpp"
+#include "Components/generator/generatorCode.hpp"
+#include "Components/optimizer/passManager.hpp"
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace {
+// Reads the `--profile-use` profile into `profile`, which the returned options
+// point into.
+GeneratorOptions generatorOptionsFor(const std::string& source, const CompileOptions& options,
+    std::string& diagnostics, const std::string& source_path, const std::string& profile_path,
+    std::optional<BranchCounts>& profile)
+{
+    GeneratorOptions generator_options;
+    if (options.debug_info) {
+        generator_options.source_path = source_path;
+    }
+    generator_options.profile_checksum = profileChecksum(source);
+    generator_options.avx2 = options.avx2;
+    if (options.instrument) {
+        generator_options.profile_path = profile_path;
+    }
+    if (!options.profile_use.empty()) {
+        std::string error;
+        profile = readBranchProfile(options.profile_use, generator_options.profile_checksum, error);
+        if (!profile.has_value()) {
+            throw CompileError(error);
+        }
+        if (profile->records == 0) {
+            diagnostics += "warning: " + options.profile_use + " has no profile for this source\n";
+        }
+        else {
+            generator_options.branch_counts = &profile->counters;
+        }
+    }
+    return generator_options;
+}
+}
+
+std::string Compiler::compile_source(std::string source, const CompileOptions& options, std::string& diagnostics,
+    TimeReport* report, const std::string& source_path, const std::string& profile_path)
+{
+    PhaseTimer timer(report);
+    m_Allocator.reset();
+    std::optional<BranchCounts> profile;
+    const GeneratorOptions generator_options
+        = generatorOptionsFor(source, options, diagnostics, source_path, profile_path, profile);
+    timer.begin("tokenize");
+    LexicalAnalyzer lexicalAnalyzer(std::move(source));
+    std::vector<Token> tokens = lexicalAnalyzer.tokenize();
+    timer.begin("parse");
+    const size_t token_count = tokens.size();
+    // Shared nodes carry the line of their first occurrence, so line info
+    // needs every node of its own.
+    SyntaxAnalyzer syntaxAnalyzer(std::move(tokens), m_Allocator, options.hash_cons && !options.debug_info);
+    std::optional<ProgramNode> prog = syntaxAnalyzer.parseProgram();
+    if (!prog.has_value()) {
+        throw CompileError("Invalid program");
+    }
+    if (prog->imports.size() != options.imports.size()) {
+        throw CompileError("Imports are only resolved when compiling a file");
+    }
+    if (report != nullptr) {
+        report->tokens = token_count;
+        report->ast_nodes = m_Allocator.allocations();
+    }
+    if (options.hash_cons && options.show_stats) {
+        diagnostics += "hash-cons: " + std::to_string(syntaxAnalyzer.sharedExprs()) + " expression nodes shared\n";
+    }
+    return generate(prog.value(), generator_options, profile.has_value(), options, diagnostics, timer, report);
+}
+
+std::string Compiler::compile_parsed(const ProgramNode& parsed, const std::string& source,
+    const CompileOptions& options, std::string& diagnostics, TimeReport* report, const std::string& source_path,
+    const std::string& profile_path)
+{
+    PhaseTimer timer(report);
+    m_Allocator.reset();
+    std::optional<BranchCounts> profile;
+    const GeneratorOptions generator_options
+        = generatorOptionsFor(source, options, diagnostics, source_path, profile_path, profile);
+    timer.begin("copy");
+    ProgramNode prog = copyProgram(m_Allocator, parsed);
+    return generate(prog, generator_options, profile.has_value(), options, diagnostics, timer, report);
+}
+
+std::string Compiler::generate(ProgramNode& prog, GeneratorOptions generator_options, const bool uses_profile,
+    const CompileOptions& options, std::string& diagnostics, PhaseTimer& timer, TimeReport* report)
+{
+    evaluateExports(prog, options.imports);
+    declareImports(m_Allocator, prog, options.imports);
+    const std::vector<std::string> pipeline = options.passes.value_or(pipelineFor(options.opt_level));
+    std::string dump;
+    const std::vector<PassReport> passes = PassManager(m_Allocator, timer).run(prog, pipeline, options.print_after, dump);
+    diagnostics += dump;
+    if (options.show_stats) {
+        diagnostics += formatPassReports(passes);
+    }
+
+    // std::cout << prog << std::endl; // Show AST
+    if (options.superopt) {
+        load_superopt_memo(options.cache_dir, diagnostics);
+        m_superoptimizer.reset_stats();
+        generator_options.superoptimizer = &m_superoptimizer;
+    }
+    timer.begin("generate");
+    Generator generator(prog, generator_options);
+    std::string assembly = generator.gen_prog();
+    timer.end();
+    if (options.superopt) {
+        save_superopt_memo(diagnostics);
+    }
+    if (generator.profile_ignored()) {
+        diagnostics += "warning: " + options.profile_use + " does not match this program; ignored\n";
+    }
+    else if (uses_profile && options.show_stats) {
+        diagnostics += "pgo: " + std::to_string(generator.outlined_arms()) + " arms moved out of line\n";
+    }
+    if (options.show_stats) {
+        diagnostics += "switch: " + std::to_string(generator.jump_tables()) + " jump tables, "
+            + std::to_string(generator.decision_trees()) + " decision trees\n";
+        diagnostics += "simd: " + std::to_string(generator.vectorized_exprs()) + " of "
+            + std::to_string(generator.elementwise_exprs()) + " array expressions vectorized ("
+            + (options.avx2 ? "avx2" : "sse2") + ")\n";
+    }
+    if (options.superopt && options.show_stats) {
+        const Superoptimizer::Stats& stats = m_superoptimizer.stats();
+        diagnostics += "superopt: " + std::to_string(stats.improved) + " expressions improved, "
+            + std::to_string(stats.searched) + " searched, " + std::to_string(stats.memo_hits) + " from the memo\n";
+    }
+    if (report != nullptr) {
+        report->arena_bytes = m_Allocator.bytesUsed();
+        report->asm_bytes = assembly.size();
+    }
+    return assembly;
+}
+
+void Compiler::load_superopt_memo(const std::string& cache_dir, std::string& diagnostics)
+{
+    const std::string path = cache_dir + "/superopt.memo";
+    if (path == m_superopt_memo) {
+        return;
+    }
+    m_superoptimizer = {};
+    m_superopt_memo = path;
+    std::string contents;
+    if (readFile(path, contents) && !m_superoptimizer.load(contents)) {
+        diagnostics += "warning: " + path + " is not a superoptimizer memo; ignored\n";
+    }
+}
+
+void Compiler::save_superopt_memo(std::string& diagnostics)
+{
+    if (!m_superoptimizer.changed()) {
+        return;
+    }
+    std::string contents;
+    if (readFile(m_superopt_memo, contents)) {
+        m_superoptimizer.load(contents);
+    }
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(m_superopt_memo).parent_path(), error);
+    if (!writeFileAtomic(m_superopt_memo, m_superoptimizer.contents(), 0644)) {
+        diagnostics += "warning: failed to write " + m_superopt_memo + "\n";
+    }
+    m_superoptimizer.mark_saved();
+}
+
+std::vector<ExportedConstant> Compiler::compile_interface(
+    std::string source, const std::vector<ImportedModule>& imports)
+{
+    m_Allocator.reset();
+    LexicalAnalyzer lexicalAnalyzer(std::move(source));
+    SyntaxAnalyzer syntaxAnalyzer(lexicalAnalyzer.tokenize(), m_Allocator);
+    std::optional<ProgramNode> prog = syntaxAnalyzer.parseProgram();
+    if (!prog.has_value()) {
+        throw CompileError("Invalid program");
+    }
+    // An imported module has no code of its own to run.
+    if (!prog->functions.empty()) {
+        throw CompileError("An imported module cannot define functions (line "
+            + std::to_string(prog->functions.front()->name.line) + ")");
+    }
+    for (const StmtNode* stmt : prog->statements) {
+        const auto* stmt_let = std::get_if<LetStatementNode*>(&stmt->statement);
+        if (stmt_let == nullptr || !(*stmt_let)->exported) {
+            throw CompileError("An imported module holds only `import`s and `export let`s (line "
+                + std::to_string(stmtLine(stmt)) + ")");
+        }
+    }
+    return evaluateExports(prog.value(), imports);
+}
+
+CompileResult Compiler::compile_file(
+    const std::string& input, const std::string& output_base, const CompileOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    CompileResult result;
+    TimeReport* report = options.time_report ? &result.time_report : nullptr;
+    PhaseTimer timer(report);
+    const auto finish = [&](const bool success) {
+        timer.end();
+        result.success = success;
+        result.total_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return result;
+    };
+
+    if (!hasKeiExtension(input)) {
+        result.diagnostics += "The input file must have a '.kei' extension.\n";
+        return finish(false);
+    }
+    timer.begin("read");
+    std::ifstream file(input);
+    if (!file) {
+        result.diagnostics += "Failed to open input file.\n";
+        return finish(false);
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    result.source_bytes = contents.size();
+    // Absolute, so profilers find the source and the instrumented program
+    // its profile from any working directory.
+    const std::string source_path = options.debug_info ? std::filesystem::absolute(input).string() : input;
+    const std::string profile_path = std::filesystem::absolute(output_base + ".kprof").string();
+
+    timer.begin("imports");
+    CompileOptions file_options = options;
+    try {
+        if (const std::vector<Token> imports = scanImports(contents); !imports.empty()) {
+            file_options.imports = buildImports(input, imports, options, result.diagnostics);
+        }
+    }
+    catch (const CompileError& error) {
+        result.diagnostics += std::string(error.what()) + "\n";
+        return finish(false);
+    }
+
+    std::optional<CompileCache> cache;
+    std::string key;
+    if (options.use_cache) {
+        timer.begin("cache");
+        cache.emplace(options.cache_dir, options.cache_max_bytes);
+        // Besides the source, the outputs depend on the paths they embed and
+        // on the profile they were laid out with.
+        std::string context;
+        if (options.debug_info) {
+            context += "source:" + source_path + '\n';
+        }
+        if (options.instrument) {
+            context += "profile:" + profile_path + '\n';
+        }
+        if (!options.profile_use.empty()) {
+            std::ifstream profile(options.profile_use, std::ios::binary);
+            context += "uses:" + std::string((std::istreambuf_iterator<char>(profile)), std::istreambuf_iterator<char>());
+        }
+        for (const ImportedModule& imported : file_options.imports) {
+            context += "import:";
+            for (const ExportedConstant& constant : imported.exports) {
+                context += constant.name + "=" + std::to_string(constant.value) + " ";
+            }
+            context += '\n';
+        }
+        key = CompileCache::key(contents, options, context);
+        if (cache->fetch(key, output_base, result.diagnostics)) {
+            result.cache_hit = true;
+            result.frontend_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            return finish(true);
+        }
+    }
+    timer.end();
+
+    std::string assembly;
+    try {
+        assembly = compile_source(
+            std::move(contents), file_options, result.diagnostics, report, source_path, profile_path);
+    }
+    catch (const CompileError& error) {
+        result.diagnostics += std::string(error.what()) + "\n";
+        return finish(false);
+    }
+    result.frontend_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!write_outputs(assembly, output_base, options, result.diagnostics, timer)) {
+        return finish(false);
+    }
+    if (cache.has_value()) {
+        timer.begin("cache");
+        cache->store(key, output_base, options, result.diagnostics);
+    }
+    return finish(true);
+}
+
+bool Compiler::write_outputs(const std::string& assembly, const std::string& output_base,
+    const CompileOptions& options, std::string& diagnostics, PhaseTimer& timer)
+{
+    const std::string asm_path = output_base + ".asm";
+    const std::string obj_path = output_base + ".o";
+    timer.begin("write");
+    std::ofstream output(asm_path);
+    output << assembly;
+    output.close();
+    if (!output) {
+        diagnostics += "Failed to write " + asm_path + "\n";
+        return false;
+    }
+    if (options.emit == CompileOptions::Emit::assembly) {
+        return true;
+    }
+    double tool_cpu_ms = 0;
+    timer.begin("nasm");
+    std::vector<std::string> nasm { "nasm", "-felf64", asm_path, "-o", obj_path };
+    if (options.debug_info) {
+        nasm.insert(nasm.end(), { "-g", "-F", "dwarf" });
+    }
+    const bool assembled = runTool(nasm, diagnostics, &tool_cpu_ms);
+    timer.end(tool_cpu_ms);
+    if (!assembled || options.emit == CompileOptions::Emit::object) {
+        return assembled;
+    }
+    timer.begin("ld");
+    // With line info, `-x` drops the jump labels from the symbol table so
+    // profilers attribute every sample to `_start` and its source line.
+    std::vector<std::string> ld { "ld", "-o", output_base, obj_path };
+    if (options.debug_info) {
+        ld.emplace_back("-x");
+    }
+    const bool linked = runTool(ld, diagnostics, &tool_cpu_ms);
+    timer.end(tool_cpu_ms);
+    return linked;
+}
+
+bool hasKeiExtension(const std::string& filename)
+{
+    return filename.ends_with(".kei");
+}
+
+std::string outputBaseFor(const std::string& input)
+{
+    return hasKeiExtension(input) ? input.substr(0, input.size() - 4) : input;
+}
+
+bool runTool(const std::vector<std::string>& argv, std::string& diagnostics, double* cpu_ms)
+{
+    std::vector<char*> args;
+    for (const std::string& arg : argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    // The tool gets default signal handling even when the caller blocks or
+    // ignores signals, as a server worker does.
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    pid_t pid;
+    const int error = posix_spawnp(&pid, args[0], nullptr, &attributes, args.data(), environ);
+    posix_spawnattr_destroy(&attributes);
+    if (error != 0) {
+        diagnostics += "Failed to run " + argv[0] + ": " + std::strerror(error) + "\n";
+        return false;
+    }
+    int status = 0;
+    rusage usage {};
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            diagnostics += "Failed to wait for " + argv[0] + ": " + std::strerror(errno) + "\n";
+            return false;
+        }
+    }
+    if (cpu_ms != nullptr) {
+        const auto ms = [](const timeval& time) {
+            return static_cast<double>(time.tv_sec) * 1e3 + static_cast<double>(time.tv_usec) / 1e3;
+        };
+        *cpu_ms = ms(usage.ru_utime) + ms(usage.ru_stime);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        diagnostics += argv[0] + " failed\n";
+        return false;
+    }
+    return true;
+}
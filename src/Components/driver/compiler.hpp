@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Components/diagnostics/timeReport.hpp"
+#include "Components/generator/superoptimizer.hpp"
+#include "Components/memory/memoryAllocator.hpp"
+#include "Components/optimizer/passManager.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct GeneratorOptions;
+struct ProgramNode;
+
+// A constant a module exports with `export let`.
+struct ExportedConstant {
+    std::string name;
+    uint64_t value;
+    bool operator==(const ExportedConstant&) const = default;
+};
+
+// What an `import` on `line` brings into scope.
+struct ImportedModule {
+    int line;
+    std::vector<ExportedConstant> exports;
+};
+
+struct CompileOptions {
+    enum class Emit {
+        executable,
+        object, // stop after the assembler (`-c`)
+        assembly, // stop after code generation (`-S`)
+    };
+    Emit emit = Emit::executable;
+    bool show_stats = false;
+    bool use_cache = false; // `--cache`: reuse outputs from `cache_dir`
+    std::string cache_dir {};
+    uint64_t cache_max_bytes = 0;
+    bool time_report = false; // fill `CompileResult::time_report`
+    bool debug_info = false; // `-g`: DWARF line info pointing at the .kei source
+    bool instrument = false; // `--instrument`: the executable appends branch counts to `<output>.kprof`
+    std::string profile_use {}; // `--profile-use=FILE`: lay branches out by an instrumented run's counts
+    bool hash_cons = false; // `--hash-cons`: share identical pure subexpressions in the AST
+    bool superopt = false; // `--superopt`: search for cheaper arithmetic, remembered in `cache_dir`
+    bool avx2 = false; // `-mavx2`: array arithmetic in AVX2 registers rather than SSE2 ones
+    OptLevel opt_level = OptLevel::O2; // `-O0`, `-O1`, `-O2`, `-Os`
+    std::optional<std::vector<std::string>> passes {}; // `--passes=a,b`: run these instead of the level's
+    std::string print_after {}; // `--print-after=PASS`: dump the program after that pass
+    size_t jobs = 0; // compilers building imported modules at once; 0: one per core
+    std::vector<ImportedModule> imports {}; // one per `import` of the input, filled by `compile_file`
+};
+
+struct CompileResult {
+    bool success = false;
+    std::string diagnostics; // errors and `--stats` lines, newline-terminated
+    size_t source_bytes = 0;
+    double frontend_seconds = 0; // lexing through code generation
+    double total_seconds = 0; // including the assembler and the linker
+    bool cache_hit = false; // outputs were copied from the cache
+    TimeReport time_report {};
+};
+
+// Runs the whole pipeline for one file at a time. The AST and every node the
+// passes create live in the compiler's arena, which is reset, not freed,
+// between files; a worker thread keeps one `Compiler` for all of its files,
+// and a server keeps its workers' compilers warm across requests.
+class Compiler {
+public:
+    // Compiles `input` into `output_base`.asm, `output_base`.o and the
+    // executable `output_base`, stopping early as `CompileOptions::emit` says.
+    CompileResult compile_file(const std::string& input, const std::string& output_base, const CompileOptions& options);
+    // Lexes, parses, optimizes and generates assembly; throws `CompileError`.
+    // Phases, token and node counts go to `report` when it is not null. With
+    // `options.debug_info`, line info names `source_path`; with
+    // `options.instrument`, the program appends its profile to `profile_path`.
+    std::string compile_source(std::string source, const CompileOptions& options, std::string& diagnostics,
+        TimeReport* report = nullptr, const std::string& source_path = {}, const std::string& profile_path = {});
+    // The same for a program parsed elsewhere from `source`, such as by watch
+    // mode. `parsed` is copied before the passes rewrite it and stays as is.
+    std::string compile_parsed(const ProgramNode& parsed, const std::string& source, const CompileOptions& options,
+        std::string& diagnostics, TimeReport* report = nullptr, const std::string& source_path = {},
+        const std::string& profile_path = {});
+    // Lexes and parses a module that another imports and evaluates its
+    // exports, with `imports` in scope; throws `CompileError`.
+    std::vector<ExportedConstant> compile_interface(std::string source, const std::vector<ImportedModule>& imports);
+    // Writes the assembly and runs the assembler and linker as `options.emit` asks.
+    static bool write_outputs(const std::string& assembly, const std::string& output_base,
+        const CompileOptions& options, std::string& diagnostics, PhaseTimer& timer);
+
+private:
+    static constexpr size_t defaultAllocatorSize = 1024 * 1024 * 4; // 4 MB default size
+
+    // Runs the passes over `prog` and generates its assembly.
+    std::string generate(ProgramNode& prog, GeneratorOptions generator_options, bool uses_profile,
+        const CompileOptions& options, std::string& diagnostics, PhaseTimer& timer, TimeReport* report);
+    // Reads the `--superopt` memo file of `cache_dir` unless it is the one read last.
+    void load_superopt_memo(const std::string& cache_dir, std::string& diagnostics);
+    // Writes what the searches added, merged with what other compilers wrote since.
+    void save_superopt_memo(std::string& diagnostics);
+    MemoryAllocator m_Allocator { defaultAllocatorSize };
+    // Kept across files, so each expression is searched once per compiler.
+    Superoptimizer m_superoptimizer {};
+    std::string m_superopt_memo {}; // the memo file `m_superoptimizer` holds
+};
+
+bool hasKeiExtension(const std::string& filename);
+// `dir/a.kei` -> `dir/a`, where a batch build puts that file's outputs.
+std::string outputBaseFor(const std::string& input);
+// Runs a tool such as the assembler without a shell, so paths need no quoting
+// and workers can call it concurrently. Returns false and appends to
+// `diagnostics` if it cannot be started or exits unsuccessfully. The tool's
+// CPU time goes to `cpu_ms` when it is not null.
+bool runTool(const std::vector<std::string>& argv, std::string& diagnostics, double* cpu_ms = nullptr);
@@ -0,0 +1,328 @@
+#include "moduleGraph.hpp"
+#include "compileCache.hpp"
+#include "threadPool.hpp"
+#include "Components/diagnostics/compileError.hpp"
+#include "Components/optimizer/astUtils.hpp"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr std::string_view interfaceMagic = "KEIFACE1\n";
+constexpr std::string_view interfaceExtension = ".kif";
+
+struct Module {
+    std::string path; // as imported, relative to the working directory or absolute
+    std::string source;
+    std::vector<Token> import_tokens;
+    std::vector<std::pair<size_t, int>> imports {}; // module and line of each `import`
+    std::vector<size_t> dependents {};
+    size_t waiting = 0; // imports not built yet
+    bool visiting = false; // on the path `discover` is following
+    bool failed = false;
+    std::vector<ExportedConstant> exports {};
+};
+
+struct Graph {
+    std::vector<Module> modules; // the input first
+    std::unordered_map<std::string, size_t> index {}; // by canonical path
+};
+
+// Adds the modules `graph.modules[i]` imports, and theirs. `path` holds the
+// modules from the input to `i`, to name a cycle.
+void discover(Graph& graph, const size_t i, std::vector<size_t>& path)
+{
+    path.push_back(i);
+    graph.modules[i].visiting = true;
+    const std::vector<Token> import_tokens = graph.modules[i].import_tokens;
+    for (const Token& import : import_tokens) {
+        const std::string& importer = graph.modules[i].path;
+        const fs::path resolved = (fs::path(importer).parent_path() / import.value.value()).lexically_normal();
+        std::error_code error;
+        const auto [it, inserted] = graph.index.try_emplace(fs::weakly_canonical(resolved, error).string(), graph.modules.size());
+        const size_t imported = it->second;
+        graph.modules[i].imports.emplace_back(imported, import.line);
+        if (!inserted) {
+            if (graph.modules[imported].visiting) {
+                std::string cycle;
+                for (auto step = std::find(path.begin(), path.end(), imported); step != path.end(); step++) {
+                    cycle += graph.modules[*step].path + " -> ";
+                }
+                throw CompileError("Import cycle: " + cycle + graph.modules[imported].path);
+            }
+            continue;
+        }
+        Module module { .path = resolved.string(), .source = {}, .import_tokens = {} };
+        if (!hasKeiExtension(module.path) || !readFile(module.path, module.source)) {
+            throw CompileError("Cannot open module " + module.path + ", imported on line " + std::to_string(import.line)
+                + " of " + importer);
+        }
+        try {
+            module.import_tokens = scanImports(module.source);
+        }
+        catch (const CompileError& scan_error) {
+            throw CompileError(module.path + ": " + scan_error.what());
+        }
+        graph.modules.push_back(std::move(module));
+        discover(graph, imported, path);
+    }
+    graph.modules[i].visiting = false;
+    path.pop_back();
+}
+
+std::optional<std::vector<ExportedConstant>> readInterface(const std::string& path, const std::string& key)
+{
+    std::string contents;
+    if (!readFile(path, contents) || !contents.starts_with(interfaceMagic)) {
+        return {};
+    }
+    std::istringstream lines(contents.substr(interfaceMagic.size()));
+    std::string recorded_key;
+    if (!std::getline(lines, recorded_key) || recorded_key != key) {
+        return {};
+    }
+    std::vector<ExportedConstant> exports;
+    ExportedConstant constant;
+    while (lines >> constant.name >> constant.value) {
+        exports.push_back(constant);
+    }
+    if (!lines.eof()) {
+        return {};
+    }
+    return exports;
+}
+
+bool writeInterface(const std::string& path, const std::string& key, const std::vector<ExportedConstant>& exports)
+{
+    std::string contents(interfaceMagic);
+    contents += key + "\n";
+    for (const ExportedConstant& constant : exports) {
+        contents += constant.name + " " + std::to_string(constant.value) + "\n";
+    }
+    return writeFileAtomic(path, contents, 0644);
+}
+
+// Reuses the interface recorded for `module` if its source and the
+// interfaces it imports are as they were then; otherwise compiles it and
+// records the new one. Returns whether it compiled.
+bool updateModule(Module& module, const std::vector<ImportedModule>& imports, Compiler& compiler)
+{
+    std::string context;
+    for (const ImportedModule& imported : imports) {
+        for (const ExportedConstant& constant : imported.exports) {
+            context += constant.name + "=" + std::to_string(constant.value) + " ";
+        }
+        context += "\n";
+    }
+    const std::string key = CompileCache::key(module.source, CompileOptions {}, context);
+    const std::string path = outputBaseFor(module.path) + std::string(interfaceExtension);
+    if (auto exports = readInterface(path, key)) {
+        module.exports = std::move(exports.value());
+        return false;
+    }
+    module.exports = compiler.compile_interface(module.source, imports);
+    if (!writeInterface(path, key, module.exports)) {
+        throw CompileError("Failed to write " + path);
+    }
+    return true;
+}
+
+uint64_t evaluate(const ExprNode* expr, const std::unordered_map<std::string, uint64_t>& constants,
+    const Token& name)
+{
+    const auto fail = [&](const std::string& reason) {
+        return CompileError(
+            "Exported constant " + name.value.value() + " on line " + std::to_string(name.line) + " " + reason);
+    };
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        const uint64_t left = evaluate(lhs, constants, name);
+        // The right operand of `&&` and `||` only counts when it would run.
+        if (isLogical(op) && (left != 0) == (op == BinaryOp::logical_or)) {
+            return left != 0 ? 1 : 0;
+        }
+        const std::optional<uint64_t> value = evalBinary(op, left, evaluate(rhs, constants, name));
+        if (!value.has_value()) {
+            throw fail("divides by zero");
+        }
+        return value.value();
+    }
+    if (const IdentifierNode* ident = identifierOf(expr)) {
+        const auto it = constants.find(ident->ident.value.value());
+        if (it == constants.end()) {
+            throw fail("uses " + ident->ident.value.value() + ", which is not a constant");
+        }
+        return it->second;
+    }
+    if (callOf(expr) != nullptr) {
+        throw fail("calls a function");
+    }
+    if (arrayLiteralOf(expr) != nullptr || indexOf(expr) != nullptr) {
+        throw fail("uses an array");
+    }
+    if (readOf(expr) != nullptr) {
+        throw fail("reads stdin");
+    }
+    if (const std::optional<uint64_t> value = intLiteralValue(expr)) {
+        return value.value();
+    }
+    throw fail("has an integer literal out of range");
+}
+}
+
+std::vector<Token> scanImports(const std::string& source)
+{
+    static constexpr std::array<TokenType, 3> statement { TokenType::import_, TokenType::string_lit, TokenType::semi };
+    std::vector<size_t> offsets;
+    size_t lexed = 0;
+    const std::vector<Token> tokens = LexicalAnalyzer(source).tokenizeFrom(0, 1, offsets,
+        [&](const Token& token, size_t) { return token.type != statement[lexed++ % statement.size()]; });
+    std::vector<Token> imports;
+    for (size_t i = 1; i + 1 < tokens.size(); i += statement.size()) {
+        imports.push_back(tokens[i]);
+    }
+    return imports;
+}
+
+std::vector<ImportedModule> buildImports(const std::string& input, const std::vector<Token>& imports,
+    const CompileOptions& options, std::string& diagnostics)
+{
+    Graph graph;
+    graph.modules.push_back({ .path = input, .source = {}, .import_tokens = imports });
+    std::error_code error;
+    graph.index.emplace(fs::weakly_canonical(input, error).string(), 0);
+    std::vector<size_t> path;
+    discover(graph, 0, path);
+    for (size_t i = 0; i < graph.modules.size(); i++) {
+        for (const auto& [imported, line] : graph.modules[i].imports) {
+            graph.modules[imported].dependents.push_back(i);
+        }
+        graph.modules[i].waiting = graph.modules[i].imports.size();
+    }
+
+    const size_t jobs = options.jobs != 0 ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    const size_t workers = std::min(jobs, graph.modules.size() - 1);
+    std::vector<std::unique_ptr<Compiler>> compilers(workers);
+    std::mutex mutex;
+    size_t compiled = 0;
+    std::string errors;
+    ThreadPool pool(workers);
+    std::function<void(size_t)> submit = [&](const size_t i) {
+        pool.submit([&, i](const size_t worker) {
+            Module& module = graph.modules[i];
+            std::vector<ImportedModule> scope;
+            bool failed = false;
+            for (const auto& [imported, line] : module.imports) {
+                failed = failed || graph.modules[imported].failed;
+                scope.push_back({ .line = line, .exports = graph.modules[imported].exports });
+            }
+            bool was_compiled = false;
+            std::string message;
+            if (!failed) {
+                if (compilers[worker] == nullptr) {
+                    compilers[worker] = std::make_unique<Compiler>();
+                }
+                try {
+                    was_compiled = updateModule(module, scope, *compilers[worker]);
+                }
+                catch (const CompileError& compile_error) {
+                    message = module.path + ": " + compile_error.what();
+                    failed = true;
+                }
+            }
+            std::vector<size_t> ready;
+            {
+                std::lock_guard lock(mutex);
+                module.failed = failed;
+                compiled += was_compiled ? 1 : 0;
+                if (!message.empty()) {
+                    errors += (errors.empty() ? "" : "\n") + message;
+                }
+                for (const size_t dependent : module.dependents) {
+                    if (--graph.modules[dependent].waiting == 0 && dependent != 0) {
+                        ready.push_back(dependent);
+                    }
+                }
+            }
+            for (const size_t dependent : ready) {
+                submit(dependent);
+            }
+        });
+    };
+    for (size_t i = 1; i < graph.modules.size(); i++) {
+        if (graph.modules[i].waiting == 0) {
+            submit(i);
+        }
+    }
+    pool.wait();
+    if (!errors.empty()) {
+        throw CompileError(errors);
+    }
+    if (options.show_stats) {
+        diagnostics += "modules: " + std::to_string(compiled) + " compiled, "
+            + std::to_string(graph.modules.size() - 1 - compiled) + " up to date\n";
+    }
+    std::vector<ImportedModule> scope;
+    for (const auto& [imported, line] : graph.modules.front().imports) {
+        scope.push_back({ .line = line, .exports = graph.modules[imported].exports });
+    }
+    return scope;
+}
+
+std::vector<ExportedConstant> evaluateExports(const ProgramNode& prog, const std::vector<ImportedModule>& imports)
+{
+    std::unordered_map<std::string, uint64_t> constants;
+    for (const ImportedModule& imported : imports) {
+        for (const ExportedConstant& constant : imported.exports) {
+            if (!constants.emplace(constant.name, constant.value).second) {
+                throw CompileError("Identifier already used: " + constant.name);
+            }
+        }
+    }
+    std::vector<ExportedConstant> exports;
+    std::unordered_set<std::string> exported;
+    for (const StmtNode* stmt : prog.statements) {
+        const auto* stmt_let = std::get_if<LetStatementNode*>(&stmt->statement);
+        if (stmt_let == nullptr || !(*stmt_let)->exported) {
+            continue;
+        }
+        const Token& name = (*stmt_let)->ident;
+        const uint64_t value = evaluate((*stmt_let)->expr, constants, name);
+        if (!constants.emplace(name.value.value(), value).second) {
+            throw CompileError("Identifier already used: " + name.value.value());
+        }
+        exports.push_back({ .name = name.value.value(), .value = value });
+        exported.insert(name.value.value());
+    }
+    // Importers were given the value the `let` starts with.
+    forEachStmt(prog.statements, [&](StmtNode* stmt) {
+        const auto* assign = std::get_if<AssignmentStatementNode*>(&stmt->statement);
+        if (assign != nullptr && exported.contains((*assign)->ident.value.value())) {
+            throw CompileError("Cannot assign to exported constant " + (*assign)->ident.value.value() + " on line "
+                + std::to_string((*assign)->ident.line));
+        }
+    });
+    return exports;
+}
+
+void declareImports(MemoryAllocator& allocator, ProgramNode& prog, const std::vector<ImportedModule>& imports)
+{
+    std::vector<StmtNode*> lets;
+    for (const ImportedModule& imported : imports) {
+        for (const ExportedConstant& constant : imported.exports) {
+            lets.push_back(allocator.construct<StmtNode>(allocator.construct<LetStatementNode>(
+                Token { TokenType::ident, imported.line, constant.name },
+                makeIntLiteral(allocator, constant.value, imported.line))));
+        }
+    }
+    prog.statements.insert(prog.statements.begin(), lets.begin(), lets.end());
+}
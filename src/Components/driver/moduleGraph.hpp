@@ -0,0 +1,34 @@
+#pragma once
+
+#include "compiler.hpp"
+#include "Components/syntax/syntaxAnalyzer.hpp"
+
+// Modules. A file starts with any number of `import "path";`, each naming
+// another `.kei` file relative to the importing one. A module that is
+// imported holds only its own imports and `export let`s; each export must be
+// a constant, built from literals, imported constants and earlier exports,
+// and importers see it as a `let` of its value.
+//
+// Before compiling a file, the driver follows its imports to the whole import
+// graph and brings each imported module up to date on a pool of compilers, a
+// module as soon as its own imports are done. A module's interface, its
+// exports, is kept next to it in `<module>.kif` with a key of its source and
+// of the interfaces it imported, so a module is only compiled again when
+// either changed: an edit that leaves a module's exports as they were does not
+// reach the modules that import it.
+
+// The path of each leading `import` of `source`; lexes no further.
+std::vector<Token> scanImports(const std::string& source);
+
+// Brings every module `input` imports, directly or not, up to date, then
+// returns what each of `imports`, the input's own, brings into scope. Throws
+// `CompileError` for a missing module, an import cycle or any module's error.
+std::vector<ImportedModule> buildImports(const std::string& input, const std::vector<Token>& imports,
+    const CompileOptions& options, std::string& diagnostics);
+
+// The exports of `prog`, with `imports` in scope. Throws `CompileError` when
+// one is not a constant or is assigned to, or a name is declared twice.
+std::vector<ExportedConstant> evaluateExports(const ProgramNode& prog, const std::vector<ImportedModule>& imports);
+
+// Declares each imported constant with a `let` at the top of `prog`.
+void declareImports(MemoryAllocator& allocator, ProgramNode& prog, const std::vector<ImportedModule>& imports);
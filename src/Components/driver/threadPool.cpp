@@ -0,0 +1,103 @@
+#include "threadPool.hpp"
+
+namespace {
+// The pool and worker index of the calling thread, if it is a pool worker.
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local size_t t_worker = 0;
+}
+
+ThreadPool::ThreadPool(size_t workers)
+{
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; i++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workers; i++) {
+        m_threads.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work_cv.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    const size_t queue = t_pool == this ? t_worker : m_next_queue++ % m_queues.size();
+    {
+        // Counted before it is pushed: once in a deque, the task can be stolen
+        // and finished at once, and `m_pending` must not reach 0 while the
+        // task submitting it still runs. Pushing under `m_mutex` keeps a woken
+        // worker from finding `m_queued` ahead of the deques.
+        std::lock_guard lock(m_mutex);
+        m_queued++;
+        m_pending++;
+        std::lock_guard queue_lock(m_queues[queue]->mutex);
+        m_queues[queue]->tasks.push_back(std::move(task));
+    }
+    m_work_cv.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock lock(m_mutex);
+    m_idle_cv.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::try_pop(const size_t worker, Task& task)
+{
+    {
+        Queue& own = *m_queues[worker];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < m_queues.size(); offset++) {
+        Queue& victim = *m_queues[(worker + offset) % m_queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(const size_t worker)
+{
+    t_pool = this;
+    t_worker = worker;
+    while (true) {
+        Task task;
+        if (try_pop(worker, task)) {
+            {
+                std::lock_guard lock(m_mutex);
+                m_queued--;
+            }
+            task(worker);
+            std::lock_guard lock(m_mutex);
+            if (--m_pending == 0) {
+                m_idle_cv.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock lock(m_mutex);
+        m_work_cv.wait(lock, [this] { return m_queued > 0 || m_stopping; });
+        if (m_stopping && m_queued == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it pops its own tasks
+// from the back (most recently pushed, still warm in cache) and, once that is
+// empty, steals from the front of the other workers' deques. Tasks submitted
+// from a worker go to that worker's deque; tasks submitted from outside are
+// spread round-robin. A task receives the index of the worker running it, so
+// callers can keep per-worker state such as an arena without locking.
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t worker)>;
+
+    explicit ThreadPool(size_t workers);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    [[nodiscard]] size_t size() const { return m_threads.size(); }
+    void submit(Task task);
+    // Blocks until every submitted task, including ones submitted by tasks, has run.
+    void wait();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues {};
+    std::vector<std::thread> m_threads {};
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_idle_cv;
+    size_t m_queued = 0; // tasks submitted and not yet taken from a deque
+    size_t m_pending = 0; // tasks submitted and not finished
+    bool m_stopping = false;
+    std::atomic<size_t> m_next_queue = 0;
+
+    bool try_pop(size_t worker, Task& task);
+    void worker_loop(size_t worker);
+};
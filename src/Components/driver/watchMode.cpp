@@ -0,0 +1,402 @@
+#include "watchMode.hpp"
+#include "moduleGraph.hpp"
+#include "Components/diagnostics/compileError.hpp"
+#include "Components/optimizer/astUtils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+// Editors often write a file in several steps; a build starts once it has
+// been quiet this long.
+constexpr int settleMs = 50;
+
+void shiftExprLines(ExprNode* expr, const int delta)
+{
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        shiftExprLines(lhs, delta);
+        shiftExprLines(rhs, delta);
+        return;
+    }
+    struct TermVisitor {
+        int delta;
+
+        void operator()(IntLiteralNode* lit) const { lit->intLit.line += delta; }
+        void operator()(IdentifierNode* ident) const { ident->ident.line += delta; }
+        void operator()(ParenthesizedExprNode* paren) const { shiftExprLines(paren->expr, delta); }
+        void operator()(CallNode* call) const
+        {
+            call->name.line += delta;
+            for (ExprNode* arg : call->args) {
+                shiftExprLines(arg, delta);
+            }
+        }
+        void operator()(ArrayLiteralNode* array) const
+        {
+            array->open.line += delta;
+            for (ExprNode* element : array->elements) {
+                shiftExprLines(element, delta);
+            }
+        }
+        void operator()(IndexNode* index) const
+        {
+            index->name.line += delta;
+            shiftExprLines(index->index, delta);
+        }
+        void operator()(ReadNode* read) const { read->read.line += delta; }
+    };
+    std::visit(TermVisitor { .delta = delta }, std::get<TermNode*>(expr->expression)->term);
+}
+
+// Moves every token of a kept item by `delta` lines. The watch arena is not
+// hash-consed, so no node is reached twice.
+void shiftLines(const std::variant<StmtNode*, FunctionNode*>& node, const int delta)
+{
+    std::vector<StmtNode*> stmts;
+    if (StmtNode* const* stmt = std::get_if<StmtNode*>(&node)) {
+        stmts.push_back(*stmt);
+    }
+    else {
+        FunctionNode* function = std::get<FunctionNode*>(node);
+        function->name.line += delta;
+        for (Token& param : function->params) {
+            param.line += delta;
+        }
+        stmts = function->body->statements;
+    }
+    forEachStmt(stmts, [&](StmtNode* stmt) {
+        if (auto* stmt_let = std::get_if<LetStatementNode*>(&stmt->statement)) {
+            (*stmt_let)->ident.line += delta;
+        }
+        else if (auto* stmt_assign = std::get_if<AssignmentStatementNode*>(&stmt->statement)) {
+            (*stmt_assign)->ident.line += delta;
+        }
+    });
+    rewriteExprs(stmts, [&](ExprNode* expr) {
+        shiftExprLines(expr, delta);
+        return expr;
+    });
+}
+
+// Replaces `items[first, last)` with `with`, moving the tail only once.
+template <typename T>
+void replaceRange(std::vector<T>& items, const size_t first, const size_t last, std::vector<T>&& with)
+{
+    const size_t common = std::min(last - first, with.size());
+    std::move(with.begin(), with.begin() + static_cast<ptrdiff_t>(common), items.begin() + static_cast<ptrdiff_t>(first));
+    const auto at = items.begin() + static_cast<ptrdiff_t>(first + common);
+    if (common < with.size()) {
+        items.insert(at, std::make_move_iterator(with.begin() + static_cast<ptrdiff_t>(common)),
+            std::make_move_iterator(with.end()));
+    }
+    else {
+        items.erase(at, items.begin() + static_cast<ptrdiff_t>(last));
+    }
+}
+
+bool sameToken(const Token& lhs, const Token& rhs)
+{
+    return lhs.type == rhs.type && lhs.line == rhs.line && lhs.value == rhs.value;
+}
+}
+
+IncrementalFrontend::Update IncrementalFrontend::parse_all(std::string source, PhaseTimer& timer)
+{
+    timer.begin("tokenize");
+    std::vector<size_t> offsets;
+    std::vector<Token> tokens
+        = LexicalAnalyzer(source).tokenizeFrom(0, 1, offsets, [](const Token&, size_t) { return false; });
+    timer.begin("parse");
+    auto allocator = std::make_unique<MemoryAllocator>(allocatorChunkSize);
+    SyntaxAnalyzer parser(std::span<const Token>(tokens), *allocator);
+    std::vector<Item> items;
+    while (!parser.atEnd()) {
+        const size_t first_token = parser.position();
+        const auto node = parser.parseTopLevel();
+        items.push_back({ first_token, parser.position(), node });
+    }
+    timer.end();
+    m_Allocator = std::move(allocator);
+    m_source = std::move(source);
+    m_tokens = std::move(tokens);
+    m_offsets = std::move(offsets);
+    m_items = std::move(items);
+    m_parsed_tokens = m_tokens.size();
+    m_valid = true;
+    return { .relexed_tokens = m_tokens.size(), .reparsed_items = m_items.size() };
+}
+
+IncrementalFrontend::Update IncrementalFrontend::update(std::string source, TimeReport* report)
+{
+    PhaseTimer timer(report);
+    // Items replaced by earlier edits stay in the arena; once they outweigh
+    // the live ones, a full parse starts a fresh arena.
+    if (!m_valid || m_parsed_tokens > 2 * m_tokens.size()) {
+        m_valid = false;
+        return parse_all(std::move(source), timer);
+    }
+    const std::string& old = m_source;
+    const size_t common = std::min(old.size(), source.size());
+    const size_t prefix = static_cast<size_t>(
+        std::mismatch(old.begin(), old.begin() + static_cast<ptrdiff_t>(common), source.begin()).first - old.begin());
+    if (prefix == old.size() && prefix == source.size()) {
+        return { .tokens_changed = false };
+    }
+    size_t suffix = 0;
+    while (suffix < common - prefix && old[old.size() - 1 - suffix] == source[source.size() - 1 - suffix]) {
+        suffix++;
+    }
+    // Until this update succeeds, the tokens and items are out of step.
+    m_valid = false;
+
+    timer.begin("relex");
+    const size_t first_changed = static_cast<size_t>(
+        std::lower_bound(m_offsets.begin(), m_offsets.end(), prefix) - m_offsets.begin());
+    const size_t restart = first_changed == 0 ? 0 : first_changed - 1;
+    const size_t begin = first_changed == 0 ? 0 : m_offsets[restart];
+    const int line = first_changed == 0 ? 1 : m_tokens[restart].line;
+    const size_t changed_end = source.size() - suffix;
+    const ptrdiff_t byte_delta = static_cast<ptrdiff_t>(source.size()) - static_cast<ptrdiff_t>(old.size());
+    size_t resync = m_tokens.size(); // first old token kept after the edit
+    int line_delta = 0;
+    size_t search = restart;
+    std::vector<size_t> offsets;
+    std::vector<Token> tokens = LexicalAnalyzer(source).tokenizeFrom(
+        begin, line, offsets, [&](const Token& token, const size_t offset) {
+            if (offset < changed_end) {
+                return false;
+            }
+            const size_t old_offset = static_cast<size_t>(static_cast<ptrdiff_t>(offset) - byte_delta);
+            search = static_cast<size_t>(
+                std::lower_bound(m_offsets.begin() + static_cast<ptrdiff_t>(search), m_offsets.end(), old_offset)
+                - m_offsets.begin());
+            if (search == m_offsets.size() || m_offsets[search] != old_offset) {
+                return false;
+            }
+            resync = search;
+            line_delta = token.line - m_tokens[search].line;
+            return true;
+        });
+    for (size_t i = resync; i < m_tokens.size(); i++) {
+        m_tokens[i].line += line_delta;
+        m_offsets[i] = static_cast<size_t>(static_cast<ptrdiff_t>(m_offsets[i]) + byte_delta);
+    }
+    const size_t removed = resync - restart;
+    const size_t added = tokens.size();
+    if (line_delta == 0 && added == removed
+        && std::equal(tokens.begin(), tokens.end(), m_tokens.begin() + static_cast<ptrdiff_t>(restart), sameToken)) {
+        std::copy(offsets.begin(), offsets.end(), m_offsets.begin() + static_cast<ptrdiff_t>(restart));
+        m_source = std::move(source);
+        m_valid = true;
+        timer.end();
+        return { .relexed_tokens = added, .tokens_changed = false };
+    }
+    replaceRange(m_tokens, restart, resync, std::move(tokens));
+    replaceRange(m_offsets, restart, resync, std::move(offsets));
+
+    timer.begin("reparse");
+    // The first item that ends at or after the restart point either holds a
+    // changed token or looked ahead at one.
+    const auto first_item = std::lower_bound(m_items.begin(), m_items.end(), restart,
+        [](const Item& item, const size_t token) { return item.end_token < token; });
+    const size_t replaced_begin = static_cast<size_t>(first_item - m_items.begin());
+    const size_t start = first_item != m_items.end() ? first_item->first_token : 0;
+    const ptrdiff_t token_delta = static_cast<ptrdiff_t>(added) - static_cast<ptrdiff_t>(removed);
+    SyntaxAnalyzer parser(std::span<const Token>(m_tokens), *m_Allocator);
+    parser.seek(start);
+    std::vector<Item> items;
+    size_t replaced_end = replaced_begin;
+    while (true) {
+        if (parser.atEnd()) {
+            replaced_end = m_items.size();
+            break;
+        }
+        const size_t first_token = parser.position();
+        if (first_token >= restart + added) {
+            // Past the new tokens: stop where an old item started.
+            const size_t old_first = static_cast<size_t>(static_cast<ptrdiff_t>(first_token) - token_delta);
+            while (replaced_end < m_items.size() && m_items[replaced_end].first_token < old_first) {
+                replaced_end++;
+            }
+            if (replaced_end < m_items.size() && m_items[replaced_end].first_token == old_first) {
+                break;
+            }
+        }
+        const auto node = parser.parseTopLevel();
+        items.push_back({ first_token, parser.position(), node });
+    }
+    m_parsed_tokens += parser.position() - start;
+    for (size_t i = replaced_end; i < m_items.size(); i++) {
+        Item& item = m_items[i];
+        item.first_token = static_cast<size_t>(static_cast<ptrdiff_t>(item.first_token) + token_delta);
+        item.end_token = static_cast<size_t>(static_cast<ptrdiff_t>(item.end_token) + token_delta);
+        if (line_delta != 0) {
+            shiftLines(item.node, line_delta);
+        }
+    }
+    const size_t reparsed = items.size();
+    replaceRange(m_items, replaced_begin, replaced_end, std::move(items));
+    timer.end();
+    m_source = std::move(source);
+    m_valid = true;
+    return { .relexed_tokens = added, .reparsed_items = reparsed };
+}
+
+ProgramNode IncrementalFrontend::program() const
+{
+    ProgramNode prog;
+    for (const Item& item : m_items) {
+        if (StmtNode* const* stmt = std::get_if<StmtNode*>(&item.node)) {
+            prog.statements.push_back(*stmt);
+        }
+        else {
+            prog.functions.push_back(std::get<FunctionNode*>(item.node));
+        }
+    }
+    return prog;
+}
+
+namespace {
+// Blocks until `name` in the watched directory is written, then until the
+// writes have settled. False if the watch itself fails.
+bool waitForChange(const int fd, const std::string& name)
+{
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    while (true) {
+        pollfd watch { .fd = fd, .events = POLLIN, .revents = 0 };
+        const int ready = poll(&watch, 1, changed ? settleMs : -1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0) {
+            return false;
+        }
+        if (ready == 0) {
+            return true;
+        }
+        const ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        for (ssize_t at = 0; at < count;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + at);
+            if ((event->mask & IN_IGNORED) != 0) {
+                return false;
+            }
+            if (event->len > 0 && name == event->name) {
+                changed = true;
+            }
+            at += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        }
+    }
+}
+
+// Rebuilds `input` and prints what happened; returns whether it succeeded.
+bool rebuild(Compiler& compiler, IncrementalFrontend& frontend, const CommandLine& command,
+    const std::string& input, const bool up_to_date)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    const CompileOptions& options = command.options;
+    const std::string output_base = outputBaseFor(command, input);
+    const std::string source_path = options.debug_info ? std::filesystem::absolute(input).string() : input;
+    const std::string profile_path = std::filesystem::absolute(output_base + ".kprof").string();
+    TimeReport time_report;
+    TimeReport* report = command.print_time_report ? &time_report : nullptr;
+    std::string diagnostics;
+    std::ostringstream summary;
+    bool success = false;
+
+    std::ifstream file(input);
+    if (!file) {
+        std::cerr << "Failed to open input file." << std::endl;
+        return false;
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    try {
+        if (!scanImports(contents).empty()) {
+            throw CompileError("--watch does not follow imports; build " + input + " without it");
+        }
+        const IncrementalFrontend::Update update = frontend.update(std::move(contents), report);
+        summary << "relexed " << update.relexed_tokens << " of " << frontend.token_count() << " tokens, reparsed "
+                << update.reparsed_items << " of " << frontend.item_count() << " top-level items";
+        // An instrumented program or a profile identifies its source by the
+        // text, comments included.
+        if (!update.tokens_changed && up_to_date && !options.instrument && options.profile_use.empty()) {
+            summary << ", output unchanged";
+            success = true;
+        }
+        else {
+            const std::string assembly = compiler.compile_parsed(
+                frontend.program(), frontend.source(), options, diagnostics, report, source_path, profile_path);
+            PhaseTimer timer(report);
+            success = Compiler::write_outputs(assembly, output_base, options, diagnostics, timer);
+        }
+        if (report != nullptr) {
+            report->tokens = frontend.token_count();
+            report->ast_nodes = frontend.node_count();
+        }
+    }
+    catch (const CompileError& error) {
+        diagnostics += std::string(error.what()) + "\n";
+    }
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cerr << diagnostics;
+    if (report != nullptr) {
+        printTimeReport(std::cerr, input, time_report);
+    }
+    std::cerr << input << ": " << (success ? "built" : "failed") << " in " << std::fixed << std::setprecision(2)
+              << ms << " ms";
+    if (!summary.str().empty()) {
+        std::cerr << " (" << summary.str() << ")";
+    }
+    std::cerr << std::endl;
+    return success;
+}
+}
+
+int runWatch(const CommandLine& command)
+{
+    const std::string& input = command.inputs.front();
+    if (!hasKeiExtension(input)) {
+        std::cerr << "The input file must have a '.kei' extension." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::filesystem::path path(input);
+    const std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+    const std::string name = path.filename().string();
+    // The directory, not the file: editors that save by renaming a new file
+    // over the old one would end a watch on the file itself.
+    const int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "Failed to watch " << directory << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+    std::cerr << "watching " << input << std::endl;
+    Compiler compiler;
+    IncrementalFrontend frontend;
+    bool built = rebuild(compiler, frontend, command, input, false);
+    while (waitForChange(fd, name)) {
+        built = rebuild(compiler, frontend, command, input, built);
+    }
+    std::cerr << "Stopped watching " << directory << std::endl;
+    close(fd);
+    return EXIT_FAILURE;
+}
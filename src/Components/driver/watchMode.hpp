@@ -0,0 +1,67 @@
+#pragma once
+
+#include "commandLine.hpp"
+#include "Components/syntax/syntaxAnalyzer.hpp"
+#include <memory>
+
+// Keeps the tokens and the parsed top-level items (functions and statements)
+// of one source between builds, and brings them up to date with a new version
+// of the source by redoing only the part an edit touched.
+//
+// The lexer restarts at the last token before the first changed byte, which
+// is a point where it carries no state but the line, and stops as soon as it
+// produces a token past the last changed byte that starts where an old token
+// did: the text from there on is unchanged, so so are its tokens, up to a
+// shift in offsets and lines. The parser then restarts at the first item
+// whose tokens, or the token it looked ahead at, changed, and stops at the
+// first item boundary past the new tokens that was an item boundary before.
+// Items after the edit are kept, with their lines moved if the edit added or
+// removed lines.
+class IncrementalFrontend {
+public:
+    struct Update {
+        size_t relexed_tokens = 0;
+        size_t reparsed_items = 0;
+        // False when the edit only touched whitespace and comments within
+        // lines, so the tokens and the program are as before.
+        bool tokens_changed = true;
+    };
+
+    // Throws `CompileError` for a lexing or parsing error, after which the
+    // next update starts from scratch.
+    Update update(std::string source, TimeReport* report = nullptr);
+    // The program as parsed from the last successful update.
+    [[nodiscard]] ProgramNode program() const;
+    [[nodiscard]] const std::string& source() const { return m_source; }
+    [[nodiscard]] size_t token_count() const { return m_tokens.size(); }
+    [[nodiscard]] size_t item_count() const { return m_items.size(); }
+    // Nodes in the arena, those of items replaced since the last full parse included.
+    [[nodiscard]] size_t node_count() const { return m_Allocator != nullptr ? m_Allocator->allocations() : 0; }
+
+private:
+    struct Item {
+        size_t first_token;
+        size_t end_token; // one past the last token
+        std::variant<StmtNode*, FunctionNode*> node;
+    };
+
+    static constexpr size_t allocatorChunkSize = 1024 * 1024 * 4;
+
+    std::unique_ptr<MemoryAllocator> m_Allocator {};
+    std::string m_source {};
+    std::vector<Token> m_tokens {};
+    std::vector<size_t> m_offsets {}; // start of each token in `m_source`
+    std::vector<Item> m_items {};
+    bool m_valid = false;
+    // Tokens parsed into the arena since it was last reset; items they
+    // replaced stay in it until a full parse starts a new one.
+    size_t m_parsed_tokens = 0;
+
+    Update parse_all(std::string source, PhaseTimer& timer);
+};
+
+// `kei_lang --watch file.kei`: builds the file, then rebuilds it every time it
+// is written, until interrupted. Lexing and parsing are incremental; the
+// passes and the code generator run over the whole program, since they work
+// across statements.
+int runWatch(const CommandLine& command);
@@ -0,0 +1,981 @@
+#pragma once
+
+#include "Components/lexing/lexicalAnalyzer.hpp"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+// Kei compiled by the C++ compiler: `kei::compile_constexpr<"...">()` lexes,
+// parses and resolves a snippet in a constant expression, so a Kei syntax
+// error is a C++ compile error. A snippet with top-level statements folds to
+// the value it exits with; one made only of functions becomes a callable for
+// the last of them, specialized per AST node into ordinary C++ code.
+//
+// The subset is the runtime language without modules, arrays, strings, print
+// and read, in containers of fixed capacity.
+namespace kei
+{
+
+inline constexpr size_t maxSnippetExprs = 512;
+inline constexpr size_t maxSnippetStmts = 256;
+inline constexpr size_t maxSnippetFunctions = 16;
+// Variables of one function, its parameters included.
+inline constexpr size_t maxSnippetSlots = 32;
+inline constexpr size_t maxSnippetParams = 6;
+
+template <typename T, size_t Capacity>
+class FixedVector
+{
+public:
+    // False, leaving the vector as it was, when it is full.
+    constexpr bool push_back(const T &value)
+    {
+        if (m_size == Capacity)
+        {
+            return false;
+        }
+        m_items[m_size++] = value;
+        return true;
+    }
+    constexpr void resize(size_t size) { m_size = size; }
+    [[nodiscard]] constexpr size_t size() const { return m_size; }
+    constexpr T &operator[](size_t i) { return m_items[i]; }
+    constexpr const T &operator[](size_t i) const { return m_items[i]; }
+    constexpr T *begin() { return m_items.data(); }
+    constexpr T *end() { return m_items.data() + m_size; }
+    constexpr const T *begin() const { return m_items.data(); }
+    constexpr const T *end() const { return m_items.data() + m_size; }
+
+private:
+    std::array<T, Capacity> m_items{};
+    size_t m_size = 0;
+};
+
+enum class SyntaxError : uint8_t
+{
+    none,
+    invalid_token,
+    integer_out_of_range,
+    expected_expression,
+    expected_identifier,
+    expected_statement,
+    expected_semi,
+    expected_open_paren,
+    expected_close_paren,
+    expected_open_curly,
+    expected_close_curly,
+    expected_eq,
+    undeclared_identifier,
+    identifier_already_used,
+    undeclared_function,
+    function_already_defined,
+    wrong_argument_count,
+    return_outside_function,
+    // Modules, arrays, strings, print and read.
+    unsupported,
+    // A capacity above was exceeded.
+    too_large,
+};
+
+struct SnippetToken
+{
+    TokenType type;
+    std::string_view text;
+    int line;
+    // Offset just past the token.
+    size_t end;
+    // False at the end of the source and at a character no token starts with.
+    bool valid;
+};
+
+struct SnippetExpr
+{
+    enum class Kind : uint8_t
+    {
+        literal,
+        variable,
+        binary,
+        call,
+    };
+    Kind kind = Kind::literal;
+    // Binary operator; `!x` is parsed as `x == 0`, as the runtime parser does.
+    TokenType op = TokenType::plus;
+    uint64_t value = 0;
+    uint16_t slot = 0;
+    uint16_t lhs = 0;
+    uint16_t rhs = 0;
+    // Calls: the callee, resolved once every function is known, and the
+    // arguments in `SnippetProgram::args[first_arg, first_arg + arg_count)`.
+    std::string_view name;
+    uint16_t function = 0;
+    uint16_t first_arg = 0;
+    uint16_t arg_count = 0;
+    int line = 0;
+};
+
+struct SnippetStmt
+{
+    enum class Kind : uint8_t
+    {
+        let,
+        assign,
+        exit,
+        return_,
+        if_,
+        while_,
+        scope,
+    };
+    Kind kind = Kind::scope;
+    uint16_t slot = 0;
+    // Value or condition.
+    uint16_t expr = 0;
+    // Body in `SnippetProgram::lists[first, first + count)`; an `if` keeps its
+    // else branch the same way, with an `elif` as the only `if` in it.
+    uint16_t first = 0;
+    uint16_t count = 0;
+    uint16_t else_first = 0;
+    uint16_t else_count = 0;
+};
+
+struct SnippetFunction
+{
+    std::string_view name;
+    uint16_t params = 0;
+    uint16_t first = 0;
+    uint16_t count = 0;
+};
+
+struct SnippetProgram
+{
+    FixedVector<SnippetExpr, maxSnippetExprs> exprs;
+    FixedVector<uint16_t, maxSnippetExprs> args;
+    FixedVector<SnippetStmt, maxSnippetStmts> stmts;
+    FixedVector<uint16_t, maxSnippetStmts> lists;
+    FixedVector<SnippetFunction, maxSnippetFunctions> functions;
+    // The top-level statements.
+    SnippetFunction main;
+    SyntaxError error = SyntaxError::none;
+    int error_line = 0;
+};
+
+constexpr bool isSnippetSpace(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+constexpr bool isSnippetDigit(const char c) { return c >= '0' && c <= '9'; }
+
+// Identifiers as the runtime lexer takes them, except that any non-ASCII byte
+// counts as a letter: XID classes are not checked here.
+constexpr bool isSnippetIdentifier(const char c, const bool first)
+{
+    const auto uc = static_cast<unsigned char>(c);
+    return (uc >= 'a' && uc <= 'z') || (uc >= 'A' && uc <= 'Z') || uc >= 0x80 || (!first && isSnippetDigit(c));
+}
+
+// The token at or after byte `pos`, which is on `line`.
+constexpr SnippetToken lexSnippet(const std::string_view source, size_t pos, int line)
+{
+    const size_t size = source.size();
+    while (pos < size)
+    {
+        const char c = source[pos];
+        if (c == '\n')
+        {
+            line++;
+            pos++;
+        }
+        else if (isSnippetSpace(c))
+        {
+            pos++;
+        }
+        else if (c == '/' && pos + 1 < size && source[pos + 1] == '/')
+        {
+            while (pos < size && source[pos] != '\n')
+            {
+                pos++;
+            }
+        }
+        else if (c == '/' && pos + 1 < size && source[pos + 1] == '*')
+        {
+            pos += 2;
+            while (pos < size && !(source[pos] == '*' && pos + 1 < size && source[pos + 1] == '/'))
+            {
+                line += source[pos] == '\n';
+                pos++;
+            }
+            pos = std::min(pos + 2, size);
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (pos == size)
+    {
+        return {TokenType::semi, {}, line, pos, false};
+    }
+    const char c = source[pos];
+    size_t end = pos + 1;
+    if (isSnippetIdentifier(c, true) || isSnippetDigit(c))
+    {
+        const bool number = isSnippetDigit(c);
+        while (end < size && (number ? isSnippetDigit(source[end]) : isSnippetIdentifier(source[end], false)))
+        {
+            end++;
+        }
+        const std::string_view text = source.substr(pos, end - pos);
+        if (number)
+        {
+            return {TokenType::int_lit, text, line, end, true};
+        }
+        for (const auto &[keyword, type] : keywordTokens)
+        {
+            if (keyword == text)
+            {
+                return {type, text, line, end, true};
+            }
+        }
+        return {TokenType::ident, text, line, end, true};
+    }
+    if (c == '"')
+    {
+        while (end < size && source[end] != '"' && source[end] != '\n')
+        {
+            end++;
+        }
+        return {TokenType::string_lit, source.substr(pos, end - pos), line, std::min(end + 1, size), true};
+    }
+    if (c == '/')
+    {
+        return {TokenType::fslash, source.substr(pos, 1), line, end, true};
+    }
+    // The tables hold disengaged entries, which constant evaluation may only
+    // test through a reference, not copy.
+    const auto uc = static_cast<unsigned char>(c);
+    if (end < size && (source[end] == '=' || source[end] == c))
+    {
+        if (const auto &type = (source[end] == '=' ? equalsTokens : doubledTokens)[uc]; type.has_value())
+        {
+            return {*type, source.substr(pos, 2), line, end + 1, true};
+        }
+    }
+    if (const auto &type = specialTokens[uc]; type.has_value())
+    {
+        return {*type, source.substr(pos, 1), line, end, true};
+    }
+    return {TokenType::semi, source.substr(pos, 1), line, end, false};
+}
+
+// Parses a whole snippet; the first error stops it and is kept in the result.
+class SnippetParser
+{
+public:
+    constexpr explicit SnippetParser(const std::string_view source)
+        : m_source(source)
+    {
+    }
+
+    constexpr SnippetProgram parse()
+    {
+        const auto [first, count] = parseBlock(true);
+        m_program.main = {{}, 0, first, count};
+        resolveCalls();
+        return m_program;
+    }
+
+private:
+    struct Name
+    {
+        std::string_view name;
+        uint16_t slot;
+    };
+
+    std::string_view m_source;
+    size_t m_pos = 0;
+    int m_line = 1;
+    SnippetProgram m_program{};
+    // Variables visible in the function being parsed, innermost last.
+    FixedVector<Name, maxSnippetSlots> m_names{};
+    uint16_t m_slots = 0;
+    bool m_in_function = false;
+
+    [[nodiscard]] constexpr SnippetToken peek(int ahead = 0) const
+    {
+        SnippetToken token = lexSnippet(m_source, m_pos, m_line);
+        for (; ahead > 0; ahead--)
+        {
+            token = lexSnippet(m_source, token.end, token.line);
+        }
+        return token;
+    }
+    constexpr SnippetToken consume()
+    {
+        const SnippetToken token = peek();
+        m_pos = token.end;
+        m_line = token.line;
+        return token;
+    }
+    [[nodiscard]] constexpr bool failed() const { return m_program.error != SyntaxError::none; }
+    constexpr void fail(const SyntaxError error, const int line)
+    {
+        if (!failed())
+        {
+            m_program.error = error;
+            m_program.error_line = line;
+        }
+    }
+    [[nodiscard]] constexpr bool next(const TokenType type) const
+    {
+        const SnippetToken token = peek();
+        return token.valid && token.type == type;
+    }
+    constexpr SnippetToken expect(const TokenType type, const SyntaxError error)
+    {
+        if (const SnippetToken token = peek(); !token.valid || token.type != type)
+        {
+            fail(token.valid || token.text.empty() ? error : SyntaxError::invalid_token, token.line);
+            return token;
+        }
+        return consume();
+    }
+
+    template <typename T, size_t Capacity>
+    constexpr uint16_t add(FixedVector<T, Capacity> &items, const T &item)
+    {
+        if (!items.push_back(item))
+        {
+            fail(SyntaxError::too_large, m_line);
+            return 0;
+        }
+        return static_cast<uint16_t>(items.size() - 1);
+    }
+
+    constexpr uint16_t addBinary(const TokenType op, const uint16_t lhs, const uint16_t rhs)
+    {
+        SnippetExpr expr;
+        expr.kind = SnippetExpr::Kind::binary;
+        expr.op = op;
+        expr.lhs = lhs;
+        expr.rhs = rhs;
+        return add(m_program.exprs, expr);
+    }
+
+    // The slot of the visible variable `name`, or -1.
+    [[nodiscard]] constexpr int lookup(const std::string_view name) const
+    {
+        for (size_t i = m_names.size(); i > 0; i--)
+        {
+            if (m_names[i - 1].name == name)
+            {
+                return m_names[i - 1].slot;
+            }
+        }
+        return -1;
+    }
+
+    // Makes `name` visible in the current scope and returns its slot.
+    constexpr uint16_t declare(const SnippetToken &name)
+    {
+        if (lookup(name.text) >= 0)
+        {
+            fail(SyntaxError::identifier_already_used, name.line);
+        }
+        if (m_slots == maxSnippetSlots || !m_names.push_back({name.text, m_slots}))
+        {
+            fail(SyntaxError::too_large, name.line);
+            return 0;
+        }
+        return m_slots++;
+    }
+
+    constexpr uint16_t parseTerm()
+    {
+        const SnippetToken token = consume();
+        SnippetExpr expr;
+        if (!token.valid)
+        {
+            fail(token.text.empty() ? SyntaxError::expected_expression : SyntaxError::invalid_token, token.line);
+            return 0;
+        }
+        switch (token.type)
+        {
+        case TokenType::int_lit:
+            for (const char digit : token.text)
+            {
+                const auto value = static_cast<uint64_t>(digit - '0');
+                if (expr.value > (UINT64_MAX - value) / 10)
+                {
+                    fail(SyntaxError::integer_out_of_range, token.line);
+                    return 0;
+                }
+                expr.value = expr.value * 10 + value;
+            }
+            return add(m_program.exprs, expr);
+        case TokenType::bang:
+        {
+            const uint16_t operand = parseTerm();
+            return addBinary(TokenType::eq_eq, operand, add(m_program.exprs, expr));
+        }
+        case TokenType::open_paren:
+        {
+            const uint16_t inner = parseExpr(0);
+            expect(TokenType::close_pared, SyntaxError::expected_close_paren);
+            return inner;
+        }
+        case TokenType::ident:
+            if (next(TokenType::open_paren))
+            {
+                return parseCall(token);
+            }
+            if (next(TokenType::open_square))
+            {
+                fail(SyntaxError::unsupported, token.line);
+                return 0;
+            }
+            if (const int slot = lookup(token.text); slot >= 0)
+            {
+                expr.kind = SnippetExpr::Kind::variable;
+                expr.slot = static_cast<uint16_t>(slot);
+                return add(m_program.exprs, expr);
+            }
+            fail(SyntaxError::undeclared_identifier, token.line);
+            return 0;
+        case TokenType::read:
+        case TokenType::string_lit:
+        case TokenType::open_square:
+            fail(SyntaxError::unsupported, token.line);
+            return 0;
+        default:
+            fail(SyntaxError::expected_expression, token.line);
+            return 0;
+        }
+    }
+
+    constexpr uint16_t parseCall(const SnippetToken &name)
+    {
+        consume();
+        FixedVector<uint16_t, maxSnippetParams> args;
+        while (!failed() && !next(TokenType::close_pared))
+        {
+            if (args.size() != 0)
+            {
+                expect(TokenType::comma, SyntaxError::expected_close_paren);
+            }
+            if (!args.push_back(parseExpr(0)))
+            {
+                fail(SyntaxError::wrong_argument_count, name.line);
+            }
+        }
+        expect(TokenType::close_pared, SyntaxError::expected_close_paren);
+        SnippetExpr expr;
+        expr.kind = SnippetExpr::Kind::call;
+        expr.name = name.text;
+        expr.line = name.line;
+        expr.first_arg = static_cast<uint16_t>(m_program.args.size());
+        expr.arg_count = static_cast<uint16_t>(args.size());
+        for (const uint16_t arg : args)
+        {
+            add(m_program.args, arg);
+        }
+        return add(m_program.exprs, expr);
+    }
+
+    // Precedence climbing over `binaryPrecedence`, left-associative like the
+    // runtime parser.
+    constexpr uint16_t parseExpr(const int min_prec)
+    {
+        uint16_t lhs = parseTerm();
+        while (!failed())
+        {
+            const SnippetToken op = peek();
+            int prec = 0;
+            if (!op.valid || !binaryPrecedence(op.type, prec) || prec < min_prec)
+            {
+                break;
+            }
+            consume();
+            const uint16_t rhs = parseExpr(prec + 1);
+            lhs = addBinary(op.type, lhs, rhs);
+        }
+        return lhs;
+    }
+
+    // `(expr)` after `if`, `elif`, `while` and `exit`.
+    constexpr uint16_t parseParenthesized()
+    {
+        expect(TokenType::open_paren, SyntaxError::expected_open_paren);
+        const uint16_t expr = parseExpr(0);
+        expect(TokenType::close_pared, SyntaxError::expected_close_paren);
+        return expr;
+    }
+
+    // `{ ... }`, returning the range of its statements in `lists`.
+    constexpr std::pair<uint16_t, uint16_t> parseScope()
+    {
+        expect(TokenType::open_curly, SyntaxError::expected_open_curly);
+        const auto body = parseBlock(false);
+        expect(TokenType::close_curly, SyntaxError::expected_close_curly);
+        return body;
+    }
+
+    // Statements up to `}`, or to the end of the source at the top level,
+    // where functions may be defined too.
+    constexpr std::pair<uint16_t, uint16_t> parseBlock(const bool top_level)
+    {
+        FixedVector<uint16_t, maxSnippetStmts> stmts;
+        const size_t names = m_names.size();
+        while (!failed())
+        {
+            const SnippetToken token = peek();
+            if (!token.valid && token.text.empty())
+            {
+                if (!top_level)
+                {
+                    fail(SyntaxError::expected_close_curly, token.line);
+                }
+                break;
+            }
+            if (!top_level && token.valid && token.type == TokenType::close_curly)
+            {
+                break;
+            }
+            if (top_level && token.valid && token.type == TokenType::fn)
+            {
+                parseFunction();
+                continue;
+            }
+            if (!stmts.push_back(parseStmt()))
+            {
+                fail(SyntaxError::too_large, token.line);
+            }
+        }
+        m_names.resize(names);
+        const auto first = static_cast<uint16_t>(m_program.lists.size());
+        for (const uint16_t stmt : stmts)
+        {
+            add(m_program.lists, stmt);
+        }
+        return {first, static_cast<uint16_t>(stmts.size())};
+    }
+
+    // After `if` or `elif`.
+    constexpr SnippetStmt parseIf()
+    {
+        SnippetStmt stmt;
+        stmt.kind = SnippetStmt::Kind::if_;
+        stmt.expr = parseParenthesized();
+        std::tie(stmt.first, stmt.count) = parseScope();
+        if (next(TokenType::elif))
+        {
+            const int line = consume().line;
+            const uint16_t elif = add(m_program.stmts, parseIf());
+            stmt.else_first = static_cast<uint16_t>(m_program.lists.size());
+            stmt.else_count = 1;
+            if (!m_program.lists.push_back(elif))
+            {
+                fail(SyntaxError::too_large, line);
+            }
+        }
+        else if (next(TokenType::else_))
+        {
+            consume();
+            std::tie(stmt.else_first, stmt.else_count) = parseScope();
+        }
+        return stmt;
+    }
+
+    constexpr uint16_t parseStmt()
+    {
+        const SnippetToken token = consume();
+        SnippetStmt stmt;
+        if (!token.valid)
+        {
+            fail(SyntaxError::invalid_token, token.line);
+            return 0;
+        }
+        switch (token.type)
+        {
+        case TokenType::exit:
+            stmt.kind = SnippetStmt::Kind::exit;
+            stmt.expr = parseParenthesized();
+            break;
+        case TokenType::return_:
+            if (!m_in_function)
+            {
+                fail(SyntaxError::return_outside_function, token.line);
+            }
+            stmt.kind = SnippetStmt::Kind::return_;
+            stmt.expr = parseExpr(0);
+            break;
+        case TokenType::let:
+        {
+            const SnippetToken name = expect(TokenType::ident, SyntaxError::expected_identifier);
+            expect(TokenType::eq, SyntaxError::expected_eq);
+            stmt.kind = SnippetStmt::Kind::let;
+            stmt.expr = parseExpr(0);
+            stmt.slot = declare(name);
+            break;
+        }
+        case TokenType::ident:
+        {
+            const int slot = lookup(token.text);
+            if (slot < 0)
+            {
+                fail(next(TokenType::open_square) ? SyntaxError::unsupported : SyntaxError::undeclared_identifier,
+                     token.line);
+                return 0;
+            }
+            expect(TokenType::eq, SyntaxError::expected_eq);
+            stmt.kind = SnippetStmt::Kind::assign;
+            stmt.slot = static_cast<uint16_t>(slot);
+            stmt.expr = parseExpr(0);
+            break;
+        }
+        case TokenType::open_curly:
+            stmt.kind = SnippetStmt::Kind::scope;
+            std::tie(stmt.first, stmt.count) = parseBlock(false);
+            expect(TokenType::close_curly, SyntaxError::expected_close_curly);
+            return add(m_program.stmts, stmt);
+        case TokenType::if_:
+            return add(m_program.stmts, parseIf());
+        case TokenType::while_:
+            stmt.kind = SnippetStmt::Kind::while_;
+            stmt.expr = parseParenthesized();
+            std::tie(stmt.first, stmt.count) = parseScope();
+            return add(m_program.stmts, stmt);
+        case TokenType::print:
+        case TokenType::read:
+        case TokenType::import_:
+        case TokenType::export_:
+            fail(SyntaxError::unsupported, token.line);
+            return 0;
+        default:
+            fail(SyntaxError::expected_statement, token.line);
+            return 0;
+        }
+        expect(TokenType::semi, SyntaxError::expected_semi);
+        return add(m_program.stmts, stmt);
+    }
+
+    // `fn name(params) { body }`, seeing only its own parameters and variables.
+    constexpr void parseFunction()
+    {
+        consume();
+        const SnippetToken name = expect(TokenType::ident, SyntaxError::expected_identifier);
+        for (const SnippetFunction &function : m_program.functions)
+        {
+            if (function.name == name.text)
+            {
+                fail(SyntaxError::function_already_defined, name.line);
+            }
+        }
+        const auto outer_names = m_names;
+        const uint16_t outer_slots = m_slots;
+        m_names.resize(0);
+        m_slots = 0;
+        m_in_function = true;
+        expect(TokenType::open_paren, SyntaxError::expected_open_paren);
+        while (!failed() && !next(TokenType::close_pared))
+        {
+            if (m_slots != 0)
+            {
+                expect(TokenType::comma, SyntaxError::expected_close_paren);
+            }
+            declare(expect(TokenType::ident, SyntaxError::expected_identifier));
+            if (m_slots > maxSnippetParams)
+            {
+                fail(SyntaxError::too_large, name.line);
+            }
+        }
+        expect(TokenType::close_pared, SyntaxError::expected_close_paren);
+        const uint16_t params = m_slots;
+        const auto [first, count] = parseScope();
+        add(m_program.functions, SnippetFunction{name.text, params, first, count});
+        m_names = outer_names;
+        m_slots = outer_slots;
+        m_in_function = false;
+    }
+
+    // Calls may name functions defined after them.
+    constexpr void resolveCalls()
+    {
+        for (SnippetExpr &expr : m_program.exprs)
+        {
+            if (failed())
+            {
+                return;
+            }
+            if (expr.kind != SnippetExpr::Kind::call)
+            {
+                continue;
+            }
+            bool found = false;
+            for (size_t f = 0; f < m_program.functions.size() && !found; f++)
+            {
+                if (m_program.functions[f].name == expr.name)
+                {
+                    found = true;
+                    expr.function = static_cast<uint16_t>(f);
+                    if (m_program.functions[f].params != expr.arg_count)
+                    {
+                        fail(SyntaxError::wrong_argument_count, expr.line);
+                    }
+                }
+            }
+            if (!found)
+            {
+                fail(SyntaxError::undeclared_function, expr.line);
+            }
+        }
+    }
+};
+
+// Runs a parsed snippet. Every node is a template argument, so each one is
+// its own small function and the whole snippet inlines like hand-written C++.
+template <const SnippetProgram &P>
+class SnippetEvaluator
+{
+public:
+    using Frame = std::array<uint64_t, maxSnippetSlots>;
+
+    // Set by a `return`, or by an `exit` anywhere, which unwinds every call.
+    struct Context
+    {
+        uint64_t value = 0;
+        bool exited = false;
+    };
+
+    // The value the top-level statements exit with; 0 if they do not exit.
+    static constexpr uint64_t run()
+    {
+        Frame frame{};
+        Context context;
+        runList<P.main.first>(frame, context, std::make_index_sequence<P.main.count>{});
+        return context.exited ? context.value : 0;
+    }
+
+    template <size_t F>
+    static constexpr uint64_t call(const std::array<uint64_t, P.functions[F].params> &args, Context &context)
+    {
+        constexpr SnippetFunction function = P.functions[F];
+        Frame frame{};
+        std::copy(args.begin(), args.end(), frame.begin());
+        const Flow flow = runList<function.first>(frame, context, std::make_index_sequence<function.count>{});
+        return flow == Flow::returned ? context.value : 0;
+    }
+
+private:
+    enum class Flow : uint8_t
+    {
+        next,
+        returned,
+        exited,
+    };
+
+    template <size_t First, size_t... I>
+    static constexpr Flow runList(Frame &frame, Context &context, std::index_sequence<I...>)
+    {
+        Flow flow = Flow::next;
+        static_cast<void>((((flow = exec<P.lists[First + I]>(frame, context)) == Flow::next) && ...));
+        return flow;
+    }
+
+    template <size_t S>
+    static constexpr Flow exec(Frame &frame, Context &context)
+    {
+        using Kind = SnippetStmt::Kind;
+        constexpr SnippetStmt stmt = P.stmts[S];
+        const auto body = [&]
+        { return runList<stmt.first>(frame, context, std::make_index_sequence<stmt.count>{}); };
+        if constexpr (stmt.kind == Kind::scope)
+        {
+            return body();
+        }
+        else if constexpr (stmt.kind == Kind::while_)
+        {
+            while (true)
+            {
+                const uint64_t condition = eval<stmt.expr>(frame, context);
+                if (context.exited)
+                {
+                    return Flow::exited;
+                }
+                if (condition == 0)
+                {
+                    return Flow::next;
+                }
+                if (const Flow flow = body(); flow != Flow::next)
+                {
+                    return flow;
+                }
+            }
+        }
+        else
+        {
+            const uint64_t value = eval<stmt.expr>(frame, context);
+            if (context.exited)
+            {
+                return Flow::exited;
+            }
+            if constexpr (stmt.kind == Kind::if_)
+            {
+                return value != 0 ? body()
+                                  : runList<stmt.else_first>(frame, context,
+                                                             std::make_index_sequence<stmt.else_count>{});
+            }
+            else if constexpr (stmt.kind == Kind::exit || stmt.kind == Kind::return_)
+            {
+                context.value = value;
+                context.exited = stmt.kind == Kind::exit;
+                return context.exited ? Flow::exited : Flow::returned;
+            }
+            else
+            {
+                frame[stmt.slot] = value;
+                return Flow::next;
+            }
+        }
+    }
+
+    // Operands right first, the order the generated code evaluates them in.
+    template <size_t E>
+    static constexpr uint64_t eval(const Frame &frame, Context &context)
+    {
+        using Kind = SnippetExpr::Kind;
+        constexpr SnippetExpr expr = P.exprs[E];
+        if constexpr (expr.kind == Kind::literal)
+        {
+            return expr.value;
+        }
+        else if constexpr (expr.kind == Kind::variable)
+        {
+            return frame[expr.slot];
+        }
+        else if constexpr (expr.kind == Kind::call)
+        {
+            return evalCall<E>(frame, context, std::make_index_sequence<expr.arg_count>{});
+        }
+        else if constexpr (expr.op == TokenType::amp_amp || expr.op == TokenType::pipe_pipe)
+        {
+            const bool lhs = eval<expr.lhs>(frame, context) != 0;
+            if (context.exited || lhs == (expr.op == TokenType::pipe_pipe))
+            {
+                return lhs;
+            }
+            return eval<expr.rhs>(frame, context) != 0;
+        }
+        else
+        {
+            const uint64_t rhs = eval<expr.rhs>(frame, context);
+            if (context.exited)
+            {
+                return 0;
+            }
+            const uint64_t lhs = eval<expr.lhs>(frame, context);
+            switch (expr.op)
+            {
+            case TokenType::plus:
+                return lhs + rhs;
+            case TokenType::minus:
+                return lhs - rhs;
+            case TokenType::star:
+                return lhs * rhs;
+            case TokenType::fslash:
+                if (rhs == 0)
+                {
+                    // Not a constant expression, so folding it fails to compile.
+                    throw std::domain_error("Kei division by zero");
+                }
+                return lhs / rhs;
+            case TokenType::eq_eq:
+                return lhs == rhs;
+            case TokenType::bang_eq:
+                return lhs != rhs;
+            case TokenType::lt:
+                return lhs < rhs;
+            case TokenType::lt_eq:
+                return lhs <= rhs;
+            case TokenType::gt:
+                return lhs > rhs;
+            default:
+                return lhs >= rhs;
+            }
+        }
+    }
+
+    template <size_t E, size_t... I>
+    static constexpr uint64_t evalCall(const Frame &frame, Context &context, std::index_sequence<I...>)
+    {
+        constexpr SnippetExpr expr = P.exprs[E];
+        std::array<uint64_t, sizeof...(I)> args{};
+        static_cast<void>(((args[I] = eval<P.args[expr.first_arg + I]>(frame, context), !context.exited) && ...));
+        if (context.exited)
+        {
+            return 0;
+        }
+        return call<expr.function>(args, context);
+    }
+};
+
+// A snippet function called from C++; an `exit` in it ends the call with the
+// exit value.
+template <const SnippetProgram &P, size_t F>
+struct SnippetFunctionRef
+{
+    template <std::convertible_to<uint64_t>... Args>
+        requires(sizeof...(Args) == P.functions[F].params)
+    constexpr uint64_t operator()(const Args... args) const
+    {
+        typename SnippetEvaluator<P>::Context context;
+        const uint64_t value = SnippetEvaluator<P>::template call<F>({static_cast<uint64_t>(args)...}, context);
+        return context.exited ? context.value : value;
+    }
+};
+
+// A string literal as a template argument.
+template <size_t N>
+struct SnippetSource
+{
+    constexpr SnippetSource(const char (&text)[N]) { std::copy_n(text, N, chars.begin()); }
+    [[nodiscard]] constexpr std::string_view view() const { return {chars.data(), N - 1}; }
+    std::array<char, N> chars{};
+};
+
+template <SnippetSource Source>
+inline constexpr SnippetProgram parsedSnippet = SnippetParser(Source.view()).parse();
+
+// Instantiated when a snippet does not parse, so the compiler's diagnostic
+// names the error and its line as the template arguments.
+template <SyntaxError Error, int Line>
+struct KeiSyntaxError
+{
+    static_assert(Error == SyntaxError::none, "Kei snippet does not compile: see the KeiSyntaxError arguments");
+};
+
+template <SnippetSource Source>
+constexpr auto compile_constexpr()
+{
+    constexpr const SnippetProgram &program = parsedSnippet<Source>;
+    if constexpr (program.error != SyntaxError::none)
+    {
+        return KeiSyntaxError<program.error, program.error_line>{};
+    }
+    else if constexpr (program.main.count == 0 && program.functions.size() != 0)
+    {
+        return SnippetFunctionRef<parsedSnippet<Source>, program.functions.size() - 1>{};
+    }
+    else
+    {
+        constexpr uint64_t value = SnippetEvaluator<parsedSnippet<Source>>::run();
+        return value;
+    }
+}
+
+} // namespace kei
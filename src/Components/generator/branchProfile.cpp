@@ -0,0 +1,60 @@
+#include "branchProfile.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+uint64_t profileChecksum(const std::string_view source)
+{
+    // FNV-1a: stable across compiler builds, unlike std::hash.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : source) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::optional<BranchCounts> readBranchProfile(const std::string& path, const uint64_t checksum, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "Failed to open profile " + path;
+        return {};
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const auto word = [&](const size_t offset) {
+        uint64_t value;
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        return value;
+    };
+
+    BranchCounts counts;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        if (data.size() - offset < 24 || word(offset) != branchProfileMagic) {
+            error = "Malformed profile " + path;
+            return {};
+        }
+        const uint64_t count = word(offset + 16);
+        if (count > (data.size() - offset - 24) / 8) {
+            error = "Truncated profile " + path;
+            return {};
+        }
+        const size_t first = offset + 24;
+        offset = first + count * 8;
+        if (word(first - 16) != checksum) {
+            continue;
+        }
+        if (counts.records != 0 && counts.counters.size() != count) {
+            error = "Profile " + path + " has records of different sizes for this program";
+            return {};
+        }
+        counts.counters.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t add = word(first + i * 8);
+            uint64_t& counter = counts.counters[i];
+            counter = counter + add < counter ? UINT64_MAX : counter + add;
+        }
+        counts.records++;
+    }
+    return counts;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Branch profiles for `--instrument` / `--profile-use`. An instrumented binary
+// keeps one counter per arm of every `if`/`elif`/`else` chain, plus one per
+// chain for "no arm taken" when it has no `else`, and appends a record to its
+// profile file at `exit`:
+//
+//     "KEIPROF1"  u64 checksum  u64 count  u64 counters[count]
+//
+// little-endian. Records from several runs, or several programs, can share a
+// file; the checksum ties a record to the source it was compiled from.
+inline constexpr uint64_t branchProfileMagic = 0x31464f5250494b45ULL; // "KEIPROF1"
+
+[[nodiscard]] uint64_t profileChecksum(std::string_view source);
+
+struct BranchCounts {
+    std::vector<uint64_t> counters; // summed over the matching records
+    size_t records = 0;
+};
+
+// Sums the records of `path` whose checksum is `checksum`. Returns nullopt
+// and sets `error` if the file cannot be read or is malformed; a file with no
+// matching record yields zero `records`.
+[[nodiscard]] std::optional<BranchCounts> readBranchProfile(
+    const std::string& path, uint64_t checksum, std::string& error);
@@ -1,109 +1,526 @@
 #include "generatorCode.hpp"
+#include "branchProfile.hpp"
+#include "Components/diagnostics/compileError.hpp"
+#include "Components/lexing/utf8.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <climits>
+#include <cstdio>
 
-Generator::Generator(ProgramNode prog)
-    : m_prog(std::move(prog))
+// SysV order; a function has at most `maxParams` parameters.
+static constexpr std::array<const char*, maxParams> argRegisters { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+// The registers of an instruction selector rule's first and second register
+// operands (see instructionSelector.hpp).
+static constexpr std::array<const char*, 2> operandRegisters { "rax", "rcx" };
+
+namespace {
+// An `if` chain needs this many arms to be lowered as a switch.
+constexpr size_t minSwitchCases = 4;
+// A jump table spends at most this many slots per case; sparser cases get a
+// decision tree.
+constexpr uint64_t maxSlotsPerCase = 3;
+// Decision tree leaves test up to this many cases one after the other.
+constexpr size_t maxLeafCases = 3;
+// The right operand of `&&` or `||` is evaluated unconditionally, to avoid a
+// branch, when it cannot trap or call and is at most this many nodes.
+constexpr size_t maxBranchlessSize = 12;
+// The size of each of `print`'s and `read()`'s buffers.
+constexpr size_t ioBufferSize = 65536;
+// Vector registers 0-13 hold values; 14 and 15 are the multiply's scratch.
+constexpr size_t vectorValueRegisters = 14;
+
+// The assembler only takes ASCII labels, so each other character of a
+// function's name is spelled as `_<hex code point>_`; names have no `_` of
+// their own, so this never clashes.
+std::string functionLabel(const std::string& name)
 {
+    std::string label = "fn_";
+    for (size_t i = 0; i < name.size();) {
+        size_t length;
+        const char32_t code_point = decodeUtf8(name, i, length);
+        if (length == 1) {
+            label += name[i];
+        }
+        else {
+            char text[16];
+            std::snprintf(text, sizeof(text), "_%x_", static_cast<unsigned>(code_point));
+            label += text;
+        }
+        i += length;
+    }
+    return label;
 }
 
-void Generator::gen_term(const TermNode* term)
+bool branchless(const BinaryOperands& logic)
 {
-    struct TermVisitor {
-        Generator& gen;
-        void operator()(const IntLiteralNode* lit) const
-        {
-            gen.m_output << "    mov rax, " << lit->intLit.value.value() << "\n";
-            gen.push("rax");
+    return !mayTrap(logic.rhs) && exprSize(logic.rhs) <= maxBranchlessSize;
+}
+
+// The `setcc`/`jcc` suffix for `op` after `cmp lhs, rhs`.
+const char* conditionCode(const BinaryOp op)
+{
+    switch (op) {
+    case BinaryOp::eq:
+        return "e";
+    case BinaryOp::ne:
+        return "ne";
+    case BinaryOp::lt:
+        return "b";
+    case BinaryOp::le:
+        return "be";
+    case BinaryOp::gt:
+        return "a";
+    case BinaryOp::ge:
+        return "ae";
+    default:
+        return "?";
+    }
+}
+
+// The comparison that holds exactly when `op` does not.
+BinaryOp negated(const BinaryOp op)
+{
+    switch (op) {
+    case BinaryOp::eq:
+        return BinaryOp::ne;
+    case BinaryOp::ne:
+        return BinaryOp::eq;
+    case BinaryOp::lt:
+        return BinaryOp::ge;
+    case BinaryOp::le:
+        return BinaryOp::gt;
+    case BinaryOp::gt:
+        return BinaryOp::le;
+    case BinaryOp::ge:
+        return BinaryOp::lt;
+    default:
+        return op;
+    }
+}
+
+// `code`, a selector rule's, with its operands, destination register and
+// parameter filled in. `indent` starts each line, and if not empty makes the
+// text whole lines of assembly.
+std::string expandCode(const char* code, const std::span<const std::string> operands, const std::string& dest,
+    const uint64_t param, const std::string& indent)
+{
+    std::string text = indent;
+    for (const char* c = code; *c != '\0'; c++) {
+        if (*c == '\n') {
+            text += "\n" + indent;
+            continue;
         }
-        void operator()(const IdentifierNode* ident) const
-        {
-            const auto it = std::find_if(gen.m_vars.begin(), gen.m_vars.end(), [&](const Var& var) {
-                return var.name == ident->ident.value.value();
-            });
-            if (it == gen.m_vars.cend()) {
-                std::cerr << "Undeclared identifier: " << ident->ident.value.value() << std::endl;
-                exit(EXIT_FAILURE);
-            }
-            std::stringstream offset;
-            offset << "QWORD [rsp + " << (gen.m_stack_size - it->stack_loc - 1) * 8 << "]";
-            gen.push(offset.str());
+        if (*c != '$') {
+            text += *c;
+            continue;
         }
-        void operator()(const ParenthesizedExprNode* paren) const
-        {
-            gen.gen_expr(paren->expr);
+        switch (*++c) {
+        case '0':
+        case '1':
+        case '2':
+            text += operands[*c - '0'];
+            break;
+        case 'd':
+            text += dest;
+            break;
+        case 'e':
+            text += "e" + dest.substr(1);
+            break;
+        case 'k':
+            text += std::to_string(param);
+            break;
         }
-    };
-    TermVisitor visitor({ .gen = *this });
-    std::visit(visitor, term->term);
+    }
+    if (!indent.empty()) {
+        text += "\n";
+    }
+    return text;
 }
 
-void Generator::gen_bin_expr(const BinaryExpressionNode* bin_expr)
+struct CaseTest {
+    const IdentifierNode* subject;
+    uint64_t value;
+};
+
+// `name == constant` or `constant == name`.
+std::optional<CaseTest> caseTest(const ExprNode* condition)
 {
-    struct BinExprVisitor {
-        Generator& gen;
+    const auto* bin = std::get_if<BinaryExpressionNode*>(&unwrapParens(condition)->expression);
+    if (bin == nullptr) {
+        return {};
+    }
+    const auto [op, lhs, rhs] = binaryOperands(*bin);
+    if (op != BinaryOp::eq) {
+        return {};
+    }
+    const bool constant_first = intLiteralValue(lhs).has_value();
+    const IdentifierNode* subject = identifierOf(constant_first ? rhs : lhs);
+    const auto value = intLiteralValue(constant_first ? lhs : rhs);
+    if (subject == nullptr || !value.has_value()) {
+        return {};
+    }
+    return CaseTest { subject, value.value() };
+}
+}
 
-        void operator()(const SubtractionNode* sub) const
-        {
-            gen.gen_expr(sub->rhs);
-            gen.gen_expr(sub->lhs);
-            gen.pop("rax");
-            gen.pop("rbx");
-            gen.m_output << "    sub rax, rbx\n";
-            gen.push("rax");
+Generator::Generator(ProgramNode prog, GeneratorOptions options)
+    : m_prog(std::move(prog))
+    , m_options(std::move(options))
+{
+    for (const FunctionNode* function : m_prog.functions) {
+        const std::string& name = function->name.value.value();
+        if (!m_functions.emplace(name, function).second) {
+            throw CompileError("Function already defined: " + name);
+        }
+        if (function->params.size() > maxParams) {
+            throw CompileError("Function " + name + " has more than " + std::to_string(maxParams) + " parameters");
         }
+    }
 
-        void operator()(const AdditionNode* add) const
-        {
-            gen.gen_expr(add->rhs);
-            gen.gen_expr(add->lhs);
-            gen.pop("rax");
-            gen.pop("rbx");
-            gen.m_output << "    add rax, rbx\n";
-            gen.push("rax");
+    // Counters are numbered in source order, before any layout change, so an
+    // instrumented build and a profile-use build agree on them. Exits ahead
+    // of the first `print` must flush too, so it is looked for here.
+    const auto number_chains = [this](StmtNode* stmt) {
+        m_prints = m_prints || std::holds_alternative<PrintStatementNode*>(stmt->statement);
+        if (const auto* stmt_if = std::get_if<IfStatementNode*>(&stmt->statement)) {
+            m_chain_counters.emplace(*stmt_if, m_counter_count);
+            m_counter_count += 2; // the `if` arm and the `else` (or no arm)
+            for (std::optional<ElseIfNode*> pred = (*stmt_if)->pred; pred.has_value();) {
+                const auto* elif = std::get_if<ElseIfBranchNode*>(&pred.value()->branch);
+                if (elif == nullptr) {
+                    break;
+                }
+                m_counter_count++;
+                pred = (*elif)->next;
+            }
         }
+    };
+    forEachStmt(m_prog.statements, number_chains);
+    for (const FunctionNode* function : m_prog.functions) {
+        forEachStmt(function->body->statements, number_chains);
+    }
+    if (m_options.branch_counts != nullptr && m_options.branch_counts->size() != m_counter_count) {
+        m_options.branch_counts = nullptr;
+        m_profile_ignored = true;
+    }
+}
 
-        void operator()(const MultiplicationNode* multi) const
-        {
-            gen.gen_expr(multi->rhs);
-            gen.gen_expr(multi->lhs);
-            gen.pop("rax");
-            gen.pop("rbx");
-            gen.m_output << "    mul rbx\n";
-            gen.push("rax");
+// Arguments are evaluated left to right onto the stack and then popped into
+// the argument registers. Everything live in the caller is on the stack, so
+// no register needs saving across the call; the result comes back in rax.
+void Generator::gen_call(const CallNode* call)
+{
+    const std::string& name = call->name.value.value();
+    const auto it = m_functions.find(name);
+    if (it == m_functions.end()) {
+        throw CompileError("Undeclared function: " + name);
+    }
+    if (it->second->params.size() != call->args.size()) {
+        throw CompileError("Function " + name + " takes " + std::to_string(it->second->params.size())
+            + " arguments, " + std::to_string(call->args.size()) + " given");
+    }
+    for (const ExprNode* arg : call->args) {
+        gen_expr(arg);
+    }
+    for (size_t i = call->args.size(); i-- > 0;) {
+        pop(argRegisters[i]);
+    }
+    m_output << "    call " << functionLabel(name) << "\n";
+}
+
+// Sets the flags for comparing the operands of `cmp`.
+void Generator::gen_compare(const ExprNode* cmp)
+{
+    gen_rule(cmp, Goal::cond, "rax");
+}
+
+// Jumps to `label` if `condition` is non-zero when `when` is set, or zero
+// when it is not. A comparison jumps on its flags without making a 0 or 1,
+// and `&&` or `||` with an expensive right operand becomes a jump per
+// operand.
+void Generator::gen_branch(const ExprNode* condition, const bool when, const std::string& label)
+{
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&unwrapParens(condition)->expression)) {
+        const BinaryOperands operands = binaryOperands(*bin);
+        if (isComparison(operands.op)) {
+            gen_compare(condition);
+            m_output << "    j" << conditionCode(when ? operands.op : negated(operands.op)) << " " << label << "\n";
+            return;
+        }
+        if (isLogical(operands.op) && !branchless(operands)) {
+            // The left operand alone decides when it is false for `&&` or
+            // true for `||`; the right one decides otherwise.
+            const bool decides = operands.op == BinaryOp::logical_or;
+            if (decides == when) {
+                gen_branch(operands.lhs, when, label);
+                gen_branch(operands.rhs, when, label);
+                return;
+            }
+            const std::string skip_label = create_label();
+            gen_branch(operands.lhs, decides, skip_label);
+            gen_branch(operands.rhs, when, label);
+            m_output << skip_label << ":\n";
+            return;
         }
+    }
+    gen_value(condition);
+    m_output << "    test rax, rax\n";
+    m_output << "    " << (when ? "jnz " : "jz ") << label << "\n";
+}
 
-        void operator()(const DivisionNode* div) const
-        {
-            gen.gen_expr(div->rhs);
-            gen.gen_expr(div->lhs);
-            gen.pop("rax");
-            gen.pop("rbx");
-            gen.m_output << "    div rbx\n";
-            gen.push("rax");
+// 1 if the comparison holds, else 0.
+void Generator::gen_comparison(const ExprNode* cmp, const BinaryOp op)
+{
+    gen_compare(cmp);
+    m_output << "    set" << conditionCode(op) << " al\n";
+    m_output << "    movzx rax, al\n";
+}
+
+// 1 if `expr` is non-zero, else 0.
+void Generator::gen_truth(const ExprNode* expr)
+{
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&unwrapParens(expr)->expression)) {
+        if (const BinaryOperands operands = binaryOperands(*bin); isComparison(operands.op) || isLogical(operands.op)) {
+            gen_value(expr);
+            return;
         }
-    };
+    }
+    gen_value(expr);
+    m_output << "    test rax, rax\n";
+    m_output << "    setnz al\n";
+    m_output << "    movzx rax, al\n";
+}
 
-    BinExprVisitor visitor { .gen = *this };
-    std::visit(visitor, bin_expr->operation);
+// A cheap right operand is evaluated along with the left one and the two
+// truth values combined with `and`/`or`, so the result takes no branch.
+// Otherwise the left operand's test jumps over the right one when it decides
+// the result, and the flags of whichever test ran last give the result.
+void Generator::gen_logical(const BinaryOperands& logic)
+{
+    const bool is_and = logic.op == BinaryOp::logical_and;
+    if (branchless(logic)) {
+        gen_truth(logic.rhs);
+        push("rax");
+        gen_truth(logic.lhs);
+        pop("rcx");
+        m_output << "    " << (is_and ? "and" : "or") << " rax, rcx\n";
+        return;
+    }
+    const std::string done_label = create_label();
+    gen_value(logic.lhs);
+    m_output << "    test rax, rax\n";
+    m_output << "    " << (is_and ? "jz " : "jnz ") << done_label << "\n";
+    gen_value(logic.rhs);
+    m_output << "    test rax, rax\n";
+    m_output << done_label << ":\n";
+    m_output << "    setnz al\n";
+    m_output << "    movzx rax, al\n";
 }
 
-void Generator::gen_expr(const ExprNode* expr)
+// The operands `match` reads, in its rule's order, with the registers it
+// reads taken from `registers`.
+std::array<std::string, 2> Generator::rule_operands(
+    const ExprNode* expr, const Match& match, std::span<const char* const>& registers)
 {
-    struct ExprVisitor {
-        Generator& gen;
+    const Rule& rule = *match.rule;
+    if (rule.shape == Shape::chain) {
+        return { gen_operand(expr, rule.lhs, registers), "" };
+    }
+    if (rule.shape == Shape::literal || rule.shape == Shape::variable) {
+        return { leaf_text(expr), "" };
+    }
+    std::string lhs = gen_operand(match.lhs, rule.lhs, registers);
+    return { std::move(lhs), gen_operand(match.rhs, rule.rhs, registers) };
+}
 
-        void operator()(const TermNode* term) const
-        {
-            gen.gen_term(term);
+// Emits the rule the selector chose to produce `expr` as `goal`, a register
+// or the flags. A register result goes to rax, or to `dest` when `expr` is a
+// leaf, whose code touches no other register.
+void Generator::gen_rule(const ExprNode* expr, const Goal goal, const std::string& dest)
+{
+    const Match match = m_selector.select(expr, goal);
+    if (match.rule->code == nullptr) {
+        gen_own(expr);
+        if (dest != "rax") {
+            m_output << "    mov " << dest << ", rax\n";
         }
+        return;
+    }
+    if (match.lhs != nullptr) {
+        gen_registers(match);
+    }
+    std::span<const char* const> registers(operandRegisters);
+    const std::array<std::string, 2> operands = rule_operands(expr, match, registers);
+    m_output << expandCode(match.rule->code, operands, dest, match.param, "    ");
+}
 
-        void operator()(const BinaryExpressionNode* bin_expr) const
-        {
-            gen.gen_bin_expr(bin_expr);
+// The text of `expr` as an operand of kind `goal`. A register operand names
+// the next of `registers`, which `gen_registers` has loaded.
+std::string Generator::gen_operand(
+    const ExprNode* expr, const Goal goal, std::span<const char* const>& registers)
+{
+    if (goal == Goal::none) {
+        return {};
+    }
+    if (goal == Goal::reg) {
+        const char* reg = registers.front();
+        registers = registers.subspan(1);
+        return reg;
+    }
+    const Match match = m_selector.select(expr, goal);
+    return expandCode(match.rule->code, rule_operands(expr, match, registers), "", match.param, "");
+}
+
+// The expression whose value `expr` as `goal` reads from a register, if any.
+const ExprNode* Generator::register_operand(const ExprNode* expr, const Goal goal)
+{
+    if (goal == Goal::none) {
+        return nullptr;
+    }
+    if (goal == Goal::reg) {
+        return expr;
+    }
+    const Match match = m_selector.select(expr, goal);
+    if (match.rule->shape == Shape::chain) {
+        return register_operand(expr, match.rule->lhs);
+    }
+    if (match.lhs == nullptr) {
+        return nullptr;
+    }
+    const ExprNode* lhs = register_operand(match.lhs, match.rule->lhs);
+    return lhs != nullptr ? lhs : register_operand(match.rhs, match.rule->rhs);
+}
+
+// Loads the register operands of `match`, the first into rax and a second
+// into rcx. As in the stack form, the source's right operand runs first when
+// both may trap or call; a leaf has no effect, so it is loaded last, straight
+// into its register.
+void Generator::gen_registers(const Match& match)
+{
+    const ExprNode* first = register_operand(match.lhs, match.rule->lhs);
+    const ExprNode* second = register_operand(match.rhs, match.rule->rhs);
+    if (first == nullptr || second == nullptr) {
+        if (first != nullptr || second != nullptr) {
+            gen_value(first != nullptr ? first : second);
         }
+        return;
+    }
+    const auto is_leaf = [](const ExprNode* expr) {
+        const Shape shape = shapeOf(expr);
+        return shape == Shape::literal || shape == Shape::variable;
     };
+    if (is_leaf(second)) {
+        gen_value(first);
+        gen_rule(second, Goal::reg, "rcx");
+    }
+    else if (is_leaf(first)) {
+        gen_value(second);
+        m_output << "    mov rcx, rax\n";
+        gen_value(first);
+    }
+    else if (match.swapped && mayTrap(first) && mayTrap(second)) {
+        gen_value(first);
+        push("rax");
+        gen_value(second);
+        m_output << "    mov rcx, rax\n";
+        pop("rax");
+    }
+    else {
+        gen_value(second);
+        push("rax");
+        gen_value(first);
+        pop("rcx");
+    }
+}
+
+std::string Generator::leaf_text(const ExprNode* expr)
+{
+    if (const IdentifierNode* ident = identifierOf(expr)) {
+        return variable_text(ident->ident.value.value());
+    }
+    if (const std::optional<uint64_t> value = intLiteralValue(expr)) {
+        return immediateText(value.value());
+    }
+    // Out of range: the assembler reports it.
+    return std::get<IntLiteralNode*>(std::get<TermNode*>(unwrapParens(expr)->expression)->term)->intLit.value.value();
+}
 
-    ExprVisitor visitor { .gen = *this };
-    std::visit(visitor, expr->expression);
+// The stack slot of the variable `name` as a memory operand.
+std::string Generator::variable_text(const std::string& name)
+{
+    const auto it = m_var_locs.find(name);
+    if (it == m_var_locs.end()) {
+        throw CompileError("Undeclared identifier: " + name);
+    }
+    if (m_array_lengths.contains(name)) {
+        throw CompileError(name + " is an array, not a number");
+    }
+    return "QWORD [rsp + " + std::to_string((m_stack_size - it->second - 1) * 8) + "]";
+}
+
+// Leaves the value of `expr` in rax.
+void Generator::gen_value(const ExprNode* expr)
+{
+    if (m_options.superoptimizer != nullptr && gen_superoptimized(expr)) {
+        return;
+    }
+    gen_rule(expr, Goal::reg, "rax");
+}
+
+// Emits the superoptimizer's sequence for `expr`, if it has one cheaper than
+// the selector's. It clobbers rcx and rdx, which no caller of `gen_value`
+// holds a value in: a second register operand is loaded after the first.
+bool Generator::gen_superoptimized(const ExprNode* expr)
+{
+    std::vector<const IdentifierNode*> inputs;
+    const std::optional<std::string> code
+        = m_options.superoptimizer->find(expr, m_selector.cost(expr, Goal::reg), inputs);
+    if (!code.has_value()) {
+        return false;
+    }
+    std::vector<std::string> operands;
+    for (const IdentifierNode* input : inputs) {
+        operands.push_back(variable_text(input->ident.value.value()));
+    }
+    m_output << expandCode(code->c_str(), operands, "", 0, "    ");
+    return true;
+}
+
+// The expressions no rule covers: calls, comparisons used as values and
+// `&&`/`||`. Leaves the value in rax.
+void Generator::gen_own(const ExprNode* expr)
+{
+    if (const CallNode* call = callOf(expr)) {
+        gen_call(call);
+        return;
+    }
+    if (const IndexNode* index = indexOf(expr)) {
+        gen_index(index);
+        return;
+    }
+    if (arrayLiteralOf(expr) != nullptr) {
+        throw CompileError("An array literal used as a number");
+    }
+    if (readOf(expr) != nullptr) {
+        m_output << "    call kei_read\n";
+        m_reads = true;
+        return;
+    }
+    const BinaryOperands operands = binaryOperands(std::get<BinaryExpressionNode*>(unwrapParens(expr)->expression));
+    if (isLogical(operands.op)) {
+        gen_logical(operands);
+    }
+    else {
+        gen_comparison(expr, operands.op);
+    }
+}
+
+// Pushes the value of `expr`.
+void Generator::gen_expr(const ExprNode* expr)
+{
+    gen_value(expr);
+    push("rax");
 }
 
 void Generator::gen_scope(const ScopeNode* scope)
@@ -115,37 +532,567 @@ void Generator::gen_scope(const ScopeNode* scope)
     end_scope();
 }
 
-void Generator::gen_if_pred(const ElseIfNode* pred, const std::string& end_label)
+void Generator::gen_if(const IfStatementNode* stmt_if)
 {
-    struct PredVisitor {
-        Generator& gen;
-        const std::string& end_label;
+    std::vector<Arm> arms { { stmt_if->condition, stmt_if->scope } };
+    const ScopeNode* else_scope = nullptr;
+    for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+        if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+            else_scope = (*else_)->scope;
+            break;
+        }
+        const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+        arms.push_back({ elif->condition, elif->scope });
+        pred = elif->next;
+    }
+    const size_t first_counter = m_chain_counters.at(stmt_if);
+    const size_t last_counter = first_counter + arms.size();
+    if (gen_switch(arms, else_scope, first_counter)) {
+        return;
+    }
 
-        void operator()(const ElseIfBranchNode* elif) const
-        {
-            gen.m_output << "    ;; elif\n";
-            gen.gen_expr(elif->condition);
-            gen.pop("rax");
-            const std::string label = gen.create_label();
-            gen.m_output << "    test rax, rax\n";
-            gen.m_output << "    jz " << label << "\n";
-            gen.gen_scope(elif->scope);
-            gen.m_output << "    jmp " << end_label << "\n";
-            if (elif->next.has_value()) {
-                gen.m_output << label << ":\n";
-                gen.gen_if_pred(elif->next.value(), end_label);
+    // Each test falls through into its arm, unless the profile says the arm
+    // is usually skipped: then the test branches to the arm, which is emitted
+    // out of line, and falls through to the next test.
+    m_output << "    ;; if\n";
+    const std::string end_label = create_label();
+    for (size_t i = 0; i < arms.size(); i++) {
+        if (i != 0) {
+            m_output << "    ;; elif\n";
+            mark_line(exprLine(arms[i].condition));
+        }
+        if (out_of_line(first_counter + i, last_counter)) {
+            const std::string arm_label = create_label();
+            gen_branch(arms[i].condition, true, arm_label);
+            emit_cold([&] {
+                m_output << arm_label << ":\n";
+                mark_line(exprLine(arms[i].condition));
+                count_arm(first_counter + i);
+                gen_scope(arms[i].scope);
+                m_output << "    jmp " << end_label << "\n";
+            });
+            m_outlined_arms++;
+            continue;
+        }
+        const bool last = i + 1 == arms.size() && else_scope == nullptr && !m_options.profile_path.has_value();
+        const std::string next_label = last ? end_label : create_label();
+        gen_branch(arms[i].condition, false, next_label);
+        count_arm(first_counter + i);
+        gen_scope(arms[i].scope);
+        if (!last) {
+            m_output << "    jmp " << end_label << "\n";
+            m_output << next_label << ":\n";
+        }
+    }
+    if (else_scope != nullptr) {
+        m_output << "    ;; else\n";
+    }
+    count_arm(last_counter);
+    if (else_scope != nullptr) {
+        gen_scope(else_scope);
+    }
+    m_output << end_label << ":\n";
+    m_output << "    ;; /if\n";
+}
+
+// An `if` chain whose every test compares the same variable with a constant
+// becomes a single dispatch on the variable, instead of one test per arm: an
+// indexed jump through a bounds-checked table when the constants are dense,
+// and a balanced tree of compares when they are sparse. The arms follow in
+// source order; a profile does not move them. Returns false, having emitted
+// nothing, for any other chain.
+bool Generator::gen_switch(const std::vector<Arm>& arms, const ScopeNode* else_scope, const size_t first_counter)
+{
+    if (arms.size() < minSwitchCases) {
+        return false;
+    }
+    std::vector<Case> cases;
+    const IdentifierNode* subject = nullptr;
+    for (size_t i = 0; i < arms.size(); i++) {
+        const auto test = caseTest(arms[i].condition);
+        if (!test.has_value() || (subject != nullptr && test->subject->ident.value != subject->ident.value)) {
+            return false;
+        }
+        subject = test->subject;
+        cases.push_back({ test->value, i });
+    }
+    // A repeated constant selects its first arm; the later ones never run.
+    std::ranges::stable_sort(cases, {}, &Case::value);
+    const auto [first_repeat, cases_end] = std::ranges::unique(cases, {}, &Case::value);
+    cases.erase(first_repeat, cases_end);
+
+    const std::string subject_text = variable_text(subject->ident.value.value());
+    m_output << "    ;; switch\n";
+    m_output << "    mov rax, " << subject_text << "\n";
+    std::vector<std::string> arm_labels;
+    for (size_t i = 0; i < arms.size(); i++) {
+        arm_labels.push_back(create_label());
+    }
+    const std::string default_label = create_label();
+    const std::string end_label = create_label();
+    const uint64_t low = cases.front().value;
+    const uint64_t span = cases.back().value - low;
+    if (span < cases.size() * maxSlotsPerCase) {
+        if (low > INT32_MAX) {
+            m_output << "    mov rbx, " << low << "\n";
+            m_output << "    sub rax, rbx\n";
+        }
+        else if (low != 0) {
+            m_output << "    sub rax, " << low << "\n";
+        }
+        m_output << "    cmp rax, " << span << "\n";
+        m_output << "    ja " << default_label << "\n";
+        const std::string table_label = create_label();
+        m_output << "    jmp QWORD [" << table_label << " + rax*8]\n";
+        m_tables += table_label + ":\n";
+        auto next = cases.begin();
+        for (uint64_t slot = 0; slot <= span; slot++) {
+            m_tables += slot % 4 == 0 ? "    dq " : ", ";
+            if (next->value - low == slot) {
+                m_tables += arm_labels[next->arm];
+                ++next;
+            }
+            else {
+                m_tables += default_label;
+            }
+            if (slot % 4 == 3 || slot == span) {
+                m_tables += "\n";
             }
         }
+        m_jump_tables++;
+    }
+    else {
+        gen_decision_tree(cases, arm_labels, default_label);
+        m_decision_trees++;
+    }
 
-        void operator()(const ElseBranchNode* else_) const
-        {
-            gen.m_output << "    ;; else\n";
-            gen.gen_scope(else_->scope);
+    std::vector<bool> reachable(arms.size());
+    for (const Case& c : cases) {
+        reachable[c.arm] = true;
+    }
+    for (size_t i = 0; i < arms.size(); i++) {
+        if (!reachable[i]) {
+            continue;
         }
+        m_output << arm_labels[i] << ":\n";
+        mark_line(exprLine(arms[i].condition));
+        count_arm(first_counter + i);
+        gen_scope(arms[i].scope);
+        m_output << "    jmp " << end_label << "\n";
+    }
+    m_output << default_label << ":\n";
+    count_arm(first_counter + arms.size());
+    if (else_scope != nullptr) {
+        m_output << "    ;; else\n";
+        gen_scope(else_scope);
+    }
+    m_output << end_label << ":\n";
+    m_output << "    ;; /switch\n";
+    return true;
+}
+
+// Compares rax, the subject of a switch, with `value`.
+void Generator::gen_compare_rax(const uint64_t value)
+{
+    if (value > INT32_MAX) {
+        m_output << "    mov rbx, " << value << "\n";
+        m_output << "    cmp rax, rbx\n";
+    }
+    else {
+        m_output << "    cmp rax, " << value << "\n";
+    }
+}
+
+// Binary search over `cases`, sorted by value: each node tests its middle
+// case and goes below or above it, down to short runs tested in order.
+void Generator::gen_decision_tree(
+    const std::span<const Case> cases, const std::vector<std::string>& arm_labels, const std::string& default_label)
+{
+    if (cases.size() <= maxLeafCases) {
+        for (const Case& c : cases) {
+            gen_compare_rax(c.value);
+            m_output << "    je " << arm_labels[c.arm] << "\n";
+        }
+        m_output << "    jmp " << default_label << "\n";
+        return;
+    }
+    const size_t mid = cases.size() / 2;
+    const std::string below_label = create_label();
+    gen_compare_rax(cases[mid].value);
+    m_output << "    je " << arm_labels[cases[mid].arm] << "\n";
+    m_output << "    jb " << below_label << "\n";
+    gen_decision_tree(cases.subspan(mid + 1), arm_labels, default_label);
+    m_output << below_label << ":\n";
+    gen_decision_tree(cases.first(mid), arm_labels, default_label);
+}
+
+// The element count of `expr` if it is an array, or 0 for a number. Arrays
+// only combine element-wise, with each other or with a number.
+size_t Generator::array_length(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const ArrayLiteralNode* array = arrayLiteralOf(expr)) {
+        for (const ExprNode* element : array->elements) {
+            if (array_length(element) != 0) {
+                throw CompileError("Array elements must be numbers");
+            }
+        }
+        return array->elements.size();
+    }
+    if (const IdentifierNode* ident = identifierOf(expr)) {
+        const auto it = m_array_lengths.find(ident->ident.value.value());
+        return it == m_array_lengths.end() ? 0 : it->second;
+    }
+    const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression);
+    if (bin == nullptr) {
+        return 0;
+    }
+    const auto [op, lhs, rhs] = binaryOperands(*bin);
+    const size_t left = array_length(lhs);
+    const size_t right = array_length(rhs);
+    if (left == 0 && right == 0) {
+        return 0;
+    }
+    if (op != BinaryOp::add && op != BinaryOp::sub && op != BinaryOp::mul) {
+        throw CompileError(std::string("`") + binaryOpText(op) + "` does not apply to arrays");
+    }
+    if (left != 0 && right != 0 && left != right) {
+        throw CompileError("Arrays of lengths " + std::to_string(left) + " and " + std::to_string(right) + " combined");
+    }
+    return std::max(left, right);
+}
+
+std::string Generator::vector_register(const size_t index) const
+{
+    return (m_options.avx2 ? "ymm" : "xmm") + std::to_string(index);
+}
+
+// Element `element` of the array whose first element is in slot `loc`, plus
+// rdx elements if `indexed`. Elements go up in memory from the first.
+std::string Generator::element_address(const size_t loc, const size_t element, const bool indexed) const
+{
+    return "[rsp + " + std::to_string((m_stack_size - loc - 1 + element) * 8) + (indexed ? " + rdx*8" : "") + "]";
+}
+
+// Reserves the slots of the array `name` and stores `expr` in them. In
+// `_start` the stack's alignment is known, so the first element is padded to
+// a vector boundary; a function's frame is only 8-byte aligned.
+void Generator::gen_array_let(const std::string& name, const ExprNode* expr, const size_t length)
+{
+    size_t slots = length;
+    if (!m_in_function) {
+        slots += (vector_width() - (m_stack_size + length) % vector_width()) % vector_width();
+    }
+    m_output << "    sub rsp, " << slots * 8 << "\n";
+    m_stack_size += slots;
+    const size_t loc = m_stack_size - 1;
+    if (const ArrayLiteralNode* array = arrayLiteralOf(unwrapParens(expr))) {
+        for (size_t i = 0; i < length; i++) {
+            gen_value(array->elements[i]);
+            m_output << "    mov QWORD " << element_address(loc, i, false) << ", rax\n";
+        }
+    }
+    else {
+        gen_elementwise(expr, loc, length);
+    }
+    m_var_locs.emplace(name, loc);
+    m_array_lengths.emplace(name, length);
+    m_vars.push_back({ .name = name, .stack_loc = loc, .slots = slots });
+}
+
+// Stores the element-wise array expression `expr` in the `length` elements
+// from slot `dest`: whole vectors of elements in SSE2 or AVX2 registers, then
+// the rest one at a time. Lanes are 64 bits wide, as Kei's numbers are.
+void Generator::gen_elementwise(const ExprNode* expr, const size_t dest, const size_t length)
+{
+    const size_t base = m_stack_size;
+    std::vector<Lane> lanes;
+    build_lanes(expr, lanes);
+    m_elementwise_exprs++;
+    const size_t vector_end = length - length % vector_width();
+    size_t scalar_begin = 0;
+    if (vector_end != 0 && gen_vector_lanes(lanes, dest, vector_end)) {
+        m_vectorized_exprs++;
+        scalar_begin = vector_end;
+    }
+    gen_scalar_lanes(lanes, dest, scalar_begin, length);
+    if (m_stack_size != base) {
+        m_output << "    add rsp, " << (m_stack_size - base) * 8 << "\n";
+        m_stack_size = base;
+    }
+}
+
+// Appends the lanes of `expr` after those of its operands and returns its
+// index. Numbers and array literals are evaluated, left to right, into
+// temporaries on the stack.
+size_t Generator::build_lanes(const ExprNode* expr, std::vector<Lane>& lanes)
+{
+    expr = unwrapParens(expr);
+    Lane lane { .kind = Lane::Kind::array };
+    if (array_length(expr) == 0) {
+        lane.kind = Lane::Kind::scalar;
+        lane.literal = intLiteralValue(expr);
+        gen_expr(expr);
+        lane.loc = m_stack_size - 1;
+    }
+    else if (const ArrayLiteralNode* array = arrayLiteralOf(expr)) {
+        m_output << "    sub rsp, " << array->elements.size() * 8 << "\n";
+        m_stack_size += array->elements.size();
+        lane.loc = m_stack_size - 1;
+        for (size_t i = 0; i < array->elements.size(); i++) {
+            gen_value(array->elements[i]);
+            m_output << "    mov QWORD " << element_address(lane.loc, i, false) << ", rax\n";
+        }
+    }
+    else if (const IdentifierNode* ident = identifierOf(expr)) {
+        lane.loc = m_var_locs.at(ident->ident.value.value());
+    }
+    else {
+        const auto [op, lhs, rhs] = binaryOperands(std::get<BinaryExpressionNode*>(expr->expression));
+        lane.kind = op == BinaryOp::add ? Lane::Kind::add : op == BinaryOp::sub ? Lane::Kind::sub : Lane::Kind::mul;
+        lane.lhs = build_lanes(lhs, lanes);
+        lane.rhs = build_lanes(rhs, lanes);
+    }
+    lanes.push_back(lane);
+    return lanes.size() - 1;
+}
+
+// Computes elements [0, end) of `lanes` a vector at a time. Numbers are
+// broadcast to a register each up front; the tree then takes registers from
+// the next free one up. Returns false, having emitted nothing, when that
+// needs more registers than there are.
+bool Generator::gen_vector_lanes(const std::vector<Lane>& lanes, const size_t dest, const size_t end)
+{
+    size_t scalars = 0;
+    std::vector<size_t> need(lanes.size());
+    for (size_t i = 0; i < lanes.size(); i++) {
+        switch (lanes[i].kind) {
+        case Lane::Kind::scalar:
+            scalars++;
+            break;
+        case Lane::Kind::array:
+            need[i] = 1;
+            break;
+        default:
+            need[i] = std::max({ need[lanes[i].lhs], 1 + need[lanes[i].rhs], size_t { 1 } });
+        }
+    }
+    if (scalars + need.back() > vectorValueRegisters) {
+        return false;
+    }
+    m_output << "    ;; " << (m_options.avx2 ? "avx2" : "sse2") << " elements 0-" << end - 1 << "\n";
+    std::vector<Lane> broadcast = lanes;
+    size_t next = 0;
+    for (Lane& lane : broadcast) {
+        if (lane.kind != Lane::Kind::scalar) {
+            continue;
+        }
+        const std::string reg = vector_register(next);
+        const std::string slot = "QWORD [rsp + " + std::to_string((m_stack_size - lane.loc - 1) * 8) + "]";
+        if (m_options.avx2) {
+            m_output << "    vpbroadcastq " << reg << ", " << slot << "\n";
+        }
+        else {
+            m_output << "    movq " << reg << ", " << slot << "\n";
+            m_output << "    punpcklqdq " << reg << ", " << reg << "\n";
+        }
+        // A broadcast number's `loc` now names its register.
+        lane.loc = next++;
+    }
+    const size_t chunks = end / vector_width();
+    const char* store = m_options.avx2 ? "vmovdqu" : "movdqu";
+    // Up to four vectors are unrolled; more take a loop counting elements in rdx.
+    if (chunks <= 4) {
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            const size_t result = gen_vector_lane(broadcast, broadcast.size() - 1, next, chunk * vector_width(), false);
+            m_output << "    " << store << " " << element_address(dest, chunk * vector_width(), false) << ", "
+                     << vector_register(result) << "\n";
+        }
+    }
+    else {
+        const std::string loop_label = create_label();
+        m_output << "    xor edx, edx\n";
+        m_output << loop_label << ":\n";
+        const size_t result = gen_vector_lane(broadcast, broadcast.size() - 1, next, 0, true);
+        m_output << "    " << store << " " << element_address(dest, 0, true) << ", " << vector_register(result) << "\n";
+        m_output << "    add rdx, " << vector_width() << "\n";
+        m_output << "    cmp rdx, " << end << "\n";
+        m_output << "    jb " << loop_label << "\n";
+    }
+    if (m_options.avx2) {
+        // Dirty upper halves slow down later SSE code, libc's included.
+        m_output << "    vzeroupper\n";
+    }
+    return true;
+}
+
+// Leaves the vector of elements from `element` (plus rdx) of `lanes[lane]`
+// in a register, `next` or above unless the lane is a broadcast number, and
+// returns the register's number.
+size_t Generator::gen_vector_lane(
+    const std::vector<Lane>& lanes, const size_t lane, const size_t next, const size_t element, const bool indexed)
+{
+    const Lane& node = lanes[lane];
+    if (node.kind == Lane::Kind::scalar) {
+        return node.loc;
+    }
+    if (node.kind == Lane::Kind::array) {
+        m_output << "    " << (m_options.avx2 ? "vmovdqu " : "movdqu ") << vector_register(next) << ", "
+                 << element_address(node.loc, element, indexed) << "\n";
+        return next;
+    }
+    if (node.kind == Lane::Kind::mul) {
+        // A constant goes on the right, where `gen_vector_mul` looks for it.
+        const bool swap = !lanes[node.rhs].literal.has_value() && lanes[node.lhs].literal.has_value();
+        const Lane& constant = lanes[swap ? node.lhs : node.rhs];
+        const size_t lhs = gen_vector_lane(lanes, swap ? node.rhs : node.lhs, next, element, indexed);
+        const size_t rhs = gen_vector_lane(lanes, swap ? node.lhs : node.rhs, next + 1, element, indexed);
+        gen_vector_mul(next, lhs, rhs, constant.literal);
+        return next;
+    }
+    const size_t lhs = gen_vector_lane(lanes, node.lhs, next, element, indexed);
+    const size_t rhs = gen_vector_lane(lanes, node.rhs, next + 1, element, indexed);
+    const char* op = node.kind == Lane::Kind::add ? "paddq" : "psubq";
+    if (m_options.avx2) {
+        m_output << "    v" << op << " " << vector_register(next) << ", " << vector_register(lhs) << ", "
+                 << vector_register(rhs) << "\n";
+        return next;
+    }
+    if (lhs != next) {
+        m_output << "    movdqa " << vector_register(next) << ", " << vector_register(lhs) << "\n";
+    }
+    m_output << "    " << op << " " << vector_register(next) << ", " << vector_register(rhs) << "\n";
+    return next;
+}
+
+// result = lhs * rhs in 64-bit lanes, which neither SSE2 nor AVX2 multiplies
+// directly: lo*lo + ((hi*lo + lo*hi) << 32) from `pmuludq`'s 32x32->64
+// products. A power of two is a shift, and a constant below 2^32 has no high
+// half to multiply. `result` may be `lhs`, never `rhs`.
+void Generator::gen_vector_mul(
+    const size_t result, const size_t lhs, const size_t rhs, const std::optional<uint64_t>& constant)
+{
+    const std::string r = vector_register(result);
+    const std::string a = vector_register(lhs);
+    const std::string b = vector_register(rhs);
+    const std::string t1 = vector_register(vectorValueRegisters);
+    const std::string t2 = vector_register(vectorValueRegisters + 1);
+    const bool power_of_two = constant.has_value() && std::has_single_bit(constant.value());
+    const bool narrow = constant.has_value() && constant.value() <= UINT32_MAX;
+    if (m_options.avx2) {
+        if (power_of_two) {
+            m_output << "    vpsllq " << r << ", " << a << ", " << std::countr_zero(constant.value()) << "\n";
+            return;
+        }
+        m_output << "    vpsrlq " << t1 << ", " << a << ", 32\n";
+        m_output << "    vpmuludq " << t1 << ", " << t1 << ", " << b << "\n";
+        if (!narrow) {
+            m_output << "    vpsrlq " << t2 << ", " << b << ", 32\n";
+            m_output << "    vpmuludq " << t2 << ", " << t2 << ", " << a << "\n";
+            m_output << "    vpaddq " << t1 << ", " << t1 << ", " << t2 << "\n";
+        }
+        m_output << "    vpsllq " << t1 << ", " << t1 << ", 32\n";
+        m_output << "    vpmuludq " << r << ", " << a << ", " << b << "\n";
+        m_output << "    vpaddq " << r << ", " << r << ", " << t1 << "\n";
+        return;
+    }
+    if (result != lhs) {
+        m_output << "    movdqa " << r << ", " << a << "\n";
+    }
+    if (power_of_two) {
+        m_output << "    psllq " << r << ", " << std::countr_zero(constant.value()) << "\n";
+        return;
+    }
+    m_output << "    movdqa " << t1 << ", " << r << "\n";
+    m_output << "    psrlq " << t1 << ", 32\n";
+    m_output << "    pmuludq " << t1 << ", " << b << "\n";
+    if (!narrow) {
+        m_output << "    movdqa " << t2 << ", " << b << "\n";
+        m_output << "    psrlq " << t2 << ", 32\n";
+        m_output << "    pmuludq " << t2 << ", " << r << "\n";
+        m_output << "    paddq " << t1 << ", " << t2 << "\n";
+    }
+    m_output << "    psllq " << t1 << ", 32\n";
+    m_output << "    pmuludq " << r << ", " << b << "\n";
+    m_output << "    paddq " << r << ", " << t1 << "\n";
+}
+
+// Computes elements [begin, end) of `lanes` one at a time in rax: unrolled
+// for up to four, else in a loop counting elements in rdx.
+void Generator::gen_scalar_lanes(const std::vector<Lane>& lanes, const size_t dest, const size_t begin, const size_t end)
+{
+    if (begin == end) {
+        return;
+    }
+    m_output << "    ;; elements " << begin << "-" << end - 1 << "\n";
+    if (end - begin <= 4) {
+        for (size_t element = begin; element < end; element++) {
+            gen_scalar_lane(lanes, lanes.size() - 1, element, false);
+            m_output << "    mov QWORD " << element_address(dest, element, false) << ", rax\n";
+        }
+        return;
+    }
+    const std::string loop_label = create_label();
+    m_output << "    mov edx, " << begin << "\n";
+    m_output << loop_label << ":\n";
+    gen_scalar_lane(lanes, lanes.size() - 1, 0, true);
+    m_output << "    mov QWORD " << element_address(dest, 0, true) << ", rax\n";
+    m_output << "    inc rdx\n";
+    m_output << "    cmp rdx, " << end << "\n";
+    m_output << "    jb " << loop_label << "\n";
+}
+
+// Leaves element `element` (plus rdx) of `lanes[lane]` in rax.
+void Generator::gen_scalar_lane(const std::vector<Lane>& lanes, const size_t lane, const size_t element, const bool indexed)
+{
+    const auto operand = [&](const Lane& leaf) {
+        if (leaf.kind == Lane::Kind::scalar) {
+            return "QWORD [rsp + " + std::to_string((m_stack_size - leaf.loc - 1) * 8) + "]";
+        }
+        return "QWORD " + element_address(leaf.loc, element, indexed);
     };
+    const Lane& node = lanes[lane];
+    if (node.kind == Lane::Kind::scalar || node.kind == Lane::Kind::array) {
+        m_output << "    mov rax, " << operand(node) << "\n";
+        return;
+    }
+    const char* op = node.kind == Lane::Kind::add ? "add" : node.kind == Lane::Kind::sub ? "sub" : "imul";
+    const Lane& rhs = lanes[node.rhs];
+    if (rhs.kind == Lane::Kind::scalar || rhs.kind == Lane::Kind::array) {
+        gen_scalar_lane(lanes, node.lhs, element, indexed);
+        m_output << "    " << op << " rax, " << operand(rhs) << "\n";
+        return;
+    }
+    gen_scalar_lane(lanes, node.rhs, element, indexed);
+    push("rax");
+    gen_scalar_lane(lanes, node.lhs, element, indexed);
+    pop("rcx");
+    m_output << "    " << op << " rax, rcx\n";
+}
 
-    PredVisitor visitor { .gen = *this, .end_label = end_label };
-    std::visit(visitor, pred->branch);
+// Loads `name[index]`. An index past the end stops the program at `ud2`
+// (SIGILL), as a division by zero stops it with SIGFPE.
+void Generator::gen_index(const IndexNode* index)
+{
+    const std::string& name = index->name.value.value();
+    const auto it = m_array_lengths.find(name);
+    if (it == m_array_lengths.end()) {
+        throw CompileError(m_var_locs.contains(name) ? name + " is a number, not an array" : "Undeclared identifier: " + name);
+    }
+    const size_t loc = m_var_locs.at(name);
+    if (const std::optional<uint64_t> constant = intLiteralValue(index->index)) {
+        if (constant.value() >= it->second) {
+            throw CompileError("Index " + std::to_string(constant.value()) + " is out of range for " + name
+                + ", an array of length " + std::to_string(it->second));
+        }
+        m_output << "    mov rax, QWORD " << element_address(loc, constant.value(), false) << "\n";
+        return;
+    }
+    gen_value(index->index);
+    m_output << "    cmp rax, " << it->second << "\n";
+    m_output << "    jae kei_index_error\n";
+    m_output << "    mov rax, QWORD [rsp + " << (m_stack_size - loc - 1) * 8 << " + rax*8]\n";
+    m_index_checked = true;
 }
 
 void Generator::gen_stmt(const StmtNode* stmt)
@@ -157,6 +1104,12 @@ void Generator::gen_stmt(const StmtNode* stmt)
         {
             gen.m_output << "    ;; exit\n";
             gen.gen_expr(stmt_exit->expr);
+            if (gen.m_options.profile_path.has_value()) {
+                gen.m_output << "    call kei_profile_dump\n";
+            }
+            if (gen.m_prints) {
+                gen.m_output << "    call kei_flush\n";
+            }
             gen.m_output << "    mov rax, 60\n";
             gen.pop("rdi");
             gen.m_output << "    syscall\n";
@@ -166,13 +1119,16 @@ void Generator::gen_stmt(const StmtNode* stmt)
         void operator()(const LetStatementNode* stmt_let) const
         {
             gen.m_output << "    ;; let\n";
-            if (std::find_if(
-                    gen.m_vars.begin(),
-                    gen.m_vars.end(),
-                    [&](const Var& var) { return var.name == stmt_let->ident.value.value(); })
-                != gen.m_vars.end()) {
-                std::cerr << "Identifier already used: " << stmt_let->ident.value.value() << std::endl;
-                exit(EXIT_FAILURE);
+            if (const size_t length = gen.array_length(stmt_let->expr); length != 0) {
+                if (gen.m_var_locs.contains(stmt_let->ident.value.value())) {
+                    throw CompileError("Identifier already used: " + stmt_let->ident.value.value());
+                }
+                gen.gen_array_let(stmt_let->ident.value.value(), stmt_let->expr, length);
+                gen.m_output << "    ;; /let\n";
+                return;
+            }
+            if (!gen.m_var_locs.emplace(stmt_let->ident.value.value(), gen.m_stack_size).second) {
+                throw CompileError("Identifier already used: " + stmt_let->ident.value.value());
             }
             gen.m_vars.push_back({ .name = stmt_let->ident.value.value(), .stack_loc = gen.m_stack_size });
             gen.gen_expr(stmt_let->expr);
@@ -181,16 +1137,26 @@ void Generator::gen_stmt(const StmtNode* stmt)
 
         void operator()(const AssignmentStatementNode* stmt_assign) const
         {
-            const auto it = std::find_if(gen.m_vars.begin(), gen.m_vars.end(), [&](const Var& var) {
-                return var.name == stmt_assign->ident.value.value();
-            });
-            if (it == gen.m_vars.end()) {
-                std::cerr << "Undeclared identifier: " << stmt_assign->ident.value.value() << std::endl;
-                exit(EXIT_FAILURE);
+            const auto it = gen.m_var_locs.find(stmt_assign->ident.value.value());
+            if (it == gen.m_var_locs.end()) {
+                throw CompileError("Undeclared identifier: " + stmt_assign->ident.value.value());
+            }
+            const size_t length = gen.array_length(stmt_assign->expr);
+            if (const auto array = gen.m_array_lengths.find(it->first); array != gen.m_array_lengths.end()) {
+                if (length != array->second) {
+                    throw CompileError("Cannot assign " + (length == 0 ? "a number" : "an array of length " + std::to_string(length))
+                        + " to " + it->first + ", an array of length " + std::to_string(array->second));
+                }
+                // Every operand is read into registers or temporaries before
+                // an element is stored, so `v = w - v` needs no copy.
+                gen.gen_elementwise(stmt_assign->expr, it->second, length);
+                return;
             }
-            gen.gen_expr(stmt_assign->expr);
-            gen.pop("rax");
-            gen.m_output << "    mov [rsp + " << (gen.m_stack_size - it->stack_loc - 1) * 8 << "], rax\n";
+            if (length != 0) {
+                throw CompileError("Cannot assign an array to the number " + it->first);
+            }
+            gen.gen_value(stmt_assign->expr);
+            gen.m_output << "    mov [rsp + " << (gen.m_stack_size - it->second - 1) * 8 << "], rax\n";
         }
 
         void operator()(const ScopeNode* scope) const
@@ -202,45 +1168,319 @@ void Generator::gen_stmt(const StmtNode* stmt)
 
         void operator()(const IfStatementNode* stmt_if) const
         {
-            gen.m_output << "    ;; if\n";
-            gen.gen_expr(stmt_if->condition);
-            gen.pop("rax");
-            const std::string label = gen.create_label();
-            gen.m_output << "    test rax, rax\n";
-            gen.m_output << "    jz " << label << "\n";
-            gen.gen_scope(stmt_if->scope);
-            if (stmt_if->pred.has_value()) {
-                const std::string end_label = gen.create_label();
-                gen.m_output << "    jmp " << end_label << "\n";
-                gen.m_output << label << ":\n";
-                gen.gen_if_pred(stmt_if->pred.value(), end_label);
+            gen.gen_if(stmt_if);
+        }
+
+        void operator()(const WhileStatementNode* stmt_while) const
+        {
+            // Rotated loop: the condition sits at the bottom so each iteration
+            // takes a single branch. Unrolled copies re-test the condition
+            // between bodies with a not-taken exit branch.
+            gen.m_output << "    ;; while\n";
+            const std::string body_label = gen.create_label();
+            const std::string cond_label = gen.create_label();
+            const std::string end_label = stmt_while->unroll > 1 ? gen.create_label() : "";
+            gen.m_output << "    jmp " << cond_label << "\n";
+            gen.m_output << body_label << ":\n";
+            for (unsigned copy = 0; copy < stmt_while->unroll; copy++) {
+                if (copy != 0) {
+                    gen.mark_line(exprLine(stmt_while->condition));
+                    gen.gen_branch(stmt_while->condition, false, end_label);
+                }
+                gen.gen_scope(stmt_while->scope);
+            }
+            gen.m_output << cond_label << ":\n";
+            gen.mark_line(exprLine(stmt_while->condition));
+            gen.gen_branch(stmt_while->condition, true, body_label);
+            if (!end_label.empty()) {
                 gen.m_output << end_label << ":\n";
             }
-            else {
-                gen.m_output << label << ":\n";
+            gen.m_output << "    ;; /while\n";
+        }
+
+        void operator()(const ReturnStatementNode* stmt_return) const
+        {
+            if (!gen.m_in_function) {
+                throw CompileError("`return` outside a function");
             }
-            gen.m_output << "    ;; /if\n";
+            gen.m_output << "    ;; return\n";
+            gen.gen_value(stmt_return->expr);
+            gen.gen_leave();
+            gen.m_output << "    ;; /return\n";
+        }
+
+        void operator()(const PrintStatementNode* stmt_print) const
+        {
+            gen.m_output << "    ;; print\n";
+            gen.gen_value(stmt_print->expr);
+            gen.m_output << "    call kei_print\n";
+            gen.m_output << "    ;; /print\n";
         }
     };
 
+    mark_line(stmtLine(stmt));
+    m_selector.forget();
     StmtVisitor visitor { .gen = *this };
     std::visit(visitor, stmt->statement);
 }
 
 [[nodiscard]] std::string Generator::gen_prog()
 {
-    m_output << "global _start\n_start:\n";
+    if (m_options.source_path.has_value()) {
+        // A sized function symbol lets profilers attribute samples to `_start`.
+        m_output << "global _start:function (_start_end - _start)\n_start:\n";
+    }
+    else {
+        m_output << "global _start\n_start:\n";
+    }
+    if (m_options.avx2) {
+        // rsp starts 16-byte aligned; arrays' slots are placed assuming 32.
+        m_output << "    and rsp, -32\n";
+    }
 
     for (const StmtNode* stmt : m_prog.statements) {
         gen_stmt(stmt);
     }
 
+    if (m_options.profile_path.has_value()) {
+        m_output << "    call kei_profile_dump\n";
+    }
+    if (m_prints) {
+        m_output << "    call kei_flush\n";
+    }
     m_output << "    mov rax, 60\n";
     m_output << "    mov rdi, 0\n";
     m_output << "    syscall\n";
+    if (!m_cold.empty()) {
+        m_output << "    ;; out-of-line arms\n" << m_cold;
+        m_cold.clear();
+    }
+    if (m_options.source_path.has_value()) {
+        m_output << "_start_end:\n";
+    }
+    m_in_function = true;
+    for (const FunctionNode* function : m_prog.functions) {
+        gen_function(function);
+    }
+    if (m_index_checked) {
+        m_output << "kei_index_error:\n";
+        m_output << "    ud2\n";
+    }
+    gen_io_runtime();
+    if (m_options.profile_path.has_value()) {
+        gen_profile_dump();
+    }
+    if (!m_tables.empty()) {
+        m_output << "section .rodata\n";
+        m_output << "align 8\n";
+        m_output << m_tables;
+    }
+    gen_io_data();
     return m_output.str();
 }
 
+// The parameters arrive in registers and are spilled to the frame, where the
+// body reads them like `let`s. A body that falls off its end returns 0.
+void Generator::gen_function(const FunctionNode* function)
+{
+    const std::string label = functionLabel(function->name.value.value());
+    if (m_options.source_path.has_value()) {
+        m_output << "global " << label << ":function (" << label << "_end - " << label << ")\n";
+    }
+    m_output << label << ":\n";
+    m_line = 0;
+    mark_line(function->name.line);
+    m_stack_size = 0;
+    m_vars.clear();
+    m_var_locs.clear();
+    m_array_lengths.clear();
+    m_scopes.clear();
+    for (size_t i = 0; i < function->params.size(); i++) {
+        const std::string& name = function->params[i].value.value();
+        if (!m_var_locs.emplace(name, m_stack_size).second) {
+            throw CompileError("Identifier already used: " + name);
+        }
+        m_vars.push_back({ .name = name, .stack_loc = m_stack_size });
+        push(argRegisters[i]);
+    }
+    gen_scope(function->body);
+    m_output << "    mov rax, 0\n";
+    gen_leave();
+    if (!m_cold.empty()) {
+        m_output << "    ;; out-of-line arms\n" << m_cold;
+        m_cold.clear();
+    }
+    if (m_options.source_path.has_value()) {
+        m_output << label << "_end:\n";
+    }
+}
+
+// `kei_print` appends rax in decimal and a newline to `kei_out_buf`, and
+// `kei_flush` writes the buffer out, when it is nearly full and at every
+// exit; a program stopped by a trap loses what is still buffered. `kei_read`
+// returns the next number on stdin in rax, refilling `kei_in_buf` a buffer
+// at a time. All of them clobber only caller-saved registers.
+void Generator::gen_io_runtime()
+{
+    if (m_prints) {
+        m_output << "kei_flush:\n";
+        m_output << "    mov rdx, [kei_out_len]\n";
+        m_output << "    lea rsi, [kei_out_buf]\n";
+        m_output << "kei_flush_more:\n"; // only after a short write
+        m_output << "    test rdx, rdx\n";
+        m_output << "    jz kei_flush_done\n";
+        m_output << "    mov eax, 1\n"; // write
+        m_output << "    mov edi, 1\n";
+        m_output << "    syscall\n";
+        m_output << "    test rax, rax\n";
+        m_output << "    jle kei_flush_done\n";
+        m_output << "    add rsi, rax\n";
+        m_output << "    sub rdx, rax\n";
+        m_output << "    jmp kei_flush_more\n";
+        m_output << "kei_flush_done:\n";
+        m_output << "    mov QWORD [kei_out_len], 0\n";
+        m_output << "    ret\n";
+        // The digits are written right to left, two at a time from
+        // `kei_digit_pairs`, below rsp in the red zone, then copied as three
+        // qwords: up to 20 digits and the newline fit in 24 bytes.
+        m_output << "kei_print:\n";
+        m_output << "    cmp QWORD [kei_out_len], " << ioBufferSize - 24 << "\n";
+        m_output << "    jbe kei_print_convert\n";
+        m_output << "    push rax\n";
+        m_output << "    call kei_flush\n";
+        m_output << "    pop rax\n";
+        m_output << "kei_print_convert:\n";
+        m_output << "    lea rsi, [rsp - 1]\n";
+        m_output << "    mov BYTE [rsi], 10\n";
+        m_output << "    mov r9, 0x28f5c28f5c28f5c3\n"; // (x >> 2) * r9 >> 66 == x / 100
+        m_output << "kei_print_pairs:\n";
+        m_output << "    cmp rax, 100\n";
+        m_output << "    jb kei_print_last\n";
+        m_output << "    mov rcx, rax\n";
+        m_output << "    shr rax, 2\n";
+        m_output << "    mul r9\n";
+        m_output << "    shr rdx, 2\n";
+        m_output << "    imul r8, rdx, 100\n";
+        m_output << "    sub rcx, r8\n";
+        m_output << "    movzx ecx, WORD [kei_digit_pairs + rcx*2]\n";
+        m_output << "    sub rsi, 2\n";
+        m_output << "    mov [rsi], cx\n";
+        m_output << "    mov rax, rdx\n";
+        m_output << "    jmp kei_print_pairs\n";
+        m_output << "kei_print_last:\n";
+        m_output << "    cmp rax, 10\n";
+        m_output << "    jb kei_print_digit\n";
+        m_output << "    movzx ecx, WORD [kei_digit_pairs + rax*2]\n";
+        m_output << "    sub rsi, 2\n";
+        m_output << "    mov [rsi], cx\n";
+        m_output << "    jmp kei_print_copy\n";
+        m_output << "kei_print_digit:\n";
+        m_output << "    add eax, '0'\n";
+        m_output << "    dec rsi\n";
+        m_output << "    mov [rsi], al\n";
+        m_output << "kei_print_copy:\n";
+        m_output << "    mov rdi, [kei_out_len]\n";
+        m_output << "    mov rdx, [rsi]\n";
+        m_output << "    mov [kei_out_buf + rdi], rdx\n";
+        m_output << "    mov rdx, [rsi + 8]\n";
+        m_output << "    mov [kei_out_buf + rdi + 8], rdx\n";
+        m_output << "    mov rdx, [rsi + 16]\n";
+        m_output << "    mov [kei_out_buf + rdi + 16], rdx\n";
+        m_output << "    lea rdi, [rdi + rsp]\n";
+        m_output << "    sub rdi, rsi\n";
+        m_output << "    mov [kei_out_len], rdi\n";
+        m_output << "    ret\n";
+    }
+    if (m_reads) {
+        // rsi and rdi hold the buffer's read position and end; anything but
+        // a digit separates numbers, and the end of the input reads as 0.
+        m_output << "kei_read:\n";
+        m_output << "    mov rsi, [kei_in_pos]\n";
+        m_output << "    mov rdi, [kei_in_end]\n";
+        m_output << "kei_read_skip:\n";
+        m_output << "    cmp rsi, rdi\n";
+        m_output << "    jb kei_read_skip_byte\n";
+        m_output << "    call kei_refill\n";
+        m_output << "    test rdi, rdi\n";
+        m_output << "    jz kei_read_end\n";
+        m_output << "kei_read_skip_byte:\n";
+        m_output << "    movzx eax, BYTE [kei_in_buf + rsi]\n";
+        m_output << "    inc rsi\n";
+        m_output << "    sub eax, '0'\n";
+        m_output << "    cmp eax, 9\n";
+        m_output << "    ja kei_read_skip\n";
+        m_output << "kei_read_digits:\n";
+        m_output << "    cmp rsi, rdi\n";
+        m_output << "    jb kei_read_digit\n";
+        m_output << "    push rax\n";
+        m_output << "    call kei_refill\n";
+        m_output << "    pop rax\n";
+        m_output << "    test rdi, rdi\n";
+        m_output << "    jz kei_read_done\n";
+        m_output << "kei_read_digit:\n";
+        m_output << "    movzx ecx, BYTE [kei_in_buf + rsi]\n";
+        m_output << "    sub ecx, '0'\n";
+        m_output << "    cmp ecx, 9\n";
+        m_output << "    ja kei_read_done\n";
+        m_output << "    inc rsi\n";
+        m_output << "    imul rax, rax, 10\n";
+        m_output << "    add rax, rcx\n";
+        m_output << "    jmp kei_read_digits\n";
+        m_output << "kei_read_end:\n";
+        m_output << "    xor eax, eax\n";
+        m_output << "kei_read_done:\n";
+        m_output << "    mov [kei_in_pos], rsi\n";
+        m_output << "    mov [kei_in_end], rdi\n";
+        m_output << "    ret\n";
+        // One `read` of up to a whole buffer; rdi is 0 at the end or on error.
+        m_output << "kei_refill:\n";
+        m_output << "    xor eax, eax\n"; // read
+        m_output << "    xor edi, edi\n";
+        m_output << "    lea rsi, [kei_in_buf]\n";
+        m_output << "    mov edx, " << ioBufferSize << "\n";
+        m_output << "    syscall\n";
+        m_output << "    xor esi, esi\n";
+        m_output << "    xor edi, edi\n";
+        m_output << "    test rax, rax\n";
+        m_output << "    cmovg rdi, rax\n";
+        m_output << "    ret\n";
+    }
+}
+
+void Generator::gen_io_data()
+{
+    if (m_prints) {
+        m_output << "section .rodata\n";
+        m_output << "kei_digit_pairs: db \"";
+        for (int pair = 0; pair < 100; pair++) {
+            m_output << static_cast<char>('0' + pair / 10) << static_cast<char>('0' + pair % 10);
+        }
+        m_output << "\"\n";
+    }
+    if (m_prints || m_reads) {
+        m_output << "section .bss\n";
+        m_output << "alignb 64\n";
+    }
+    if (m_prints) {
+        m_output << "kei_out_buf: resb " << ioBufferSize << "\n";
+        m_output << "kei_out_len: resq 1\n";
+    }
+    if (m_reads) {
+        m_output << "kei_in_buf: resb " << ioBufferSize << "\n";
+        m_output << "kei_in_pos: resq 1\n";
+        m_output << "kei_in_end: resq 1\n";
+    }
+}
+
+// Drops the function's whole frame, parameters included, and returns rax.
+void Generator::gen_leave()
+{
+    if (m_stack_size != 0) {
+        m_output << "    add rsp, " << m_stack_size * 8 << "\n";
+    }
+    m_output << "    ret\n";
+}
+
 void Generator::push(const std::string& reg)
 {
     m_output << "    push " << reg << "\n";
@@ -260,17 +1500,102 @@ void Generator::begin_scope()
 
 void Generator::end_scope()
 {
-    const size_t pop_count = m_vars.size() - m_scopes.back();
-    if (pop_count != 0) {
-        m_output << "    add rsp, " << pop_count * 8 << "\n";
+    size_t pop_slots = 0;
+    for (size_t i = m_scopes.back(); i < m_vars.size(); i++) {
+        pop_slots += m_vars[i].slots;
+    }
+    if (pop_slots != 0) {
+        m_output << "    add rsp, " << pop_slots * 8 << "\n";
     }
-    m_stack_size -= pop_count;
-    for (size_t i = 0; i < pop_count; i++) {
+    m_stack_size -= pop_slots;
+    while (m_vars.size() != m_scopes.back()) {
+        m_var_locs.erase(m_vars.back().name);
+        m_array_lengths.erase(m_vars.back().name);
         m_vars.pop_back();
     }
     m_scopes.pop_back();
 }
 
+void Generator::mark_line(const int line)
+{
+    if (!m_options.source_path.has_value() || line <= 0 || line == m_line) {
+        return;
+    }
+    // `+0`: every following assembly line maps to `line` until the next mark.
+    m_output << "%line " << line << "+0 " << m_options.source_path.value() << "\n";
+    m_line = line;
+}
+
+void Generator::count_arm(const size_t counter)
+{
+    if (m_options.profile_path.has_value()) {
+        m_output << "    inc QWORD [kei_profile_counters + " << counter * 8 << "]\n";
+    }
+}
+
+bool Generator::out_of_line(const size_t counter, const size_t last_counter) const
+{
+    if (m_options.branch_counts == nullptr) {
+        return false;
+    }
+    // How often the test ran: the runs that reached this arm or a later one.
+    const std::vector<uint64_t>& counts = *m_options.branch_counts;
+    uint64_t tested = 0;
+    for (size_t i = counter; i <= last_counter; i++) {
+        tested += counts[i];
+    }
+    return counts[counter] < tested - counts[counter] || tested == 0;
+}
+
+// Emits what `emit` writes into the out-of-line area instead of in place.
+// Nested out-of-line arms go there on their own.
+template <typename Emit>
+void Generator::emit_cold(Emit emit)
+{
+    std::stringstream hot;
+    std::swap(hot, m_output);
+    const int line = m_line;
+    m_line = 0;
+    emit();
+    m_cold += m_output.str();
+    std::swap(hot, m_output);
+    m_line = line;
+}
+
+// Appends the header and the counters to the profile file with a single
+// `writev` on an `O_APPEND` descriptor, so concurrent runs add whole records.
+void Generator::gen_profile_dump()
+{
+    m_output << "kei_profile_dump:\n";
+    m_output << "    mov rax, 2\n"; // open
+    m_output << "    lea rdi, [kei_profile_path]\n";
+    m_output << "    mov rsi, 0x441\n"; // O_WRONLY | O_CREAT | O_APPEND
+    m_output << "    mov rdx, 420\n"; // 0644
+    m_output << "    syscall\n";
+    m_output << "    test rax, rax\n";
+    m_output << "    js kei_profile_done\n";
+    m_output << "    mov rdi, rax\n";
+    m_output << "    mov rax, 20\n"; // writev
+    m_output << "    lea rsi, [kei_profile_iov]\n";
+    m_output << "    mov rdx, 2\n";
+    m_output << "    syscall\n";
+    m_output << "    mov rax, 3\n"; // close
+    m_output << "    syscall\n";
+    m_output << "kei_profile_done:\n";
+    m_output << "    ret\n";
+    m_output << "section .data\n";
+    m_output << "kei_profile_header: dq 0x" << std::hex << branchProfileMagic << ", 0x"
+             << m_options.profile_checksum << std::dec << ", " << m_counter_count << "\n";
+    m_output << "kei_profile_iov: dq kei_profile_header, 24, kei_profile_counters, " << m_counter_count * 8 << "\n";
+    m_output << "kei_profile_path: db ";
+    for (const char c : m_options.profile_path.value()) {
+        m_output << static_cast<int>(static_cast<unsigned char>(c)) << ", ";
+    }
+    m_output << "0\n";
+    m_output << "section .bss\n";
+    m_output << "kei_profile_counters: resq " << m_counter_count << "\n";
+}
+
 std::string Generator::create_label()
 {
     std::stringstream ss;
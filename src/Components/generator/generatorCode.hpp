@@ -1,35 +1,156 @@
 #pragma once
 
+#include "instructionSelector.hpp"
+#include "superoptimizer.hpp"
+#include "Components/optimizer/astUtils.hpp"
 #include "Components/syntax/syntaxAnalyzer.hpp"
 #include <algorithm>
 #include <ranges>
+#include <span>
 #include <sstream>
+#include <unordered_map>
+
+struct GeneratorOptions {
+    // Attributes the instructions to the statements' source lines through
+    // nasm `%line` directives, which `nasm -g -F dwarf` turns into `.debug_line`.
+    std::optional<std::string> source_path;
+    // `--instrument`: count the arms taken in every `if` chain and append the
+    // counters to this file at `exit` (see branchProfile.hpp).
+    std::optional<std::string> profile_path;
+    uint64_t profile_checksum = 0; // identifies the source in the profile
+    // `--profile-use`: arm counts from an instrumented run of the same source.
+    // Arms that usually fail their test move out of line, off the fallthrough path.
+    const std::vector<uint64_t>* branch_counts = nullptr;
+    // `--superopt`: small arithmetic expressions take the cheapest sequence
+    // this finds when it beats the selector's code.
+    Superoptimizer* superoptimizer = nullptr;
+    // `-mavx2`: element-wise array arithmetic in 256-bit registers, 4 elements
+    // at a time, instead of SSE2's 128-bit ones.
+    bool avx2 = false;
+};
 
 class Generator {
 private:
     struct Var {
         std::string name;
         size_t stack_loc;
+        size_t slots = 1; // an array's elements and its alignment padding
+    };
+    // A node of an element-wise array expression, with its operands before it.
+    struct Lane {
+        enum class Kind : uint8_t {
+            array, // the elements from slot `loc` down
+            scalar, // the number in slot `loc`, the same for every element
+            add,
+            sub,
+            mul,
+        };
+        Kind kind;
+        size_t loc = 0;
+        size_t lhs = 0;
+        size_t rhs = 0;
+        std::optional<uint64_t> literal {}; // a scalar known at compile time
+    };
+    struct Arm {
+        const ExprNode* condition;
+        const ScopeNode* scope;
+    };
+    // `subject == value` selects `arm`.
+    struct Case {
+        uint64_t value;
+        size_t arm;
     };
     const ProgramNode m_prog;
     std::stringstream m_output;
     size_t m_stack_size = 0;
-    std::vector<Var> m_vars {};
+    std::vector<Var> m_vars {}; // in declaration order, for `end_scope`
+    std::unordered_map<std::string, size_t> m_var_locs {}; // name -> stack_loc
     std::vector<size_t> m_scopes {};
     int m_label_count = 0;
+    GeneratorOptions m_options;
+    int m_line = 0; // last line given to the assembler
+    std::unordered_map<std::string, const FunctionNode*> m_functions {};
+    bool m_in_function = false;
+    std::unordered_map<const IfStatementNode*, size_t> m_chain_counters {}; // first counter of each chain
+    size_t m_counter_count = 0;
+    std::string m_cold {}; // out-of-line arms, placed after the program
+    size_t m_outlined_arms = 0;
+    bool m_profile_ignored = false;
+    std::string m_tables {}; // jump tables, placed in `.rodata` after the code
+    size_t m_jump_tables = 0;
+    size_t m_decision_trees = 0;
+    InstructionSelector m_selector {};
+    std::unordered_map<std::string, size_t> m_array_lengths {}; // arrays in scope -> element count
+    size_t m_elementwise_exprs = 0;
+    size_t m_vectorized_exprs = 0;
+    bool m_index_checked = false; // some index jumps to `kei_index_error`
+    bool m_prints = false; // some statement is a `print`, so every exit flushes the output buffer
+    bool m_reads = false; // some expression calls `kei_read`
     void push(const std::string& reg);
     void pop(const std::string& reg);
     void begin_scope();
     void end_scope();
     std::string create_label();
+    void mark_line(int line);
+    void count_arm(size_t counter);
+    [[nodiscard]] bool out_of_line(size_t counter, size_t last_counter) const;
+    template <typename Emit>
+    void emit_cold(Emit emit);
+    void gen_profile_dump();
+    void gen_io_runtime();
+    void gen_io_data();
+    [[nodiscard]] std::array<std::string, 2> rule_operands(
+        const ExprNode* expr, const Match& match, std::span<const char* const>& registers);
+    void gen_rule(const ExprNode* expr, Goal goal, const std::string& dest);
+    [[nodiscard]] std::string gen_operand(const ExprNode* expr, Goal goal, std::span<const char* const>& registers);
+    [[nodiscard]] const ExprNode* register_operand(const ExprNode* expr, Goal goal);
+    void gen_registers(const Match& match);
+    [[nodiscard]] std::string leaf_text(const ExprNode* expr);
+    [[nodiscard]] std::string variable_text(const std::string& name);
+    [[nodiscard]] bool gen_superoptimized(const ExprNode* expr);
+    void gen_value(const ExprNode* expr);
+    void gen_own(const ExprNode* expr);
+    void gen_compare(const ExprNode* cmp);
+    void gen_comparison(const ExprNode* cmp, BinaryOp op);
+    void gen_truth(const ExprNode* expr);
+    void gen_logical(const BinaryOperands& logic);
+    void gen_branch(const ExprNode* condition, bool when, const std::string& label);
+    void gen_compare_rax(uint64_t value);
+    void gen_decision_tree(std::span<const Case> cases, const std::vector<std::string>& arm_labels,
+        const std::string& default_label);
+    [[nodiscard]] bool gen_switch(const std::vector<Arm>& arms, const ScopeNode* else_scope, size_t first_counter);
+    void gen_leave();
+    [[nodiscard]] size_t array_length(const ExprNode* expr);
+    [[nodiscard]] size_t vector_width() const { return m_options.avx2 ? 4 : 2; }
+    [[nodiscard]] std::string vector_register(size_t index) const;
+    [[nodiscard]] std::string element_address(size_t loc, size_t element, bool indexed) const;
+    void gen_array_let(const std::string& name, const ExprNode* expr, size_t length);
+    void gen_elementwise(const ExprNode* expr, size_t dest, size_t length);
+    size_t build_lanes(const ExprNode* expr, std::vector<Lane>& lanes);
+    [[nodiscard]] bool gen_vector_lanes(const std::vector<Lane>& lanes, size_t dest, size_t end);
+    size_t gen_vector_lane(const std::vector<Lane>& lanes, size_t lane, size_t next, size_t element, bool indexed);
+    void gen_vector_mul(size_t result, size_t lhs, size_t rhs, const std::optional<uint64_t>& constant);
+    void gen_scalar_lanes(const std::vector<Lane>& lanes, size_t dest, size_t begin, size_t end);
+    void gen_scalar_lane(const std::vector<Lane>& lanes, size_t lane, size_t element, bool indexed);
+    void gen_index(const IndexNode* index);
 
 public:
-    explicit Generator(ProgramNode prog);
-    void gen_term(const TermNode* term);
-    void gen_bin_expr(const BinaryExpressionNode* bin_expr);
+    explicit Generator(ProgramNode prog, GeneratorOptions options = {});
+    void gen_call(const CallNode* call);
     void gen_expr(const ExprNode* expr);
     void gen_scope(const ScopeNode* scope);
-    void gen_if_pred(const ElseIfNode* pred, const std::string& end_label);
+    void gen_if(const IfStatementNode* stmt_if);
     void gen_stmt(const StmtNode* stmt);
+    void gen_function(const FunctionNode* function);
     [[nodiscard]] std::string gen_prog();
+    // Arms `gen_prog` moved out of line because of the profile.
+    [[nodiscard]] size_t outlined_arms() const { return m_outlined_arms; }
+    // The profile's counters did not fit this program and were not used.
+    [[nodiscard]] bool profile_ignored() const { return m_profile_ignored; }
+    // `if` chains `gen_prog` lowered to a jump table or a decision tree.
+    [[nodiscard]] size_t jump_tables() const { return m_jump_tables; }
+    [[nodiscard]] size_t decision_trees() const { return m_decision_trees; }
+    // Element-wise array expressions, and those computed in vector registers.
+    [[nodiscard]] size_t elementwise_exprs() const { return m_elementwise_exprs; }
+    [[nodiscard]] size_t vectorized_exprs() const { return m_vectorized_exprs; }
 };
\ No newline at end of file
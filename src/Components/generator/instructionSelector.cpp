@@ -0,0 +1,232 @@
+#include "instructionSelector.hpp"
+#include <bit>
+#include <limits>
+
+namespace {
+constexpr uint32_t unreachable = std::numeric_limits<uint32_t>::max();
+
+// Costs are encoded bytes, taking a variable's slot as `[rsp + disp8]`. Ties
+// go to the rule listed first. A rule reads at most one register operand on
+// each side.
+constexpr Rule rules[] = {
+    // Leaves.
+    { Goal::imm8, Shape::literal, Goal::none, Goal::none, Guard::simm8, 0, "$0" },
+    { Goal::imm, Shape::literal, Goal::none, Goal::none, Guard::simm32, 0, "$0" },
+    { Goal::mem, Shape::variable, Goal::none, Goal::none, Guard::none, 0, "$0" },
+    { Goal::reg, Shape::literal, Goal::none, Goal::none, Guard::zero, 2, "xor $e, $e" },
+    { Goal::reg, Shape::literal, Goal::none, Goal::none, Guard::u32, 5, "mov $e, $0" },
+    { Goal::reg, Shape::literal, Goal::none, Goal::none, Guard::simm32, 7, "mov $d, $0" },
+    { Goal::reg, Shape::literal, Goal::none, Goal::none, Guard::none, 10, "mov $d, $0" },
+    { Goal::reg, Shape::chain, Goal::mem, Goal::none, Guard::none, 5, "mov $d, $0" },
+
+    // Addresses: `lea` adds a base to a scaled index without touching the
+    // flags, and multiplies by 3, 5 or 9 as `x + x*2`, `x + x*4`, `x + x*8`.
+    { Goal::scaled, Shape::mul, Goal::reg, Goal::none, Guard::scale, 0, "$0*$k" },
+    { Goal::reg, Shape::add, Goal::reg, Goal::scaled, Guard::none, 4, "lea rax, [rax + $1]" },
+    { Goal::reg, Shape::add, Goal::scaled, Goal::imm, Guard::none, 8, "lea rax, [$0 + $1]" },
+    { Goal::reg, Shape::mul, Goal::reg, Goal::none, Guard::leaScale, 4, "lea rax, [rax + rax*$k]" },
+
+    { Goal::reg, Shape::add, Goal::reg, Goal::imm8, Guard::none, 4, "add rax, $1" },
+    { Goal::reg, Shape::add, Goal::reg, Goal::imm, Guard::none, 6, "add rax, $1" },
+    { Goal::reg, Shape::add, Goal::reg, Goal::mem, Guard::none, 5, "add rax, $1" },
+    { Goal::reg, Shape::add, Goal::reg, Goal::reg, Guard::none, 3, "add rax, rcx" },
+
+    { Goal::reg, Shape::sub, Goal::reg, Goal::imm8, Guard::none, 4, "sub rax, $1" },
+    { Goal::reg, Shape::sub, Goal::reg, Goal::imm, Guard::none, 6, "sub rax, $1" },
+    { Goal::reg, Shape::sub, Goal::reg, Goal::mem, Guard::none, 5, "sub rax, $1" },
+    { Goal::reg, Shape::sub, Goal::imm8, Goal::reg, Guard::none, 7, "neg rax\nadd rax, $0" },
+    { Goal::reg, Shape::sub, Goal::imm, Goal::reg, Guard::none, 9, "neg rax\nadd rax, $0" },
+    { Goal::reg, Shape::sub, Goal::reg, Goal::reg, Guard::none, 3, "sub rax, rcx" },
+
+    // The low 64 bits of a product are the same signed or unsigned, so the
+    // immediate and memory forms of `imul` serve.
+    { Goal::reg, Shape::mul, Goal::reg, Goal::none, Guard::pow2, 4, "shl rax, $k" },
+    { Goal::reg, Shape::mul, Goal::reg, Goal::imm8, Guard::none, 4, "imul rax, rax, $1" },
+    { Goal::reg, Shape::mul, Goal::reg, Goal::imm, Guard::none, 7, "imul rax, rax, $1" },
+    { Goal::reg, Shape::mul, Goal::mem, Goal::imm8, Guard::none, 6, "imul rax, $0, $1" },
+    { Goal::reg, Shape::mul, Goal::mem, Goal::imm, Guard::none, 9, "imul rax, $0, $1" },
+    { Goal::reg, Shape::mul, Goal::reg, Goal::mem, Guard::none, 6, "imul rax, $1" },
+    { Goal::reg, Shape::mul, Goal::reg, Goal::reg, Guard::none, 4, "imul rax, rcx" },
+
+    // No memory form for `div`: loading the divisor first measured faster.
+    { Goal::reg, Shape::div, Goal::reg, Goal::none, Guard::pow2, 4, "shr rax, $k" },
+    { Goal::reg, Shape::div, Goal::reg, Goal::reg, Guard::none, 5, "xor edx, edx\ndiv rcx" },
+
+    // Against zero, `test` leaves the flags every unsigned condition needs.
+    { Goal::cond, Shape::compare, Goal::reg, Goal::none, Guard::zero, 3, "test rax, rax" },
+    { Goal::cond, Shape::compare, Goal::reg, Goal::imm8, Guard::none, 4, "cmp rax, $1" },
+    { Goal::cond, Shape::compare, Goal::reg, Goal::imm, Guard::none, 6, "cmp rax, $1" },
+    { Goal::cond, Shape::compare, Goal::mem, Goal::imm8, Guard::none, 5, "cmp $0, $1" },
+    { Goal::cond, Shape::compare, Goal::mem, Goal::imm, Guard::none, 8, "cmp $0, $1" },
+    { Goal::cond, Shape::compare, Goal::reg, Goal::mem, Guard::none, 5, "cmp rax, $1" },
+    { Goal::cond, Shape::compare, Goal::mem, Goal::reg, Guard::none, 5, "cmp $0, rax" },
+    { Goal::cond, Shape::compare, Goal::reg, Goal::reg, Guard::none, 3, "cmp rax, rcx" },
+
+    { Goal::reg, Shape::compare, Goal::none, Goal::none, Guard::none, 16, nullptr },
+    { Goal::reg, Shape::other, Goal::none, Goal::none, Guard::none, 16, nullptr },
+};
+static_assert(std::size(rules) <= std::numeric_limits<uint8_t>::max());
+
+bool commutative(const Shape shape)
+{
+    return shape == Shape::add || shape == Shape::mul;
+}
+
+// Whether `guard` holds for an operand of value `literal`, if it is a
+// literal, and its parameter.
+bool guardHolds(const Guard guard, const std::optional<uint64_t>& literal, uint64_t& param)
+{
+    if (guard == Guard::none) {
+        return true;
+    }
+    if (!literal.has_value()) {
+        return false;
+    }
+    const uint64_t value = literal.value();
+    switch (guard) {
+    case Guard::none:
+        return true;
+    case Guard::zero:
+        return value == 0;
+    case Guard::simm8:
+        return value <= INT8_MAX || value >= static_cast<uint64_t>(INT8_MIN);
+    case Guard::simm32:
+        return value <= INT32_MAX || value >= static_cast<uint64_t>(INT32_MIN);
+    case Guard::u32:
+        return value <= UINT32_MAX;
+    case Guard::pow2:
+        param = std::countr_zero(value);
+        return std::has_single_bit(value);
+    case Guard::scale:
+        param = value;
+        return value == 2 || value == 4 || value == 8;
+    case Guard::leaScale:
+        param = value - 1;
+        return value == 3 || value == 5 || value == 9;
+    }
+    return false;
+}
+}
+
+Shape shapeOf(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        switch (binaryOperands(*bin).op) {
+        case BinaryOp::add:
+            return Shape::add;
+        case BinaryOp::sub:
+            return Shape::sub;
+        case BinaryOp::mul:
+            return Shape::mul;
+        case BinaryOp::div:
+            return Shape::div;
+        case BinaryOp::logical_and:
+        case BinaryOp::logical_or:
+            return Shape::other;
+        default:
+            return Shape::compare;
+        }
+    }
+    const TermNode* term = std::get<TermNode*>(expr->expression);
+    if (std::holds_alternative<IntLiteralNode*>(term->term)) {
+        return Shape::literal;
+    }
+    return std::holds_alternative<IdentifierNode*>(term->term) ? Shape::variable : Shape::other;
+}
+
+std::string immediateText(const uint64_t value)
+{
+    if (value >= static_cast<uint64_t>(INT32_MIN)) {
+        return std::to_string(static_cast<int64_t>(value));
+    }
+    return std::to_string(value);
+}
+
+Match InstructionSelector::select(const ExprNode* expr, const Goal goal)
+{
+    expr = unwrapParens(expr);
+    const Label& labels = label(expr);
+    const auto g = static_cast<size_t>(goal);
+    if (labels.cost[g] == unreachable) {
+        return { nullptr, nullptr, nullptr, false, 0 };
+    }
+    const Rule& rule = rules[labels.rule[g]];
+    Match match { &rule, nullptr, nullptr, false, 0 };
+    const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression);
+    if (bin != nullptr && rule.shape != Shape::chain && rule.shape != Shape::other) {
+        const BinaryOperands operands = binaryOperands(*bin);
+        match.swapped = (labels.swapped >> g) & 1;
+        match.lhs = match.swapped ? operands.rhs : operands.lhs;
+        match.rhs = match.swapped ? operands.lhs : operands.rhs;
+    }
+    guardHolds(rule.guard, match.rhs != nullptr ? label(unwrapParens(match.rhs)).literal : labels.literal, match.param);
+    return match;
+}
+
+uint32_t InstructionSelector::cost(const ExprNode* expr, const Goal goal)
+{
+    return label(unwrapParens(expr)).cost[static_cast<size_t>(goal)];
+}
+
+const InstructionSelector::Label& InstructionSelector::label(const ExprNode* expr)
+{
+    if (const auto it = m_labels.find(expr); it != m_labels.end()) {
+        return it->second;
+    }
+    Label labels;
+    labels.cost.fill(unreachable);
+    labels.rule.fill(0);
+    const Shape shape = shapeOf(expr);
+    if (shape == Shape::literal) {
+        labels.literal = intLiteralValue(expr);
+    }
+    const Label* operands[2] = { nullptr, nullptr };
+    // Calls and `&&`/`||` are labelled when the generator reaches their operands.
+    const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression);
+    if (bin != nullptr && shape != Shape::other) {
+        const BinaryOperands binary = binaryOperands(*bin);
+        operands[0] = &label(unwrapParens(binary.lhs));
+        operands[1] = &label(unwrapParens(binary.rhs));
+    }
+    const auto operandCost = [&](const Label* operand, const Goal goal) -> uint32_t {
+        return goal == Goal::none ? 0 : operand->cost[static_cast<size_t>(goal)];
+    };
+    const auto consider = [&](const size_t index, const uint32_t cost, const bool swapped) {
+        const auto g = static_cast<size_t>(rules[index].goal);
+        if (cost < labels.cost[g]) {
+            labels.cost[g] = cost;
+            labels.rule[g] = static_cast<uint8_t>(index);
+            labels.swapped = static_cast<uint8_t>((labels.swapped & ~(1u << g)) | (swapped ? 1u << g : 0));
+        }
+    };
+    for (size_t i = 0; i < std::size(rules); i++) {
+        const Rule& rule = rules[i];
+        if (rule.shape != shape) {
+            continue;
+        }
+        for (const bool swapped : { false, true }) {
+            if (swapped && !commutative(shape)) {
+                break;
+            }
+            const Label* lhs = operands[swapped ? 1 : 0];
+            const Label* rhs = operands[swapped ? 0 : 1];
+            uint64_t param = 0;
+            if (!guardHolds(rule.guard, rhs != nullptr ? rhs->literal : labels.literal, param)) {
+                continue;
+            }
+            const uint32_t lhs_cost = operandCost(lhs, rule.lhs);
+            const uint32_t rhs_cost = operandCost(rhs, rule.rhs);
+            if (lhs_cost != unreachable && rhs_cost != unreachable) {
+                consider(i, rule.cost + lhs_cost + rhs_cost, swapped);
+            }
+        }
+    }
+    for (size_t i = 0; i < std::size(rules); i++) {
+        const Rule& rule = rules[i];
+        if (rule.shape == Shape::chain && labels.cost[static_cast<size_t>(rule.lhs)] != unreachable) {
+            consider(i, rule.cost + labels.cost[static_cast<size_t>(rule.lhs)], false);
+        }
+    }
+    return m_labels.emplace(expr, labels).first->second;
+}
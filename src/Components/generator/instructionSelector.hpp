@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Components/optimizer/astUtils.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+// Instruction selection for expression trees by bottom-up rewriting (BURS).
+// Each node is labelled, children first, with the cheapest way to produce it
+// as each goal: a value in a register, the flags of a comparison, or an
+// operand an instruction can take directly (an immediate, a variable's stack
+// slot, a scaled index for `lea`). The generator then walks the chosen rules
+// from the root down and expands their code.
+//
+// The rules are a table in instructionSelector.cpp. A rule matches a node by
+// its shape and its operands' goals, optionally guarded by the value of the
+// literal it reads, and costs the bytes its code encodes to.
+
+enum class Goal : uint8_t {
+    reg, // in rax, or in the register the caller names for a leaf
+    cond, // the flags of `cmp lhs, rhs`
+    imm8, // a literal that fits a sign-extended 8-bit immediate
+    imm, // a literal that fits a sign-extended 32-bit immediate
+    mem, // a variable's stack slot
+    scaled, // `reg*2`, `reg*4` or `reg*8`, the index of an address
+    none, // no operand
+};
+
+enum class Shape : uint8_t {
+    literal,
+    variable,
+    add,
+    sub,
+    mul,
+    div,
+    compare,
+    other, // calls and `&&`/`||`, which the generator lowers itself
+    chain, // a rule that turns one goal of a node into another
+};
+
+enum class Guard : uint8_t {
+    none,
+    zero,
+    simm8,
+    simm32,
+    u32,
+    pow2, // the parameter is the exponent
+    scale, // 2, 4 or 8; the parameter is the value
+    leaScale, // 3, 5 or 9; the parameter is the value less one
+};
+
+// `code` is one instruction per line, or for an operand goal the operand's
+// text, with `$0`/`$1` for the operands (for a leaf, `$0` is the leaf
+// itself), `$d`/`$e` for the 64/32-bit destination register and `$k` for the
+// guard's parameter. Register operands are in rax and, for a second one, rcx.
+// A null `code` leaves the node to the generator's own lowering.
+struct Rule {
+    Goal goal;
+    Shape shape;
+    Goal lhs;
+    Goal rhs;
+    Guard guard; // on the literal the rule reads: the node for a leaf, else `rhs`
+    uint8_t cost;
+    const char* code;
+};
+
+struct Match {
+    const Rule* rule;
+    const ExprNode* lhs; // the operands in the rule's order, which for `+`
+    const ExprNode* rhs; // and `*` may be swapped
+    bool swapped;
+    uint64_t param;
+};
+
+[[nodiscard]] Shape shapeOf(const ExprNode* expr);
+// `value` as an assembler immediate: negative when it is a sign-extended
+// 32-bit one.
+[[nodiscard]] std::string immediateText(uint64_t value);
+
+class InstructionSelector {
+public:
+    // The cheapest rule producing `goal` for `expr`, or a null `rule` when no
+    // rule can.
+    [[nodiscard]] Match select(const ExprNode* expr, Goal goal);
+    // The bytes the code of that rule and its operands' rules encodes to.
+    [[nodiscard]] uint32_t cost(const ExprNode* expr, Goal goal);
+    // Drops the labels computed so far, which are kept for the nodes a later
+    // `select` reaches again.
+    void forget() { m_labels.clear(); }
+
+private:
+    static constexpr size_t goalCount = static_cast<size_t>(Goal::none);
+    struct Label {
+        std::array<uint32_t, goalCount> cost;
+        std::array<uint8_t, goalCount> rule;
+        uint8_t swapped = 0; // a bit per goal
+        std::optional<uint64_t> literal {}; // the value of a literal leaf
+    };
+    const Label& label(const ExprNode* expr);
+    std::unordered_map<const ExprNode*, Label> m_labels {};
+};
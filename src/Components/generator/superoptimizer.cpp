@@ -0,0 +1,652 @@
+#include "superoptimizer.hpp"
+#include "instructionSelector.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <queue>
+
+namespace {
+constexpr std::string_view memoMagic = "kei-superopt 1\n";
+constexpr size_t registerCount = 3;
+constexpr std::array<const char*, registerCount> registerNames { "rax", "rcx", "rdx" };
+constexpr std::array<const char*, registerCount> registerNames32 { "eax", "ecx", "edx" };
+// Inputs every candidate runs on while searching; its registers on them are
+// its fingerprint.
+constexpr size_t testCount = 4;
+constexpr size_t randomChecks = 256;
+// Width of the exhaustive check, by the number of variables.
+constexpr std::array<unsigned, Superoptimizer::maxInputs + 1> exhaustiveBits { 0, 16, 8, 5 };
+// No instruction that writes rax costs less.
+constexpr uint32_t minInstructionCost = 2;
+
+// The expression in postfix order. A division by `2^k` is a single `shr`
+// step on its dividend.
+enum class Op : uint8_t {
+    literal,
+    input,
+    add,
+    sub,
+    mul,
+    shr,
+};
+
+struct Step {
+    Op op;
+    uint64_t value; // the literal, the input's index or the shift
+};
+
+struct Flat {
+    std::vector<Step> steps {};
+    size_t nodes = 0;
+    std::string key {};
+};
+
+enum class Kind : uint8_t {
+    movMem,
+    movImm,
+    movReg,
+    addReg,
+    addMem,
+    addImm,
+    subReg,
+    subMem,
+    imulReg,
+    imulMem,
+    imulImm, // dst = src * imm
+    imulMemImm,
+    lea, // dst = src + index * scale
+    leaDisp, // dst = src + imm
+    shl,
+    shr,
+    neg,
+};
+
+struct Instr {
+    Kind kind;
+    uint8_t dst;
+    uint8_t src; // a register, or for the memory forms an input
+    uint8_t index;
+    uint8_t scale;
+    uint64_t imm;
+};
+
+bool simm8(const uint64_t value)
+{
+    return value <= INT8_MAX || value >= static_cast<uint64_t>(INT8_MIN);
+}
+
+bool simm32(const uint64_t value)
+{
+    return value <= INT32_MAX || value >= static_cast<uint64_t>(INT32_MIN);
+}
+
+uint64_t splitmix64(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+bool flatten(const ExprNode* expr, Flat& flat, std::vector<const IdentifierNode*>& inputs)
+{
+    expr = unwrapParens(expr);
+    if (++flat.nodes > Superoptimizer::maxExprNodes) {
+        return false;
+    }
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        if (op == BinaryOp::div) {
+            const std::optional<uint64_t> divisor = intLiteralValue(rhs);
+            if (!divisor.has_value() || !std::has_single_bit(divisor.value()) || !flatten(lhs, flat, inputs)
+                || ++flat.nodes > Superoptimizer::maxExprNodes) {
+                return false;
+            }
+            flat.steps.push_back({ Op::shr, static_cast<uint64_t>(std::countr_zero(divisor.value())) });
+            flat.key += std::to_string(divisor.value()) + " / ";
+            return true;
+        }
+        if (op != BinaryOp::add && op != BinaryOp::sub && op != BinaryOp::mul) {
+            return false;
+        }
+        if (!flatten(lhs, flat, inputs) || !flatten(rhs, flat, inputs)) {
+            return false;
+        }
+        flat.steps.push_back({ op == BinaryOp::add ? Op::add : op == BinaryOp::sub ? Op::sub : Op::mul, 0 });
+        flat.key += binaryOpText(op);
+        flat.key += ' ';
+        return true;
+    }
+    if (const std::optional<uint64_t> value = intLiteralValue(expr)) {
+        flat.steps.push_back({ Op::literal, value.value() });
+        flat.key += std::to_string(value.value()) + " ";
+        return true;
+    }
+    const IdentifierNode* ident = identifierOf(expr);
+    if (ident == nullptr) {
+        return false; // a call, or a literal out of range
+    }
+    const auto it = std::ranges::find_if(inputs, [&](const IdentifierNode* input) {
+        return input->ident.value == ident->ident.value;
+    });
+    const size_t index = static_cast<size_t>(it - inputs.begin());
+    if (it == inputs.end()) {
+        if (inputs.size() == Superoptimizer::maxInputs) {
+            return false;
+        }
+        inputs.push_back(ident);
+    }
+    flat.steps.push_back({ Op::input, index });
+    flat.key += "$" + std::to_string(index) + " ";
+    return true;
+}
+
+// The expression on `inputs` in arithmetic of the width `mask` covers.
+uint64_t evaluate(const std::vector<Step>& steps, const uint64_t* inputs, const uint64_t mask)
+{
+    std::array<uint64_t, Superoptimizer::maxExprNodes> stack {};
+    size_t top = 0;
+    for (const Step& step : steps) {
+        switch (step.op) {
+        case Op::literal:
+            stack[top++] = step.value & mask;
+            break;
+        case Op::input:
+            stack[top++] = inputs[step.value];
+            break;
+        case Op::shr:
+            stack[top - 1] >>= step.value;
+            break;
+        case Op::add:
+        case Op::sub:
+        case Op::mul: {
+            const uint64_t rhs = stack[--top];
+            uint64_t& lhs = stack[top - 1];
+            lhs = (step.op == Op::add ? lhs + rhs : step.op == Op::sub ? lhs - rhs : lhs * rhs) & mask;
+            break;
+        }
+        }
+    }
+    return stack[0];
+}
+
+void execute(const Instr& instr, uint64_t* regs, const uint64_t* inputs, const uint64_t mask)
+{
+    const uint64_t imm = instr.imm & mask;
+    uint64_t& dst = regs[instr.dst];
+    switch (instr.kind) {
+    case Kind::movMem:
+        dst = inputs[instr.src];
+        break;
+    case Kind::movImm:
+        dst = imm;
+        break;
+    case Kind::movReg:
+        dst = regs[instr.src];
+        break;
+    case Kind::addReg:
+        dst += regs[instr.src];
+        break;
+    case Kind::addMem:
+        dst += inputs[instr.src];
+        break;
+    case Kind::addImm:
+        dst += imm;
+        break;
+    case Kind::subReg:
+        dst -= regs[instr.src];
+        break;
+    case Kind::subMem:
+        dst -= inputs[instr.src];
+        break;
+    case Kind::imulReg:
+        dst *= regs[instr.src];
+        break;
+    case Kind::imulMem:
+        dst *= inputs[instr.src];
+        break;
+    case Kind::imulImm:
+        dst = regs[instr.src] * imm;
+        break;
+    case Kind::imulMemImm:
+        dst = inputs[instr.src] * imm;
+        break;
+    case Kind::lea:
+        dst = regs[instr.src] + regs[instr.index] * instr.scale;
+        break;
+    case Kind::leaDisp:
+        dst = regs[instr.src] + imm;
+        break;
+    case Kind::shl:
+        dst <<= instr.imm;
+        break;
+    case Kind::shr:
+        dst >>= instr.imm;
+        break;
+    case Kind::neg:
+        dst = 0 - dst;
+        break;
+    }
+    dst &= mask;
+}
+
+// Encoded bytes, in the instruction selector's model: a variable is
+// `[rsp + disp8]`.
+uint32_t encodedSize(const Instr& instr)
+{
+    switch (instr.kind) {
+    case Kind::movMem:
+    case Kind::addMem:
+    case Kind::subMem:
+        return 5;
+    case Kind::movImm:
+        return instr.imm == 0 ? 2 : instr.imm <= UINT32_MAX ? 5 : simm32(instr.imm) ? 7 : 10;
+    case Kind::movReg:
+    case Kind::addReg:
+    case Kind::subReg:
+    case Kind::neg:
+        return 3;
+    case Kind::addImm:
+        return simm8(instr.imm) ? 4 : instr.dst == 0 ? 6 : 7;
+    case Kind::imulReg:
+    case Kind::lea:
+        return 4;
+    case Kind::imulMem:
+        return 6;
+    case Kind::imulImm:
+        return simm8(instr.imm) ? 4 : 7;
+    case Kind::imulMemImm:
+        return simm8(instr.imm) ? 6 : 9;
+    case Kind::leaDisp:
+        return simm8(instr.imm) ? 4 : 7;
+    case Kind::shl:
+    case Kind::shr:
+        return instr.imm == 1 ? 3 : 4;
+    }
+    return 0;
+}
+
+std::string instrText(const Instr& instr)
+{
+    const std::string dst = registerNames[instr.dst];
+    const std::string src = registerNames[instr.src];
+    const std::string mem = "$" + std::to_string(instr.src);
+    switch (instr.kind) {
+    case Kind::movMem:
+        return "mov " + dst + ", " + mem;
+    case Kind::movImm:
+        if (instr.imm == 0) {
+            return "xor " + std::string(registerNames32[instr.dst]) + ", " + registerNames32[instr.dst];
+        }
+        if (instr.imm <= UINT32_MAX) {
+            return "mov " + std::string(registerNames32[instr.dst]) + ", " + std::to_string(instr.imm);
+        }
+        return "mov " + dst + ", " + immediateText(instr.imm);
+    case Kind::movReg:
+        return "mov " + dst + ", " + src;
+    case Kind::addReg:
+        return "add " + dst + ", " + src;
+    case Kind::addMem:
+        return "add " + dst + ", " + mem;
+    case Kind::addImm:
+        return "add " + dst + ", " + immediateText(instr.imm);
+    case Kind::subReg:
+        return "sub " + dst + ", " + src;
+    case Kind::subMem:
+        return "sub " + dst + ", " + mem;
+    case Kind::imulReg:
+        return "imul " + dst + ", " + src;
+    case Kind::imulMem:
+        return "imul " + dst + ", " + mem;
+    case Kind::imulImm:
+        return "imul " + dst + ", " + src + ", " + immediateText(instr.imm);
+    case Kind::imulMemImm:
+        return "imul " + dst + ", " + mem + ", " + immediateText(instr.imm);
+    case Kind::lea:
+        return "lea " + dst + ", [" + src + " + " + registerNames[instr.index]
+            + (instr.scale == 1 ? "" : "*" + std::to_string(instr.scale)) + "]";
+    case Kind::leaDisp:
+        if (instr.imm >= static_cast<uint64_t>(INT32_MIN)) {
+            return "lea " + dst + ", [" + src + " - " + std::to_string(0 - instr.imm) + "]";
+        }
+        return "lea " + dst + ", [" + src + " + " + std::to_string(instr.imm) + "]";
+    case Kind::shl:
+        return "shl " + dst + ", " + std::to_string(instr.imm);
+    case Kind::shr:
+        return "shr " + dst + ", " + std::to_string(instr.imm);
+    case Kind::neg:
+        return "neg " + dst;
+    }
+    return {};
+}
+
+uint64_t mix(uint64_t h, const uint64_t value)
+{
+    h = (h ^ value) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+class Search {
+public:
+    Search(const Flat& flat, const size_t input_count)
+        : m_flat(flat)
+        , m_input_count(input_count)
+    {
+        uint64_t seed = 0x73757065726f7074ULL;
+        for (size_t t = 0; t < testCount; t++) {
+            for (size_t i = 0; i < input_count; i++) {
+                m_tests[t][i] = splitmix64(seed);
+            }
+            m_targets[t] = evaluate(flat.steps, m_tests[t].data(), UINT64_MAX);
+        }
+        // Immediates come from the expression's literals and their
+        // negations, shift counts from its powers of two.
+        for (const Step& step : flat.steps) {
+            if (step.op == Op::literal) {
+                for (const uint64_t value : { step.value, 0 - step.value }) {
+                    if (std::ranges::find(m_constants, value) == m_constants.end()) {
+                        m_constants.push_back(value);
+                    }
+                }
+            }
+            const uint64_t shift = step.op == Op::shr ? step.value
+                : step.op == Op::literal && std::has_single_bit(step.value) ? std::countr_zero(step.value)
+                                                                            : 0;
+            if (shift != 0 && std::ranges::find(m_shifts, shift) == m_shifts.end()) {
+                m_shifts.push_back(shift);
+            }
+        }
+    }
+
+    // The cheapest sequence costing less than `bound` that passes `verify`.
+    std::optional<std::vector<Instr>> run(uint32_t bound)
+    {
+        std::optional<std::vector<Instr>> best;
+        m_nodes.push_back({ UINT32_MAX, 0, 0, {} });
+        using Entry = std::pair<uint32_t, uint32_t>; // cost, node
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+        queue.emplace(0, 0);
+        size_t expansions = 0;
+        while (!queue.empty() && expansions < Superoptimizer::maxExpansions) {
+            const auto [cost, index] = queue.top();
+            queue.pop();
+            if (cost + minInstructionCost >= bound) {
+                break;
+            }
+            const Node node = m_nodes[index];
+            if (const auto it = m_seen.find(node.fingerprint); it != m_seen.end() && it->second < cost) {
+                continue; // reached more cheaply since
+            }
+            expansions++;
+            const std::vector<Instr> sequence = sequenceOf(index);
+            std::array<std::array<uint64_t, registerCount>, testCount> regs {};
+            for (size_t t = 0; t < testCount; t++) {
+                for (const Instr& instr : sequence) {
+                    execute(instr, regs[t].data(), m_tests[t].data(), UINT64_MAX);
+                }
+            }
+            uint8_t defined = 0;
+            for (const Instr& instr : sequence) {
+                defined |= 1 << instr.dst;
+            }
+            successors(defined, [&](const Instr& instr) {
+                const uint32_t next_cost = cost + encodedSize(instr);
+                if (next_cost >= bound) {
+                    return;
+                }
+                auto next = regs;
+                bool reaches = true;
+                for (size_t t = 0; t < testCount; t++) {
+                    execute(instr, next[t].data(), m_tests[t].data(), UINT64_MAX);
+                    reaches = reaches && next[t][0] == m_targets[t];
+                }
+                const uint8_t next_defined = defined | (1 << instr.dst);
+                if (reaches && (next_defined & 1) != 0) {
+                    std::vector<Instr> candidate = sequence;
+                    candidate.push_back(instr);
+                    if (verify(candidate)) {
+                        best = std::move(candidate);
+                        bound = next_cost;
+                        return;
+                    }
+                }
+                if (next_cost + minInstructionCost >= bound) {
+                    return;
+                }
+                uint64_t fingerprint = next_defined;
+                for (size_t t = 0; t < testCount; t++) {
+                    for (size_t r = 0; r < registerCount; r++) {
+                        fingerprint = mix(fingerprint, (next_defined >> r) & 1 ? next[t][r] : 0);
+                    }
+                }
+                const auto [it, inserted] = m_seen.try_emplace(fingerprint, next_cost);
+                if (!inserted && it->second <= next_cost) {
+                    return;
+                }
+                it->second = next_cost;
+                queue.emplace(next_cost, static_cast<uint32_t>(m_nodes.size()));
+                m_nodes.push_back({ index, next_cost, fingerprint, instr });
+            });
+        }
+        return best;
+    }
+
+private:
+    struct Node {
+        uint32_t parent;
+        uint32_t cost;
+        uint64_t fingerprint;
+        Instr instr;
+    };
+
+    std::vector<Instr> sequenceOf(uint32_t index) const
+    {
+        std::vector<Instr> sequence;
+        for (; m_nodes[index].parent != UINT32_MAX; index = m_nodes[index].parent) {
+            sequence.push_back(m_nodes[index].instr);
+        }
+        std::ranges::reverse(sequence);
+        return sequence;
+    }
+
+    // Calls `fn` on every instruction that reads only the registers in
+    // `defined`, skipping forms another one already covers.
+    template <typename Fn>
+    void successors(const uint8_t defined, Fn fn) const
+    {
+        const auto is_defined = [&](const size_t reg) { return ((defined >> reg) & 1) != 0; };
+        for (uint8_t d = 0; d < registerCount; d++) {
+            for (uint8_t i = 0; i < m_input_count; i++) {
+                fn({ Kind::movMem, d, i, 0, 0, 0 });
+                for (const uint64_t c : m_constants) {
+                    if (simm32(c) && c > 1) {
+                        fn({ Kind::imulMemImm, d, i, 0, 0, c });
+                    }
+                }
+                if (is_defined(d)) {
+                    fn({ Kind::addMem, d, i, 0, 0, 0 });
+                    fn({ Kind::subMem, d, i, 0, 0, 0 });
+                    fn({ Kind::imulMem, d, i, 0, 0, 0 });
+                }
+            }
+            for (const uint64_t c : m_constants) {
+                fn({ Kind::movImm, d, 0, 0, 0, c });
+                if (is_defined(d) && simm32(c) && c != 0) {
+                    fn({ Kind::addImm, d, 0, 0, 0, c });
+                }
+            }
+            for (uint8_t s = 0; s < registerCount; s++) {
+                if (!is_defined(s)) {
+                    continue;
+                }
+                if (s != d) {
+                    fn({ Kind::movReg, d, s, 0, 0, 0 });
+                }
+                if (is_defined(d)) {
+                    fn({ Kind::addReg, d, s, 0, 0, 0 });
+                    if (s != d) {
+                        fn({ Kind::subReg, d, s, 0, 0, 0 });
+                    }
+                    fn({ Kind::imulReg, d, s, 0, 0, 0 });
+                }
+                for (const uint64_t c : m_constants) {
+                    if (simm32(c) && c > 1) {
+                        fn({ Kind::imulImm, d, s, 0, 0, c });
+                    }
+                    if (simm32(c) && c != 0) {
+                        fn({ Kind::leaDisp, d, s, 0, 0, c });
+                    }
+                }
+                for (uint8_t x = 0; x < registerCount; x++) {
+                    if (!is_defined(x)) {
+                        continue;
+                    }
+                    for (const uint8_t scale : { 1, 2, 4, 8 }) {
+                        if (scale != 1 || s <= x) {
+                            fn({ Kind::lea, d, s, x, scale, 0 });
+                        }
+                    }
+                }
+            }
+            if (is_defined(d)) {
+                for (const uint64_t k : m_shifts) {
+                    fn({ Kind::shl, d, 0, 0, 0, k });
+                    fn({ Kind::shr, d, 0, 0, 0, k });
+                }
+                fn({ Kind::neg, d, 0, 0, 0, 0 });
+            }
+        }
+    }
+
+    bool matches(const std::vector<Instr>& sequence, const uint64_t* inputs, const uint64_t mask) const
+    {
+        std::array<uint64_t, registerCount> regs {};
+        for (const Instr& instr : sequence) {
+            execute(instr, regs.data(), inputs, mask);
+        }
+        return regs[0] == evaluate(m_flat.steps, inputs, mask);
+    }
+
+    // Random 64-bit inputs, then every input of a small width.
+    bool verify(const std::vector<Instr>& sequence) const
+    {
+        uint64_t seed = 0x6b65692d76657269ULL;
+        std::array<uint64_t, Superoptimizer::maxInputs> inputs {};
+        for (size_t check = 0; check < randomChecks; check++) {
+            for (size_t i = 0; i < m_input_count; i++) {
+                inputs[i] = splitmix64(seed);
+            }
+            if (!matches(sequence, inputs.data(), UINT64_MAX)) {
+                return false;
+            }
+        }
+        const unsigned bits = exhaustiveBits[m_input_count];
+        if (bits == 0) {
+            return true;
+        }
+        const uint64_t mask = (uint64_t { 1 } << bits) - 1;
+        const uint64_t combinations = uint64_t { 1 } << (bits * m_input_count);
+        for (uint64_t combination = 0; combination < combinations; combination++) {
+            for (size_t i = 0; i < m_input_count; i++) {
+                inputs[i] = (combination >> (bits * i)) & mask;
+            }
+            if (!matches(sequence, inputs.data(), mask)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const Flat& m_flat;
+    size_t m_input_count;
+    std::array<std::array<uint64_t, Superoptimizer::maxInputs>, testCount> m_tests {};
+    std::array<uint64_t, testCount> m_targets {};
+    std::vector<uint64_t> m_constants {};
+    std::vector<uint64_t> m_shifts {};
+    std::vector<Node> m_nodes {};
+    std::unordered_map<uint64_t, uint32_t> m_seen {}; // fingerprint -> cheapest cost queued
+};
+}
+
+std::optional<std::string> Superoptimizer::find(
+    const ExprNode* expr, const uint32_t baseline_cost, std::vector<const IdentifierNode*>& inputs)
+{
+    inputs.clear();
+    const ExprNode* root = unwrapParens(expr);
+    if (!std::holds_alternative<BinaryExpressionNode*>(root->expression)) {
+        return {};
+    }
+    Flat flat;
+    if (!flatten(root, flat, inputs)) {
+        return {};
+    }
+    auto it = m_memo.find(flat.key);
+    if (it != m_memo.end()) {
+        m_stats.memo_hits++;
+    }
+    else {
+        m_stats.searched++;
+        const std::optional<std::vector<Instr>> sequence = Search(flat, inputs.size()).run(baseline_cost);
+        std::string code;
+        for (const Instr& instr : sequence.value_or(std::vector<Instr> {})) {
+            code += (code.empty() ? "" : "\n") + instrText(instr);
+        }
+        it = m_memo.emplace(std::move(flat.key), std::move(code)).first;
+        m_changed = true;
+    }
+    if (it->second.empty()) {
+        return {};
+    }
+    m_stats.improved++;
+    return it->second;
+}
+
+// One entry per line: the key, a tab, and the code with its lines separated
+// by `; `, which never occurs in it.
+bool Superoptimizer::load(const std::string_view contents)
+{
+    if (!contents.starts_with(memoMagic)) {
+        return false;
+    }
+    std::string_view rest = contents.substr(memoMagic.size());
+    std::vector<std::pair<std::string, std::string>> entries;
+    while (!rest.empty()) {
+        const size_t end = rest.find('\n');
+        const std::string_view line = rest.substr(0, end);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        const size_t tab = line.find('\t');
+        if (tab == std::string_view::npos) {
+            return false;
+        }
+        std::string code;
+        for (std::string_view text = line.substr(tab + 1); !text.empty();) {
+            const size_t separator = text.find("; ");
+            code += (code.empty() ? "" : "\n") + std::string(text.substr(0, separator));
+            text.remove_prefix(separator == std::string_view::npos ? text.size() : separator + 2);
+        }
+        entries.emplace_back(line.substr(0, tab), std::move(code));
+    }
+    for (auto& [key, code] : entries) {
+        m_memo.try_emplace(std::move(key), std::move(code));
+    }
+    return true;
+}
+
+std::string Superoptimizer::contents() const
+{
+    std::vector<const std::pair<const std::string, std::string>*> entries;
+    for (const auto& entry : m_memo) {
+        entries.push_back(&entry);
+    }
+    std::ranges::sort(entries, {}, [](const auto* entry) { return entry->first; });
+    std::string text(memoMagic);
+    for (const auto* entry : entries) {
+        text += entry->first + "\t";
+        for (const char c : entry->second) {
+            text += c == '\n' ? std::string("; ") : std::string(1, c);
+        }
+        text += "\n";
+    }
+    return text;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Components/optimizer/astUtils.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// `--superopt`: searches for the cheapest x86-64 sequence that computes a
+// small arithmetic expression, instead of covering it with the selector's
+// rules. An expression qualifies when it has at most `maxExprNodes` nodes,
+// only `+`, `-`, `*` and division by a power of two, literals, and at most
+// `maxInputs` distinct variables.
+//
+// The search enumerates sequences of mov, add, sub, imul, lea, shl, shr and
+// neg over rax, rcx and rdx, cheapest first in the selector's cost model of
+// encoded bytes, reading the variables as memory operands and immediates
+// made from the expression's literals. Sequences that leave the same values
+// in the registers on a few test inputs are explored once. A sequence whose
+// rax matches the expression on those inputs must then agree with it on 256
+// more random 64-bit inputs and on every input at a small width (16 bits
+// for one variable, 8 for two, 5 for three) before it is used. The search
+// gives up past `maxExpansions` sequences or once nothing cheaper than the
+// selector's code is left.
+//
+// Results, found or not, are remembered by the expression with its
+// variables numbered in order of appearance, so `a * 3 + b` and `x * 3 + y`
+// share an entry. The driver keeps them in a memo file so later compiles skip
+// the search.
+class Superoptimizer {
+public:
+    struct Stats {
+        size_t searched = 0;
+        size_t memo_hits = 0;
+        size_t improved = 0; // expressions given a sequence, searched or remembered
+    };
+    static constexpr size_t maxExprNodes = 9;
+    static constexpr size_t maxInputs = 3;
+    static constexpr size_t maxExpansions = 4000;
+
+    // Assembly for `expr`, one instruction per line, leaving its value in rax
+    // and clobbering rcx and rdx, when a sequence cheaper than `baseline_cost`
+    // exists. `$0`, `$1` and `$2` stand for the memory operands of the
+    // variables in `inputs`, in order of first appearance.
+    [[nodiscard]] std::optional<std::string> find(
+        const ExprNode* expr, uint32_t baseline_cost, std::vector<const IdentifierNode*>& inputs);
+    // Adds the entries of the memo file `contents` that are not known yet.
+    // Returns false, adding nothing, if it is not a memo file.
+    bool load(std::string_view contents);
+    // The memo file for every entry known.
+    [[nodiscard]] std::string contents() const;
+    // Whether a search added an entry since `mark_saved`.
+    [[nodiscard]] bool changed() const { return m_changed; }
+    void mark_saved() { m_changed = false; }
+    [[nodiscard]] const Stats& stats() const { return m_stats; }
+    void reset_stats() { m_stats = {}; }
+
+private:
+    std::unordered_map<std::string, std::string> m_memo {}; // key -> code, empty when nothing was found
+    bool m_changed = false;
+    Stats m_stats {};
+};
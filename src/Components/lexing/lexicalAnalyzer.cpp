@@ -1,11 +1,18 @@
 #include "lexicalAnalyzer.hpp"
+#include "Components/diagnostics/compileError.hpp"
+#include "utf8.hpp"
+#include "xidTables.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 
 const char *toString(TokenType type)
 {
-    static const std::array<const char *, 17> tokenStrings = {"`exit`", "int literal", "`;`", "`(`", "`)`", "identifier", "`let`", "`=`", "`+`",
-                                                              "`*`", "`-`", "`/`", "`{`", "`}`", "`if`", "`elif`", "`7`"};
+    static const std::array<const char *, 37> tokenStrings = {"`exit`", "int literal", "`;`", "`(`", "`)`", "identifier", "`let`", "`=`", "`+`",
+                                                              "`*`", "`-`", "`/`", "`{`", "`}`", "`if`", "`elif`", "`else`", "`while`",
+                                                              "`fn`", "`return`", "`,`", "`==`", "`!=`", "`<`", "`<=`", "`>`", "`>=`",
+                                                              "`&&`", "`||`", "`!`", "`import`", "`export`", "string literal", "`[`", "`]`",
+                                                              "`print`", "`read`"};
     assert(static_cast<int>(type) >= 0 && static_cast<int>(type) < tokenStrings.size());
     return tokenStrings[static_cast<int>(type)];
 }
@@ -65,6 +72,66 @@ std::ostream &operator<<(std::ostream &os, TokenType type)
     case TokenType::else_:
         os << "else_";
         break;
+    case TokenType::while_:
+        os << "while_";
+        break;
+    case TokenType::fn:
+        os << "fn";
+        break;
+    case TokenType::return_:
+        os << "return_";
+        break;
+    case TokenType::comma:
+        os << "comma";
+        break;
+    case TokenType::eq_eq:
+        os << "eq_eq";
+        break;
+    case TokenType::bang_eq:
+        os << "bang_eq";
+        break;
+    case TokenType::lt:
+        os << "lt";
+        break;
+    case TokenType::lt_eq:
+        os << "lt_eq";
+        break;
+    case TokenType::gt:
+        os << "gt";
+        break;
+    case TokenType::gt_eq:
+        os << "gt_eq";
+        break;
+    case TokenType::amp_amp:
+        os << "amp_amp";
+        break;
+    case TokenType::pipe_pipe:
+        os << "pipe_pipe";
+        break;
+    case TokenType::bang:
+        os << "bang";
+        break;
+    case TokenType::import_:
+        os << "import_";
+        break;
+    case TokenType::export_:
+        os << "export_";
+        break;
+    case TokenType::string_lit:
+        os << "string_lit";
+        break;
+    case TokenType::open_square:
+        os << "open_square";
+        break;
+    case TokenType::close_square:
+        os << "close_square";
+        break;
+    case TokenType::print:
+        os << "print";
+        break;
+    case TokenType::read:
+        os << "read";
+        break;
     }
     return os;
 }
@@ -76,23 +143,6 @@ std::ostream &operator<<(std::ostream &os, const Token &token)
     os << ")";
     return os;
 }
-bool binaryPrecedence(const TokenType type, int &precedence)
-{
-    switch (type)
-    {
-    case TokenType::minus:
-    case TokenType::plus:
-        precedence = 0;
-        return true;
-    case TokenType::fslash:
-    case TokenType::star:
-        precedence = 1;
-        return true;
-    default:
-        return false;
-    }
-}
-
 LexicalAnalyzer::LexicalAnalyzer(std::string src)
     : sourceCode(std::move(src))
 {
@@ -114,7 +164,7 @@ char LexicalAnalyzer::consume()
 
 void LexicalAnalyzer::skipWhitespace(int &lineCount)
 {
-    while (std::isspace(peek()))
+    while (std::isspace(static_cast<unsigned char>(peek())))
     {
         if (peek() == '\n')
             lineCount++;
@@ -122,18 +172,36 @@ void LexicalAnalyzer::skipWhitespace(int &lineCount)
     }
 }
 
+// Identifiers are a letter or an XID_Start character followed by letters,
+// digits and XID_Continue characters. They are taken as their bytes, without
+// normalization, and the source has been checked to be valid UTF-8.
 std::optional<Token> LexicalAnalyzer::parseIdentifierOrKeyword(int lineCount)
 {
-    std::string buffer;
-    while (std::isalnum(peek()))
+    const size_t start = currentIndex;
+    size_t end = currentIndex;
+    while (end < sourceCode.length())
     {
-        buffer.push_back(consume());
+        const auto c = static_cast<unsigned char>(sourceCode[end]);
+        if (c < 0x80)
+        {
+            if (!std::isalnum(c))
+                break;
+            end++;
+            continue;
+        }
+        size_t length;
+        const char32_t codePoint = decodeUtf8(sourceCode, end, length);
+        if (!(end == start ? isXidStart(codePoint) : isXidContinue(codePoint)))
+        {
+            if (end == start)
+                throw CompileError("Invalid token: " + sourceCode.substr(start, length));
+            break;
+        }
+        end += length;
     }
-    static const std::map<std::string, TokenType, std::less<>> keywords = {{"exit", TokenType::exit},
-                                                                           {"let", TokenType::let},
-                                                                           {"if", TokenType::if_},
-                                                                           {"elif", TokenType::elif},
-                                                                           {"else", TokenType::else_}};
+    currentIndex = end;
+    std::string buffer = sourceCode.substr(start, end - start);
+    static const std::map<std::string, TokenType, std::less<>> keywords(keywordTokens.begin(), keywordTokens.end());
     if (auto it = keywords.find(buffer); it != keywords.end())
     {
         return Token{it->second, lineCount};
@@ -151,6 +219,22 @@ std::optional<Token> LexicalAnalyzer::parseNumber(int lineCount)
     return Token{TokenType::int_lit, lineCount, buffer};
 }
 
+// `"..."` on one line, without escapes; the token's value is the text between
+// the quotes.
+std::optional<Token> LexicalAnalyzer::parseString(int lineCount)
+{
+    consume();
+    std::string buffer;
+    while (peek() != '"')
+    {
+        if (peek() == '\n' || peek() == '\0')
+            throw CompileError("Unterminated string on line " + std::to_string(lineCount));
+        buffer.push_back(consume());
+    }
+    consume();
+    return Token{TokenType::string_lit, lineCount, buffer};
+}
+
 std::optional<Token> LexicalAnalyzer::parseCommentOrSlash(int lineCount)
 {
     if (peek(1) == '/')
@@ -186,59 +270,88 @@ std::optional<Token> LexicalAnalyzer::parseCommentOrSlash(int lineCount)
 
 std::optional<Token> LexicalAnalyzer::parseSpecialCharacter(char c, int lineCount)
 {
-    const std::map<char, TokenType> specialTokens = {{'(', TokenType::open_paren}, {')', TokenType::close_pared}, {';', TokenType::semi}, {'=', TokenType::eq}, {'+', TokenType::plus}, {'*', TokenType::star}, {'-', TokenType::minus}, {'{', TokenType::open_curly}, {'}', TokenType::close_curly}};
-    if (auto it = specialTokens.find(c); it != specialTokens.end())
+    if (const char next = peek(1); next == '=' || next == c)
     {
-        consume();
-        return Token{it->second, lineCount};
+        if (const auto type = (next == '=' ? equalsTokens : doubledTokens)[static_cast<unsigned char>(c)])
+        {
+            consume();
+            consume();
+            return Token{type.value(), lineCount};
+        }
     }
-    else
+    if (const auto type = specialTokens[static_cast<unsigned char>(c)])
     {
-        std::cerr << "Invalid token: " << c << std::endl;
-        exit(EXIT_FAILURE);
+        consume();
+        return Token{type.value(), lineCount};
     }
+    throw CompileError(std::string("Invalid token: ") + c);
 }
 
-std::vector<Token> LexicalAnalyzer::tokenize()
+// Lexes from `currentIndex`, a token boundary on line `lineCount`, handing
+// each token and its start offset to `onToken` until it returns false.
+template <typename OnToken>
+void LexicalAnalyzer::lex(int lineCount, OnToken onToken)
 {
-    std::vector<Token> tokens;
-    int lineCount = 1;
     char c;
     while ((c = peek()) != '\0')
     {
-        if (std::isspace(c))
+        const auto uc = static_cast<unsigned char>(c);
+        if (std::isspace(uc))
         {
             skipWhitespace(lineCount);
+            continue;
         }
-        else if (std::isalpha(c))
+        const size_t start = currentIndex;
+        std::optional<Token> token = std::isalpha(uc) || uc >= 0x80 ? parseIdentifierOrKeyword(lineCount)
+                                     : std::isdigit(uc)             ? parseNumber(lineCount)
+                                     : c == '/'                     ? parseCommentOrSlash(lineCount)
+                                     : c == '"'                     ? parseString(lineCount)
+                                                                    : parseSpecialCharacter(c, lineCount);
+        if (token.has_value() && !onToken(std::move(*token), start))
         {
-            if (auto token = parseIdentifierOrKeyword(lineCount))
-            {
-                tokens.push_back(*token);
-            }
-        }
-        else if (std::isdigit(c))
-        {
-            if (auto token = parseNumber(lineCount))
-            {
-                tokens.push_back(*token);
-            }
+            return;
         }
-        else if (c == '/')
+    }
+}
+
+void LexicalAnalyzer::checkUtf8(const size_t begin, const int line) const
+{
+    if (const auto invalid = findInvalidUtf8(std::string_view(sourceCode).substr(begin)))
+    {
+        const auto first = sourceCode.begin() + static_cast<std::ptrdiff_t>(begin);
+        const auto lineOfError = line + std::count(first, first + static_cast<std::ptrdiff_t>(*invalid), '\n');
+        throw CompileError("Invalid UTF-8 on line " + std::to_string(lineOfError));
+    }
+}
+
+std::vector<Token> LexicalAnalyzer::tokenize()
+{
+    std::vector<Token> tokens;
+    checkUtf8(0, 1);
+    currentIndex = 0;
+    lex(1, [&](Token token, size_t)
         {
-            if (auto token = parseCommentOrSlash(lineCount))
-            {
-                tokens.push_back(*token);
-            }
-        }
-        else
+            tokens.push_back(std::move(token));
+            return true; });
+    currentIndex = 0;
+    return tokens;
+}
+
+std::vector<Token> LexicalAnalyzer::tokenizeFrom(const size_t begin, const int line, std::vector<size_t> &offsets,
+                                                 const std::function<bool(const Token &, size_t)> &resync)
+{
+    std::vector<Token> tokens;
+    checkUtf8(begin, line);
+    currentIndex = begin;
+    lex(line, [&](Token token, const size_t offset)
         {
-            if (auto token = parseSpecialCharacter(c, lineCount))
+            if (resync(token, offset))
             {
-                tokens.push_back(*token);
+                return false;
             }
-        }
-    }
+            tokens.push_back(std::move(token));
+            offsets.push_back(offset);
+            return true; });
     currentIndex = 0;
     return tokens;
-}
\ No newline at end of file
+}
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 enum class TokenType
@@ -26,6 +29,26 @@ enum class TokenType
     if_,
     elif,
     else_,
+    while_,
+    fn,
+    return_,
+    comma,
+    eq_eq,
+    bang_eq,
+    lt,
+    lt_eq,
+    gt,
+    gt_eq,
+    amp_amp,
+    pipe_pipe,
+    bang,
+    import_,
+    export_,
+    string_lit,
+    open_square,
+    close_square,
+    print,
+    read,
 };
 std::ostream &operator<<(std::ostream &os, TokenType type);
 struct Token
@@ -45,14 +68,117 @@ private:
     [[nodiscard]] char peek(size_t offset = 0) const;
     char consume();
     void skipWhitespace(int &lineCount);
+    // Throws `CompileError` if the source from byte `begin`, on `line`, is not valid UTF-8.
+    void checkUtf8(size_t begin, int line) const;
     std::optional<Token> parseIdentifierOrKeyword(int lineCount);
     std::optional<Token> parseNumber(int lineCount);
+    std::optional<Token> parseString(int lineCount);
     std::optional<Token> parseCommentOrSlash(int lineCount);
     std::optional<Token> parseSpecialCharacter(char c, int lineCount);
+    template <typename OnToken>
+    void lex(int lineCount, OnToken onToken);
 
 public:
     explicit LexicalAnalyzer(std::string src);
     std::vector<Token> tokenize();
+    // Lexes from byte `begin`, which must be the start of a token on `line` or
+    // of the whitespace and comments before one, and stops before the first
+    // token for which `resync(token, offset)` holds. The start offset of each
+    // returned token is appended to `offsets`.
+    std::vector<Token> tokenizeFrom(size_t begin, int line, std::vector<size_t> &offsets,
+                                    const std::function<bool(const Token &, size_t)> &resync);
 };
 const char *toString(TokenType type);
-bool binaryPrecedence(TokenType type, int &precedence);
\ No newline at end of file
+
+// Reserved words, constexpr so the compile-time front end shares them.
+inline constexpr std::array<std::pair<std::string_view, TokenType>, 12> keywordTokens = {{
+    {"exit", TokenType::exit},
+    {"let", TokenType::let},
+    {"if", TokenType::if_},
+    {"elif", TokenType::elif},
+    {"else", TokenType::else_},
+    {"while", TokenType::while_},
+    {"fn", TokenType::fn},
+    {"return", TokenType::return_},
+    {"import", TokenType::import_},
+    {"export", TokenType::export_},
+    {"print", TokenType::print},
+    {"read", TokenType::read},
+}};
+
+// Single-character tokens (`/` aside, which may open a comment). Built at
+// compile time and only read afterwards, so lexers running on several threads
+// share them without locking.
+inline constexpr std::array<std::optional<TokenType>, 256> specialTokens = []
+{
+    std::array<std::optional<TokenType>, 256> table{};
+    table['('] = TokenType::open_paren;
+    table[')'] = TokenType::close_pared;
+    table[';'] = TokenType::semi;
+    table['='] = TokenType::eq;
+    table['+'] = TokenType::plus;
+    table['*'] = TokenType::star;
+    table['-'] = TokenType::minus;
+    table['{'] = TokenType::open_curly;
+    table['}'] = TokenType::close_curly;
+    table[','] = TokenType::comma;
+    table['['] = TokenType::open_square;
+    table[']'] = TokenType::close_square;
+    table['<'] = TokenType::lt;
+    table['>'] = TokenType::gt;
+    table['!'] = TokenType::bang;
+    return table;
+}();
+
+// Operators spelled as the character twice.
+inline constexpr std::array<std::optional<TokenType>, 256> doubledTokens = []
+{
+    std::array<std::optional<TokenType>, 256> table{};
+    table['&'] = TokenType::amp_amp;
+    table['|'] = TokenType::pipe_pipe;
+    return table;
+}();
+
+// Operators spelled as the character followed by `=`.
+inline constexpr std::array<std::optional<TokenType>, 256> equalsTokens = []
+{
+    std::array<std::optional<TokenType>, 256> table{};
+    table['='] = TokenType::eq_eq;
+    table['!'] = TokenType::bang_eq;
+    table['<'] = TokenType::lt_eq;
+    table['>'] = TokenType::gt_eq;
+    return table;
+}();
+
+constexpr bool binaryPrecedence(const TokenType type, int &precedence)
+{
+    switch (type)
+    {
+    case TokenType::pipe_pipe:
+        precedence = 0;
+        return true;
+    case TokenType::amp_amp:
+        precedence = 1;
+        return true;
+    case TokenType::eq_eq:
+    case TokenType::bang_eq:
+        precedence = 2;
+        return true;
+    case TokenType::lt:
+    case TokenType::lt_eq:
+    case TokenType::gt:
+    case TokenType::gt_eq:
+        precedence = 3;
+        return true;
+    case TokenType::minus:
+    case TokenType::plus:
+        precedence = 4;
+        return true;
+    case TokenType::fslash:
+    case TokenType::star:
+        precedence = 5;
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,220 @@
+#include "utf8.hpp"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define KEI_UTF8_SSSE3 1
+#endif
+
+namespace
+{
+// Index of the first byte from `i` on that may be non-ASCII: whole blocks of
+// ASCII are skipped, so the result is only exact past the last full block.
+size_t skipAscii(const std::string_view text, size_t i)
+{
+#if defined(__SSE2__)
+    for (; i + 16 <= text.size(); i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+        if (_mm_movemask_epi8(block) != 0)
+        {
+            return i;
+        }
+    }
+#endif
+    while (i < text.size() && static_cast<unsigned char>(text[i]) < 0x80)
+    {
+        i++;
+    }
+    return i;
+}
+
+// One sequence at a time from `i`, a character boundary.
+std::optional<size_t> findInvalidScalar(const std::string_view text, size_t i)
+{
+    const auto byte = [&](const size_t k)
+    { return k < text.size() ? static_cast<unsigned char>(text[k]) : 0; };
+    while ((i = skipAscii(text, i)) < text.size())
+    {
+        const unsigned char lead = byte(i);
+        if (lead < 0x80)
+        {
+            i++;
+            continue;
+        }
+        // The lead byte gives the length, and limits the second byte to
+        // rule out overlong forms, surrogates and code points past U+10FFFF.
+        size_t length = 0;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            length = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            low = lead == 0xE0 ? 0xA0 : low;
+            high = lead == 0xED ? 0x9F : high;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            low = lead == 0xF0 ? 0x90 : low;
+            high = lead == 0xF4 ? 0x8F : high;
+        }
+        else
+        {
+            return i;
+        }
+        if (byte(i + 1) < low || byte(i + 1) > high)
+        {
+            return i;
+        }
+        for (size_t k = 2; k < length; k++)
+        {
+            if ((byte(i + k) & 0xC0) != 0x80)
+            {
+                return i;
+            }
+        }
+        i += length;
+    }
+    return {};
+}
+
+#ifdef KEI_UTF8_SSSE3
+// Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per
+// Byte": three 16-entry lookups, on the high and low nibbles of each byte's
+// predecessor and the high nibble of the byte itself, flag every error that
+// spans two bytes; the third and fourth bytes of longer sequences are
+// checked against the lead two and three bytes back.
+constexpr char tooShort = 1 << 0;
+constexpr char tooLong = 1 << 1;
+constexpr char overlong3 = 1 << 2;
+constexpr char tooLarge = 1 << 3;
+constexpr char surrogate = 1 << 4;
+constexpr char overlong2 = 1 << 5;
+constexpr char tooLarge1000 = 1 << 6;
+constexpr char overlong4 = 1 << 6;
+constexpr char twoConts = static_cast<char>(1 << 7);
+constexpr char carry = tooShort | tooLong | twoConts;
+
+__attribute__((target("ssse3"))) __m128i highNibbles(const __m128i bytes)
+{
+    return _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+}
+
+__attribute__((target("ssse3"))) __m128i blockErrors(const __m128i input, const __m128i previous)
+{
+    const __m128i byte1High = _mm_setr_epi8(
+        tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, twoConts, twoConts, twoConts, twoConts,
+        tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate, tooShort | tooLarge | tooLarge1000 | overlong4);
+    const __m128i byte1Low = _mm_setr_epi8(
+        carry | overlong3 | overlong2 | overlong4, carry | overlong2, carry, carry, carry | tooLarge,
+        carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+        carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000 | surrogate,
+        carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000);
+    const __m128i byte2High = _mm_setr_epi8(
+        tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+        tooLong | overlong2 | twoConts | overlong3 | tooLarge1000 | overlong4,
+        tooLong | overlong2 | twoConts | overlong3 | tooLarge, tooLong | overlong2 | twoConts | surrogate | tooLarge,
+        tooLong | overlong2 | twoConts | surrogate | tooLarge, tooShort, tooShort, tooShort, tooShort);
+
+    const __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+    const __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte1High, highNibbles(prev1)),
+                      _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+        _mm_shuffle_epi8(byte2High, highNibbles(input)));
+    // High bit set where the byte must continue a sequence begun by an
+    // `1110____` lead two bytes back or a `11110___` lead three bytes back.
+    const __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 14), _mm_set1_epi8(0xE0 - 0x80));
+    const __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 13), _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    const __m128i continuation = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(continuation, special);
+}
+
+// Non-zero when the block ends inside a sequence.
+__attribute__((target("ssse3"))) __m128i incomplete(const __m128i input)
+{
+    const __m128i limits = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1),
+                                         static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+    return _mm_subs_epu8(input, limits);
+}
+
+__attribute__((target("ssse3"))) bool validSsse3(const char *data, const size_t size)
+{
+    __m128i errors = _mm_setzero_si128();
+    __m128i previous = _mm_setzero_si128();
+    __m128i previous_incomplete = _mm_setzero_si128();
+    for (size_t i = 0; i < size; i += 16)
+    {
+        __m128i input;
+        if (i + 16 <= size)
+        {
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        }
+        else
+        {
+            // Padding with NULs, which are ASCII, ends any open sequence.
+            char tail[16] = {};
+            std::memcpy(tail, data + i, size - i);
+            input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tail));
+        }
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            errors = _mm_or_si128(errors, previous_incomplete);
+        }
+        else
+        {
+            errors = _mm_or_si128(errors, blockErrors(input, previous));
+            previous_incomplete = incomplete(input);
+        }
+        previous = input;
+    }
+    errors = _mm_or_si128(errors, previous_incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+}
+
+std::optional<size_t> findInvalidUtf8(const std::string_view text)
+{
+    const size_t start = skipAscii(text, 0);
+    if (start == text.size())
+    {
+        return {};
+    }
+#ifdef KEI_UTF8_SSSE3
+    // The vector check only says whether there is an error; the scalar one
+    // finds it.
+    static const bool hasSsse3 = __builtin_cpu_supports("ssse3");
+    if (hasSsse3 && validSsse3(text.data() + start, text.size() - start))
+    {
+        return {};
+    }
+#endif
+    return findInvalidScalar(text, start);
+}
+
+char32_t decodeUtf8(const std::string_view text, const size_t offset, size_t &length)
+{
+    const auto lead = static_cast<unsigned char>(text[offset]);
+    if (lead < 0x80)
+    {
+        length = 1;
+        return lead;
+    }
+    length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+    char32_t cp = lead & (0x7F >> length);
+    for (size_t k = 1; k < length; k++)
+    {
+        cp = cp << 6 | (static_cast<unsigned char>(text[offset + k]) & 0x3F);
+    }
+    return cp;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// Offset of the first byte of `text` that is not part of a well-formed UTF-8
+// sequence (no overlong forms, surrogates or code points past U+10FFFF), or
+// nothing if all of it is. ASCII is skipped 16 bytes at a time; blocks with
+// other bytes are checked 16 at a time as well where the CPU has SSSE3.
+std::optional<size_t> findInvalidUtf8(std::string_view text);
+
+// The code point starting at `text[offset]`, which must begin a well-formed
+// sequence, and the sequence's length in bytes.
+char32_t decodeUtf8(std::string_view text, size_t offset, size_t &length);
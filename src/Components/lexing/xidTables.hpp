@@ -0,0 +1,6 @@
+#pragma once
+
+// Unicode identifier properties for the code points above U+007F; ASCII
+// identifiers follow the lexer's own rules.
+bool isXidStart(char32_t cp);
+bool isXidContinue(char32_t cp);
@@ -2,35 +2,84 @@
 
 #include <cstddef>
 #include <memory>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 class MemoryAllocator {
 private:
+    struct Chunk {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
     size_t capacity_;
-    std::vector<std::byte> buffer_;
-    std::byte* current_;
+    std::vector<Chunk> chunks_;
+    size_t chunkIndex_ = 0;
+    std::byte* current_ = nullptr;
+    std::byte* end_ = nullptr;
+    size_t usedInFullChunks_ = 0;
+    size_t highWater_ = 0;
+    size_t allocations_ = 0;
+    std::vector<Destructor> destructors_;
+
+    void useChunk(size_t index)
+    {
+        chunkIndex_ = index;
+        current_ = chunks_[index].data.get();
+        end_ = current_ + chunks_[index].size;
+    }
+
+    // Moves to the next chunk that can hold `bytes`, reusing chunks kept by
+    // `reset()` before allocating a new one.
+    void nextChunk(size_t bytes)
+    {
+        usedInFullChunks_ += static_cast<size_t>(current_ - chunks_[chunkIndex_].data.get());
+        for (size_t index = chunkIndex_ + 1; index < chunks_.size(); index++) {
+            if (chunks_[index].size >= bytes) {
+                useChunk(index);
+                return;
+            }
+        }
+        const size_t size = std::max(capacity_, bytes);
+        chunks_.push_back({ std::make_unique_for_overwrite<std::byte[]>(size), size });
+        useChunk(chunks_.size() - 1);
+    }
 
 public:
+    // `capacity` is the size of each chunk; the arena grows by whole chunks.
     explicit MemoryAllocator(size_t capacity)
         : capacity_(capacity)
-        , buffer_(capacity)
-        , current_(buffer_.data())
     {
+        chunks_.push_back({ std::make_unique_for_overwrite<std::byte[]>(capacity), capacity });
+        useChunk(0);
     }
     MemoryAllocator(const MemoryAllocator&) = delete;
     MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+    ~MemoryAllocator() { reset(); }
 
     template <typename T>
     [[nodiscard]] T* allocate()
     {
-        size_t remainingBytes = capacity_ - static_cast<size_t>(current_ - buffer_.data());
         auto pointer = static_cast<void*>(current_);
+        size_t remainingBytes = static_cast<size_t>(end_ - current_);
         void* alignedAddress = std::align(alignof(T), sizeof(T), pointer, remainingBytes);
         if (alignedAddress == nullptr) {
-            throw std::bad_alloc {};
+            nextChunk(sizeof(T) + alignof(T));
+            pointer = static_cast<void*>(current_);
+            remainingBytes = static_cast<size_t>(end_ - current_);
+            alignedAddress = std::align(alignof(T), sizeof(T), pointer, remainingBytes);
+            if (alignedAddress == nullptr) {
+                throw std::bad_alloc {};
+            }
         }
         current_ = static_cast<std::byte*>(alignedAddress) + sizeof(T);
+        allocations_++;
+        highWater_ = std::max(highWater_, bytesUsed());
         return static_cast<T*>(alignedAddress);
     }
 
@@ -38,6 +87,32 @@ public:
     [[nodiscard]] T* construct(Args&&... args)
     {
         T* allocatedSpace = allocate<T>();
-        return new (allocatedSpace) T(std::forward<Args>(args)...);
+        T* object = new (allocatedSpace) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors_.push_back({ object, [](void* p) { static_cast<T*>(p)->~T(); } });
+        }
+        return object;
+    }
+
+    // Destroys every constructed object and rewinds to the first chunk. The
+    // chunks are kept, so an arena reused across compilations stops
+    // allocating once it has grown to the largest input.
+    void reset()
+    {
+        for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it) {
+            it->destroy(it->object);
+        }
+        destructors_.clear();
+        usedInFullChunks_ = 0;
+        allocations_ = 0;
+        useChunk(0);
+    }
+
+    [[nodiscard]] size_t bytesUsed() const
+    {
+        return usedInFullChunks_ + static_cast<size_t>(current_ - chunks_[chunkIndex_].data.get());
     }
+    [[nodiscard]] size_t highWater() const { return highWater_; }
+    // Objects allocated since the last `reset()`.
+    [[nodiscard]] size_t allocations() const { return allocations_; }
 };
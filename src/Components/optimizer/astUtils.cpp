@@ -0,0 +1,705 @@
+#include "astUtils.hpp"
+#include <algorithm>
+#include <limits>
+
+BinaryOperands binaryOperands(const BinaryExpressionNode* bin_expr)
+{
+    struct OperandsVisitor {
+        BinaryOperands operator()(const AdditionNode* add) const { return { BinaryOp::add, add->lhs, add->rhs }; }
+        BinaryOperands operator()(const SubtractionNode* sub) const { return { BinaryOp::sub, sub->lhs, sub->rhs }; }
+        BinaryOperands operator()(const MultiplicationNode* multi) const
+        {
+            return { BinaryOp::mul, multi->lhs, multi->rhs };
+        }
+        BinaryOperands operator()(const DivisionNode* div) const { return { BinaryOp::div, div->lhs, div->rhs }; }
+        BinaryOperands operator()(const LogicalAndNode* logic) const
+        {
+            return { BinaryOp::logical_and, logic->lhs, logic->rhs };
+        }
+        BinaryOperands operator()(const LogicalOrNode* logic) const
+        {
+            return { BinaryOp::logical_or, logic->lhs, logic->rhs };
+        }
+        BinaryOperands operator()(const EqualNode* cmp) const { return { BinaryOp::eq, cmp->lhs, cmp->rhs }; }
+        BinaryOperands operator()(const NotEqualNode* cmp) const { return { BinaryOp::ne, cmp->lhs, cmp->rhs }; }
+        BinaryOperands operator()(const LessNode* cmp) const { return { BinaryOp::lt, cmp->lhs, cmp->rhs }; }
+        BinaryOperands operator()(const LessEqualNode* cmp) const { return { BinaryOp::le, cmp->lhs, cmp->rhs }; }
+        BinaryOperands operator()(const GreaterNode* cmp) const { return { BinaryOp::gt, cmp->lhs, cmp->rhs }; }
+        BinaryOperands operator()(const GreaterEqualNode* cmp) const { return { BinaryOp::ge, cmp->lhs, cmp->rhs }; }
+    };
+    return std::visit(OperandsVisitor {}, bin_expr->operation);
+}
+
+const char* binaryOpText(const BinaryOp op)
+{
+    switch (op) {
+    case BinaryOp::add:
+        return "+";
+    case BinaryOp::sub:
+        return "-";
+    case BinaryOp::mul:
+        return "*";
+    case BinaryOp::div:
+        return "/";
+    case BinaryOp::logical_and:
+        return "&&";
+    case BinaryOp::logical_or:
+        return "||";
+    case BinaryOp::eq:
+        return "==";
+    case BinaryOp::ne:
+        return "!=";
+    case BinaryOp::lt:
+        return "<";
+    case BinaryOp::le:
+        return "<=";
+    case BinaryOp::gt:
+        return ">";
+    case BinaryOp::ge:
+        return ">=";
+    }
+    return "?";
+}
+
+std::optional<uint64_t> parseIntLiteral(const Token& token)
+{
+    if (!token.value.has_value() || token.value->empty()) {
+        return {};
+    }
+    uint64_t value = 0;
+    for (const char c : token.value.value()) {
+        const auto digit = static_cast<uint64_t>(c - '0');
+        if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+            return {};
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+std::optional<uint64_t> evalBinary(const BinaryOp op, const uint64_t lhs, const uint64_t rhs)
+{
+    // Mirrors the generated code: 64-bit wrapping arithmetic, unsigned division
+    // and comparisons.
+    switch (op) {
+    case BinaryOp::add:
+        return lhs + rhs;
+    case BinaryOp::sub:
+        return lhs - rhs;
+    case BinaryOp::mul:
+        return lhs * rhs;
+    case BinaryOp::div:
+        if (rhs == 0) {
+            return {};
+        }
+        return lhs / rhs;
+    case BinaryOp::logical_and:
+        return lhs != 0 && rhs != 0 ? 1 : 0;
+    case BinaryOp::logical_or:
+        return lhs != 0 || rhs != 0 ? 1 : 0;
+    case BinaryOp::eq:
+        return lhs == rhs ? 1 : 0;
+    case BinaryOp::ne:
+        return lhs != rhs ? 1 : 0;
+    case BinaryOp::lt:
+        return lhs < rhs ? 1 : 0;
+    case BinaryOp::le:
+        return lhs <= rhs ? 1 : 0;
+    case BinaryOp::gt:
+        return lhs > rhs ? 1 : 0;
+    case BinaryOp::ge:
+        return lhs >= rhs ? 1 : 0;
+    }
+    return {};
+}
+
+bool isComparison(const BinaryOp op)
+{
+    return op >= BinaryOp::eq;
+}
+
+bool isLogical(const BinaryOp op)
+{
+    return op == BinaryOp::logical_and || op == BinaryOp::logical_or;
+}
+
+const ExprNode* unwrapParens(const ExprNode* expr)
+{
+    while (const auto* term = std::get_if<TermNode*>(&expr->expression)) {
+        const auto* paren = std::get_if<ParenthesizedExprNode*>(&(*term)->term);
+        if (paren == nullptr) {
+            break;
+        }
+        expr = (*paren)->expr;
+    }
+    return expr;
+}
+
+std::optional<uint64_t> intLiteralValue(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    if (term == nullptr) {
+        return {};
+    }
+    const auto* lit = std::get_if<IntLiteralNode*>(&(*term)->term);
+    if (lit == nullptr) {
+        return {};
+    }
+    return parseIntLiteral((*lit)->intLit);
+}
+
+const IdentifierNode* identifierOf(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    if (term == nullptr) {
+        return nullptr;
+    }
+    const auto* ident = std::get_if<IdentifierNode*>(&(*term)->term);
+    return ident == nullptr ? nullptr : *ident;
+}
+
+const CallNode* callOf(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    if (term == nullptr) {
+        return nullptr;
+    }
+    const auto* call = std::get_if<CallNode*>(&(*term)->term);
+    return call == nullptr ? nullptr : *call;
+}
+
+const ArrayLiteralNode* arrayLiteralOf(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    if (term == nullptr) {
+        return nullptr;
+    }
+    const auto* array = std::get_if<ArrayLiteralNode*>(&(*term)->term);
+    return array == nullptr ? nullptr : *array;
+}
+
+const IndexNode* indexOf(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    if (term == nullptr) {
+        return nullptr;
+    }
+    const auto* index = std::get_if<IndexNode*>(&(*term)->term);
+    return index == nullptr ? nullptr : *index;
+}
+
+const ReadNode* readOf(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    if (term == nullptr) {
+        return nullptr;
+    }
+    const auto* read = std::get_if<ReadNode*>(&(*term)->term);
+    return read == nullptr ? nullptr : *read;
+}
+
+bool containsCall(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        return containsCall(lhs) || containsCall(rhs);
+    }
+    if (const ArrayLiteralNode* array = arrayLiteralOf(expr)) {
+        return std::ranges::any_of(array->elements, containsCall);
+    }
+    if (const IndexNode* index = indexOf(expr)) {
+        return containsCall(index->index);
+    }
+    return callOf(expr) != nullptr || readOf(expr) != nullptr;
+}
+
+bool mayTrap(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression);
+    if (bin == nullptr) {
+        if (const ArrayLiteralNode* array = arrayLiteralOf(expr)) {
+            return std::ranges::any_of(array->elements, mayTrap);
+        }
+        return callOf(expr) != nullptr || indexOf(expr) != nullptr || readOf(expr) != nullptr;
+    }
+    const auto [op, lhs, rhs] = binaryOperands(*bin);
+    if (op == BinaryOp::div) {
+        const auto divisor = intLiteralValue(rhs);
+        if (!divisor.has_value() || divisor.value() == 0) {
+            return true;
+        }
+    }
+    return mayTrap(lhs) || mayTrap(rhs);
+}
+
+int exprLine(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        return exprLine(binaryOperands(*bin).lhs);
+    }
+    const TermNode* term = std::get<TermNode*>(expr->expression);
+    if (const auto* lit = std::get_if<IntLiteralNode*>(&term->term)) {
+        return (*lit)->intLit.line;
+    }
+    if (const auto* ident = std::get_if<IdentifierNode*>(&term->term)) {
+        return (*ident)->ident.line;
+    }
+    if (const auto* call = std::get_if<CallNode*>(&term->term)) {
+        return (*call)->name.line;
+    }
+    if (const auto* array = std::get_if<ArrayLiteralNode*>(&term->term)) {
+        return (*array)->open.line;
+    }
+    if (const auto* index = std::get_if<IndexNode*>(&term->term)) {
+        return (*index)->name.line;
+    }
+    if (const auto* read = std::get_if<ReadNode*>(&term->term)) {
+        return (*read)->read.line;
+    }
+    return 0;
+}
+
+int stmtLine(const StmtNode* stmt)
+{
+    struct LineVisitor {
+        int operator()(const ExitStatementNode* stmt_exit) const { return exprLine(stmt_exit->expr); }
+        int operator()(const LetStatementNode* stmt_let) const { return stmt_let->ident.line; }
+        int operator()(const AssignmentStatementNode* stmt_assign) const { return stmt_assign->ident.line; }
+        int operator()(const ScopeNode*) const { return 0; }
+        int operator()(const IfStatementNode* stmt_if) const { return exprLine(stmt_if->condition); }
+        int operator()(const WhileStatementNode* stmt_while) const { return exprLine(stmt_while->condition); }
+        int operator()(const ReturnStatementNode* stmt_return) const { return exprLine(stmt_return->expr); }
+        int operator()(const PrintStatementNode* stmt_print) const { return exprLine(stmt_print->expr); }
+    };
+    return std::visit(LineVisitor {}, stmt->statement);
+}
+
+ExprNode* makeIntLiteral(MemoryAllocator& allocator, const uint64_t value, const int line)
+{
+    auto lit = allocator.construct<IntLiteralNode>(Token { TokenType::int_lit, line, std::to_string(value) });
+    auto term = allocator.construct<TermNode>(lit);
+    return allocator.construct<ExprNode>(term);
+}
+
+ExprNode* makeIdentifier(MemoryAllocator& allocator, const std::string& name, const int line)
+{
+    auto ident = allocator.construct<IdentifierNode>(Token { TokenType::ident, line, name });
+    auto term = allocator.construct<TermNode>(ident);
+    return allocator.construct<ExprNode>(term);
+}
+
+ExprNode* makeBinary(MemoryAllocator& allocator, const BinaryOp op, ExprNode* lhs, ExprNode* rhs)
+{
+    auto bin = allocator.construct<BinaryExpressionNode>();
+    switch (op) {
+    case BinaryOp::add:
+        bin->operation = allocator.construct<AdditionNode>(lhs, rhs);
+        break;
+    case BinaryOp::sub:
+        bin->operation = allocator.construct<SubtractionNode>(lhs, rhs);
+        break;
+    case BinaryOp::mul:
+        bin->operation = allocator.construct<MultiplicationNode>(lhs, rhs);
+        break;
+    case BinaryOp::div:
+        bin->operation = allocator.construct<DivisionNode>(lhs, rhs);
+        break;
+    case BinaryOp::logical_and:
+        bin->operation = allocator.construct<LogicalAndNode>(lhs, rhs);
+        break;
+    case BinaryOp::logical_or:
+        bin->operation = allocator.construct<LogicalOrNode>(lhs, rhs);
+        break;
+    case BinaryOp::eq:
+        bin->operation = allocator.construct<EqualNode>(lhs, rhs);
+        break;
+    case BinaryOp::ne:
+        bin->operation = allocator.construct<NotEqualNode>(lhs, rhs);
+        break;
+    case BinaryOp::lt:
+        bin->operation = allocator.construct<LessNode>(lhs, rhs);
+        break;
+    case BinaryOp::le:
+        bin->operation = allocator.construct<LessEqualNode>(lhs, rhs);
+        break;
+    case BinaryOp::gt:
+        bin->operation = allocator.construct<GreaterNode>(lhs, rhs);
+        break;
+    case BinaryOp::ge:
+        bin->operation = allocator.construct<GreaterEqualNode>(lhs, rhs);
+        break;
+    }
+    return allocator.construct<ExprNode>(bin);
+}
+
+void forEachStmt(const std::vector<StmtNode*>& stmts, const std::function<void(StmtNode*)>& fn)
+{
+    struct StmtVisitor {
+        const std::function<void(StmtNode*)>& fn;
+
+        void operator()(const ExitStatementNode*) const { }
+        void operator()(const LetStatementNode*) const { }
+        void operator()(const AssignmentStatementNode*) const { }
+        void operator()(const ScopeNode* scope) const { forEachStmt(scope->statements, fn); }
+        void operator()(const IfStatementNode* stmt_if) const
+        {
+            forEachStmt(stmt_if->scope->statements, fn);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    forEachStmt((*else_)->scope->statements, fn);
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                forEachStmt(elif->scope->statements, fn);
+                pred = elif->next;
+            }
+        }
+        void operator()(const WhileStatementNode* stmt_while) const { forEachStmt(stmt_while->scope->statements, fn); }
+        void operator()(const ReturnStatementNode*) const { }
+        void operator()(const PrintStatementNode*) const { }
+    };
+    for (StmtNode* stmt : stmts) {
+        fn(stmt);
+        std::visit(StmtVisitor { .fn = fn }, stmt->statement);
+    }
+}
+
+void rewriteExprs(const std::vector<StmtNode*>& stmts, const std::function<ExprNode*(ExprNode*)>& fn)
+{
+    struct SlotVisitor {
+        const std::function<ExprNode*(ExprNode*)>& fn;
+
+        void operator()(ExitStatementNode* stmt_exit) const { stmt_exit->expr = fn(stmt_exit->expr); }
+        void operator()(LetStatementNode* stmt_let) const { stmt_let->expr = fn(stmt_let->expr); }
+        void operator()(AssignmentStatementNode* stmt_assign) const { stmt_assign->expr = fn(stmt_assign->expr); }
+        void operator()(ScopeNode*) const { }
+        void operator()(IfStatementNode* stmt_if) const
+        {
+            stmt_if->condition = fn(stmt_if->condition);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                auto* elif = std::get_if<ElseIfBranchNode*>(&pred.value()->branch);
+                if (elif == nullptr) {
+                    break;
+                }
+                (*elif)->condition = fn((*elif)->condition);
+                pred = (*elif)->next;
+            }
+        }
+        void operator()(WhileStatementNode* stmt_while) const { stmt_while->condition = fn(stmt_while->condition); }
+        void operator()(ReturnStatementNode* stmt_return) const { stmt_return->expr = fn(stmt_return->expr); }
+        void operator()(PrintStatementNode* stmt_print) const { stmt_print->expr = fn(stmt_print->expr); }
+    };
+    forEachStmt(stmts, [&](StmtNode* stmt) { std::visit(SlotVisitor { .fn = fn }, stmt->statement); });
+}
+
+ScopeNode* cloneScope(MemoryAllocator& allocator, const ScopeNode* scope,
+    const std::function<ExprNode*(ExprNode*)>& expr, const std::function<Token(const Token&)>& ident)
+{
+    auto new_scope = allocator.construct<ScopeNode>();
+    new_scope->statements.reserve(scope->statements.size());
+    for (const StmtNode* stmt : scope->statements) {
+        new_scope->statements.push_back(cloneStmt(allocator, stmt, expr, ident));
+    }
+    return new_scope;
+}
+
+StmtNode* cloneStmt(MemoryAllocator& allocator, const StmtNode* stmt,
+    const std::function<ExprNode*(ExprNode*)>& expr, const std::function<Token(const Token&)>& ident)
+{
+    struct StmtVisitor {
+        MemoryAllocator& allocator;
+        const std::function<ExprNode*(ExprNode*)>& expr;
+        const std::function<Token(const Token&)>& ident;
+
+        ScopeNode* scope(const ScopeNode* node) const { return cloneScope(allocator, node, expr, ident); }
+
+        StmtNode* operator()(const ExitStatementNode* stmt_exit) const
+        {
+            return allocator.construct<StmtNode>(allocator.construct<ExitStatementNode>(expr(stmt_exit->expr)));
+        }
+
+        StmtNode* operator()(const LetStatementNode* stmt_let) const
+        {
+            return allocator.construct<StmtNode>(
+                allocator.construct<LetStatementNode>(ident(stmt_let->ident), expr(stmt_let->expr), stmt_let->exported));
+        }
+
+        StmtNode* operator()(const AssignmentStatementNode* stmt_assign) const
+        {
+            return allocator.construct<StmtNode>(
+                allocator.construct<AssignmentStatementNode>(ident(stmt_assign->ident), expr(stmt_assign->expr)));
+        }
+
+        StmtNode* operator()(const ScopeNode* node) const { return allocator.construct<StmtNode>(scope(node)); }
+
+        StmtNode* operator()(const IfStatementNode* stmt_if) const
+        {
+            auto new_if = allocator.construct<IfStatementNode>(expr(stmt_if->condition), scope(stmt_if->scope));
+            std::optional<ElseIfNode*>* tail = &new_if->pred;
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    auto new_else = allocator.construct<ElseBranchNode>(scope((*else_)->scope));
+                    *tail = allocator.construct<ElseIfNode>(new_else);
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                auto new_elif = allocator.construct<ElseIfBranchNode>(expr(elif->condition), scope(elif->scope));
+                *tail = allocator.construct<ElseIfNode>(new_elif);
+                tail = &new_elif->next;
+                pred = elif->next;
+            }
+            return allocator.construct<StmtNode>(new_if);
+        }
+
+        StmtNode* operator()(const WhileStatementNode* stmt_while) const
+        {
+            return allocator.construct<StmtNode>(allocator.construct<WhileStatementNode>(
+                expr(stmt_while->condition), scope(stmt_while->scope), stmt_while->unroll));
+        }
+
+        StmtNode* operator()(const ReturnStatementNode* stmt_return) const
+        {
+            return allocator.construct<StmtNode>(allocator.construct<ReturnStatementNode>(expr(stmt_return->expr)));
+        }
+
+        StmtNode* operator()(const PrintStatementNode* stmt_print) const
+        {
+            return allocator.construct<StmtNode>(allocator.construct<PrintStatementNode>(expr(stmt_print->expr)));
+        }
+    };
+    return std::visit(StmtVisitor { .allocator = allocator, .expr = expr, .ident = ident }, stmt->statement);
+}
+
+ProgramNode copyProgram(MemoryAllocator& allocator, const ProgramNode& prog)
+{
+    const std::function<ExprNode*(ExprNode*)> same_expr = [](ExprNode* expr) { return expr; };
+    const std::function<Token(const Token&)> same_ident = [](const Token& token) { return token; };
+    ProgramNode copy;
+    copy.imports = prog.imports;
+    copy.statements.reserve(prog.statements.size());
+    for (const StmtNode* stmt : prog.statements) {
+        copy.statements.push_back(cloneStmt(allocator, stmt, same_expr, same_ident));
+    }
+    for (const FunctionNode* function : prog.functions) {
+        copy.functions.push_back(allocator.construct<FunctionNode>(
+            function->name, function->params, cloneScope(allocator, function->body, same_expr, same_ident)));
+    }
+    return copy;
+}
+
+size_t exprSize(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        return 1 + exprSize(lhs) + exprSize(rhs);
+    }
+    size_t size = 1;
+    if (const CallNode* call = callOf(expr)) {
+        for (const ExprNode* arg : call->args) {
+            size += exprSize(arg);
+        }
+    }
+    if (const ArrayLiteralNode* array = arrayLiteralOf(expr)) {
+        for (const ExprNode* element : array->elements) {
+            size += exprSize(element);
+        }
+    }
+    if (const IndexNode* index = indexOf(expr)) {
+        size += exprSize(index->index);
+    }
+    return size;
+}
+
+std::string exprText(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        return "(" + exprText(lhs) + " " + binaryOpText(op) + " " + exprText(rhs) + ")";
+    }
+    const TermNode* term = std::get<TermNode*>(expr->expression);
+    if (const auto* lit = std::get_if<IntLiteralNode*>(&term->term)) {
+        return (*lit)->intLit.value.value();
+    }
+    if (const auto* call = std::get_if<CallNode*>(&term->term)) {
+        std::string text = (*call)->name.value.value() + "(";
+        for (size_t i = 0; i < (*call)->args.size(); i++) {
+            text += (i == 0 ? "" : ", ") + exprText((*call)->args[i]);
+        }
+        return text + ")";
+    }
+    if (const auto* array = std::get_if<ArrayLiteralNode*>(&term->term)) {
+        std::string text = "[";
+        for (size_t i = 0; i < (*array)->elements.size(); i++) {
+            text += (i == 0 ? "" : ", ") + exprText((*array)->elements[i]);
+        }
+        return text + "]";
+    }
+    if (const auto* index = std::get_if<IndexNode*>(&term->term)) {
+        return (*index)->name.value.value() + "[" + exprText((*index)->index) + "]";
+    }
+    if (std::holds_alternative<ReadNode*>(term->term)) {
+        return "read()";
+    }
+    return std::get<IdentifierNode*>(term->term)->ident.value.value();
+}
+
+void collectAssigned(const ScopeNode* scope, std::unordered_set<std::string>& names)
+{
+    forEachStmt(scope->statements, [&](const StmtNode* stmt) {
+        if (const auto* stmt_assign = std::get_if<AssignmentStatementNode*>(&stmt->statement)) {
+            names.insert((*stmt_assign)->ident.value.value());
+        }
+    });
+}
+
+void collectDeclared(const ScopeNode* scope, std::unordered_set<std::string>& names)
+{
+    forEachStmt(scope->statements, [&](const StmtNode* stmt) {
+        if (const auto* stmt_let = std::get_if<LetStatementNode*>(&stmt->statement)) {
+            names.insert((*stmt_let)->ident.value.value());
+        }
+    });
+}
+
+namespace {
+
+class NameChecker {
+public:
+    bool check_program(const ProgramNode& prog)
+    {
+        for (const FunctionNode* function : prog.functions) {
+            if (function->params.size() > maxParams
+                || !m_arity.emplace(function->name.value.value(), function->params.size()).second) {
+                return false;
+            }
+        }
+        if (!check_block(prog.statements)) {
+            return false;
+        }
+        m_in_function = true;
+        for (const FunctionNode* function : prog.functions) {
+            m_declared.clear();
+            for (const Token& param : function->params) {
+                if (!m_declared.insert(param.value.value()).second) {
+                    return false;
+                }
+            }
+            if (!check_scope(function->body)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::unordered_map<std::string, size_t> m_arity;
+    std::unordered_set<std::string> m_declared;
+    std::vector<std::vector<std::string>> m_scopes;
+    bool m_in_function = false;
+
+    bool check_block(const std::vector<StmtNode*>& stmts)
+    {
+        return std::ranges::all_of(stmts, [this](const StmtNode* stmt) { return check_stmt(stmt); });
+    }
+
+    bool check_expr(const ExprNode* expr) const
+    {
+        expr = unwrapParens(expr);
+        if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+            const auto [op, lhs, rhs] = binaryOperands(*bin);
+            return check_expr(lhs) && check_expr(rhs);
+        }
+        if (const CallNode* call = callOf(expr)) {
+            const auto it = m_arity.find(call->name.value.value());
+            return it != m_arity.end() && it->second == call->args.size()
+                && std::ranges::all_of(call->args, [this](const ExprNode* arg) { return check_expr(arg); });
+        }
+        if (arrayLiteralOf(expr) != nullptr || indexOf(expr) != nullptr) {
+            return false;
+        }
+        const IdentifierNode* ident = identifierOf(expr);
+        return ident == nullptr || m_declared.contains(ident->ident.value.value());
+    }
+    bool check_scope(const ScopeNode* scope)
+    {
+        m_scopes.emplace_back();
+        const bool ok = check_block(scope->statements);
+        for (const std::string& name : m_scopes.back()) {
+            m_declared.erase(name);
+        }
+        m_scopes.pop_back();
+        return ok;
+    }
+
+    bool check_pred(const ElseIfNode* pred)
+    {
+        if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred->branch)) {
+            return check_scope((*else_)->scope);
+        }
+        const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred->branch);
+        return check_expr(elif->condition) && check_scope(elif->scope)
+            && (!elif->next.has_value() || check_pred(elif->next.value()));
+    }
+
+    bool check_stmt(const StmtNode* stmt)
+    {
+        struct StmtVisitor {
+            NameChecker& checker;
+
+            bool operator()(const ExitStatementNode* stmt_exit) const { return checker.check_expr(stmt_exit->expr); }
+
+            bool operator()(const LetStatementNode* stmt_let) const
+            {
+                const std::string& name = stmt_let->ident.value.value();
+                if (checker.m_declared.contains(name) || !checker.check_expr(stmt_let->expr)) {
+                    return false;
+                }
+                checker.m_declared.insert(name);
+                if (!checker.m_scopes.empty()) {
+                    checker.m_scopes.back().push_back(name);
+                }
+                return true;
+            }
+
+            bool operator()(const AssignmentStatementNode* stmt_assign) const
+            {
+                return checker.m_declared.contains(stmt_assign->ident.value.value())
+                    && checker.check_expr(stmt_assign->expr);
+            }
+
+            bool operator()(const ScopeNode* scope) const { return checker.check_scope(scope); }
+
+            bool operator()(const IfStatementNode* stmt_if) const
+            {
+                return checker.check_expr(stmt_if->condition) && checker.check_scope(stmt_if->scope)
+                    && (!stmt_if->pred.has_value() || checker.check_pred(stmt_if->pred.value()));
+            }
+
+            bool operator()(const WhileStatementNode* stmt_while) const
+            {
+                return checker.check_expr(stmt_while->condition) && checker.check_scope(stmt_while->scope);
+            }
+
+            bool operator()(const ReturnStatementNode* stmt_return) const
+            {
+                return checker.m_in_function && checker.check_expr(stmt_return->expr);
+            }
+
+            bool operator()(const PrintStatementNode* stmt_print) const { return checker.check_expr(stmt_print->expr); }
+        };
+        return std::visit(StmtVisitor { .checker = *this }, stmt->statement);
+    }
+};
+
+} // namespace
+
+bool namesResolve(const ProgramNode& prog)
+{
+    NameChecker checker;
+    return checker.check_program(prog);
+}
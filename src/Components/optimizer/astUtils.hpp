@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Components/syntax/syntaxAnalyzer.hpp"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+// Helpers shared by the AST passes. Expression nodes are treated as immutable:
+// a pass that rewrites an expression builds new nodes in its own arena and
+// replaces the pointer held by the statement.
+
+enum class BinaryOp {
+    add,
+    sub,
+    mul,
+    div,
+    logical_and,
+    logical_or,
+    // Comparisons, which `isComparison` expects last.
+    eq,
+    ne,
+    lt,
+    le,
+    gt,
+    ge,
+};
+
+struct BinaryOperands {
+    BinaryOp op;
+    ExprNode* lhs;
+    ExprNode* rhs;
+};
+
+[[nodiscard]] const char* binaryOpText(BinaryOp op);
+[[nodiscard]] BinaryOperands binaryOperands(const BinaryExpressionNode* bin_expr);
+[[nodiscard]] std::optional<uint64_t> parseIntLiteral(const Token& token);
+[[nodiscard]] std::optional<uint64_t> evalBinary(BinaryOp op, uint64_t lhs, uint64_t rhs);
+[[nodiscard]] bool isComparison(BinaryOp op);
+// `&&` or `||`, whose right operand does not always run.
+[[nodiscard]] bool isLogical(BinaryOp op);
+// Strips any number of parentheses around `expr`.
+[[nodiscard]] const ExprNode* unwrapParens(const ExprNode* expr);
+[[nodiscard]] std::optional<uint64_t> intLiteralValue(const ExprNode* expr);
+[[nodiscard]] const IdentifierNode* identifierOf(const ExprNode* expr);
+[[nodiscard]] const CallNode* callOf(const ExprNode* expr);
+[[nodiscard]] const ArrayLiteralNode* arrayLiteralOf(const ExprNode* expr);
+[[nodiscard]] const IndexNode* indexOf(const ExprNode* expr);
+[[nodiscard]] const ReadNode* readOf(const ExprNode* expr);
+// True when `expr` calls a function or reads stdin, so two evaluations may
+// differ.
+[[nodiscard]] bool containsCall(const ExprNode* expr);
+// True when evaluating `expr` can fault at runtime (division by anything but a
+// non-zero literal, an array index) or has an effect (any call, which may
+// `exit` or not return, or `read()`), so it must not be removed or moved to a
+// new path.
+[[nodiscard]] bool mayTrap(const ExprNode* expr);
+[[nodiscard]] int exprLine(const ExprNode* expr);
+// Source line a statement starts on, or 0 for a bare scope.
+[[nodiscard]] int stmtLine(const StmtNode* stmt);
+
+[[nodiscard]] ExprNode* makeIntLiteral(MemoryAllocator& allocator, uint64_t value, int line);
+[[nodiscard]] ExprNode* makeIdentifier(MemoryAllocator& allocator, const std::string& name, int line);
+[[nodiscard]] ExprNode* makeBinary(MemoryAllocator& allocator, BinaryOp op, ExprNode* lhs, ExprNode* rhs);
+
+// Calls `fn` on every statement of `stmts`, nested statements included,
+// parents before their children.
+void forEachStmt(const std::vector<StmtNode*>& stmts, const std::function<void(StmtNode*)>& fn);
+// Replaces every expression slot (statement expressions and conditions) of
+// `stmts`, nested statements included, with what `fn` returns for it.
+void rewriteExprs(const std::vector<StmtNode*>& stmts, const std::function<ExprNode*(ExprNode*)>& fn);
+// Copies the statement nodes of `stmt`, nested statements included. Each
+// expression slot of the copy holds what `expr` returns for the original one,
+// and each declared or assigned name what `ident` returns.
+[[nodiscard]] StmtNode* cloneStmt(MemoryAllocator& allocator, const StmtNode* stmt,
+    const std::function<ExprNode*(ExprNode*)>& expr, const std::function<Token(const Token&)>& ident);
+[[nodiscard]] ScopeNode* cloneScope(MemoryAllocator& allocator, const ScopeNode* scope,
+    const std::function<ExprNode*(ExprNode*)>& expr, const std::function<Token(const Token&)>& ident);
+// A copy of `prog` the passes can rewrite while `prog` stays as parsed. Only
+// statements are copied; expressions are immutable and shared.
+[[nodiscard]] ProgramNode copyProgram(MemoryAllocator& allocator, const ProgramNode& prog);
+[[nodiscard]] size_t exprSize(const ExprNode* expr);
+// Fully parenthesized source text, usable as a structural key.
+[[nodiscard]] std::string exprText(const ExprNode* expr);
+// Add the target of every assignment / the name of every `let` in `scope`.
+void collectAssigned(const ScopeNode* scope, std::unordered_set<std::string>& names);
+void collectDeclared(const ScopeNode* scope, std::unordered_set<std::string>& names);
+
+// Arguments are passed in registers, so a function takes at most this many.
+inline constexpr size_t maxParams = 6;
+
+// Mirrors the declaration checks `Generator` performs. The passes assume every
+// identifier resolves to exactly one `let` or parameter and every call to a
+// function of the right arity, so they are skipped when this fails and the
+// generator reports the error as usual. They also model every value as a
+// number, so this fails for a program that uses arrays.
+[[nodiscard]] bool namesResolve(const ProgramNode& prog);
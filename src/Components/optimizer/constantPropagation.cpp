@@ -0,0 +1,411 @@
+#include "constantPropagation.hpp"
+
+ConstantPropagation::ConstantPropagation(MemoryAllocator& allocator, const size_t budget)
+    : m_Allocator(allocator)
+    , m_budget(budget)
+{
+}
+
+ConstantPropagation::LatticeValue ConstantPropagation::LatticeValue::meet(const LatticeValue& other) const
+{
+    if (kind == Kind::undefined) {
+        return other;
+    }
+    if (other.kind == Kind::undefined) {
+        return *this;
+    }
+    if (kind == Kind::constant && other.kind == Kind::constant && value == other.value) {
+        return *this;
+    }
+    return { .kind = Kind::overdefined };
+}
+
+bool ConstantPropagation::spend(const size_t units)
+{
+    if (m_stats.budget_exhausted) {
+        return false;
+    }
+    if (units > m_budget) {
+        m_stats.budget_exhausted = true;
+        return false;
+    }
+    m_budget -= units;
+    return true;
+}
+
+void ConstantPropagation::assign(const std::string& name, const LatticeValue value)
+{
+    LatticeValue& slot = m_values.at(name);
+    m_trail.emplace_back(name, slot);
+    slot = value;
+}
+
+void ConstantPropagation::rollback(const size_t mark)
+{
+    while (m_trail.size() > mark) {
+        auto& [name, old] = m_trail.back();
+        // Names declared inside the rolled back arm are already out of scope.
+        if (const auto it = m_values.find(name); it != m_values.end()) {
+            it->second = old;
+        }
+        m_trail.pop_back();
+    }
+}
+
+ConstantPropagation::Folded ConstantPropagation::fold(ExprNode* expr)
+{
+    if (!spend(1)) {
+        return { expr, {} };
+    }
+    if (auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        const Folded new_lhs = fold(lhs);
+        // A constant left operand that decides `&&` or `||` skips the right one.
+        if (isLogical(op) && new_lhs.value.has_value()
+            && (new_lhs.value.value() != 0) == (op == BinaryOp::logical_or)) {
+            const uint64_t value = op == BinaryOp::logical_or ? 1 : 0;
+            m_stats.folded_exprs++;
+            return { makeIntLiteral(m_Allocator, value, exprLine(expr)), value };
+        }
+        const Folded new_rhs = fold(rhs);
+        if (new_lhs.value.has_value() && new_rhs.value.has_value()) {
+            if (const auto value = evalBinary(op, new_lhs.value.value(), new_rhs.value.value())) {
+                m_stats.folded_exprs++;
+                return { makeIntLiteral(m_Allocator, value.value(), exprLine(expr)), value };
+            }
+        }
+        if (new_lhs.expr == lhs && new_rhs.expr == rhs) {
+            return { expr, {} };
+        }
+        return { makeBinary(m_Allocator, op, new_lhs.expr, new_rhs.expr), {} };
+    }
+
+    struct TermVisitor {
+        ConstantPropagation& pass;
+        ExprNode* expr;
+
+        Folded operator()(const IntLiteralNode* lit) const { return { expr, parseIntLiteral(lit->intLit) }; }
+
+        Folded operator()(const IdentifierNode* ident) const
+        {
+            const LatticeValue& value = pass.m_values.at(ident->ident.value.value());
+            if (!value.is_constant()) {
+                return { expr, {} };
+            }
+            pass.m_stats.folded_exprs++;
+            return { makeIntLiteral(pass.m_Allocator, value.value, ident->ident.line), value.value };
+        }
+
+        Folded operator()(const ParenthesizedExprNode* paren) const
+        {
+            const Folded inner = pass.fold(paren->expr);
+            if (inner.value.has_value()) {
+                return inner;
+            }
+            if (inner.expr == paren->expr) {
+                return { expr, {} };
+            }
+            auto new_paren = pass.m_Allocator.construct<ParenthesizedExprNode>(inner.expr);
+            auto term = pass.m_Allocator.construct<TermNode>(new_paren);
+            return { pass.m_Allocator.construct<ExprNode>(term), {} };
+        }
+
+        // The callee's result is unknown here; only the arguments fold.
+        Folded operator()(const CallNode* call) const
+        {
+            std::vector<ExprNode*> args;
+            bool changed = false;
+            for (ExprNode* arg : call->args) {
+                args.push_back(pass.fold(arg).expr);
+                changed = changed || args.back() != arg;
+            }
+            if (!changed) {
+                return { expr, {} };
+            }
+            auto new_call = pass.m_Allocator.construct<CallNode>(call->name, std::move(args));
+            auto term = pass.m_Allocator.construct<TermNode>(new_call);
+            return { pass.m_Allocator.construct<ExprNode>(term), {} };
+        }
+
+        // Programs with arrays skip the passes (see `namesResolve`).
+        Folded operator()(const ArrayLiteralNode*) const { return { expr, {} }; }
+        Folded operator()(const IndexNode*) const { return { expr, {} }; }
+        Folded operator()(const ReadNode*) const { return { expr, {} }; }
+    };
+    return std::visit(TermVisitor { .pass = *this, .expr = expr }, std::get<TermNode*>(expr->expression)->term);
+}
+
+void ConstantPropagation::visit_block(std::vector<StmtNode*>& stmts)
+{
+    std::vector<StmtNode*> kept;
+    kept.reserve(stmts.size());
+    for (StmtNode* stmt : stmts) {
+        if (!m_reachable && !m_stats.budget_exhausted) {
+            m_stats.removed_stmts++;
+            continue;
+        }
+        if (visit_stmt(stmt)) {
+            kept.push_back(stmt);
+        }
+        else {
+            m_stats.removed_stmts++;
+        }
+    }
+    stmts = std::move(kept);
+}
+
+void ConstantPropagation::visit_scope(ScopeNode* scope)
+{
+    m_scopes.emplace_back();
+    visit_block(scope->statements);
+    for (const std::string& name : m_scopes.back()) {
+        m_values.erase(name);
+    }
+    m_scopes.pop_back();
+}
+
+bool ConstantPropagation::visit_if(StmtNode* stmt, IfStatementNode* stmt_if)
+{
+    // Every condition of the chain is evaluated in the state before the `if`,
+    // so they can all be folded up front. Arms after a condition that is
+    // always true can never run.
+    std::vector<Arm> arms;
+    size_t arm_count = 0;
+    auto add_arm = [&](ExprNode* condition, ScopeNode* scope) {
+        arm_count++;
+        if (!arms.empty() && arms.back().condition == nullptr) {
+            return;
+        }
+        if (condition == nullptr) {
+            arms.push_back({ nullptr, scope });
+            return;
+        }
+        const Folded folded = fold(condition);
+        if (!folded.value.has_value()) {
+            arms.push_back({ folded.expr, scope });
+        }
+        else if (folded.value.value() != 0) {
+            arms.push_back({ nullptr, scope });
+        }
+    };
+    add_arm(stmt_if->condition, stmt_if->scope);
+    for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+        if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+            add_arm(nullptr, (*else_)->scope);
+            break;
+        }
+        const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+        add_arm(elif->condition, elif->scope);
+        pred = elif->next;
+    }
+    if (m_stats.budget_exhausted) {
+        return true;
+    }
+
+    if (arms.size() != arm_count || (!arms.empty() && arms.front().condition == nullptr)) {
+        m_stats.folded_branches++;
+    }
+    if (arms.empty()) {
+        return false;
+    }
+    if (arms.front().condition == nullptr) {
+        stmt->statement = arms.front().scope;
+        visit_scope(arms.front().scope);
+        return true;
+    }
+
+    // Walk each arm from the entry state, remember the values it leaves in
+    // outer variables and undo them before the next arm.
+    const bool falls_through = arms.back().condition != nullptr;
+    std::vector<std::unordered_map<std::string, LatticeValue>> arm_exits;
+    for (const Arm& arm : arms) {
+        const size_t mark = m_trail.size();
+        m_reachable = true;
+        visit_scope(arm.scope);
+        if (m_stats.budget_exhausted) {
+            return true;
+        }
+        if (m_reachable) {
+            auto& exits = arm_exits.emplace_back();
+            for (size_t i = mark; i < m_trail.size(); i++) {
+                const std::string& name = m_trail[i].first;
+                if (const auto it = m_values.find(name); it != m_values.end()) {
+                    exits[name] = it->second;
+                }
+            }
+        }
+        rollback(mark);
+    }
+    std::unordered_map<std::string, LatticeValue> merged;
+    for (const auto& exits : arm_exits) {
+        for (const auto& [name, value] : exits) {
+            merged.try_emplace(name);
+        }
+    }
+    if (!spend(merged.size() * (arm_exits.size() + 1))) {
+        return true;
+    }
+    for (auto& [name, value] : merged) {
+        const LatticeValue entry = m_values.at(name);
+        for (const auto& exits : arm_exits) {
+            const auto it = exits.find(name);
+            value = value.meet(it == exits.end() ? entry : it->second);
+        }
+        if (falls_through) {
+            value = value.meet(entry);
+        }
+        assign(name, value);
+    }
+    m_reachable = falls_through || !arm_exits.empty();
+
+    stmt_if->condition = arms.front().condition;
+    stmt_if->scope = arms.front().scope;
+    stmt_if->pred.reset();
+    std::optional<ElseIfNode*>* tail = &stmt_if->pred;
+    for (size_t i = 1; i < arms.size(); i++) {
+        if (arms[i].condition == nullptr) {
+            auto else_ = m_Allocator.construct<ElseBranchNode>(arms[i].scope);
+            *tail = m_Allocator.construct<ElseIfNode>(else_);
+            break;
+        }
+        auto elif = m_Allocator.construct<ElseIfBranchNode>(arms[i].condition, arms[i].scope);
+        *tail = m_Allocator.construct<ElseIfNode>(elif);
+        tail = &elif->next;
+    }
+    return true;
+}
+
+bool ConstantPropagation::visit_while(WhileStatementNode* stmt_while)
+{
+    // The entry test only probes the condition; the fold that replaces it,
+    // at the loop head, is the one counted.
+    const size_t folded_exprs = m_stats.folded_exprs;
+    const Folded entry = fold(stmt_while->condition);
+    m_stats.folded_exprs = folded_exprs;
+    if (m_stats.budget_exhausted) {
+        return true;
+    }
+    if (entry.value.has_value() && entry.value.value() == 0) {
+        m_stats.folded_branches++;
+        return false;
+    }
+
+    // The loop head merges the entry state with every back edge, so anything
+    // the body assigns is overdefined there and after the loop.
+    std::unordered_set<std::string> assigned;
+    collectAssigned(stmt_while->scope, assigned);
+    if (!spend(assigned.size() * 2 + 1)) {
+        return true;
+    }
+    const auto kill_assigned = [&] {
+        for (const std::string& name : assigned) {
+            if (m_values.contains(name)) {
+                assign(name, { .kind = LatticeValue::Kind::overdefined });
+            }
+        }
+    };
+    kill_assigned();
+    const Folded head = fold(stmt_while->condition);
+    stmt_while->condition = head.expr;
+    visit_scope(stmt_while->scope);
+    if (m_stats.budget_exhausted) {
+        return true;
+    }
+    kill_assigned();
+    // Only a false condition leaves the loop.
+    m_reachable = !head.value.has_value() || head.value.value() == 0;
+    return true;
+}
+
+bool ConstantPropagation::visit_stmt(StmtNode* stmt)
+{
+    if (!spend(1)) {
+        return true;
+    }
+    struct StmtVisitor {
+        ConstantPropagation& pass;
+        StmtNode* stmt;
+
+        bool operator()(ExitStatementNode* stmt_exit) const
+        {
+            stmt_exit->expr = pass.fold(stmt_exit->expr).expr;
+            pass.m_reachable = false;
+            return true;
+        }
+
+        bool operator()(LetStatementNode* stmt_let) const
+        {
+            const Folded folded = pass.fold(stmt_let->expr);
+            stmt_let->expr = folded.expr;
+            LatticeValue value { .kind = LatticeValue::Kind::overdefined };
+            if (folded.value.has_value()) {
+                value = { .kind = LatticeValue::Kind::constant, .value = folded.value.value() };
+            }
+            const std::string& name = stmt_let->ident.value.value();
+            pass.m_values[name] = value;
+            if (!pass.m_scopes.empty()) {
+                pass.m_scopes.back().push_back(name);
+            }
+            return true;
+        }
+
+        bool operator()(AssignmentStatementNode* stmt_assign) const
+        {
+            const Folded folded = pass.fold(stmt_assign->expr);
+            stmt_assign->expr = folded.expr;
+            LatticeValue value { .kind = LatticeValue::Kind::overdefined };
+            if (folded.value.has_value()) {
+                value = { .kind = LatticeValue::Kind::constant, .value = folded.value.value() };
+            }
+            pass.assign(stmt_assign->ident.value.value(), value);
+            return true;
+        }
+
+        bool operator()(ScopeNode* scope) const
+        {
+            pass.visit_scope(scope);
+            return true;
+        }
+
+        bool operator()(IfStatementNode* stmt_if) const { return pass.visit_if(stmt, stmt_if); }
+
+        bool operator()(WhileStatementNode* stmt_while) const { return pass.visit_while(stmt_while); }
+
+        bool operator()(ReturnStatementNode* stmt_return) const
+        {
+            stmt_return->expr = pass.fold(stmt_return->expr).expr;
+            pass.m_reachable = false;
+            return true;
+        }
+
+        bool operator()(PrintStatementNode* stmt_print) const
+        {
+            stmt_print->expr = pass.fold(stmt_print->expr).expr;
+            return true;
+        }
+    };
+    return std::visit(StmtVisitor { .pass = *this, .stmt = stmt }, stmt->statement);
+}
+
+ConstantPropagation::Stats ConstantPropagation::run(ProgramNode& prog)
+{
+    m_stats = {};
+    m_values.clear();
+    m_scopes.clear();
+    m_trail.clear();
+    m_reachable = true;
+    visit_block(prog.statements);
+    // Each body starts from unknown parameters; nothing flows between
+    // functions.
+    for (FunctionNode* function : prog.functions) {
+        m_values.clear();
+        m_scopes.clear();
+        m_trail.clear();
+        m_reachable = true;
+        for (const Token& param : function->params) {
+            m_values[param.value.value()] = { .kind = LatticeValue::Kind::overdefined };
+        }
+        visit_scope(function->body);
+    }
+    return m_stats;
+}
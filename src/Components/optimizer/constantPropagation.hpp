@@ -0,0 +1,68 @@
+#pragma once
+
+#include "astUtils.hpp"
+#include <unordered_map>
+
+// Sparse conditional constant propagation over the structured control flow of
+// the AST. Variables carry a lattice value (constant or overdefined) along
+// `let`, assignment, `if/elif/else` and `while`; arms whose condition folds to
+// a constant are pruned or taken unconditionally, loops that never run are
+// removed, and code after an `exit` or `return` that always runs is dropped.
+// Function bodies are walked separately with unknown parameters. The walk is
+// linear in the program size; `budget` caps the work units spent before the
+// pass stops rewriting.
+class ConstantPropagation {
+public:
+    struct Stats {
+        size_t folded_exprs = 0;
+        size_t folded_branches = 0;
+        size_t removed_stmts = 0;
+        bool budget_exhausted = false;
+    };
+
+    static constexpr size_t defaultBudget = 1 << 24;
+
+    // Rewritten expressions are placed in `allocator`.
+    explicit ConstantPropagation(MemoryAllocator& allocator, size_t budget = defaultBudget);
+    Stats run(ProgramNode& prog);
+
+private:
+    struct LatticeValue {
+        enum class Kind {
+            undefined,
+            constant,
+            overdefined,
+        };
+        Kind kind = Kind::undefined;
+        uint64_t value = 0;
+
+        [[nodiscard]] bool is_constant() const { return kind == Kind::constant; }
+        [[nodiscard]] LatticeValue meet(const LatticeValue& other) const;
+    };
+    struct Folded {
+        ExprNode* expr;
+        std::optional<uint64_t> value;
+    };
+    struct Arm {
+        ExprNode* condition; // nullptr for `else`
+        ScopeNode* scope;
+    };
+
+    MemoryAllocator& m_Allocator;
+    size_t m_budget;
+    Stats m_stats {};
+    std::unordered_map<std::string, LatticeValue> m_values {};
+    std::vector<std::vector<std::string>> m_scopes {};
+    std::vector<std::pair<std::string, LatticeValue>> m_trail {};
+    bool m_reachable = true;
+
+    bool spend(size_t units);
+    void assign(const std::string& name, LatticeValue value);
+    void rollback(size_t mark);
+    Folded fold(ExprNode* expr);
+    void visit_block(std::vector<StmtNode*>& stmts);
+    void visit_scope(ScopeNode* scope);
+    bool visit_if(StmtNode* stmt, IfStatementNode* stmt_if);
+    bool visit_while(WhileStatementNode* stmt_while);
+    bool visit_stmt(StmtNode* stmt);
+};
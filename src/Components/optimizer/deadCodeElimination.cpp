@@ -0,0 +1,220 @@
+#include "deadCodeElimination.hpp"
+
+void DeadCodeElimination::count_reads(const ExprNode* expr, const std::optional<size_t> store_of)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        count_reads(lhs, store_of);
+        count_reads(rhs, store_of);
+        return;
+    }
+    if (const CallNode* call = callOf(expr)) {
+        for (const ExprNode* arg : call->args) {
+            count_reads(arg, store_of);
+        }
+        return;
+    }
+    const IdentifierNode* ident = identifierOf(expr);
+    if (ident == nullptr) {
+        return;
+    }
+    const size_t decl = m_in_scope.at(ident->ident.value.value());
+    // `x = x + 1` alone does not keep `x` alive.
+    if (store_of.has_value() && store_of.value() == decl) {
+        return;
+    }
+    m_decls[decl].reads++;
+    if (store_of.has_value()) {
+        m_decls[store_of.value()].store_reads.push_back(decl);
+    }
+}
+
+void DeadCodeElimination::collect_block(const std::vector<StmtNode*>& stmts)
+{
+    for (StmtNode* stmt : stmts) {
+        collect_stmt(stmt);
+    }
+}
+
+void DeadCodeElimination::collect_scope(const ScopeNode* scope)
+{
+    m_scopes.emplace_back();
+    collect_block(scope->statements);
+    for (const std::string& name : m_scopes.back()) {
+        m_in_scope.erase(name);
+    }
+    m_scopes.pop_back();
+}
+
+void DeadCodeElimination::collect_stmt(StmtNode* stmt)
+{
+    struct StmtVisitor {
+        DeadCodeElimination& pass;
+        StmtNode* stmt;
+
+        void operator()(const ExitStatementNode* stmt_exit) const { pass.count_reads(stmt_exit->expr, {}); }
+
+        void operator()(const LetStatementNode* stmt_let) const
+        {
+            const size_t decl = pass.m_decls.size();
+            Decl& entry = pass.m_decls.emplace_back();
+            entry.stores.push_back(stmt);
+            entry.removable = !mayTrap(stmt_let->expr);
+            pass.count_reads(stmt_let->expr, decl);
+            const std::string& name = stmt_let->ident.value.value();
+            pass.m_in_scope[name] = decl;
+            if (!pass.m_scopes.empty()) {
+                pass.m_scopes.back().push_back(name);
+            }
+        }
+
+        void operator()(const AssignmentStatementNode* stmt_assign) const
+        {
+            const size_t decl = pass.m_in_scope.at(stmt_assign->ident.value.value());
+            Decl& entry = pass.m_decls[decl];
+            entry.stores.push_back(stmt);
+            entry.removable = entry.removable && !mayTrap(stmt_assign->expr);
+            pass.count_reads(stmt_assign->expr, decl);
+        }
+
+        void operator()(const ScopeNode* scope) const { pass.collect_scope(scope); }
+
+        void operator()(const IfStatementNode* stmt_if) const
+        {
+            pass.count_reads(stmt_if->condition, {});
+            pass.collect_scope(stmt_if->scope);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    pass.collect_scope((*else_)->scope);
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                pass.count_reads(elif->condition, {});
+                pass.collect_scope(elif->scope);
+                pred = elif->next;
+            }
+        }
+
+        void operator()(const WhileStatementNode* stmt_while) const
+        {
+            pass.count_reads(stmt_while->condition, {});
+            pass.collect_scope(stmt_while->scope);
+        }
+
+        void operator()(const ReturnStatementNode* stmt_return) const { pass.count_reads(stmt_return->expr, {}); }
+
+        void operator()(const PrintStatementNode* stmt_print) const { pass.count_reads(stmt_print->expr, {}); }
+    };
+    std::visit(StmtVisitor { .pass = *this, .stmt = stmt }, stmt->statement);
+}
+
+void DeadCodeElimination::remove_dead()
+{
+    std::vector<size_t> worklist;
+    for (size_t decl = 0; decl < m_decls.size(); decl++) {
+        if (m_decls[decl].reads == 0 && m_decls[decl].removable) {
+            worklist.push_back(decl);
+        }
+    }
+    while (!worklist.empty()) {
+        Decl& decl = m_decls[worklist.back()];
+        worklist.pop_back();
+        if (decl.removed) {
+            continue;
+        }
+        decl.removed = true;
+        m_dead.insert(decl.stores.begin(), decl.stores.end());
+        for (const size_t read : decl.store_reads) {
+            Decl& source = m_decls[read];
+            if (--source.reads == 0 && source.removable && !source.removed) {
+                worklist.push_back(read);
+            }
+        }
+    }
+}
+
+void DeadCodeElimination::sweep_block(std::vector<StmtNode*>& stmts)
+{
+    std::erase_if(stmts, [this](StmtNode* stmt) {
+        if (sweep_stmt(stmt)) {
+            return false;
+        }
+        m_stats.removed_stmts++;
+        return true;
+    });
+}
+
+bool DeadCodeElimination::sweep_stmt(StmtNode* stmt)
+{
+    if (m_dead.contains(stmt)) {
+        return false;
+    }
+    struct StmtVisitor {
+        DeadCodeElimination& pass;
+
+        bool operator()(const ExitStatementNode*) const { return true; }
+        bool operator()(const LetStatementNode*) const { return true; }
+        bool operator()(const AssignmentStatementNode*) const { return true; }
+        bool operator()(const ReturnStatementNode*) const { return true; }
+        bool operator()(const PrintStatementNode*) const { return true; }
+
+        bool operator()(ScopeNode* scope) const
+        {
+            pass.sweep_block(scope->statements);
+            return !scope->statements.empty();
+        }
+
+        bool operator()(IfStatementNode* stmt_if) const
+        {
+            pass.sweep_block(stmt_if->scope->statements);
+            bool needed = !stmt_if->scope->statements.empty() || mayTrap(stmt_if->condition);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    pass.sweep_block((*else_)->scope->statements);
+                    needed = needed || !(*else_)->scope->statements.empty();
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                pass.sweep_block(elif->scope->statements);
+                needed = needed || !elif->scope->statements.empty() || mayTrap(elif->condition);
+                pred = elif->next;
+            }
+            return needed;
+        }
+
+        // A loop is kept even when empty: it may never terminate.
+        bool operator()(WhileStatementNode* stmt_while) const
+        {
+            pass.sweep_block(stmt_while->scope->statements);
+            return true;
+        }
+    };
+    return std::visit(StmtVisitor { .pass = *this }, stmt->statement);
+}
+
+DeadCodeElimination::Stats DeadCodeElimination::run(ProgramNode& prog)
+{
+    m_decls.clear();
+    m_in_scope.clear();
+    m_scopes.clear();
+    m_dead.clear();
+    m_stats = {};
+    collect_block(prog.statements);
+    // A parameter is a declaration without a `let`: when it is never read,
+    // the assignments to it go.
+    for (const FunctionNode* function : prog.functions) {
+        m_in_scope.clear();
+        for (const Token& param : function->params) {
+            m_in_scope[param.value.value()] = m_decls.size();
+            m_decls.emplace_back();
+        }
+        collect_scope(function->body);
+    }
+    remove_dead();
+    sweep_block(prog.statements);
+    for (FunctionNode* function : prog.functions) {
+        sweep_block(function->body->statements);
+    }
+    return m_stats;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "astUtils.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+// Removes variables that are never read: their `let` and every assignment to
+// them, as long as none of those expressions can trap. Removing a store can
+// leave other variables unread, so this runs to a fixed point over a worklist.
+// Scopes and `if` statements that end up empty are dropped as well.
+class DeadCodeElimination {
+public:
+    struct Stats {
+        size_t removed_stmts = 0;
+    };
+
+    Stats run(ProgramNode& prog);
+
+private:
+    struct Decl {
+        size_t reads = 0;
+        bool removable = true;
+        bool removed = false;
+        std::vector<StmtNode*> stores {};
+        std::vector<size_t> store_reads {}; // decls read by the stores, with repetition
+    };
+
+    std::vector<Decl> m_decls {};
+    std::unordered_map<std::string, size_t> m_in_scope {};
+    std::vector<std::vector<std::string>> m_scopes {};
+    std::unordered_set<const StmtNode*> m_dead {};
+    Stats m_stats {};
+
+    void count_reads(const ExprNode* expr, std::optional<size_t> store_of);
+    void collect_block(const std::vector<StmtNode*>& stmts);
+    void collect_scope(const ScopeNode* scope);
+    void collect_stmt(StmtNode* stmt);
+    void remove_dead();
+    void sweep_block(std::vector<StmtNode*>& stmts);
+    [[nodiscard]] bool sweep_stmt(StmtNode* stmt);
+};
@@ -0,0 +1,366 @@
+#include "inliner.hpp"
+#include <algorithm>
+
+namespace {
+
+void forEachCall(const ExprNode* expr, const std::function<void(const CallNode*)>& fn)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        forEachCall(lhs, fn);
+        forEachCall(rhs, fn);
+        return;
+    }
+    if (const CallNode* call = callOf(expr)) {
+        fn(call);
+        for (const ExprNode* arg : call->args) {
+            forEachCall(arg, fn);
+        }
+    }
+}
+
+// Calls and `read()`s in `expr`: the leaves whose effects must stay in order.
+size_t countEffects(const ExprNode* expr)
+{
+    expr = unwrapParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        return countEffects(lhs) + countEffects(rhs);
+    }
+    if (const CallNode* call = callOf(expr)) {
+        size_t effects = 1;
+        for (const ExprNode* arg : call->args) {
+            effects += countEffects(arg);
+        }
+        return effects;
+    }
+    return readOf(expr) != nullptr ? 1 : 0;
+}
+
+// Every call in `stmts`, in any expression slot.
+void forEachCall(const std::vector<StmtNode*>& stmts, const std::function<void(const CallNode*)>& fn)
+{
+    rewriteExprs(stmts, [&](ExprNode* expr) {
+        forEachCall(expr, fn);
+        return expr;
+    });
+}
+
+// Copies a function body for one call site with its parameters and variables
+// renamed. Expressions without identifiers are shared, as they are immutable.
+struct Cloner {
+    MemoryAllocator& allocator;
+    const std::unordered_map<std::string, std::string>& names;
+
+    [[nodiscard]] Token rename(const Token& token) const
+    {
+        return { token.type, token.line, names.at(token.value.value()) };
+    }
+
+    ExprNode* expr(ExprNode* node) const
+    {
+        if (const auto* bin = std::get_if<BinaryExpressionNode*>(&node->expression)) {
+            const auto [op, lhs, rhs] = binaryOperands(*bin);
+            return makeBinary(allocator, op, expr(lhs), expr(rhs));
+        }
+        struct TermVisitor {
+            const Cloner& cloner;
+            ExprNode* node;
+
+            ExprNode* operator()(const IntLiteralNode*) const { return node; }
+
+            ExprNode* operator()(const IdentifierNode* ident) const
+            {
+                return makeIdentifier(cloner.allocator, cloner.names.at(ident->ident.value.value()), ident->ident.line);
+            }
+
+            ExprNode* operator()(const ParenthesizedExprNode* paren) const
+            {
+                auto new_paren = cloner.allocator.construct<ParenthesizedExprNode>(cloner.expr(paren->expr));
+                return cloner.allocator.construct<ExprNode>(cloner.allocator.construct<TermNode>(new_paren));
+            }
+
+            ExprNode* operator()(const CallNode* call) const
+            {
+                std::vector<ExprNode*> args;
+                for (ExprNode* arg : call->args) {
+                    args.push_back(cloner.expr(arg));
+                }
+                auto new_call = cloner.allocator.construct<CallNode>(call->name, std::move(args));
+                return cloner.allocator.construct<ExprNode>(cloner.allocator.construct<TermNode>(new_call));
+            }
+
+            ExprNode* operator()(const ArrayLiteralNode* array) const
+            {
+                std::vector<ExprNode*> elements;
+                for (ExprNode* element : array->elements) {
+                    elements.push_back(cloner.expr(element));
+                }
+                auto new_array = cloner.allocator.construct<ArrayLiteralNode>(array->open, std::move(elements));
+                return cloner.allocator.construct<ExprNode>(cloner.allocator.construct<TermNode>(new_array));
+            }
+
+            ExprNode* operator()(const IndexNode* index) const
+            {
+                auto new_index
+                    = cloner.allocator.construct<IndexNode>(cloner.rename(index->name), cloner.expr(index->index));
+                return cloner.allocator.construct<ExprNode>(cloner.allocator.construct<TermNode>(new_index));
+            }
+
+            ExprNode* operator()(const ReadNode*) const { return node; }
+        };
+        return std::visit(TermVisitor { .cloner = *this, .node = node }, std::get<TermNode*>(node->expression)->term);
+    }
+
+    StmtNode* stmt(const StmtNode* node) const
+    {
+        return cloneStmt(
+            allocator, node, [this](ExprNode* slot) { return expr(slot); },
+            [this](const Token& token) { return rename(token); });
+    }
+};
+
+} // namespace
+
+Inliner::Inliner(MemoryAllocator& allocator)
+    : m_Allocator(allocator)
+{
+}
+
+void Inliner::process(Callee& callee)
+{
+    if (callee.visited) {
+        return;
+    }
+    callee.visited = true;
+    std::vector<StmtNode*>& body = callee.function->body->statements;
+    forEachCall(body, [this](const CallNode* call) { process(m_callees.at(call->name.value.value())); });
+    m_loop_depth = 0;
+    visit_block(body);
+    analyze(callee);
+}
+
+void Inliner::analyze(Callee& callee) const
+{
+    const std::vector<StmtNode*>& body = callee.function->body->statements;
+    const StmtNode* final_return
+        = !body.empty() && std::holds_alternative<ReturnStatementNode*>(body.back()->statement) ? body.back() : nullptr;
+    bool inlinable = true;
+    bool prints = false;
+    size_t size = 0;
+    forEachStmt(body, [&](const StmtNode* stmt) {
+        size++;
+        prints = prints || std::holds_alternative<PrintStatementNode*>(stmt->statement);
+        inlinable = inlinable && !std::holds_alternative<ExitStatementNode*>(stmt->statement)
+            && !std::holds_alternative<WhileStatementNode*>(stmt->statement)
+            && (stmt == final_return || !std::holds_alternative<ReturnStatementNode*>(stmt->statement));
+    });
+    rewriteExprs(body, [&](ExprNode* expr) {
+        size += exprSize(expr);
+        inlinable = inlinable && !mayTrap(expr);
+        return expr;
+    });
+    callee.analyzed = true;
+    callee.inlinable = inlinable;
+    callee.prints = prints;
+    callee.size = size;
+}
+
+bool Inliner::should_inline(const Callee& callee, const std::vector<ExprNode*>& args, const bool reorder_ok) const
+{
+    if (!callee.analyzed || !callee.inlinable) {
+        return false;
+    }
+    if (!reorder_ok
+        && (callee.prints || std::ranges::any_of(args, [](const ExprNode* arg) { return mayTrap(arg); }))) {
+        return false;
+    }
+    return callee.size <= alwaysInlineSize || callee.sites == 1
+        || (callee.size <= maxInlineSize && m_loop_depth > 0);
+}
+
+ExprNode* Inliner::expand(const FunctionNode* function, const std::vector<ExprNode*>& args, const int line)
+{
+    const std::string prefix = "$inl" + std::to_string(m_inline_count++) + "_";
+    std::unordered_map<std::string, std::string> names;
+    for (const Token& param : function->params) {
+        names.emplace(param.value.value(), prefix + param.value.value());
+    }
+    const std::vector<StmtNode*>& body = function->body->statements;
+    forEachStmt(body, [&](const StmtNode* stmt) {
+        if (const auto* stmt_let = std::get_if<LetStatementNode*>(&stmt->statement)) {
+            names.emplace((*stmt_let)->ident.value.value(), prefix + (*stmt_let)->ident.value.value());
+        }
+    });
+
+    for (size_t i = 0; i < args.size(); i++) {
+        auto stmt_let = m_Allocator.construct<LetStatementNode>(
+            Token { TokenType::ident, line, names.at(function->params[i].value.value()) }, args[i]);
+        m_pending_lets.push_back(m_Allocator.construct<StmtNode>(stmt_let));
+    }
+    const Cloner cloner { .allocator = m_Allocator, .names = names };
+    for (const StmtNode* stmt : body) {
+        if (const auto* stmt_return = std::get_if<ReturnStatementNode*>(&stmt->statement)) {
+            return cloner.expr((*stmt_return)->expr);
+        }
+        m_pending_lets.push_back(cloner.stmt(stmt));
+    }
+    return makeIntLiteral(m_Allocator, 0, line);
+}
+
+ExprNode* Inliner::inline_calls(ExprNode* expr, const bool sole_call, const bool whole)
+{
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        // Right operand first, the order the generated code evaluates them in.
+        // The right operand of `&&` and `||` may not run at all, so its calls
+        // only move ahead of the statement when their arguments cannot trap.
+        ExprNode* new_rhs = inline_calls(rhs, sole_call && !isLogical(op), false);
+        ExprNode* new_lhs = inline_calls(lhs, sole_call, false);
+        if (new_lhs == lhs && new_rhs == rhs) {
+            return expr;
+        }
+        return makeBinary(m_Allocator, op, new_lhs, new_rhs);
+    }
+    const TermNode* term = std::get<TermNode*>(expr->expression);
+    if (const auto* paren = std::get_if<ParenthesizedExprNode*>(&term->term)) {
+        ExprNode* inner = inline_calls((*paren)->expr, sole_call, whole);
+        if (inner == (*paren)->expr) {
+            return expr;
+        }
+        auto new_paren = m_Allocator.construct<ParenthesizedExprNode>(inner);
+        return m_Allocator.construct<ExprNode>(m_Allocator.construct<TermNode>(new_paren));
+    }
+    const auto* call = std::get_if<CallNode*>(&term->term);
+    if (call == nullptr) {
+        return expr;
+    }
+    std::vector<ExprNode*> args;
+    bool changed = false;
+    for (ExprNode* arg : (*call)->args) {
+        args.push_back(inline_calls(arg, sole_call, false));
+        changed = changed || args.back() != arg;
+    }
+    const Callee& callee = m_callees.at((*call)->name.value.value());
+    // Arguments keep their order when the call is the whole expression.
+    if (should_inline(callee, args, sole_call || whole)) {
+        m_stats.inlined_calls++;
+        return expand(callee.function, args, (*call)->name.line);
+    }
+    if (!changed) {
+        return expr;
+    }
+    auto new_call = m_Allocator.construct<CallNode>((*call)->name, std::move(args));
+    return m_Allocator.construct<ExprNode>(m_Allocator.construct<TermNode>(new_call));
+}
+
+ExprNode* Inliner::inline_slot(ExprNode* expr)
+{
+    // A call is alone only when no other call or `read()` shares the slot.
+    const size_t effects = countEffects(expr);
+    return effects == 0 ? expr : inline_calls(expr, effects == 1, true);
+}
+
+void Inliner::visit_block(std::vector<StmtNode*>& stmts)
+{
+    std::vector<StmtNode*> result;
+    result.reserve(stmts.size());
+    for (StmtNode* stmt : stmts) {
+        std::vector<StmtNode*> outer_pending;
+        std::swap(outer_pending, m_pending_lets);
+        visit_stmt(stmt);
+        result.insert(result.end(), m_pending_lets.begin(), m_pending_lets.end());
+        result.push_back(stmt);
+        m_pending_lets = std::move(outer_pending);
+    }
+    stmts = std::move(result);
+}
+
+void Inliner::visit_stmt(StmtNode* stmt)
+{
+    struct StmtVisitor {
+        Inliner& pass;
+
+        void operator()(ExitStatementNode* stmt_exit) const { stmt_exit->expr = pass.inline_slot(stmt_exit->expr); }
+        void operator()(LetStatementNode* stmt_let) const { stmt_let->expr = pass.inline_slot(stmt_let->expr); }
+        void operator()(AssignmentStatementNode* stmt_assign) const
+        {
+            stmt_assign->expr = pass.inline_slot(stmt_assign->expr);
+        }
+        void operator()(ReturnStatementNode* stmt_return) const
+        {
+            stmt_return->expr = pass.inline_slot(stmt_return->expr);
+        }
+        void operator()(PrintStatementNode* stmt_print) const { stmt_print->expr = pass.inline_slot(stmt_print->expr); }
+        void operator()(ScopeNode* scope) const { pass.visit_block(scope->statements); }
+
+        // Later conditions only run when the earlier ones fail, so they keep
+        // their calls.
+        void operator()(IfStatementNode* stmt_if) const
+        {
+            stmt_if->condition = pass.inline_slot(stmt_if->condition);
+            pass.visit_block(stmt_if->scope->statements);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    pass.visit_block((*else_)->scope->statements);
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                pass.visit_block(elif->scope->statements);
+                pred = elif->next;
+            }
+        }
+
+        void operator()(WhileStatementNode* stmt_while) const
+        {
+            pass.m_loop_depth++;
+            pass.visit_block(stmt_while->scope->statements);
+            pass.m_loop_depth--;
+        }
+    };
+    std::visit(StmtVisitor { .pass = *this }, stmt->statement);
+}
+
+void Inliner::remove_unreachable(ProgramNode& prog)
+{
+    std::unordered_set<std::string> reachable;
+    std::vector<const FunctionNode*> worklist;
+    const auto reach = [&](const CallNode* call) {
+        const std::string& name = call->name.value.value();
+        if (reachable.insert(name).second) {
+            worklist.push_back(m_callees.at(name).function);
+        }
+    };
+    forEachCall(prog.statements, reach);
+    while (!worklist.empty()) {
+        const FunctionNode* function = worklist.back();
+        worklist.pop_back();
+        forEachCall(function->body->statements, reach);
+    }
+    m_stats.removed_functions = std::erase_if(prog.functions,
+        [&](const FunctionNode* function) { return !reachable.contains(function->name.value.value()); });
+}
+
+Inliner::Stats Inliner::run(ProgramNode& prog)
+{
+    m_stats = {};
+    m_callees.clear();
+    m_inline_count = 0;
+    for (FunctionNode* function : prog.functions) {
+        m_callees.emplace(function->name.value.value(), Callee { .function = function });
+    }
+    const auto count_site = [this](const CallNode* call) { m_callees.at(call->name.value.value()).sites++; };
+    forEachCall(prog.statements, count_site);
+    for (const FunctionNode* function : prog.functions) {
+        forEachCall(function->body->statements, count_site);
+    }
+
+    for (FunctionNode* function : prog.functions) {
+        process(m_callees.at(function->name.value.value()));
+    }
+    m_loop_depth = 0;
+    visit_block(prog.statements);
+    remove_unreachable(prog);
+    return m_stats;
+}
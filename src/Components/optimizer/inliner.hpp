@@ -0,0 +1,63 @@
+#pragma once
+
+#include "astUtils.hpp"
+#include <unordered_map>
+
+// Inlines calls to small functions, callees before their callers, so a
+// function's own calls are folded in before its size is measured. A callee is
+// inlinable when it has no effect besides its result (no `exit`, no `while`,
+// no call left and no expression that may trap), so running it ahead of the
+// rest of the caller's statement cannot be observed, and returns only through
+// a `return` at the end of its body. A call site is inlined when the callee is
+// at most `alwaysInlineSize` nodes, has a single call site, or is at most
+// `maxInlineSize` nodes and is called from inside a loop.
+//
+// The arguments become `let`s of `$inlN_<param>` right before the statement,
+// followed by the body with its variables renamed the same way, and the call is
+// replaced by the returned expression. Only expressions that always run are
+// rewritten: statement expressions and the first condition of an `if`.
+// Arguments that may trap or call are only moved when the call is the whole
+// expression or the only call in it. Functions no call can reach any more are
+// removed.
+class Inliner {
+public:
+    struct Stats {
+        size_t inlined_calls = 0;
+        size_t removed_functions = 0;
+    };
+
+    static constexpr size_t alwaysInlineSize = 12;
+    static constexpr size_t maxInlineSize = 64;
+
+    // New nodes are placed in `allocator`.
+    explicit Inliner(MemoryAllocator& allocator);
+    Stats run(ProgramNode& prog);
+
+private:
+    struct Callee {
+        FunctionNode* function;
+        size_t sites = 0; // call sites in the whole program
+        bool visited = false;
+        bool analyzed = false;
+        bool inlinable = false;
+        bool prints = false; // its body has a `print`, an effect inlining moves ahead of the statement
+        size_t size = 0;
+    };
+
+    MemoryAllocator& m_Allocator;
+    Stats m_stats {};
+    std::unordered_map<std::string, Callee> m_callees {};
+    size_t m_inline_count = 0;
+    size_t m_loop_depth = 0;
+    std::vector<StmtNode*> m_pending_lets {};
+
+    void process(Callee& callee);
+    void analyze(Callee& callee) const;
+    [[nodiscard]] bool should_inline(const Callee& callee, const std::vector<ExprNode*>& args, bool reorder_ok) const;
+    ExprNode* expand(const FunctionNode* function, const std::vector<ExprNode*>& args, int line);
+    ExprNode* inline_calls(ExprNode* expr, bool sole_call, bool whole);
+    ExprNode* inline_slot(ExprNode* expr);
+    void visit_block(std::vector<StmtNode*>& stmts);
+    void visit_stmt(StmtNode* stmt);
+    void remove_unreachable(ProgramNode& prog);
+};
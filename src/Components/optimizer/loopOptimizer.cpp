@@ -0,0 +1,252 @@
+#include "loopOptimizer.hpp"
+#include <map>
+
+LoopOptimizer::LoopOptimizer(MemoryAllocator& allocator)
+    : m_Allocator(allocator)
+{
+}
+
+StmtNode* LoopOptimizer::make_let(const std::string& name, ExprNode* expr, const int line)
+{
+    auto stmt_let = m_Allocator.construct<LetStatementNode>(Token { TokenType::ident, line, name }, expr);
+    return m_Allocator.construct<StmtNode>(stmt_let);
+}
+
+void LoopOptimizer::visit_block(std::vector<StmtNode*>& stmts)
+{
+    std::vector<StmtNode*> result;
+    result.reserve(stmts.size());
+    for (StmtNode* stmt : stmts) {
+        std::vector<StmtNode*> outer_pending;
+        std::swap(outer_pending, m_pending_lets);
+        visit_stmt(stmt);
+        result.insert(result.end(), m_pending_lets.begin(), m_pending_lets.end());
+        result.push_back(stmt);
+        m_pending_lets = std::move(outer_pending);
+    }
+    stmts = std::move(result);
+}
+
+void LoopOptimizer::visit_stmt(StmtNode* stmt)
+{
+    struct StmtVisitor {
+        LoopOptimizer& pass;
+
+        void operator()(const ExitStatementNode*) const { }
+        void operator()(const LetStatementNode*) const { }
+        void operator()(const AssignmentStatementNode*) const { }
+        void operator()(const ReturnStatementNode*) const { }
+        void operator()(const PrintStatementNode*) const { }
+        void operator()(ScopeNode* scope) const { pass.visit_block(scope->statements); }
+
+        void operator()(IfStatementNode* stmt_if) const
+        {
+            pass.visit_block(stmt_if->scope->statements);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    pass.visit_block((*else_)->scope->statements);
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                pass.visit_block(elif->scope->statements);
+                pred = elif->next;
+            }
+        }
+
+        void operator()(WhileStatementNode* stmt_while) const
+        {
+            pass.visit_block(stmt_while->scope->statements);
+            pass.hoist_invariants(stmt_while);
+            pass.reduce_strength(stmt_while);
+            pass.choose_unroll(stmt_while);
+        }
+    };
+    std::visit(StmtVisitor { .pass = *this }, stmt->statement);
+}
+
+void LoopOptimizer::hoist_invariants(WhileStatementNode* stmt_while)
+{
+    std::unordered_set<std::string> variant;
+    collectAssigned(stmt_while->scope, variant);
+    collectDeclared(stmt_while->scope, variant);
+    std::function<bool(const ExprNode*)> invariant = [&](const ExprNode* expr) {
+        expr = unwrapParens(expr);
+        if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+            const auto [op, lhs, rhs] = binaryOperands(*bin);
+            return invariant(lhs) && invariant(rhs);
+        }
+        const IdentifierNode* ident = identifierOf(expr);
+        return ident == nullptr || !variant.contains(ident->ident.value.value());
+    };
+
+    std::unordered_map<std::string, std::string> temps;
+    std::function<ExprNode*(ExprNode*)> hoist = [&](ExprNode* expr) -> ExprNode* {
+        if (auto* term = std::get_if<TermNode*>(&expr->expression)) {
+            const auto* paren = std::get_if<ParenthesizedExprNode*>(&(*term)->term);
+            if (paren == nullptr) {
+                return expr;
+            }
+            ExprNode* inner = hoist((*paren)->expr);
+            if (inner == (*paren)->expr) {
+                return expr;
+            }
+            return inner;
+        }
+        if (invariant(expr) && !mayTrap(expr)) {
+            const int line = exprLine(expr);
+            const auto [it, inserted] = temps.try_emplace(exprText(expr));
+            if (inserted) {
+                it->second = "$licm" + std::to_string(m_licm_count++);
+                m_pending_lets.push_back(make_let(it->second, expr, line));
+            }
+            m_stats.hoisted_exprs++;
+            return makeIdentifier(m_Allocator, it->second, line);
+        }
+        const auto [op, lhs, rhs] = binaryOperands(std::get<BinaryExpressionNode*>(expr->expression));
+        ExprNode* new_lhs = hoist(lhs);
+        ExprNode* new_rhs = hoist(rhs);
+        if (new_lhs == lhs && new_rhs == rhs) {
+            return expr;
+        }
+        return makeBinary(m_Allocator, op, new_lhs, new_rhs);
+    };
+    stmt_while->condition = hoist(stmt_while->condition);
+    rewriteExprs(stmt_while->scope->statements, hoist);
+}
+
+void LoopOptimizer::reduce_strength(WhileStatementNode* stmt_while)
+{
+    std::vector<StmtNode*>& body = stmt_while->scope->statements;
+    std::unordered_map<std::string, size_t> assignments;
+    forEachStmt(body, [&](const StmtNode* stmt) {
+        if (const auto* stmt_assign = std::get_if<AssignmentStatementNode*>(&stmt->statement)) {
+            assignments[(*stmt_assign)->ident.value.value()]++;
+        }
+    });
+    std::unordered_set<std::string> declared;
+    collectDeclared(stmt_while->scope, declared);
+
+    // Basic induction variables: `i = i + c`, `i = c + i` or `i = i - c` as the
+    // only write to `i` in the loop, directly in the body so it runs exactly
+    // once per iteration.
+    std::unordered_map<std::string, Induction> inductions;
+    for (size_t index = 0; index < body.size(); index++) {
+        const auto* stmt_assign = std::get_if<AssignmentStatementNode*>(&body[index]->statement);
+        if (stmt_assign == nullptr) {
+            continue;
+        }
+        const std::string& name = (*stmt_assign)->ident.value.value();
+        if (assignments.at(name) != 1 || declared.contains(name)) {
+            continue;
+        }
+        const auto* bin = std::get_if<BinaryExpressionNode*>(&unwrapParens((*stmt_assign)->expr)->expression);
+        if (bin == nullptr) {
+            continue;
+        }
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        const auto is_self = [&](const ExprNode* expr) {
+            const IdentifierNode* ident = identifierOf(expr);
+            return ident != nullptr && ident->ident.value.value() == name;
+        };
+        std::optional<uint64_t> step;
+        if ((op == BinaryOp::add || op == BinaryOp::sub) && is_self(lhs)) {
+            step = intLiteralValue(rhs);
+        }
+        else if (op == BinaryOp::add && is_self(rhs)) {
+            step = intLiteralValue(lhs);
+        }
+        if (step.has_value()) {
+            inductions.emplace(name, Induction { name, op, step.value(), index });
+        }
+    }
+    if (inductions.empty()) {
+        return;
+    }
+
+    // Each `i * k` is kept in a temporary that moves with `i`; wrapping
+    // arithmetic makes `(i + c) * k == i * k + c * k` exact.
+    std::map<std::pair<std::string, uint64_t>, std::string> temps;
+    std::map<size_t, std::vector<StmtNode*>> updates;
+    std::function<ExprNode*(ExprNode*)> reduce = [&](ExprNode* expr) -> ExprNode* {
+        if (auto* term = std::get_if<TermNode*>(&expr->expression)) {
+            const auto* paren = std::get_if<ParenthesizedExprNode*>(&(*term)->term);
+            if (paren == nullptr) {
+                return expr;
+            }
+            ExprNode* inner = reduce((*paren)->expr);
+            return inner == (*paren)->expr ? expr : inner;
+        }
+        const auto [op, lhs, rhs] = binaryOperands(std::get<BinaryExpressionNode*>(expr->expression));
+        if (op == BinaryOp::mul) {
+            const IdentifierNode* ident = identifierOf(lhs);
+            std::optional<uint64_t> factor = intLiteralValue(rhs);
+            if (ident == nullptr || !factor.has_value()) {
+                ident = identifierOf(rhs);
+                factor = intLiteralValue(lhs);
+            }
+            const auto induction = ident == nullptr ? inductions.end() : inductions.find(ident->ident.value.value());
+            if (induction != inductions.end() && factor.has_value()) {
+                const Induction& iv = induction->second;
+                const int line = exprLine(expr);
+                const auto [it, inserted] = temps.try_emplace({ iv.name, factor.value() });
+                if (inserted) {
+                    it->second = "$sr" + std::to_string(m_sr_count++);
+                    m_pending_lets.push_back(make_let(it->second,
+                        makeBinary(m_Allocator, BinaryOp::mul, makeIdentifier(m_Allocator, iv.name, line),
+                            makeIntLiteral(m_Allocator, factor.value(), line)),
+                        line));
+                    auto bump = m_Allocator.construct<AssignmentStatementNode>(Token { TokenType::ident, line, it->second },
+                        makeBinary(m_Allocator, iv.step_op, makeIdentifier(m_Allocator, it->second, line),
+                            makeIntLiteral(m_Allocator, iv.step * factor.value(), line)));
+                    updates[iv.index].push_back(m_Allocator.construct<StmtNode>(bump));
+                }
+                m_stats.reduced_exprs++;
+                return makeIdentifier(m_Allocator, it->second, line);
+            }
+        }
+        ExprNode* new_lhs = reduce(lhs);
+        ExprNode* new_rhs = reduce(rhs);
+        if (new_lhs == lhs && new_rhs == rhs) {
+            return expr;
+        }
+        return makeBinary(m_Allocator, op, new_lhs, new_rhs);
+    };
+    stmt_while->condition = reduce(stmt_while->condition);
+    rewriteExprs(body, reduce);
+    for (auto it = updates.rbegin(); it != updates.rend(); ++it) {
+        body.insert(body.begin() + static_cast<std::ptrdiff_t>(it->first) + 1, it->second.begin(), it->second.end());
+    }
+}
+
+void LoopOptimizer::choose_unroll(WhileStatementNode* stmt_while)
+{
+    size_t size = exprSize(stmt_while->condition);
+    bool nested = false;
+    forEachStmt(stmt_while->scope->statements, [&](const StmtNode* stmt) {
+        size++;
+        nested = nested || std::holds_alternative<WhileStatementNode*>(stmt->statement);
+    });
+    rewriteExprs(stmt_while->scope->statements, [&](ExprNode* expr) {
+        size += exprSize(expr);
+        return expr;
+    });
+    // Nested loops are left alone so code size stays proportional.
+    const size_t factor = std::min(maxUnrollFactor, maxUnrolledSize / size);
+    if (nested || factor < 2) {
+        return;
+    }
+    stmt_while->unroll = static_cast<unsigned>(factor);
+    m_stats.unrolled_loops++;
+}
+
+LoopOptimizer::Stats LoopOptimizer::run(ProgramNode& prog)
+{
+    m_stats = {};
+    m_licm_count = 0;
+    m_sr_count = 0;
+    visit_block(prog.statements);
+    for (FunctionNode* function : prog.functions) {
+        visit_block(function->body->statements);
+    }
+    return m_stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "astUtils.hpp"
+#include <unordered_map>
+
+// Loop optimizations for `while`, innermost loops first:
+//  - loop-invariant code motion: maximal pure subexpressions that read no
+//    variable the loop assigns or declares are computed once into a `$licmN`
+//    temporary before the loop (trapping divisions stay put, since the loop
+//    may not run at all);
+//  - strength reduction: for a basic induction variable `i = i +/- c` assigned
+//    once at the top level of the body, each `i * k` becomes a `$srN`
+//    temporary that is bumped by `c * k` right after `i`;
+//  - partial unrolling: small loops get `unroll` set so `Generator` emits
+//    several body copies per back edge, bounded by `maxUnrolledSize` nodes.
+class LoopOptimizer {
+public:
+    struct Stats {
+        size_t hoisted_exprs = 0;
+        size_t reduced_exprs = 0;
+        size_t unrolled_loops = 0;
+    };
+
+    static constexpr size_t maxUnrollFactor = 4;
+    static constexpr size_t maxUnrolledSize = 64;
+
+    // New nodes are placed in `allocator`.
+    explicit LoopOptimizer(MemoryAllocator& allocator);
+    Stats run(ProgramNode& prog);
+
+private:
+    struct Induction {
+        std::string name;
+        BinaryOp step_op;
+        uint64_t step;
+        size_t index; // position of the update in the body
+    };
+
+    MemoryAllocator& m_Allocator;
+    Stats m_stats {};
+    size_t m_licm_count = 0;
+    size_t m_sr_count = 0;
+    std::vector<StmtNode*> m_pending_lets {};
+
+    StmtNode* make_let(const std::string& name, ExprNode* expr, int line);
+    void visit_block(std::vector<StmtNode*>& stmts);
+    void visit_stmt(StmtNode* stmt);
+    void hoist_invariants(WhileStatementNode* stmt_while);
+    void reduce_strength(WhileStatementNode* stmt_while);
+    void choose_unroll(WhileStatementNode* stmt_while);
+};
@@ -0,0 +1,267 @@
+#include "passManager.hpp"
+#include "constantPropagation.hpp"
+#include "deadCodeElimination.hpp"
+#include "inliner.hpp"
+#include "loopOptimizer.hpp"
+#include "reassociation.hpp"
+#include "valueNumbering.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+struct Pass {
+    std::string_view name;
+    // Runs the pass, writes its counters to `stats` and returns how many
+    // changes it made.
+    size_t (*run)(ProgramNode& prog, MemoryAllocator& allocator, std::ostream& stats);
+};
+
+constexpr std::array<Pass, 6> passes = { {
+    { "inline",
+        [](ProgramNode& prog, MemoryAllocator& allocator, std::ostream& stats) -> size_t {
+            const Inliner::Stats s = Inliner(allocator).run(prog);
+            stats << s.inlined_calls << " calls inlined, " << s.removed_functions << " functions removed";
+            return s.inlined_calls + s.removed_functions;
+        } },
+    { "sccp",
+        [](ProgramNode& prog, MemoryAllocator& allocator, std::ostream& stats) -> size_t {
+            const ConstantPropagation::Stats s = ConstantPropagation(allocator).run(prog);
+            stats << s.folded_exprs << " folded expressions, " << s.folded_branches << " folded branches, "
+                  << s.removed_stmts << " unreachable statements removed"
+                  << (s.budget_exhausted ? " (budget exhausted)" : "");
+            return s.folded_exprs + s.folded_branches + s.removed_stmts;
+        } },
+    { "loops",
+        [](ProgramNode& prog, MemoryAllocator& allocator, std::ostream& stats) -> size_t {
+            const LoopOptimizer::Stats s = LoopOptimizer(allocator).run(prog);
+            stats << s.hoisted_exprs << " invariant expressions hoisted, " << s.reduced_exprs
+                  << " multiplications strength-reduced, " << s.unrolled_loops << " loops unrolled";
+            return s.hoisted_exprs + s.reduced_exprs + s.unrolled_loops;
+        } },
+    { "gvn",
+        [](ProgramNode& prog, MemoryAllocator& allocator, std::ostream& stats) -> size_t {
+            const ValueNumbering::Stats s = ValueNumbering(allocator).run(prog);
+            stats << s.eliminated_exprs << " expressions eliminated, " << s.temporaries << " temporaries";
+            return s.eliminated_exprs;
+        } },
+    { "reassoc",
+        [](ProgramNode& prog, MemoryAllocator& allocator, std::ostream& stats) -> size_t {
+            const Reassociation::Stats s = Reassociation(allocator).run(prog);
+            stats << s.rebuilt_chains << " chains rebuilt, " << s.folded_constants << " constants folded";
+            return s.rebuilt_chains + s.folded_constants;
+        } },
+    { "dce",
+        [](ProgramNode& prog, MemoryAllocator&, std::ostream& stats) -> size_t {
+            const DeadCodeElimination::Stats s = DeadCodeElimination().run(prog);
+            stats << s.removed_stmts << " statements removed";
+            return s.removed_stmts;
+        } },
+} };
+
+const Pass* findPass(const std::string_view name)
+{
+    for (const Pass& pass : passes) {
+        if (pass.name == name) {
+            return &pass;
+        }
+    }
+    return nullptr;
+}
+
+void printScope(std::ostream& os, const ScopeNode* scope, int depth);
+
+void printStmt(std::ostream& os, const StmtNode* stmt, const int depth)
+{
+    struct StmtVisitor {
+        std::ostream& os;
+        int depth;
+
+        void operator()(const ExitStatementNode* stmt_exit) const { os << "exit(" << exprText(stmt_exit->expr) << ");\n"; }
+        void operator()(const LetStatementNode* stmt_let) const
+        {
+            os << (stmt_let->exported ? "export let " : "let ") << stmt_let->ident.value.value() << " = "
+               << exprText(stmt_let->expr) << ";\n";
+        }
+        void operator()(const AssignmentStatementNode* stmt_assign) const
+        {
+            os << stmt_assign->ident.value.value() << " = " << exprText(stmt_assign->expr) << ";\n";
+        }
+        void operator()(const ReturnStatementNode* stmt_return) const
+        {
+            os << "return " << exprText(stmt_return->expr) << ";\n";
+        }
+        void operator()(const PrintStatementNode* stmt_print) const
+        {
+            os << "print(" << exprText(stmt_print->expr) << ");\n";
+        }
+        void operator()(const ScopeNode* scope) const
+        {
+            printScope(os, scope, depth);
+            os << "\n";
+        }
+        void operator()(const IfStatementNode* stmt_if) const
+        {
+            os << "if (" << exprText(stmt_if->condition) << ") ";
+            printScope(os, stmt_if->scope, depth);
+            for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+                if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+                    os << " else ";
+                    printScope(os, (*else_)->scope, depth);
+                    break;
+                }
+                const ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+                os << " elif (" << exprText(elif->condition) << ") ";
+                printScope(os, elif->scope, depth);
+                pred = elif->next;
+            }
+            os << "\n";
+        }
+        void operator()(const WhileStatementNode* stmt_while) const
+        {
+            os << "while (" << exprText(stmt_while->condition) << ") ";
+            printScope(os, stmt_while->scope, depth);
+            if (stmt_while->unroll > 1) {
+                os << " // unrolled " << stmt_while->unroll << " times";
+            }
+            os << "\n";
+        }
+    };
+    os << std::string(depth * 4, ' ');
+    std::visit(StmtVisitor { .os = os, .depth = depth }, stmt->statement);
+}
+
+void printScope(std::ostream& os, const ScopeNode* scope, const int depth)
+{
+    os << "{\n";
+    for (const StmtNode* stmt : scope->statements) {
+        printStmt(os, stmt, depth + 1);
+    }
+    os << std::string(depth * 4, ' ') << "}";
+}
+
+} // namespace
+
+std::vector<std::string> pipelineFor(const OptLevel level)
+{
+    switch (level) {
+    case OptLevel::O0:
+        return {};
+    case OptLevel::O1:
+        return { "sccp", "dce" };
+    case OptLevel::Os:
+        return { "sccp", "gvn", "reassoc", "dce" };
+    case OptLevel::O2:
+        break;
+    }
+    return { "inline", "sccp", "loops", "gvn", "reassoc", "dce" };
+}
+
+bool isPassName(const std::string_view name)
+{
+    return findPass(name) != nullptr;
+}
+
+std::string passNames()
+{
+    std::string names;
+    for (const Pass& pass : passes) {
+        names += (names.empty() ? "" : ", ") + std::string(pass.name);
+    }
+    return names;
+}
+
+std::optional<std::vector<std::string>> parsePassList(const std::string_view list, std::string& error)
+{
+    std::vector<std::string> pipeline;
+    size_t start = 0;
+    while (start <= list.size()) {
+        const size_t comma = std::min(list.find(',', start), list.size());
+        const std::string_view name = list.substr(start, comma - start);
+        if (!isPassName(name)) {
+            error = list.empty() ? "no passes given"
+                : name.empty()   ? "empty pass name in '" + std::string(list) + "'"
+                                 : "unknown pass '" + std::string(name) + "'";
+            return {};
+        }
+        pipeline.emplace_back(name);
+        start = comma + 1;
+    }
+    return pipeline;
+}
+
+PassManager::PassManager(MemoryAllocator& allocator, PhaseTimer& timer)
+    : m_Allocator(allocator)
+    , m_timer(timer)
+{
+}
+
+std::vector<PassReport> PassManager::run(ProgramNode& prog, const std::vector<std::string>& pipeline,
+    const std::string& print_after, std::string& dump)
+{
+    if (pipeline.empty()) {
+        return {};
+    }
+    m_timer.begin("optimize");
+    if (!namesResolve(prog)) {
+        return {};
+    }
+    std::vector<PassReport> reports;
+    reports.reserve(pipeline.size());
+    for (const std::string& name : pipeline) {
+        const Pass* pass = findPass(name);
+        m_timer.begin(name);
+        const size_t arena_start = m_Allocator.bytesUsed();
+        const uint64_t heap_start = threadAllocations().bytes;
+        const auto start = std::chrono::steady_clock::now();
+        std::ostringstream stats;
+        PassReport report { .name = name };
+        report.changes = pass->run(prog, m_Allocator, stats);
+        report.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        report.heap_bytes = threadAllocations().bytes - heap_start;
+        report.arena_bytes = m_Allocator.bytesUsed() - arena_start;
+        report.stats = stats.str();
+        reports.push_back(std::move(report));
+        if (name == print_after) {
+            std::ostringstream text;
+            text << "// after " << name << "\n";
+            printProgram(text, prog);
+            dump += text.str();
+        }
+    }
+    return reports;
+}
+
+std::string formatPassReports(const std::vector<PassReport>& reports)
+{
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3);
+    for (const PassReport& report : reports) {
+        text << report.name << ": " << report.stats << " [" << report.wall_ms << " ms, "
+             << static_cast<double>(report.arena_bytes + report.heap_bytes) / 1024 << " KB, " << report.changes
+             << " changes]\n";
+    }
+    return text.str();
+}
+
+void printProgram(std::ostream& os, const ProgramNode& prog)
+{
+    for (const Token& import : prog.imports) {
+        os << "import \"" << import.value.value() << "\";\n";
+    }
+    for (const FunctionNode* function : prog.functions) {
+        os << "fn " << function->name.value.value() << "(";
+        for (size_t i = 0; i < function->params.size(); i++) {
+            os << (i == 0 ? "" : ", ") << function->params[i].value.value();
+        }
+        os << ") ";
+        printScope(os, function->body, 0);
+        os << "\n";
+    }
+    for (const StmtNode* stmt : prog.statements) {
+        printStmt(os, stmt, 0);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Components/diagnostics/timeReport.hpp"
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MemoryAllocator;
+struct ProgramNode;
+
+// Optimization levels, each a fixed pipeline of the registered AST passes:
+//  -O0  none, not even the name resolution they need;
+//  -O1  sccp, dce: constants and dead stores, each a linear walk;
+//  -O2  inline, sccp, loops, gvn, reassoc, dce (the default);
+//  -Os  sccp, gvn, reassoc, dce: nothing that copies code, as inlining and
+//       unrolling do.
+enum class OptLevel {
+    O0,
+    O1,
+    O2,
+    Os,
+};
+
+[[nodiscard]] std::vector<std::string> pipelineFor(OptLevel level);
+[[nodiscard]] bool isPassName(std::string_view name);
+// The registered passes, as `inline, sccp, ...`.
+[[nodiscard]] std::string passNames();
+// `inline,sccp,dce` as pass names, in that order; nullopt, with `error`
+// naming the problem, if one is not a registered pass.
+[[nodiscard]] std::optional<std::vector<std::string>> parsePassList(std::string_view list, std::string& error);
+
+// What one pass run did.
+struct PassReport {
+    std::string name;
+    double wall_ms = 0;
+    size_t arena_bytes = 0; // nodes the pass built in the compiler's arena
+    uint64_t heap_bytes = 0; // its own tables, through `operator new`
+    size_t changes = 0;
+    std::string stats; // the pass's own counters
+};
+
+// Runs pipelines of registered passes over a program's AST. Each pass is a
+// phase of `timer`, so `--time-report` shows it on a line of its own.
+class PassManager {
+public:
+    // New nodes are placed in `allocator`.
+    PassManager(MemoryAllocator& allocator, PhaseTimer& timer);
+    // Runs `pipeline` in order, or nothing when the program's names do not
+    // resolve (see `namesResolve`). After each pass named `print_after`, the
+    // program is appended to `dump` as source.
+    std::vector<PassReport> run(ProgramNode& prog, const std::vector<std::string>& pipeline,
+        const std::string& print_after, std::string& dump);
+
+private:
+    MemoryAllocator& m_Allocator;
+    PhaseTimer& m_timer;
+};
+
+// One `--stats` line per report.
+[[nodiscard]] std::string formatPassReports(const std::vector<PassReport>& reports);
+// `prog` as Kei source, with every expression fully parenthesized.
+void printProgram(std::ostream& os, const ProgramNode& prog);
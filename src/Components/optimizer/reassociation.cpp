@@ -0,0 +1,216 @@
+#include "reassociation.hpp"
+#include <algorithm>
+
+namespace {
+
+ExprNode* stripParens(ExprNode* expr)
+{
+    while (auto* term = std::get_if<TermNode*>(&expr->expression)) {
+        auto* paren = std::get_if<ParenthesizedExprNode*>(&(*term)->term);
+        if (paren == nullptr) {
+            break;
+        }
+        expr = (*paren)->expr;
+    }
+    return expr;
+}
+
+// A variable or a literal, which an instruction takes as its memory or
+// immediate operand.
+bool isLeaf(const ExprNode* expr)
+{
+    const auto* term = std::get_if<TermNode*>(&unwrapParens(expr)->expression);
+    return term != nullptr
+        && (std::holds_alternative<IdentifierNode*>((*term)->term) || std::holds_alternative<IntLiteralNode*>((*term)->term));
+}
+
+// The operands of the `op` chain rooted at `expr`, in source order.
+void flattenChain(ExprNode* expr, const BinaryOp op, std::vector<ExprNode*>& operands)
+{
+    ExprNode* inner = stripParens(expr);
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&inner->expression)) {
+        const auto [bin_op, lhs, rhs] = binaryOperands(*bin);
+        if (bin_op == op) {
+            flattenChain(lhs, op, operands);
+            flattenChain(rhs, op, operands);
+            return;
+        }
+    }
+    operands.push_back(expr);
+}
+
+} // namespace
+
+// A leaf operand is read in place; two computed ones need one more register
+// only when they need as many each.
+int Reassociation::combinedNeed(const Operand& lhs, const Operand& rhs)
+{
+    const int need = std::max(lhs.need, rhs.need);
+    return !isLeaf(lhs.expr) && !isLeaf(rhs.expr) && lhs.need == rhs.need ? need + 1 : need;
+}
+
+Reassociation::Reassociation(MemoryAllocator& allocator)
+    : m_Allocator(allocator)
+{
+}
+
+Reassociation::Operand Reassociation::combine(const BinaryOp op, const Operand& lhs, const Operand& rhs)
+{
+    return { makeBinary(m_Allocator, op, lhs.expr, rhs.expr), combinedNeed(lhs, rhs) };
+}
+
+Reassociation::Operand Reassociation::rewrite(ExprNode* expr, const std::string* target)
+{
+    if (auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        if (op == BinaryOp::add || op == BinaryOp::mul) {
+            return rewrite_chain(expr, op, target);
+        }
+        const Operand new_lhs = rewrite(lhs, nullptr);
+        const Operand new_rhs = rewrite(rhs, nullptr);
+        if (new_lhs.expr == lhs && new_rhs.expr == rhs) {
+            return { expr, combinedNeed(new_lhs, new_rhs) };
+        }
+        return combine(op, new_lhs, new_rhs);
+    }
+
+    struct TermVisitor {
+        Reassociation& pass;
+        ExprNode* expr;
+        const std::string* target;
+
+        Operand operator()(const IntLiteralNode*) const { return { expr, 1 }; }
+        Operand operator()(const IdentifierNode*) const { return { expr, 1 }; }
+
+        Operand operator()(const ParenthesizedExprNode* paren) const
+        {
+            const Operand inner = pass.rewrite(paren->expr, target);
+            return inner.expr == paren->expr ? Operand { expr, inner.need } : inner;
+        }
+
+        Operand operator()(const CallNode* call) const
+        {
+            std::vector<ExprNode*> args;
+            bool changed = false;
+            for (ExprNode* arg : call->args) {
+                args.push_back(pass.rewrite(arg, nullptr).expr);
+                changed = changed || args.back() != arg;
+            }
+            if (!changed) {
+                return { expr, 2 };
+            }
+            auto new_call = pass.m_Allocator.construct<CallNode>(call->name, std::move(args));
+            auto term = pass.m_Allocator.construct<TermNode>(new_call);
+            return { pass.m_Allocator.construct<ExprNode>(term), 2 };
+        }
+
+        // Programs with arrays skip the passes (see `namesResolve`).
+        Operand operator()(const ArrayLiteralNode*) const { return { expr, 2 }; }
+        Operand operator()(const IndexNode*) const { return { expr, 2 }; }
+        Operand operator()(const ReadNode*) const { return { expr, 2 }; }
+    };
+    return std::visit(TermVisitor { .pass = *this, .expr = expr, .target = target },
+        std::get<TermNode*>(expr->expression)->term);
+}
+
+Reassociation::Operand Reassociation::rewrite_chain(ExprNode* expr, const BinaryOp op, const std::string* target)
+{
+    std::vector<ExprNode*> operands;
+    flattenChain(expr, op, operands);
+    if (std::ranges::count_if(operands, mayTrap) > 1) {
+        const auto [bin_op, lhs, rhs] = binaryOperands(std::get<BinaryExpressionNode*>(stripParens(expr)->expression));
+        const Operand new_lhs = rewrite(lhs, nullptr);
+        const Operand new_rhs = rewrite(rhs, nullptr);
+        if (new_lhs.expr == lhs && new_rhs.expr == rhs) {
+            return { expr, combinedNeed(new_lhs, new_rhs) };
+        }
+        return combine(op, new_lhs, new_rhs);
+    }
+
+    const uint64_t identity = op == BinaryOp::mul ? 1 : 0;
+    uint64_t constant = identity;
+    size_t literals = 0;
+    std::vector<Operand> computed;
+    std::vector<Operand> leaves;
+    std::optional<Operand> stored;
+    for (ExprNode* operand : operands) {
+        if (const std::optional<uint64_t> value = intLiteralValue(operand)) {
+            constant = evalBinary(op, constant, value.value()).value();
+            literals++;
+            continue;
+        }
+        const Operand rewritten = rewrite(operand, nullptr);
+        const IdentifierNode* ident = identifierOf(rewritten.expr);
+        if (ident != nullptr && target != nullptr && !stored.has_value() && ident->ident.value.value() == *target) {
+            stored = rewritten;
+        }
+        else {
+            (isLeaf(rewritten.expr) ? leaves : computed).push_back(rewritten);
+        }
+    }
+    if (operands.size() > 2) {
+        m_stats.rebuilt_chains++;
+    }
+
+    // A zero factor decides the product unless another factor may trap.
+    if (op == BinaryOp::mul && literals != 0 && constant == 0 && std::ranges::none_of(operands, mayTrap)) {
+        m_stats.folded_constants += literals;
+        return { makeIntLiteral(m_Allocator, 0, exprLine(expr)), 1 };
+    }
+    const bool keeps_constant = constant != identity || operands.size() == literals;
+    m_stats.folded_constants += literals - (keeps_constant && literals != 0 ? 1 : 0);
+
+    // Pairing the two that need the fewest registers, the larger on the right,
+    // builds a balanced tree from operands that need as many each.
+    while (computed.size() > 1) {
+        std::ranges::stable_sort(computed, {}, &Operand::need);
+        const Operand paired = combine(op, computed[0], computed[1]);
+        computed.erase(computed.begin(), computed.begin() + 2);
+        computed.push_back(paired);
+    }
+    std::optional<Operand> result;
+    if (!computed.empty()) {
+        result = computed.front();
+    }
+    const auto attach = [&](const Operand& operand) {
+        result = result.has_value() ? combine(op, result.value(), operand) : operand;
+    };
+    for (const Operand& leaf : leaves) {
+        attach(leaf);
+    }
+    if (keeps_constant) {
+        attach({ makeIntLiteral(m_Allocator, constant, exprLine(expr)), 1 });
+    }
+    if (stored.has_value()) {
+        attach(stored.value());
+    }
+    return result.value();
+}
+
+void Reassociation::collect_targets(const std::vector<StmtNode*>& stmts)
+{
+    forEachStmt(stmts, [&](StmtNode* stmt) {
+        if (const auto* stmt_assign = std::get_if<AssignmentStatementNode*>(&stmt->statement)) {
+            m_targets.emplace((*stmt_assign)->expr, (*stmt_assign)->ident.value.value());
+        }
+    });
+}
+
+Reassociation::Stats Reassociation::run(ProgramNode& prog)
+{
+    m_stats = {};
+    m_targets.clear();
+    collect_targets(prog.statements);
+    for (const FunctionNode* function : prog.functions) {
+        collect_targets(function->body->statements);
+    }
+    const auto fn = [&](ExprNode* expr) {
+        const auto it = m_targets.find(expr);
+        return rewrite(expr, it != m_targets.end() ? &it->second : nullptr).expr;
+    };
+    rewriteExprs(prog.statements, fn);
+    for (const FunctionNode* function : prog.functions) {
+        rewriteExprs(function->body->statements, fn);
+    }
+    return m_stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "astUtils.hpp"
+#include <unordered_map>
+
+// Reassociates `+` and `*` chains. A chain is flattened through parentheses,
+// its literal operands are folded into one (an identity is dropped), and it is
+// rebuilt for `Generator`, which keeps one value in rax and pushes the other:
+//  - operands that need a register of their own (products, calls, ...) are
+//    paired into a balanced tree, fewest registers first by Sethi-Ullman
+//    number, with the operand that needs more on the right, which the
+//    generator evaluates first, so fewer temporaries are live at once;
+//  - variables and the folded constant are then combined on top as memory or
+//    immediate operands. The variable an assignment stores to comes last, so
+//    a loop-carried accumulator waits on one operation instead of the chain.
+// A chain with two operands that may trap keeps its shape, so their effects
+// stay in order.
+class Reassociation {
+public:
+    struct Stats {
+        size_t rebuilt_chains = 0;
+        size_t folded_constants = 0;
+    };
+
+    // New nodes are placed in `allocator`.
+    explicit Reassociation(MemoryAllocator& allocator);
+    Stats run(ProgramNode& prog);
+
+private:
+    struct Operand {
+        ExprNode* expr;
+        int need; // Sethi-Ullman number: registers needed to evaluate it
+    };
+
+    MemoryAllocator& m_Allocator;
+    Stats m_stats {};
+    // The variable each assignment's expression is stored to.
+    std::unordered_map<const ExprNode*, std::string> m_targets {};
+
+    static int combinedNeed(const Operand& lhs, const Operand& rhs);
+    void collect_targets(const std::vector<StmtNode*>& stmts);
+    Operand rewrite(ExprNode* expr, const std::string* target);
+    Operand rewrite_chain(ExprNode* expr, BinaryOp op, const std::string* target);
+    Operand combine(BinaryOp op, const Operand& lhs, const Operand& rhs);
+};
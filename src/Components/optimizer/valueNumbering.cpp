@@ -0,0 +1,377 @@
+#include "valueNumbering.hpp"
+
+ValueNumbering::ValueNumbering(MemoryAllocator& allocator)
+    : m_Allocator(allocator)
+{
+}
+
+ValueNumbering::ValueNumber ValueNumbering::fresh()
+{
+    return m_next_vn++;
+}
+
+ValueNumbering::ValueNumber ValueNumbering::number(const ExprNode* expr)
+{
+    if (const auto it = m_expr_vn.find(expr); it != m_expr_vn.end()) {
+        return it->second;
+    }
+    ValueNumber vn;
+    if (const auto* bin = std::get_if<BinaryExpressionNode*>(&expr->expression)) {
+        const auto [op, lhs, rhs] = binaryOperands(*bin);
+        ExprKey key { op, number(lhs), number(rhs) };
+        if ((op == BinaryOp::add || op == BinaryOp::mul || op == BinaryOp::eq || op == BinaryOp::ne) && key.lhs > key.rhs) {
+            std::swap(key.lhs, key.rhs);
+        }
+        const auto [it, inserted] = m_exprs.try_emplace(key, 0);
+        if (inserted) {
+            it->second = fresh();
+        }
+        vn = it->second;
+    }
+    else {
+        struct TermVisitor {
+            ValueNumbering& pass;
+
+            ValueNumber operator()(const IntLiteralNode* lit) const
+            {
+                const auto value = parseIntLiteral(lit->intLit);
+                if (!value.has_value()) {
+                    return pass.fresh();
+                }
+                const auto [it, inserted] = pass.m_literals.try_emplace(value.value(), 0);
+                if (inserted) {
+                    it->second = pass.fresh();
+                }
+                return it->second;
+            }
+
+            ValueNumber operator()(const IdentifierNode* ident) const
+            {
+                return pass.m_var_vn.at(ident->ident.value.value());
+            }
+
+            ValueNumber operator()(const ParenthesizedExprNode* paren) const { return pass.number(paren->expr); }
+
+            // Every call may differ, even with the same arguments.
+            ValueNumber operator()(const CallNode*) const { return pass.fresh(); }
+
+            // Programs with arrays skip the passes (see `namesResolve`).
+            ValueNumber operator()(const ArrayLiteralNode*) const { return pass.fresh(); }
+            ValueNumber operator()(const IndexNode*) const { return pass.fresh(); }
+
+            // Each `read()` takes the next number from stdin.
+            ValueNumber operator()(const ReadNode*) const { return pass.fresh(); }
+        };
+        vn = std::visit(TermVisitor { .pass = *this }, std::get<TermNode*>(expr->expression)->term);
+    }
+    m_expr_vn.emplace(expr, vn);
+    return vn;
+}
+
+const ValueNumbering::Holder* ValueNumbering::lookup(const ValueNumber vn) const
+{
+    const auto it = m_available.find(vn);
+    if (it == m_available.end()) {
+        return nullptr;
+    }
+    if (it->second.is_variable) {
+        const auto var = m_var_vn.find(it->second.name);
+        if (var == m_var_vn.end() || var->second != vn) {
+            return nullptr;
+        }
+    }
+    return &it->second;
+}
+
+void ValueNumbering::make_available(const ValueNumber vn, Holder holder)
+{
+    std::optional<Holder> previous;
+    if (const auto it = m_available.find(vn); it != m_available.end()) {
+        previous = std::move(it->second);
+    }
+    m_scopes.back().shadowed.emplace_back(vn, std::move(previous));
+    m_available[vn] = std::move(holder);
+}
+
+ExprNode* ValueNumbering::scan(ExprNode* expr, const bool hoistable, const bool top)
+{
+    if (auto* term = std::get_if<TermNode*>(&expr->expression)) {
+        const auto* paren = std::get_if<ParenthesizedExprNode*>(&(*term)->term);
+        if (paren == nullptr) {
+            return expr;
+        }
+        ExprNode* inner = scan((*paren)->expr, hoistable, top);
+        if (inner == (*paren)->expr) {
+            return expr;
+        }
+        auto new_paren = m_Allocator.construct<ParenthesizedExprNode>(inner);
+        return m_Allocator.construct<ExprNode>(m_Allocator.construct<TermNode>(new_paren));
+    }
+
+    const ValueNumber vn = m_expr_vn.at(expr);
+    if (const Holder* holder = lookup(vn)) {
+        if (!m_rewrite) {
+            if (!holder->is_variable) {
+                m_needed.insert(holder->candidate);
+            }
+            return expr;
+        }
+        m_stats.eliminated_exprs++;
+        return makeIdentifier(m_Allocator, holder->name, exprLine(expr));
+    }
+
+    const auto [op, lhs, rhs] = binaryOperands(std::get<BinaryExpressionNode*>(expr->expression));
+    ExprNode* new_lhs = scan(lhs, hoistable, false);
+    // The right operand of `&&` and `||` does not always run.
+    ExprNode* new_rhs = scan(rhs, hoistable && !isLogical(op), false);
+    ExprNode* result = new_lhs == lhs && new_rhs == rhs ? expr : makeBinary(m_Allocator, op, new_lhs, new_rhs);
+    if (!hoistable || top) {
+        return result;
+    }
+    const size_t candidate = m_candidate_count++;
+    if (!m_rewrite) {
+        make_available(vn, { .candidate = candidate });
+        return result;
+    }
+    if (!m_needed.contains(candidate)) {
+        return result;
+    }
+    const int line = exprLine(expr);
+    const std::string name = "$cse" + std::to_string(m_stats.temporaries++);
+    auto stmt_let = m_Allocator.construct<LetStatementNode>(Token { TokenType::ident, line, name }, result);
+    m_pending_lets.push_back(m_Allocator.construct<StmtNode>(stmt_let));
+    declare(name, vn);
+    make_available(vn, { .name = name });
+    return makeIdentifier(m_Allocator, name, line);
+}
+
+ExprNode* ValueNumbering::visit_expr(ExprNode* expr, const bool hoistable)
+{
+    m_expr_vn.clear();
+    number(expr);
+    // A temporary would run before a call that may `exit` ahead of a trap.
+    return scan(expr, hoistable && !containsCall(expr), false);
+}
+
+void ValueNumbering::declare(const std::string& name, const ValueNumber vn)
+{
+    m_var_vn[name] = vn;
+    m_scopes.back().names.push_back(name);
+}
+
+void ValueNumbering::set_var(const std::string& name, const ValueNumber vn)
+{
+    ValueNumber& slot = m_var_vn.at(name);
+    m_trail.emplace_back(name, slot);
+    slot = vn;
+}
+
+void ValueNumbering::begin_scope()
+{
+    m_scopes.emplace_back();
+}
+
+void ValueNumbering::end_scope()
+{
+    Scope& scope = m_scopes.back();
+    for (const std::string& name : scope.names) {
+        m_var_vn.erase(name);
+    }
+    for (auto it = scope.shadowed.rbegin(); it != scope.shadowed.rend(); ++it) {
+        if (it->second.has_value()) {
+            m_available[it->first] = std::move(it->second.value());
+        }
+        else {
+            m_available.erase(it->first);
+        }
+    }
+    m_scopes.pop_back();
+}
+
+void ValueNumbering::visit_block(std::vector<StmtNode*>& stmts)
+{
+    std::vector<StmtNode*> result;
+    result.reserve(stmts.size());
+    for (StmtNode* stmt : stmts) {
+        std::vector<StmtNode*> outer_pending;
+        std::swap(outer_pending, m_pending_lets);
+        visit_stmt(stmt);
+        result.insert(result.end(), m_pending_lets.begin(), m_pending_lets.end());
+        result.push_back(stmt);
+        m_pending_lets = std::move(outer_pending);
+    }
+    stmts = std::move(result);
+}
+
+void ValueNumbering::visit_scope(ScopeNode* scope)
+{
+    begin_scope();
+    visit_block(scope->statements);
+    end_scope();
+}
+
+void ValueNumbering::rollback(const size_t mark)
+{
+    while (m_trail.size() > mark) {
+        // Names declared inside the rolled back arm are already out of scope.
+        if (const auto it = m_var_vn.find(m_trail.back().first); it != m_var_vn.end()) {
+            it->second = m_trail.back().second;
+        }
+        m_trail.pop_back();
+    }
+}
+
+void ValueNumbering::visit_if(IfStatementNode* stmt_if)
+{
+    // Only the first condition always runs, so only it may introduce
+    // temporaries; the others are evaluated in the same state but can only
+    // reuse values.
+    stmt_if->condition = visit_expr(stmt_if->condition, true);
+    std::vector<ScopeNode*> arms { stmt_if->scope };
+    for (std::optional<ElseIfNode*> pred = stmt_if->pred; pred.has_value();) {
+        if (const auto* else_ = std::get_if<ElseBranchNode*>(&pred.value()->branch)) {
+            arms.push_back((*else_)->scope);
+            break;
+        }
+        ElseIfBranchNode* elif = std::get<ElseIfBranchNode*>(pred.value()->branch);
+        elif->condition = visit_expr(elif->condition, false);
+        arms.push_back(elif->scope);
+        pred = elif->next;
+    }
+
+    std::vector<std::string> assigned;
+    for (ScopeNode* arm : arms) {
+        const size_t mark = m_trail.size();
+        visit_scope(arm);
+        for (size_t i = mark; i < m_trail.size(); i++) {
+            if (m_var_vn.contains(m_trail[i].first)) {
+                assigned.push_back(m_trail[i].first);
+            }
+        }
+        rollback(mark);
+    }
+    for (const std::string& name : assigned) {
+        set_var(name, fresh());
+    }
+}
+
+void ValueNumbering::visit_while(WhileStatementNode* stmt_while)
+{
+    // Variables the body assigns get an unknown value at the loop head. The
+    // condition runs on every iteration, so it can reuse values but never
+    // introduce a temporary before the loop. Leaving the loop happens at the
+    // head, so the head numbers stay valid after it.
+    std::unordered_set<std::string> assigned;
+    collectAssigned(stmt_while->scope, assigned);
+    for (const std::string& name : assigned) {
+        if (m_var_vn.contains(name)) {
+            set_var(name, fresh());
+        }
+    }
+    stmt_while->condition = visit_expr(stmt_while->condition, false);
+    const size_t mark = m_trail.size();
+    visit_scope(stmt_while->scope);
+    rollback(mark);
+}
+
+void ValueNumbering::visit_stmt(StmtNode* stmt)
+{
+    struct StmtVisitor {
+        ValueNumbering& pass;
+
+        struct Stored {
+            ValueNumber vn;
+            bool computed;
+        };
+
+        // A stored expression is not hoisted itself: the variable it is
+        // stored in becomes the holder of its value.
+        Stored store(ExprNode*& expr) const
+        {
+            pass.m_expr_vn.clear();
+            const ValueNumber vn = pass.number(expr);
+            const bool computed = std::holds_alternative<BinaryExpressionNode*>(unwrapParens(expr)->expression);
+            expr = pass.scan(expr, !containsCall(expr), true);
+            return { vn, computed };
+        }
+
+        void hold(const std::string& name, const Stored stored) const
+        {
+            if (stored.computed && pass.lookup(stored.vn) == nullptr) {
+                pass.make_available(stored.vn, { .name = name, .is_variable = true });
+            }
+        }
+
+        void operator()(ExitStatementNode* stmt_exit) const
+        {
+            stmt_exit->expr = pass.visit_expr(stmt_exit->expr, true);
+        }
+
+        void operator()(LetStatementNode* stmt_let) const
+        {
+            const Stored stored = store(stmt_let->expr);
+            pass.declare(stmt_let->ident.value.value(), stored.vn);
+            hold(stmt_let->ident.value.value(), stored);
+        }
+
+        void operator()(AssignmentStatementNode* stmt_assign) const
+        {
+            const Stored stored = store(stmt_assign->expr);
+            pass.set_var(stmt_assign->ident.value.value(), stored.vn);
+            hold(stmt_assign->ident.value.value(), stored);
+        }
+
+        void operator()(ScopeNode* scope) const { pass.visit_scope(scope); }
+
+        void operator()(IfStatementNode* stmt_if) const { pass.visit_if(stmt_if); }
+
+        void operator()(WhileStatementNode* stmt_while) const { pass.visit_while(stmt_while); }
+
+        void operator()(ReturnStatementNode* stmt_return) const
+        {
+            stmt_return->expr = pass.visit_expr(stmt_return->expr, true);
+        }
+
+        void operator()(PrintStatementNode* stmt_print) const
+        {
+            stmt_print->expr = pass.visit_expr(stmt_print->expr, true);
+        }
+    };
+    std::visit(StmtVisitor { .pass = *this }, stmt->statement);
+}
+
+void ValueNumbering::walk(ProgramNode& prog)
+{
+    m_next_vn = 0;
+    m_exprs.clear();
+    m_literals.clear();
+    m_var_vn.clear();
+    m_trail.clear();
+    m_available.clear();
+    m_scopes.clear();
+    m_candidate_count = 0;
+    begin_scope();
+    visit_block(prog.statements);
+    end_scope();
+    for (FunctionNode* function : prog.functions) {
+        m_var_vn.clear();
+        m_trail.clear();
+        begin_scope();
+        for (const Token& param : function->params) {
+            declare(param.value.value(), fresh());
+        }
+        visit_scope(function->body);
+        end_scope();
+    }
+}
+
+ValueNumbering::Stats ValueNumbering::run(ProgramNode& prog)
+{
+    m_stats = {};
+    m_needed.clear();
+    m_rewrite = false;
+    walk(prog);
+    m_rewrite = true;
+    walk(prog);
+    return m_stats;
+}
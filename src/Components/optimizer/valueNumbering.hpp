@@ -0,0 +1,89 @@
+#pragma once
+
+#include "astUtils.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+// Global value numbering with common-subexpression elimination. Every pure
+// expression gets a value number from its operator and the value numbers of
+// its operands; variables take the number of the value stored in them and a
+// fresh one whenever an assignment in an `if` arm or a loop makes it ambiguous.
+//
+// Available values are kept in a table scoped like the dominator tree: a value
+// computed before an `if` can be reused in its arms and after it, one computed
+// inside an arm only within that arm. A repeated expression reuses the
+// variable that already holds it, or a `$cseN` temporary declared right before
+// the statement that first computes it. The program is walked twice: the
+// first walk finds which first occurrences are reused, the second rewrites.
+class ValueNumbering {
+public:
+    struct Stats {
+        size_t eliminated_exprs = 0;
+        size_t temporaries = 0;
+    };
+
+    // New nodes are placed in `allocator`.
+    explicit ValueNumbering(MemoryAllocator& allocator);
+    Stats run(ProgramNode& prog);
+
+private:
+    using ValueNumber = uint32_t;
+
+    struct ExprKey {
+        BinaryOp op;
+        ValueNumber lhs;
+        ValueNumber rhs;
+        bool operator==(const ExprKey&) const = default;
+    };
+    struct ExprKeyHash {
+        size_t operator()(const ExprKey& key) const
+        {
+            return std::hash<uint64_t> {}((static_cast<uint64_t>(key.lhs) << 32 | key.rhs) * 31
+                + static_cast<uint64_t>(key.op));
+        }
+    };
+    // Where an available value can be read from. `name` is empty for a first
+    // occurrence that has not been given a temporary.
+    struct Holder {
+        std::string name;
+        bool is_variable = false;
+        size_t candidate = 0;
+    };
+
+    MemoryAllocator& m_Allocator;
+    bool m_rewrite = false;
+    Stats m_stats {};
+    ValueNumber m_next_vn = 0;
+    std::unordered_map<ExprKey, ValueNumber, ExprKeyHash> m_exprs {};
+    std::unordered_map<uint64_t, ValueNumber> m_literals {};
+    std::unordered_map<const ExprNode*, ValueNumber> m_expr_vn {};
+    std::unordered_map<std::string, ValueNumber> m_var_vn {};
+    std::vector<std::pair<std::string, ValueNumber>> m_trail {};
+    std::unordered_map<ValueNumber, Holder> m_available {};
+    struct Scope {
+        std::vector<std::string> names;
+        std::vector<std::pair<ValueNumber, std::optional<Holder>>> shadowed;
+    };
+    std::vector<Scope> m_scopes {};
+    size_t m_candidate_count = 0;
+    std::unordered_set<size_t> m_needed {};
+    std::vector<StmtNode*> m_pending_lets {};
+
+    ValueNumber fresh();
+    ValueNumber number(const ExprNode* expr);
+    ExprNode* scan(ExprNode* expr, bool hoistable, bool top);
+    ExprNode* visit_expr(ExprNode* expr, bool hoistable);
+    [[nodiscard]] const Holder* lookup(ValueNumber vn) const;
+    void make_available(ValueNumber vn, Holder holder);
+    void declare(const std::string& name, ValueNumber vn);
+    void set_var(const std::string& name, ValueNumber vn);
+    void begin_scope();
+    void end_scope();
+    void visit_block(std::vector<StmtNode*>& stmts);
+    void visit_scope(ScopeNode* scope);
+    void rollback(size_t mark);
+    void visit_if(IfStatementNode* stmt_if);
+    void visit_while(WhileStatementNode* stmt_while);
+    void visit_stmt(StmtNode* stmt);
+    void walk(ProgramNode& prog);
+};
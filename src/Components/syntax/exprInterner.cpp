@@ -0,0 +1,172 @@
+#include "exprInterner.hpp"
+#include "syntaxAnalyzer.hpp"
+#include <algorithm>
+
+namespace
+{
+constexpr size_t initialSlots = 1024;
+
+size_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    return value;
+}
+
+size_t hashNode(const uint64_t op, const ExprNode *lhs, const ExprNode *rhs)
+{
+    return mix(reinterpret_cast<uintptr_t>(lhs) * 0x9e3779b97f4a7c15ULL + mix(reinterpret_cast<uintptr_t>(rhs) + op));
+}
+
+// The operands of `expr` if it is the binary operation `op`.
+template <typename Node>
+const Node *operationOf(const ExprNode *expr)
+{
+    const auto *binary = std::get_if<BinaryExpressionNode *>(&expr->expression);
+    if (binary == nullptr)
+    {
+        return nullptr;
+    }
+    const auto *node = std::get_if<Node *>(&(*binary)->operation);
+    return node == nullptr ? nullptr : *node;
+}
+
+bool isBinary(const ExprNode *expr, const TokenType op, const ExprNode *lhs, const ExprNode *rhs)
+{
+    const auto same = [&](const auto *node)
+    { return node != nullptr && node->lhs == lhs && node->rhs == rhs; };
+    switch (op)
+    {
+    case TokenType::plus:
+        return same(operationOf<AdditionNode>(expr));
+    case TokenType::star:
+        return same(operationOf<MultiplicationNode>(expr));
+    case TokenType::minus:
+        return same(operationOf<SubtractionNode>(expr));
+    case TokenType::fslash:
+        return same(operationOf<DivisionNode>(expr));
+    case TokenType::eq_eq:
+        return same(operationOf<EqualNode>(expr));
+    case TokenType::bang_eq:
+        return same(operationOf<NotEqualNode>(expr));
+    case TokenType::lt:
+        return same(operationOf<LessNode>(expr));
+    case TokenType::lt_eq:
+        return same(operationOf<LessEqualNode>(expr));
+    case TokenType::gt:
+        return same(operationOf<GreaterNode>(expr));
+    case TokenType::gt_eq:
+        return same(operationOf<GreaterEqualNode>(expr));
+    case TokenType::amp_amp:
+        return same(operationOf<LogicalAndNode>(expr));
+    case TokenType::pipe_pipe:
+        return same(operationOf<LogicalOrNode>(expr));
+    default:
+        return false;
+    }
+}
+
+bool isParenthesized(const ExprNode *expr, const ExprNode *inner)
+{
+    const auto *term = std::get_if<TermNode *>(&expr->expression);
+    if (term == nullptr)
+    {
+        return false;
+    }
+    const auto *paren = std::get_if<ParenthesizedExprNode *>(&(*term)->term);
+    return paren != nullptr && (*paren)->expr == inner;
+}
+}
+
+ExprInterner::ExprInterner(MemoryAllocator &allocator)
+    : m_Allocator(allocator)
+{
+}
+
+template <typename Build>
+ExprNode *ExprInterner::leaf(std::unordered_map<std::string, ExprNode *> &nodes, const Token &token, Build build)
+{
+    const auto [it, inserted] = nodes.try_emplace(token.value.value(), nullptr);
+    if (!inserted)
+    {
+        m_reused++;
+        return it->second;
+    }
+    it->second = build();
+    return it->second;
+}
+
+void ExprInterner::grow()
+{
+    std::vector<Slot> old(std::max(initialSlots, m_slots.size() * 2));
+    old.swap(m_slots);
+    const size_t mask = m_slots.size() - 1;
+    for (const Slot &slot : old)
+    {
+        if (slot.node != nullptr)
+        {
+            size_t i = slot.hash & mask;
+            while (m_slots[i].node != nullptr)
+            {
+                i = (i + 1) & mask;
+            }
+            m_slots[i] = slot;
+        }
+    }
+}
+
+template <typename Matches, typename Build>
+ExprNode *ExprInterner::intern(const size_t hash, Matches matches, Build build)
+{
+    if ((m_count + 1) * 2 > m_slots.size())
+    {
+        grow();
+    }
+    const size_t mask = m_slots.size() - 1;
+    size_t i = hash & mask;
+    for (; m_slots[i].node != nullptr; i = (i + 1) & mask)
+    {
+        if (m_slots[i].hash == hash && matches(m_slots[i].node))
+        {
+            m_reused++;
+            return m_slots[i].node;
+        }
+    }
+    m_slots[i] = {hash, build()};
+    m_count++;
+    return m_slots[i].node;
+}
+
+ExprNode *ExprInterner::intLiteral(const Token &token)
+{
+    return leaf(m_int_literals, token, [&]
+                { return m_Allocator.construct<ExprNode>(
+                      m_Allocator.construct<TermNode>(m_Allocator.construct<IntLiteralNode>(token))); });
+}
+
+ExprNode *ExprInterner::identifier(const Token &token)
+{
+    return leaf(m_identifiers, token, [&]
+                { return m_Allocator.construct<ExprNode>(
+                      m_Allocator.construct<TermNode>(m_Allocator.construct<IdentifierNode>(token))); });
+}
+
+ExprNode *ExprInterner::parenthesized(ExprNode *expr)
+{
+    return intern(
+        hashNode(0, expr, nullptr), [&](const ExprNode *node)
+        { return isParenthesized(node, expr); },
+        [&]
+        { return m_Allocator.construct<ExprNode>(
+              m_Allocator.construct<TermNode>(m_Allocator.construct<ParenthesizedExprNode>(expr))); });
+}
+
+ExprNode *ExprInterner::binary(const TokenType op, ExprNode *lhs, ExprNode *rhs)
+{
+    return intern(
+        hashNode(static_cast<uint64_t>(op) + 1, lhs, rhs), [&](const ExprNode *node)
+        { return isBinary(node, op, lhs, rhs); },
+        [&]
+        { return buildBinaryExpr(m_Allocator, op, lhs, rhs); });
+}
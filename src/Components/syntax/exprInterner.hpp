@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Components/lexing/lexicalAnalyzer.hpp"
+#include "Components/memory/memoryAllocator.hpp"
+
+struct ExprNode;
+
+// Hash-consing for the parser: structurally identical pure expressions
+// (literals, identifiers, parentheses and arithmetic on them) are built once
+// and shared, so repeated subtrees become a DAG. Literals and identifiers are
+// keyed on their text, and composite nodes on their operator and children,
+// which are unique already. A call is never shared, and since its node is
+// never reused, neither is anything containing it. The passes treat
+// expressions as immutable, so sharing is invisible to them, except that a
+// shared node keeps the line of its first occurrence.
+class ExprInterner
+{
+public:
+    explicit ExprInterner(MemoryAllocator &allocator);
+    ExprNode *intLiteral(const Token &token);
+    ExprNode *identifier(const Token &token);
+    ExprNode *parenthesized(ExprNode *expr);
+    ExprNode *binary(TokenType op, ExprNode *lhs, ExprNode *rhs);
+    // Nodes handed out again instead of being built.
+    [[nodiscard]] size_t reused() const { return m_reused; }
+
+private:
+    // Open addressing with linear probing in a power-of-two table. A slot
+    // holds only the hash and the node, which is compared on a hash match, so
+    // the table stays small next to the nodes it saves. A null node marks a
+    // free slot.
+    struct Slot
+    {
+        size_t hash = 0;
+        ExprNode *node = nullptr;
+    };
+
+    MemoryAllocator &m_Allocator;
+    std::unordered_map<std::string, ExprNode *> m_int_literals;
+    std::unordered_map<std::string, ExprNode *> m_identifiers;
+    std::vector<Slot> m_slots;
+    size_t m_count = 0;
+    size_t m_reused = 0;
+
+    template <typename Build>
+    ExprNode *leaf(std::unordered_map<std::string, ExprNode *> &nodes, const Token &token, Build build);
+    template <typename Matches, typename Build>
+    ExprNode *intern(size_t hash, Matches matches, Build build);
+    void grow();
+};
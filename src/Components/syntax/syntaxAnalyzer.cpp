@@ -1,4 +1,5 @@
 #include "syntaxAnalyzer.hpp"
+#include "Components/diagnostics/compileError.hpp"
 
 // Imprime el nodo IntLiteralNode
 std::ostream &operator<<(std::ostream &os, const IntLiteralNode &node)
@@ -61,6 +62,132 @@ std::ostream &operator<<(std::ostream &os, const DivisionNode &node)
     return os;
 }
 
+// Imprime el nodo EqualNode
+std::ostream &operator<<(std::ostream &os, const EqualNode &node)
+{
+    os << "EqualNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo NotEqualNode
+std::ostream &operator<<(std::ostream &os, const NotEqualNode &node)
+{
+    os << "NotEqualNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo LessNode
+std::ostream &operator<<(std::ostream &os, const LessNode &node)
+{
+    os << "LessNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo LessEqualNode
+std::ostream &operator<<(std::ostream &os, const LessEqualNode &node)
+{
+    os << "LessEqualNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo GreaterNode
+std::ostream &operator<<(std::ostream &os, const GreaterNode &node)
+{
+    os << "GreaterNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo GreaterEqualNode
+std::ostream &operator<<(std::ostream &os, const GreaterEqualNode &node)
+{
+    os << "GreaterEqualNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo LogicalAndNode
+std::ostream &operator<<(std::ostream &os, const LogicalAndNode &node)
+{
+    os << "LogicalAndNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo LogicalOrNode
+std::ostream &operator<<(std::ostream &os, const LogicalOrNode &node)
+{
+    os << "LogicalOrNode(\n"
+       << "    LHS: " << *node.lhs << "\n"
+       << "    RHS: " << *node.rhs
+       << ")";
+    return os;
+}
+
+// Imprime el nodo CallNode
+std::ostream &operator<<(std::ostream &os, const CallNode &node)
+{
+    os << "CallNode(\n"
+       << "    Name: " << node.name << "\n"
+       << "    Args: [\n";
+    for (const auto *arg : node.args)
+    {
+        os << "        " << *arg << ",\n";
+    }
+    os << "    ]"
+       << ")";
+    return os;
+}
+
+// Imprime el nodo ArrayLiteralNode
+std::ostream &operator<<(std::ostream &os, const ArrayLiteralNode &node)
+{
+    os << "ArrayLiteralNode(\n"
+       << "    Elements: [\n";
+    for (const auto *element : node.elements)
+    {
+        os << "        " << *element << ",\n";
+    }
+    os << "    ]"
+       << ")";
+    return os;
+}
+
+// Imprime el nodo IndexNode
+std::ostream &operator<<(std::ostream &os, const IndexNode &node)
+{
+    os << "IndexNode(\n"
+       << "    Name: " << node.name << "\n"
+       << "    Index: " << *node.index
+       << ")";
+    return os;
+}
+
+// Imprime el nodo ReadNode
+std::ostream &operator<<(std::ostream &os, const ReadNode &)
+{
+    os << "ReadNode()";
+    return os;
+}
+
 // Imprime el nodo BinaryExpressionNode
 std::ostream &operator<<(std::ostream &os, const BinaryExpressionNode &node)
 {
@@ -108,6 +235,7 @@ std::ostream &operator<<(std::ostream &os, const LetStatementNode &node)
 {
     os << "LetStatementNode(\n"
        << "    Identifier: " << node.ident << "\n"
+       << "    Exported: " << (node.exported ? "true" : "false") << "\n"
        << "    Expression: " << *node.expr
        << ")";
     return os;
@@ -172,6 +300,16 @@ std::ostream &operator<<(std::ostream &os, const IfStatementNode &node)
     return os;
 }
 
+// Imprime el nodo WhileStatementNode
+std::ostream &operator<<(std::ostream &os, const WhileStatementNode &node)
+{
+    os << "WhileStatementNode(\n"
+       << "    Condition: " << *node.condition << "\n"
+       << "    Scope: " << *node.scope
+       << ")";
+    return os;
+}
+
 // Imprime el nodo AssignmentStatementNode
 std::ostream &operator<<(std::ostream &os, const AssignmentStatementNode &node)
 {
@@ -182,6 +320,24 @@ std::ostream &operator<<(std::ostream &os, const AssignmentStatementNode &node)
     return os;
 }
 
+// Imprime el nodo ReturnStatementNode
+std::ostream &operator<<(std::ostream &os, const ReturnStatementNode &node)
+{
+    os << "ReturnStatementNode(\n"
+       << "    Expression: " << *node.expr
+       << ")";
+    return os;
+}
+
+// Imprime el nodo PrintStatementNode
+std::ostream &operator<<(std::ostream &os, const PrintStatementNode &node)
+{
+    os << "PrintStatementNode(\n"
+       << "    Expression: " << *node.expr
+       << ")";
+    return os;
+}
+
 // Imprime el nodo StmtNode
 std::ostream &operator<<(std::ostream &os, const StmtNode &node)
 {
@@ -192,10 +348,38 @@ std::ostream &operator<<(std::ostream &os, const StmtNode &node)
     return os;
 }
 
+// Imprime el nodo FunctionNode
+std::ostream &operator<<(std::ostream &os, const FunctionNode &node)
+{
+    os << "FunctionNode(\n"
+       << "    Name: " << node.name << "\n"
+       << "    Params: [\n";
+    for (const auto &param : node.params)
+    {
+        os << "        " << param << ",\n";
+    }
+    os << "    ]\n"
+       << "    Body: " << *node.body
+       << ")";
+    return os;
+}
+
 // Imprime el nodo ProgramNode
 std::ostream &operator<<(std::ostream &os, const ProgramNode &node)
 {
     os << "ProgramNode(\n"
+       << "    Imports: [\n";
+    for (const auto &import : node.imports)
+    {
+        os << "        " << import << ",\n";
+    }
+    os << "    ]\n"
+       << "    Functions: [\n";
+    for (const auto *function : node.functions)
+    {
+        os << "        " << *function << ",\n";
+    }
+    os << "    ]\n"
        << "    Statements: [\n";
     for (const auto *stmt : node.statements)
     {
@@ -205,15 +389,81 @@ std::ostream &operator<<(std::ostream &os, const ProgramNode &node)
        << ")";
     return os;
 }
-SyntaxAnalyzer::SyntaxAnalyzer(std::vector<Token> tokens)
-    : m_tokens(std::move(tokens))
+ExprNode *buildBinaryExpr(MemoryAllocator &allocator, const TokenType op, ExprNode *lhs, ExprNode *rhs)
+{
+    auto expr = allocator.construct<BinaryExpressionNode>();
+    switch (op)
+    {
+    case TokenType::plus:
+        expr->operation = allocator.construct<AdditionNode>(lhs, rhs);
+        break;
+    case TokenType::star:
+        expr->operation = allocator.construct<MultiplicationNode>(lhs, rhs);
+        break;
+    case TokenType::minus:
+        expr->operation = allocator.construct<SubtractionNode>(lhs, rhs);
+        break;
+    case TokenType::fslash:
+        expr->operation = allocator.construct<DivisionNode>(lhs, rhs);
+        break;
+    case TokenType::eq_eq:
+        expr->operation = allocator.construct<EqualNode>(lhs, rhs);
+        break;
+    case TokenType::bang_eq:
+        expr->operation = allocator.construct<NotEqualNode>(lhs, rhs);
+        break;
+    case TokenType::lt:
+        expr->operation = allocator.construct<LessNode>(lhs, rhs);
+        break;
+    case TokenType::lt_eq:
+        expr->operation = allocator.construct<LessEqualNode>(lhs, rhs);
+        break;
+    case TokenType::gt:
+        expr->operation = allocator.construct<GreaterNode>(lhs, rhs);
+        break;
+    case TokenType::gt_eq:
+        expr->operation = allocator.construct<GreaterEqualNode>(lhs, rhs);
+        break;
+    case TokenType::amp_amp:
+        expr->operation = allocator.construct<LogicalAndNode>(lhs, rhs);
+        break;
+    case TokenType::pipe_pipe:
+        expr->operation = allocator.construct<LogicalOrNode>(lhs, rhs);
+        break;
+    default:
+        assert(false);
+    }
+    return allocator.construct<ExprNode>(expr);
+}
+
+SyntaxAnalyzer::SyntaxAnalyzer(std::vector<Token> tokens, MemoryAllocator &allocator, const bool hash_cons)
+    : m_owned_tokens(std::move(tokens)), m_tokens(m_owned_tokens), m_Allocator(allocator)
+{
+    if (hash_cons)
+    {
+        m_interner.emplace(allocator);
+    }
+}
+
+SyntaxAnalyzer::SyntaxAnalyzer(const std::span<const Token> tokens, MemoryAllocator &allocator, const bool hash_cons)
+    : m_tokens(tokens), m_Allocator(allocator)
+{
+    if (hash_cons)
+    {
+        m_interner.emplace(allocator);
+    }
+}
+
+size_t SyntaxAnalyzer::sharedExprs() const
 {
+    return m_interner.has_value() ? m_interner->reused() : 0;
 }
 
 [[noreturn]] void SyntaxAnalyzer::errorExpected(const std::string &msg) const
 {
-    std::cerr << "[Parse Error] Expected " << msg << " on line " << peek(-1).value().line << std::endl;
-    exit(EXIT_FAILURE);
+    // The line of the last token read, or of the first one if none was.
+    const std::optional<Token> at = m_index > 0 ? peek(-1) : peek();
+    throw CompileError("[Parse Error] Expected " + msg + " on line " + std::to_string(at.has_value() ? at->line : 1));
 }
 
 std::optional<TermNode *> SyntaxAnalyzer::parseTerm()
@@ -226,10 +476,32 @@ std::optional<TermNode *> SyntaxAnalyzer::parseTerm()
     }
     if (auto ident = tryConsume(TokenType::ident))
     {
+        if (peek().has_value() && peek().value().type == TokenType::open_paren)
+        {
+            auto term = m_Allocator.construct<TermNode>(parseCall(ident.value()));
+            return term;
+        }
+        if (peek().has_value() && peek().value().type == TokenType::open_square)
+        {
+            auto term = m_Allocator.construct<TermNode>(parseIndex(ident.value()));
+            return term;
+        }
         auto expr_ident = m_Allocator.construct<IdentifierNode>(ident.value());
         auto term = m_Allocator.construct<TermNode>(expr_ident);
         return term;
     }
+    if (const auto read = tryConsume(TokenType::read))
+    {
+        tryConsumeErr(TokenType::open_paren);
+        tryConsumeErr(TokenType::close_pared);
+        auto term = m_Allocator.construct<TermNode>(m_Allocator.construct<ReadNode>(read.value()));
+        return term;
+    }
+    if (const auto open_square = tryConsume(TokenType::open_square))
+    {
+        auto term = m_Allocator.construct<TermNode>(parseArrayLiteral(open_square.value()));
+        return term;
+    }
     if (const auto open_paren = tryConsume(TokenType::open_paren))
     {
         auto expr = parseExpr();
@@ -245,14 +517,118 @@ std::optional<TermNode *> SyntaxAnalyzer::parseTerm()
     return {};
 }
 
+CallNode *SyntaxAnalyzer::parseCall(const Token &name)
+{
+    consume();
+    auto call = m_Allocator.construct<CallNode>(name);
+    if (!tryConsume(TokenType::close_pared).has_value())
+    {
+        do
+        {
+            if (const auto expr = parseExpr())
+            {
+                call->args.push_back(expr.value());
+            }
+            else
+            {
+                errorExpected("expression");
+            }
+        } while (tryConsume(TokenType::comma).has_value());
+        tryConsumeErr(TokenType::close_pared);
+    }
+    return call;
+}
+
+ArrayLiteralNode *SyntaxAnalyzer::parseArrayLiteral(const Token &open)
+{
+    auto array = m_Allocator.construct<ArrayLiteralNode>(open);
+    do
+    {
+        if (const auto expr = parseExpr())
+        {
+            array->elements.push_back(expr.value());
+        }
+        else
+        {
+            errorExpected("expression");
+        }
+    } while (tryConsume(TokenType::comma).has_value());
+    tryConsumeErr(TokenType::close_square);
+    return array;
+}
+
+IndexNode *SyntaxAnalyzer::parseIndex(const Token &name)
+{
+    consume();
+    auto index = parseExpr();
+    if (!index.has_value())
+    {
+        errorExpected("expression");
+    }
+    tryConsumeErr(TokenType::close_square);
+    return m_Allocator.construct<IndexNode>(name, index.value());
+}
+
+// A term as an expression. Shared terms are looked up before anything is
+// allocated for them.
+std::optional<ExprNode *> SyntaxAnalyzer::parseOperand()
+{
+    if (const auto bang = tryConsume(TokenType::bang))
+    {
+        auto operand = parseOperand();
+        if (!operand.has_value())
+        {
+            errorExpected("expression");
+        }
+        const Token zero{TokenType::int_lit, bang->line, "0"};
+        if (m_interner.has_value())
+        {
+            return m_interner->parenthesized(
+                m_interner->binary(TokenType::eq_eq, operand.value(), m_interner->intLiteral(zero)));
+        }
+        auto lit = m_Allocator.construct<ExprNode>(
+            m_Allocator.construct<TermNode>(m_Allocator.construct<IntLiteralNode>(zero)));
+        auto term_paren =
+            m_Allocator.construct<ParenthesizedExprNode>(buildBinaryExpr(m_Allocator, TokenType::eq_eq, operand.value(), lit));
+        return m_Allocator.construct<ExprNode>(m_Allocator.construct<TermNode>(term_paren));
+    }
+    if (m_interner.has_value())
+    {
+        if (auto int_lit = tryConsume(TokenType::int_lit))
+        {
+            return m_interner->intLiteral(int_lit.value());
+        }
+        if (peek().has_value() && peek().value().type == TokenType::ident &&
+            !(peek(1).has_value() &&
+              (peek(1).value().type == TokenType::open_paren || peek(1).value().type == TokenType::open_square)))
+        {
+            return m_interner->identifier(consume());
+        }
+        if (tryConsume(TokenType::open_paren))
+        {
+            auto expr = parseExpr();
+            if (!expr.has_value())
+            {
+                errorExpected("expression");
+            }
+            tryConsumeErr(TokenType::close_pared);
+            return m_interner->parenthesized(expr.value());
+        }
+    }
+    if (auto term = parseTerm())
+    {
+        return m_Allocator.construct<ExprNode>(term.value());
+    }
+    return {};
+}
+
 std::optional<ExprNode *> SyntaxAnalyzer::parseExpr(const int min_prec)
 {
-    std::optional<TermNode *> term_lhs = parseTerm();
-    if (!term_lhs.has_value())
+    std::optional<ExprNode *> expr_lhs = parseOperand();
+    if (!expr_lhs.has_value())
     {
         return {};
     }
-    auto expr_lhs = m_Allocator.construct<ExprNode>(term_lhs.value());
     while (true)
     {
         std::optional<Token> curr_tok = peek();
@@ -268,27 +644,14 @@ std::optional<ExprNode *> SyntaxAnalyzer::parseExpr(const int min_prec)
         {
             errorExpected("expression");
         }
-        auto expr = m_Allocator.construct<BinaryExpressionNode>();
-        auto expr_lhs2 = m_Allocator.construct<ExprNode>();
-        expr_lhs2->expression = expr_lhs->expression;
-        switch (type)
+        if (m_interner.has_value())
         {
-        case TokenType::plus:
-            expr->operation = m_Allocator.construct<AdditionNode>(expr_lhs2, expr_rhs.value());
-            break;
-        case TokenType::star:
-            expr->operation = m_Allocator.construct<MultiplicationNode>(expr_lhs2, expr_rhs.value());
-            break;
-        case TokenType::minus:
-            expr->operation = m_Allocator.construct<SubtractionNode>(expr_lhs2, expr_rhs.value());
-            break;
-        case TokenType::fslash:
-            expr->operation = m_Allocator.construct<DivisionNode>(expr_lhs2, expr_rhs.value());
-            break;
-        default:
-            assert(false);
+            expr_lhs = m_interner->binary(type, expr_lhs.value(), expr_rhs.value());
+        }
+        else
+        {
+            expr_lhs = buildBinaryExpr(m_Allocator, type, expr_lhs.value(), expr_rhs.value());
         }
-        expr_lhs->expression = expr;
     }
     return expr_lhs;
 }
@@ -313,7 +676,7 @@ std::optional<ElseIfNode *> SyntaxAnalyzer::parseIfPred()
     if (tryConsume(TokenType::elif))
     {
         tryConsumeErr(TokenType::open_paren);
-        const auto elif = m_Allocator.allocate<ElseIfBranchNode>();
+        const auto elif = m_Allocator.construct<ElseIfBranchNode>();
         if (const auto expr = parseExpr())
         {
             elif->condition = expr.value();
@@ -337,7 +700,7 @@ std::optional<ElseIfNode *> SyntaxAnalyzer::parseIfPred()
     }
     if (tryConsume(TokenType::else_))
     {
-        auto else_ = m_Allocator.allocate<ElseBranchNode>();
+        auto else_ = m_Allocator.construct<ElseBranchNode>();
         if (const auto scope = parseScope())
         {
             else_->scope = scope.value();
@@ -372,6 +735,26 @@ std::optional<StmtNode *> SyntaxAnalyzer::parseExitStmt()
     return stmt;
 }
 
+std::optional<StmtNode *> SyntaxAnalyzer::parsePrintStmt()
+{
+    consume();
+    consume();
+    auto stmt_print = m_Allocator.construct<PrintStatementNode>();
+    if (const auto node_expr = parseExpr())
+    {
+        stmt_print->expr = node_expr.value();
+    }
+    else
+    {
+        errorExpected("expression");
+    }
+    tryConsumeErr(TokenType::close_pared);
+    tryConsumeErr(TokenType::semi);
+    auto stmt = m_Allocator.construct<StmtNode>();
+    stmt->statement = stmt_print;
+    return stmt;
+}
+
 std::optional<StmtNode *> SyntaxAnalyzer::parseLetStmt()
 {
     consume();
@@ -394,7 +777,7 @@ std::optional<StmtNode *> SyntaxAnalyzer::parseLetStmt()
 
 std::optional<StmtNode *> SyntaxAnalyzer::parseAssignStmt()
 {
-    const auto assign = m_Allocator.allocate<AssignmentStatementNode>();
+    const auto assign = m_Allocator.construct<AssignmentStatementNode>();
     assign->ident = consume();
     consume();
     if (const auto expr = parseExpr())
@@ -447,12 +830,57 @@ std::optional<StmtNode *> SyntaxAnalyzer::parseIfStmt()
     return stmt;
 }
 
+std::optional<StmtNode *> SyntaxAnalyzer::parseWhileStmt()
+{
+    tryConsumeErr(TokenType::open_paren);
+    auto stmt_while = m_Allocator.construct<WhileStatementNode>();
+    if (const auto expr = parseExpr())
+    {
+        stmt_while->condition = expr.value();
+    }
+    else
+    {
+        errorExpected("expression");
+    }
+    tryConsumeErr(TokenType::close_pared);
+    if (const auto scope = parseScope())
+    {
+        stmt_while->scope = scope.value();
+    }
+    else
+    {
+        errorExpected("scope");
+    }
+    auto stmt = m_Allocator.construct<StmtNode>(stmt_while);
+    return stmt;
+}
+
+std::optional<StmtNode *> SyntaxAnalyzer::parseReturnStmt()
+{
+    auto stmt_return = m_Allocator.construct<ReturnStatementNode>();
+    if (const auto expr = parseExpr())
+    {
+        stmt_return->expr = expr.value();
+    }
+    else
+    {
+        errorExpected("expression");
+    }
+    tryConsumeErr(TokenType::semi);
+    auto stmt = m_Allocator.construct<StmtNode>(stmt_return);
+    return stmt;
+}
+
 std::optional<StmtNode *> SyntaxAnalyzer::parseStmt()
 {
     if (peek().has_value() && peek().value().type == TokenType::exit && peek(1).has_value() && peek(1).value().type == TokenType::open_paren)
     {
         return parseExitStmt();
     }
+    if (peek().has_value() && peek().value().type == TokenType::print && peek(1).has_value() && peek(1).value().type == TokenType::open_paren)
+    {
+        return parsePrintStmt();
+    }
     if (peek().has_value() && peek().value().type == TokenType::let && peek(1).has_value() && peek(1).value().type == TokenType::ident && peek(2).has_value() && peek(2).value().type == TokenType::eq)
     {
         return parseLetStmt();
@@ -469,21 +897,87 @@ std::optional<StmtNode *> SyntaxAnalyzer::parseStmt()
     {
         return parseIfStmt();
     }
+    if (auto while_ = tryConsume(TokenType::while_))
+    {
+        return parseWhileStmt();
+    }
+    if (auto return_ = tryConsume(TokenType::return_))
+    {
+        return parseReturnStmt();
+    }
     return {};
 }
 
+FunctionNode *SyntaxAnalyzer::parseFunction()
+{
+    consume();
+    auto function = m_Allocator.construct<FunctionNode>();
+    function->name = tryConsumeErr(TokenType::ident);
+    tryConsumeErr(TokenType::open_paren);
+    if (!tryConsume(TokenType::close_pared).has_value())
+    {
+        do
+        {
+            function->params.push_back(tryConsumeErr(TokenType::ident));
+        } while (tryConsume(TokenType::comma).has_value());
+        tryConsumeErr(TokenType::close_pared);
+    }
+    if (const auto scope = parseScope())
+    {
+        function->body = scope.value();
+    }
+    else
+    {
+        errorExpected("scope");
+    }
+    return function;
+}
+
+std::variant<StmtNode *, FunctionNode *> SyntaxAnalyzer::parseTopLevel()
+{
+    if (peek().has_value() && peek().value().type == TokenType::fn)
+    {
+        return parseFunction();
+    }
+    if (peek().has_value() && peek().value().type == TokenType::import_)
+    {
+        throw CompileError("[Parse Error] `import` must come before everything else, on line " + std::to_string(peek().value().line));
+    }
+    if (tryConsume(TokenType::export_).has_value())
+    {
+        if (!(peek().has_value() && peek().value().type == TokenType::let && peek(1).has_value() && peek(1).value().type == TokenType::ident && peek(2).has_value() && peek(2).value().type == TokenType::eq))
+        {
+            errorExpected("`let`");
+        }
+        StmtNode *stmt = parseLetStmt().value();
+        std::get<LetStatementNode *>(stmt->statement)->exported = true;
+        return stmt;
+    }
+    if (auto stmt = parseStmt())
+    {
+        return stmt.value();
+    }
+    errorExpected("statement");
+}
+
 std::optional<ProgramNode> SyntaxAnalyzer::parseProgram()
 {
     ProgramNode program;
-    while (peek().has_value())
+    while (tryConsume(TokenType::import_).has_value())
+    {
+        program.imports.push_back(tryConsumeErr(TokenType::string_lit));
+        tryConsumeErr(TokenType::semi);
+    }
+    while (!atEnd())
     {
-        if (auto stmt = parseStmt())
+        const auto node = parseTopLevel();
+        if (const auto *stmt = std::get_if<StmtNode *>(&node))
         {
-            program.statements.push_back(stmt.value());
+            program.statements.push_back(*stmt);
         }
         else
         {
-            errorExpected("statement");
+            program.functions.push_back(std::get<FunctionNode *>(node));
         }
     }
     return program;
@@ -495,12 +989,12 @@ std::optional<ProgramNode> SyntaxAnalyzer::parseProgram()
     {
         return {};
     }
-    return m_tokens.at(m_index + offset);
+    return m_tokens[m_index + offset];
 }
 
 Token SyntaxAnalyzer::consume()
 {
-    auto token = m_tokens.at(m_index);
+    auto token = m_tokens[m_index];
     m_index++;
     return token;
 }
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <cassert>
+#include <span>
 #include <variant>
 
 #include "Components/lexing/lexicalAnalyzer.hpp"
 #include "Components/memory/memoryAllocator.hpp"
+#include "exprInterner.hpp"
 
 struct ExprNode;
 
@@ -47,14 +49,99 @@ struct DivisionNode
     ExprNode *rhs;
 };
 
+// Comparisons are unsigned, like the rest of the arithmetic, and give 1 or 0.
+struct EqualNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+struct NotEqualNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+struct LessNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+struct LessEqualNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+struct GreaterNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+struct GreaterEqualNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+// `&&` and `||` evaluate `rhs` only when `lhs` does not decide the result,
+// and give 1 or 0. `!e` is parsed as `(e == 0)`.
+struct LogicalAndNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+struct LogicalOrNode
+{
+    ExprNode *lhs;
+    ExprNode *rhs;
+};
+
+// `name(args...)`. Functions have their own namespace, separate from variables.
+struct CallNode
+{
+    Token name;
+    std::vector<ExprNode *> args;
+};
+
+// `[e0, e1, ...]`, a fixed-length array of numbers. Arrays are values: `+`,
+// `-` and `*` between two arrays of the same length or an array and a number
+// apply element by element.
+struct ArrayLiteralNode
+{
+    Token open;
+    std::vector<ExprNode *> elements;
+};
+
+// `name[index]`, one element of an array variable.
+struct IndexNode
+{
+    Token name;
+    ExprNode *index;
+};
+
+// `read()`: the next decimal number on stdin, skipping whatever precedes it;
+// 0 once the input is exhausted.
+struct ReadNode
+{
+    Token read;
+};
+
 struct BinaryExpressionNode
 {
-    std::variant<AdditionNode *, MultiplicationNode *, SubtractionNode *, DivisionNode *> operation;
+    std::variant<AdditionNode *, MultiplicationNode *, SubtractionNode *, DivisionNode *, EqualNode *, NotEqualNode *,
+                 LessNode *, LessEqualNode *, GreaterNode *, GreaterEqualNode *, LogicalAndNode *, LogicalOrNode *>
+        operation;
 };
 
 struct TermNode
 {
-    std::variant<IntLiteralNode *, IdentifierNode *, ParenthesizedExprNode *> term;
+    std::variant<IntLiteralNode *, IdentifierNode *, ParenthesizedExprNode *, CallNode *, ArrayLiteralNode *, IndexNode *,
+                 ReadNode *>
+        term;
 };
 
 struct ExprNode
@@ -71,6 +158,7 @@ struct LetStatementNode
 {
     Token ident;
     ExprNode *expr{};
+    bool exported = false; // `export let`, only at the top level
 };
 
 struct StmtNode;
@@ -106,21 +194,51 @@ struct IfStatementNode
     std::optional<ElseIfNode *> pred;
 };
 
+struct WhileStatementNode
+{
+    ExprNode *condition{};
+    ScopeNode *scope{};
+    unsigned unroll = 1; // body copies per back edge, chosen by the loop optimizer
+};
+
 struct AssignmentStatementNode
 {
     Token ident;
     ExprNode *expr{};
 };
 
+struct ReturnStatementNode
+{
+    ExprNode *expr;
+};
+
+// `print(expr);`: writes the value in decimal and a newline to stdout.
+struct PrintStatementNode
+{
+    ExprNode *expr;
+};
+
 struct StmtNode
 {
-    std::variant<ExitStatementNode *, LetStatementNode *, ScopeNode *, IfStatementNode *, AssignmentStatementNode *>
+    std::variant<ExitStatementNode *, LetStatementNode *, ScopeNode *, IfStatementNode *, AssignmentStatementNode *,
+                 WhileStatementNode *, ReturnStatementNode *, PrintStatementNode *>
         statement;
 };
 
+// `fn name(params...) { ... }`, only at the top level. The body sees its
+// parameters and its own `let`s; falling off its end returns 0.
+struct FunctionNode
+{
+    Token name;
+    std::vector<Token> params;
+    ScopeNode *body{};
+};
+
 struct ProgramNode
 {
+    std::vector<Token> imports; // the string of each leading `import "path";`
     std::vector<StmtNode *> statements;
+    std::vector<FunctionNode *> functions; // in source order, callable from anywhere
 };
 
 std::ostream &operator<<(std::ostream &os, const IntLiteralNode &node);
@@ -130,6 +248,18 @@ std::ostream &operator<<(std::ostream &os, const AdditionNode &node);
 std::ostream &operator<<(std::ostream &os, const MultiplicationNode &node);
 std::ostream &operator<<(std::ostream &os, const SubtractionNode &node);
 std::ostream &operator<<(std::ostream &os, const DivisionNode &node);
+std::ostream &operator<<(std::ostream &os, const EqualNode &node);
+std::ostream &operator<<(std::ostream &os, const NotEqualNode &node);
+std::ostream &operator<<(std::ostream &os, const LessNode &node);
+std::ostream &operator<<(std::ostream &os, const LessEqualNode &node);
+std::ostream &operator<<(std::ostream &os, const GreaterNode &node);
+std::ostream &operator<<(std::ostream &os, const GreaterEqualNode &node);
+std::ostream &operator<<(std::ostream &os, const LogicalAndNode &node);
+std::ostream &operator<<(std::ostream &os, const LogicalOrNode &node);
+std::ostream &operator<<(std::ostream &os, const CallNode &node);
+std::ostream &operator<<(std::ostream &os, const ArrayLiteralNode &node);
+std::ostream &operator<<(std::ostream &os, const IndexNode &node);
+std::ostream &operator<<(std::ostream &os, const ReadNode &node);
 std::ostream &operator<<(std::ostream &os, const BinaryExpressionNode &node);
 std::ostream &operator<<(std::ostream &os, const TermNode &node);
 std::ostream &operator<<(std::ostream &os, const ExprNode &node);
@@ -140,34 +270,63 @@ std::ostream &operator<<(std::ostream &os, const ElseIfBranchNode &node);
 std::ostream &operator<<(std::ostream &os, const ElseBranchNode &node);
 std::ostream &operator<<(std::ostream &os, const ElseIfNode &node);
 std::ostream &operator<<(std::ostream &os, const IfStatementNode &node);
+std::ostream &operator<<(std::ostream &os, const WhileStatementNode &node);
 std::ostream &operator<<(std::ostream &os, const AssignmentStatementNode &node);
+std::ostream &operator<<(std::ostream &os, const ReturnStatementNode &node);
+std::ostream &operator<<(std::ostream &os, const PrintStatementNode &node);
 std::ostream &operator<<(std::ostream &os, const StmtNode &node);
+std::ostream &operator<<(std::ostream &os, const FunctionNode &node);
 std::ostream &operator<<(std::ostream &os, const ProgramNode &node);
 
+// A new `lhs <op> rhs` node, for an operator token with a binary precedence.
+ExprNode *buildBinaryExpr(MemoryAllocator &allocator, TokenType op, ExprNode *lhs, ExprNode *rhs);
+
 class SyntaxAnalyzer
 {
 private:
-    const std::vector<Token> m_tokens;
+    const std::vector<Token> m_owned_tokens;
+    const std::span<const Token> m_tokens;
     size_t m_index = 0;
-    static constexpr size_t defaultAllocatorSize = 1024 * 1024 * 4; // 4 MB default size
-    MemoryAllocator m_Allocator{defaultAllocatorSize};
+    MemoryAllocator &m_Allocator;
+    std::optional<ExprInterner> m_interner;
     [[nodiscard]] std::optional<Token> peek(const int offset = 0) const;
     Token consume();
     Token tryConsumeErr(const TokenType type);
     std::optional<Token> tryConsume(const TokenType type);
+    std::optional<ExprNode *> parseOperand();
 
 public:
-    explicit SyntaxAnalyzer(std::vector<Token> tokens);
+    // Nodes are placed in `allocator`, which must outlive the returned program.
+    // With `hash_cons`, identical pure subexpressions share their nodes (see
+    // ExprInterner).
+    SyntaxAnalyzer(std::vector<Token> tokens, MemoryAllocator &allocator, bool hash_cons = false);
+    // Parses `tokens` in place; they must outlive the analyzer.
+    SyntaxAnalyzer(std::span<const Token> tokens, MemoryAllocator &allocator, bool hash_cons = false);
+    // Expression nodes shared instead of built; 0 without `hash_cons`.
+    [[nodiscard]] size_t sharedExprs() const;
     [[noreturn]] void errorExpected(const std::string &msg) const;
     std::optional<TermNode *> parseTerm();
+    CallNode *parseCall(const Token &name);
+    ArrayLiteralNode *parseArrayLiteral(const Token &open);
+    IndexNode *parseIndex(const Token &name);
     std::optional<ExprNode *> parseExpr(const int min_prec = 0);
     std::optional<ScopeNode *> parseScope();
     std::optional<ElseIfNode *> parseIfPred();
     std::optional<StmtNode *> parseExitStmt();
+    std::optional<StmtNode *> parsePrintStmt();
     std::optional<StmtNode *> parseLetStmt();
     std::optional<StmtNode *> parseAssignStmt();
     std::optional<StmtNode *> parseScopeStmt();
     std::optional<StmtNode *> parseIfStmt();
+    std::optional<StmtNode *> parseWhileStmt();
+    std::optional<StmtNode *> parseReturnStmt();
     std::optional<StmtNode *> parseStmt();
+    FunctionNode *parseFunction();
+    // One function or statement at the top level, starting at `position()`.
+    std::variant<StmtNode *, FunctionNode *> parseTopLevel();
     std::optional<ProgramNode> parseProgram();
+    // Index of the next token to parse, and whether every token is parsed.
+    [[nodiscard]] size_t position() const { return m_index; }
+    void seek(const size_t index) { m_index = index; }
+    [[nodiscard]] bool atEnd() const { return m_index >= m_tokens.size(); }
 };
\ No newline at end of file
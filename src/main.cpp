@@ -1,70 +1,93 @@
-#include "Components/generator/generatorCode.hpp"
-#include <cctype>
-#include <cstring>
-#include <fstream>
+#include "Components/driver/commandLine.hpp"
+#include "Components/driver/compileServer.hpp"
+#include "Components/driver/threadPool.hpp"
+#include "Components/driver/watchMode.hpp"
+#include <chrono>
 #include <iostream>
 
-void show_usage(const char *program_name)
+// Compiles the inputs on a pool of workers; every worker reuses its own
+// compiler and arena for the files it runs.
+int compile_batch(const CommandLine &command)
 {
-    std::cerr << "Incorrect usage. Correct usage is:" << std::endl;
-    std::cerr << program_name << " <input.kei>" << std::endl;
-}
-
-bool has_correct_extension(const char *filename)
-{
-    const char *extension = ".kei";
-    size_t len = std::strlen(filename);
-    size_t ext_len = std::strlen(extension);
-    return len >= ext_len && std::strcmp(filename + len - ext_len, extension) == 0;
-}
-
-void generateAndSaveOutput(const ProgramNode &prog)
-{
-    Generator generator(prog);
-    std::fstream file("out.asm", std::ios::out);
-    file << generator.gen_prog();
+    const size_t jobs = command.jobs != 0 ? command.jobs : std::max(1u, std::thread::hardware_concurrency());
+    const size_t workers = std::min(jobs, command.inputs.size());
+    std::vector<std::unique_ptr<Compiler>> compilers;
+    for (size_t i = 0; i < workers; i++)
+    {
+        compilers.push_back(std::make_unique<Compiler>());
+    }
+    std::vector<CompileResult> results(command.inputs.size());
+    const auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(workers);
+        for (size_t i = 0; i < command.inputs.size(); i++)
+        {
+            pool.submit([&, i](size_t worker) {
+                const std::string &input = command.inputs[i];
+                results[i] = compilers[worker]->compile_file(input, outputBaseFor(command, input), command.options);
+            });
+        }
+        pool.wait();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::string diagnostics = batchReport(command.inputs, results, workers, seconds);
+    reportTimes(command, "", results, diagnostics);
+    std::cerr << diagnostics;
+    if (command.cache_stats)
+    {
+        CompileCache(command.options.cache_dir, command.options.cache_max_bytes).print_stats(std::cerr);
+    }
+    for (const CompileResult &result : results)
+    {
+        if (!result.success)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
-    {
-        show_usage(argv[0]);
-        return EXIT_FAILURE;
-    }
-    const char *filename = argv[1];
-    if (!has_correct_extension(filename))
+    std::string usage_error;
+    const std::optional<CommandLine> command
+        = parseCommandLine(std::vector<std::string>(argv + 1, argv + argc), usage_error);
+    if (!command.has_value())
     {
-        std::cerr << "The input file must have a '.kei' extension." << std::endl;
+        if (!usage_error.empty())
+        {
+            std::cerr << usage_error << std::endl;
+        }
+        showUsage(argv[0]);
         return EXIT_FAILURE;
     }
-    std::ifstream input(filename);
-    if (!input)
+    switch (command->mode)
     {
-        std::cerr << "Failed to open input file." << std::endl;
-        return EXIT_FAILURE;
+    case CommandLine::Mode::server:
+        return runServer(command->socket_path);
+    case CommandLine::Mode::client:
+        // Without a server the client compiles in-process.
+        if (const std::optional<int> status = runClient(command->socket_path, command->forwarded))
+        {
+            return status.value();
+        }
+        break;
+    case CommandLine::Mode::compile:
+        break;
     }
-    std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
-    LexicalAnalyzer lexicalAnalyzer(std::move(contents));
-    std::vector<Token> tokens = lexicalAnalyzer.tokenize();
-    /* Show Tokens of FIle
-    for (const Token &token : tokens)
+    if (command->watch)
     {
-        std::cout << token << std::endl;
+        return runWatch(command.value());
     }
-    */
-    SyntaxAnalyzer syntaxAnalyzer(std::move(tokens));
-    std::optional<ProgramNode> prog = syntaxAnalyzer.parseProgram();
-    if (!prog.has_value())
+
+    // A single input without `-j` keeps the historical `out.asm`/`out` names.
+    if (command->inputs.empty() || (command->inputs.size() == 1 && command->jobs == 0))
     {
-        std::cerr << "Invalid program" << std::endl;
-        exit(EXIT_FAILURE);
+        std::string diagnostics;
+        Compiler compiler;
+        const int status = compileSequentially(compiler, command.value(), "", diagnostics);
+        std::cerr << diagnostics;
+        return status;
     }
-
-    // std::cout << prog.value() << std::endl; // Show AST
-    generateAndSaveOutput(prog.value());
-    system("nasm -felf64 out.asm");
-    system("ld -o out out.o");
-
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    return compile_batch(command.value());
+}